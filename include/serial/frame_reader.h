@@ -0,0 +1,501 @@
+/*!
+ * \file serial/frame_reader.h
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2012 William Woodall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides a frame reader which splits the byte stream of a serial port
+ * into frames.  The bytes are collected with bulk reads into one buffer and
+ * the frames are handed out as views into that buffer, so no memory is
+ * allocated per frame.  How frames are delimited is decided by a framer
+ * given as template parameter; framers for delimiters, fixed length frames,
+ * length fields, SLIP and COBS are provided.  Every frame carries the
+ * arrival times of its first and last byte, taken from the read system
+ * calls.
+ *
+ */
+
+#ifndef SERIAL_FRAME_READER_H
+#define SERIAL_FRAME_READER_H
+
+#include "serial/serial.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace serial {
+
+/*!
+ * A frame inside the buffer of a serial::FrameReader.  The view stays valid
+ * until the next call to FrameReader::read, FrameReader::feed or
+ * FrameReader::clear.
+ */
+struct FrameView {
+  /*! First byte of the frame. */
+  const uint8_t *data;
+  /*! Number of bytes in the frame. */
+  size_t size;
+  /*! Arrival of the first byte, see serial::ReadTimestamps.  0 if the
+   *  bytes came without a time. */
+  uint64_t first_ns;
+  /*! Arrival of the last byte. */
+  uint64_t last_ns;
+
+  FrameView () : data(NULL), size(0), first_ns(0), last_ns(0) {}
+  FrameView (const uint8_t *data_, size_t size_)
+  : data(data_), size(size_), first_ns(0), last_ns(0) {}
+
+  const uint8_t &
+  operator[] (size_t index) const
+  {
+    return data[index];
+  }
+};
+
+/*!
+ * Result of a framer looking at the buffered bytes.
+ *
+ * consumed is the number of bytes the reader drops from the front of the
+ * buffer.  Zero means the framer needs more bytes.  If consumed is not zero
+ * but frame.size is, the bytes were discarded (noise, an empty frame or a
+ * frame which failed to decode).
+ */
+struct FrameMatch {
+  size_t consumed;
+  FrameView frame;
+
+  FrameMatch () : consumed(0) {}
+  FrameMatch (size_t consumed_, const uint8_t *data, size_t size)
+  : consumed(consumed_), frame(data, size) {}
+};
+
+/*!
+ * Splits at a delimiter of one or more bytes.  The delimiter is not part of
+ * the frame unless include_delimiter is set.
+ *
+ * A framer is any class with a member
+ *   FrameMatch find (uint8_t *data, size_t size);
+ * It may rewrite the bytes it consumes, which the SLIP and COBS framers use
+ * to decode in place.
+ */
+class DelimiterFramer {
+public:
+  explicit DelimiterFramer (const std::string &delimiter = "\n",
+                            bool include_delimiter = false)
+  : delimiter_(delimiter), include_delimiter_(include_delimiter)
+  {
+    if (delimiter_.empty ()) {
+      throw std::invalid_argument ("The delimiter must not be empty.");
+    }
+  }
+
+  FrameMatch
+  find (uint8_t *data, size_t size)
+  {
+    const size_t length = delimiter_.size ();
+    const uint8_t first = static_cast<uint8_t> (delimiter_[0]);
+    size_t pos = 0;
+    while (pos + length <= size) {
+      const uint8_t *hit = static_cast<const uint8_t *> (
+        memchr (data + pos, first, size - pos - length + 1));
+      if (hit == NULL) {
+        break;
+      }
+      pos = static_cast<size_t> (hit - data);
+      if (memcmp (hit, delimiter_.data (), length) == 0) {
+        return FrameMatch (pos + length, data,
+                           include_delimiter_ ? pos + length : pos);
+      }
+      ++pos;
+    }
+    return FrameMatch ();
+  }
+
+private:
+  std::string delimiter_;
+  bool include_delimiter_;
+};
+
+/*!
+ * Splits into frames of a fixed number of bytes.
+ */
+class FixedLengthFramer {
+public:
+  explicit FixedLengthFramer (size_t length) : length_(length)
+  {
+    if (length_ == 0) {
+      throw std::invalid_argument ("The frame length must not be zero.");
+    }
+  }
+
+  FrameMatch
+  find (uint8_t *data, size_t size)
+  {
+    if (size < length_) {
+      return FrameMatch ();
+    }
+    return FrameMatch (length_, data, length_);
+  }
+
+private:
+  size_t length_;
+};
+
+/*!
+ * Frames which carry their length in a field at a fixed offset.
+ *
+ * The frame is value + extra bytes long, where value is the unsigned
+ * integer of width bytes (1, 2 or 4) at offset.  extra covers everything the
+ * field does not count, e.g. a MEDIBUS response (06 CMD LEN data CS) is
+ * LengthFieldFramer (2, 1, 4).  Frames longer than max_frame are treated as
+ * noise and the reader resynchronizes one byte later.
+ */
+class LengthFieldFramer {
+public:
+  LengthFieldFramer (size_t offset, size_t width = 1, size_t extra = 0,
+                     bool big_endian = false, size_t max_frame = 65535)
+  : offset_(offset), width_(width), extra_(extra), big_endian_(big_endian),
+    max_frame_(max_frame)
+  {
+    if (width_ != 1 && width_ != 2 && width_ != 4) {
+      throw std::invalid_argument ("The length field must be 1, 2 or 4 bytes.");
+    }
+  }
+
+  FrameMatch
+  find (uint8_t *data, size_t size)
+  {
+    if (size < offset_ + width_) {
+      return FrameMatch ();
+    }
+    size_t value = 0;
+    for (size_t i = 0; i < width_; ++i) {
+      const size_t byte = big_endian_ ? i : width_ - 1 - i;
+      value = (value << 8) | data[offset_ + byte];
+    }
+    const size_t length = value + extra_;
+    if (length < offset_ + width_ || length > max_frame_) {
+      return FrameMatch (1, data, 0);
+    }
+    if (size < length) {
+      return FrameMatch ();
+    }
+    return FrameMatch (length, data, length);
+  }
+
+private:
+  size_t offset_;
+  size_t width_;
+  size_t extra_;
+  bool big_endian_;
+  size_t max_frame_;
+};
+
+/*!
+ * SLIP (RFC 1055) frames, decoded in place.  Empty frames, as produced by a
+ * sender which starts every frame with END, are skipped.
+ */
+class SlipFramer {
+public:
+  static const uint8_t END = 0xC0;
+  static const uint8_t ESC = 0xDB;
+  static const uint8_t ESC_END = 0xDC;
+  static const uint8_t ESC_ESC = 0xDD;
+
+  FrameMatch
+  find (uint8_t *data, size_t size)
+  {
+    const uint8_t *end = static_cast<const uint8_t *> (memchr (data, END, size));
+    if (end == NULL) {
+      return FrameMatch ();
+    }
+    const size_t encoded = static_cast<size_t> (end - data);
+    size_t out = 0;
+    for (size_t in = 0; in < encoded; ++in) {
+      uint8_t byte = data[in];
+      if (byte == ESC) {
+        if (++in == encoded) {
+          return FrameMatch (encoded + 1, data, 0);
+        }
+        if (data[in] == ESC_END) {
+          byte = END;
+        } else if (data[in] == ESC_ESC) {
+          byte = ESC;
+        } else {
+          return FrameMatch (encoded + 1, data, 0);
+        }
+      }
+      data[out++] = byte;
+    }
+    return FrameMatch (encoded + 1, data, out);
+  }
+};
+
+/*!
+ * COBS frames terminated by a zero byte, decoded in place.  Frames with an
+ * invalid code sequence are discarded.
+ */
+class CobsFramer {
+public:
+  FrameMatch
+  find (uint8_t *data, size_t size)
+  {
+    const uint8_t *zero = static_cast<const uint8_t *> (memchr (data, 0, size));
+    if (zero == NULL) {
+      return FrameMatch ();
+    }
+    const size_t encoded = static_cast<size_t> (zero - data);
+    size_t in = 0;
+    size_t out = 0;
+    while (in < encoded) {
+      const size_t code = data[in];
+      if (in + code > encoded) {
+        return FrameMatch (encoded + 1, data, 0);
+      }
+      // the block is moved down by at most one byte per block before it,
+      // so the copy never overtakes the input
+      memmove (data + out, data + in + 1, code - 1);
+      out += code - 1;
+      in += code;
+      if (code != 0xFF && in < encoded) {
+        data[out++] = 0;
+      }
+    }
+    return FrameMatch (encoded + 1, data, out);
+  }
+};
+
+/*!
+ * Collects bytes from a serial port, or from any other source through
+ * FrameReader::feed, and hands out complete frames.
+ *
+ * The buffer is allocated once.  Consumed bytes are moved out of the way
+ * only when more room is needed, so a frame is normally not copied at all.
+ * If the buffer is full and the framer still needs more bytes the buffered
+ * bytes are dropped and counted in FrameReader::discarded.
+ *
+ * \tparam Framer The framing rule, see serial::DelimiterFramer for the
+ * expected interface.  Being a template parameter, its find member is
+ * inlined into FrameReader::next.
+ */
+template <typename Framer>
+class FrameReader {
+public:
+  explicit FrameReader (const Framer &framer = Framer (),
+                        size_t capacity = 4096)
+  : framer_(framer), buffer_(capacity), begin_(0), end_(0), base_(0),
+    discarded_(0)
+  {
+    if (capacity == 0) {
+      throw std::invalid_argument ("The capacity must not be zero.");
+    }
+    chunks_.reserve (MAX_CHUNKS);
+  }
+
+  /*! Reads as many bytes as fit into the free part of the buffer with one
+   * call to Serial::read, which blocks according to the port's timeouts.
+   * The bytes are stamped with Serial::getReadTimestamps, so the times of a
+   * frame are exact to one read system call.
+   *
+   * \return The number of bytes read, 0 without reading if the buffer is
+   * full.
+   *
+   * \throw serial::PortNotOpenedException
+   * \throw serial::SerialException
+   */
+  size_t
+  read (Serial &serial)
+  {
+    makeRoom ();
+    if (end_ == buffer_.size ()) {
+      return 0;
+    }
+    // buffer_[end_] would be out of range once the buffer is full
+    const size_t bytes_read = serial.read (&buffer_[0] + end_, buffer_.size () - end_);
+    end_ += bytes_read;
+    const ReadTimestamps stamps = serial.getReadTimestamps ();
+    addChunk (bytes_read, stamps.first_ns, stamps.last_ns);
+    return bytes_read;
+  }
+
+  /*! Appends bytes to the buffer, optionally with the time the first and
+   * the last of them arrived.
+   *
+   * \return The number of bytes taken, less than size if the buffer is full.
+   */
+  size_t
+  feed (const uint8_t *data, size_t size, uint64_t first_ns = 0,
+        uint64_t last_ns = 0)
+  {
+    makeRoom ();
+    const size_t taken = std::min (size, buffer_.size () - end_);
+    if (taken == 0) {
+      return 0;
+    }
+    memcpy (&buffer_[0] + end_, data, taken);
+    end_ += taken;
+    addChunk (taken, first_ns, last_ns);
+    return taken;
+  }
+
+  /*! Gets the next complete frame.
+   *
+   * \return false if the buffered bytes do not hold a complete frame.
+   */
+  bool
+  next (FrameView &frame)
+  {
+    while (begin_ < end_) {
+      FrameMatch match = framer_.find (&buffer_[begin_], end_ - begin_);
+      if (match.consumed == 0) {
+        if (begin_ == 0 && end_ == buffer_.size ()) {
+          // the frame does not fit into the buffer
+          discarded_ += end_;
+          clear ();
+        }
+        return false;
+      }
+      const uint64_t first = base_ + begin_;
+      begin_ += match.consumed;
+      if (match.frame.size != 0) {
+        frame = match.frame;
+        frame.first_ns = chunkAt (first).first_ns;
+        frame.last_ns = chunkAt (base_ + begin_ - 1).last_ns;
+        dropChunks ();
+        return true;
+      }
+      discarded_ += match.consumed;
+    }
+    dropChunks ();
+    return false;
+  }
+
+  /*! Drops all buffered bytes. */
+  void
+  clear ()
+  {
+    base_ += end_;
+    begin_ = end_ = 0;
+    chunks_.clear ();
+  }
+
+  /*! Number of bytes waiting for a frame to complete. */
+  size_t
+  buffered () const
+  {
+    return end_ - begin_;
+  }
+
+  /*! Number of bytes dropped as noise or because a frame did not fit. */
+  uint64_t
+  discarded () const
+  {
+    return discarded_;
+  }
+
+  Framer &
+  framer ()
+  {
+    return framer_;
+  }
+
+private:
+  // Bytes which arrived together, up to the stream position end.
+  struct Chunk {
+    uint64_t end;
+    uint64_t first_ns;
+    uint64_t last_ns;
+  };
+
+  // Beyond this many chunks the two oldest are merged, which widens their
+  // times but keeps memory fixed.
+  static const size_t MAX_CHUNKS = 32;
+
+  void
+  makeRoom ()
+  {
+    if (begin_ == end_) {
+      clear ();
+    } else if (begin_ != 0 && end_ == buffer_.size ()) {
+      memmove (&buffer_[0], &buffer_[begin_], end_ - begin_);
+      base_ += begin_;
+      end_ -= begin_;
+      begin_ = 0;
+    }
+  }
+
+  void
+  addChunk (size_t size, uint64_t first_ns, uint64_t last_ns)
+  {
+    if (size == 0) {
+      return;
+    }
+    if (chunks_.size () == MAX_CHUNKS) {
+      chunks_[1].first_ns = chunks_[0].first_ns;
+      chunks_.erase (chunks_.begin ());
+    }
+    Chunk chunk = { base_ + end_, first_ns, last_ns };
+    chunks_.push_back (chunk);
+  }
+
+  // The chunk holding the byte at the stream position.
+  const Chunk &
+  chunkAt (uint64_t position) const
+  {
+    for (size_t i = 0; i + 1 < chunks_.size (); ++i) {
+      if (chunks_[i].end > position) {
+        return chunks_[i];
+      }
+    }
+    return chunks_.back ();
+  }
+
+  // Forgets the chunks whose bytes are all consumed.
+  void
+  dropChunks ()
+  {
+    size_t consumed = 0;
+    while (consumed < chunks_.size () && chunks_[consumed].end <= base_ + begin_) {
+      ++consumed;
+    }
+    chunks_.erase (chunks_.begin (), chunks_.begin () + consumed);
+  }
+
+  Framer framer_;
+  std::vector<uint8_t> buffer_;
+  size_t begin_;
+  size_t end_;
+  uint64_t base_;             // stream position of buffer_[0]
+  std::vector<Chunk> chunks_;
+  uint64_t discarded_;
+};
+
+} // namespace serial
+
+#endif // SERIAL_FRAME_READER_H
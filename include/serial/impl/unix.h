@@ -86,6 +86,9 @@ public:
   size_t
   available ();
 
+  size_t
+  outputPending ();
+
   bool
   waitReadable (uint32_t timeout);
 
@@ -134,6 +137,12 @@ public:
   bool
   getCD ();
 
+  ModemStatus
+  getModemStatus ();
+
+  int
+  getFd () const;
+
   void
   setPort (const string &port);
 
@@ -146,6 +155,21 @@ public:
   Timeout
   getTimeout () const;
 
+  void
+  setReadPolicy (readpolicy_t policy);
+
+  readpolicy_t
+  getReadPolicy () const;
+
+  ReadStats
+  getReadStats () const;
+
+  void
+  resetReadStats ();
+
+  ReadTimestamps
+  getReadTimestamps () const;
+
   void
   setBaudrate (unsigned long baudrate);
 
@@ -176,6 +200,12 @@ public:
   flowcontrol_t
   getFlowcontrol () const;
 
+  void
+  configure (const PortSettings &settings);
+
+  PortSettings
+  getSettings () const;
+
   void
   readLock ();
 
@@ -191,6 +221,12 @@ public:
 protected:
   void reconfigurePort ();
 
+  bool
+  coalesces () const;
+
+  void
+  coalesceRead (size_t missing, int64_t timeout_remaining_ms);
+
 private:
   string port_;               // Path to the file descriptor
   int fd_;                    // The current file descriptor
@@ -208,6 +244,10 @@ private:
   stopbits_t stopbits_;       // Stop Bits
   flowcontrol_t flowcontrol_; // Flow Control
 
+  readpolicy_t read_policy_;  // How read waits for the rest of a request
+  ReadStats read_stats_;      // Read counters, updated under the read lock
+  ReadTimestamps read_stamps_; // Arrival of the bytes of the last read
+
   // Mutex used to lock the read functions
   pthread_mutex_t read_mutex;
   // Mutex used to lock the write functions
@@ -74,6 +74,9 @@ public:
 
   size_t
   available ();
+
+  size_t
+  outputPending ();
   
   bool
   waitReadable (uint32_t timeout);
@@ -123,6 +126,9 @@ public:
   bool
   getCD ();
 
+  ModemStatus
+  getModemStatus ();
+
   void
   setPort (const string &port);
 
@@ -135,6 +141,21 @@ public:
   Timeout
   getTimeout () const;
 
+  void
+  setReadPolicy (readpolicy_t policy);
+
+  readpolicy_t
+  getReadPolicy () const;
+
+  ReadStats
+  getReadStats () const;
+
+  void
+  resetReadStats ();
+
+  ReadTimestamps
+  getReadTimestamps () const;
+
   void
   setBaudrate (unsigned long baudrate);
 
@@ -165,6 +186,12 @@ public:
   flowcontrol_t
   getFlowcontrol () const;
 
+  void
+  configure (const PortSettings &settings);
+
+  PortSettings
+  getSettings () const;
+
   void
   readLock ();
 
@@ -194,6 +221,10 @@ private:
   stopbits_t stopbits_;       // Stop Bits
   flowcontrol_t flowcontrol_; // Flow Control
 
+  readpolicy_t read_policy_;  // Only stored, reads are timed by the driver
+  ReadStats read_stats_;      // Read counters, updated under the read lock
+  ReadTimestamps read_stamps_; // Arrival of the bytes of the last read
+
   // Mutex used to lock the read functions
   HANDLE read_mutex;
   // Mutex used to lock the write functions
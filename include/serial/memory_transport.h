@@ -0,0 +1,502 @@
+/*!
+ * \file serial/memory_transport.h
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2012 William Woodall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides an in-process transport for serial::Serial: two lock-free
+ * single producer, single consumer byte pipes, optionally paced by a
+ * simulated baud rate and optionally driven by a virtual clock.  It lets
+ * protocol layers be tested and profiled without the tty layer of the
+ * kernel, at memory speed or with exactly reproducible timing.
+ *
+ * This header needs C++11.
+ *
+ */
+
+#ifndef SERIAL_MEMORY_TRANSPORT_H
+#define SERIAL_MEMORY_TRANSPORT_H
+
+#include "serial/transport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace serial {
+
+/*!
+ * Time source of simulated links, in nanoseconds.  Nothing advances it
+ * except the calls below and memory transports waiting on it, so runs
+ * driven from one thread are exactly reproducible.
+ */
+class VirtualClock {
+public:
+  VirtualClock () : now_ns_(0) {}
+
+  uint64_t
+  now () const
+  {
+    return now_ns_.load (std::memory_order_acquire);
+  }
+
+  void
+  advance (uint64_t ns)
+  {
+    now_ns_.fetch_add (ns, std::memory_order_acq_rel);
+  }
+
+  /*! Moves the clock forward to time_ns, never backwards. */
+  void
+  advanceTo (uint64_t time_ns)
+  {
+    uint64_t current = now_ns_.load (std::memory_order_acquire);
+    while (current < time_ns &&
+           !now_ns_.compare_exchange_weak (current, time_ns,
+                                           std::memory_order_acq_rel)) {
+    }
+  }
+
+private:
+  std::atomic<uint64_t> now_ns_;
+};
+
+/*!
+ * One direction of a memory link.  One thread writes, one thread reads.
+ *
+ * With a baud rate every byte gets the time it has fully arrived, one byte
+ * time after the previous one, and is only readable from then on.  Without
+ * a baud rate bytes are readable as soon as they are written.
+ *
+ * Reading and writing take no lock.  A side waiting on the steady clock for
+ * the other one blocks in waitWhilePending, which is only woken when a
+ * waiter is registered.
+ */
+class MemoryPipe {
+public:
+  /*!
+   * \param capacity Bytes the pipe holds, rounded up to a power of two.
+   * \param baudrate Simulated line rate, 0 for none.
+   * \param clock Virtual clock, NULL to use the steady clock.
+   * \param bits_per_byte Bits on the line per byte, start and stop bits
+   * included.
+   */
+  explicit MemoryPipe (size_t capacity = 65536, uint32_t baudrate = 0,
+                       VirtualClock *clock = NULL, uint32_t bits_per_byte = 10)
+  : clock_(clock), byte_time_ns_(0), last_arrival_ns_(0), head_(0), tail_(0),
+    waiters_(0)
+  {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    bytes_.resize (size);
+    mask_ = size - 1;
+    if (baudrate != 0) {
+      byte_time_ns_ = 1000000000ULL * bits_per_byte / baudrate;
+      arrival_ns_.resize (size);
+    }
+  }
+
+  MemoryPipe (const MemoryPipe &) = delete;
+  MemoryPipe &operator= (const MemoryPipe &) = delete;
+
+  /*! Current time of the pipe's clock in nanoseconds. */
+  uint64_t
+  now () const
+  {
+    if (clock_) {
+      return clock_->now ();
+    }
+    return static_cast<uint64_t> (
+      std::chrono::duration_cast<std::chrono::nanoseconds> (
+        std::chrono::steady_clock::now ().time_since_epoch ()).count ());
+  }
+
+  VirtualClock *
+  clock () const
+  {
+    return clock_;
+  }
+
+  uint64_t
+  byteTime () const
+  {
+    return byte_time_ns_;
+  }
+
+  /*! Bytes the pipe holds. */
+  size_t
+  capacity () const
+  {
+    return bytes_.size ();
+  }
+
+  /*! Writer side.  Never blocks, returns the number of bytes taken. */
+  size_t
+  write (const uint8_t *data, size_t size)
+  {
+    const size_t head = head_.load (std::memory_order_relaxed);
+    const size_t tail = tail_.load (std::memory_order_acquire);
+    const size_t count = std::min (size, bytes_.size () - (head - tail));
+    uint64_t arrival = std::max (last_arrival_ns_, now ());
+    for (size_t i = 0; i < count; ++i) {
+      bytes_[(head + i) & mask_] = data[i];
+      if (byte_time_ns_ != 0) {
+        arrival += byte_time_ns_;
+        arrival_ns_[(head + i) & mask_] = arrival;
+      }
+    }
+    last_arrival_ns_ = arrival;
+    head_.store (head + count, std::memory_order_release);
+    notify ();
+    return count;
+  }
+
+  /*! Reader side.  Number of bytes which have arrived by time_ns. */
+  size_t
+  readable (uint64_t time_ns) const
+  {
+    const size_t tail = tail_.load (std::memory_order_relaxed);
+    const size_t head = head_.load (std::memory_order_acquire);
+    if (byte_time_ns_ == 0) {
+      return head - tail;
+    }
+    // arrival times never decrease, search for the first byte still on the line
+    size_t low = tail;
+    size_t high = head;
+    while (low < high) {
+      const size_t middle = low + (high - low) / 2;
+      if (arrival_ns_[middle & mask_] <= time_ns) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return low - tail;
+  }
+
+  /*! Reader side.  Arrival time of the next byte still on the line, or
+   * false if nothing is on the line. */
+  bool
+  nextArrival (uint64_t time_ns, uint64_t &arrival_ns) const
+  {
+    const size_t tail = tail_.load (std::memory_order_relaxed);
+    const size_t head = head_.load (std::memory_order_acquire);
+    const size_t ready = readable (time_ns);
+    if (tail + ready == head) {
+      return false;
+    }
+    arrival_ns = byte_time_ns_ == 0 ? time_ns
+                                    : arrival_ns_[(tail + ready) & mask_];
+    return true;
+  }
+
+  /*! Reader side.  Reads up to size bytes which have arrived by time_ns. */
+  size_t
+  read (uint8_t *buffer, size_t size, uint64_t time_ns)
+  {
+    const size_t tail = tail_.load (std::memory_order_relaxed);
+    const size_t count = std::min (size, readable (time_ns));
+    const size_t first = std::min (count, bytes_.size () - (tail & mask_));
+    std::copy (&bytes_[tail & mask_], &bytes_[tail & mask_] + first, buffer);
+    std::copy (&bytes_[0], &bytes_[0] + (count - first), buffer + first);
+    tail_.store (tail + count, std::memory_order_release);
+    notify ();
+    return count;
+  }
+
+  /*! Reader side.  Drops everything written so far. */
+  void
+  clear ()
+  {
+    tail_.store (head_.load (std::memory_order_acquire),
+                 std::memory_order_release);
+    notify ();
+  }
+
+  /*! Bytes written and not read yet, arrived or not. */
+  size_t
+  pending () const
+  {
+    return head_.load (std::memory_order_acquire) -
+           tail_.load (std::memory_order_acquire);
+  }
+
+  /*!
+   * Blocks while pending() equals count, at most timeout_ns.  The reader
+   * waits with 0 for the next write, the writer with capacity() for the
+   * next read.
+   */
+  void
+  waitWhilePending (size_t count, uint64_t timeout_ns)
+  {
+    waiters_.fetch_add (1, std::memory_order_seq_cst);
+    // pairs with the fence in notify: either the other side sees the
+    // waiter or this side sees its update
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    {
+      std::unique_lock<std::mutex> lock (wait_mutex_);
+      changed_.wait_for (lock, std::chrono::nanoseconds (timeout_ns),
+                         [&] { return pending () != count; });
+    }
+    waiters_.fetch_sub (1, std::memory_order_relaxed);
+  }
+
+private:
+  void
+  notify ()
+  {
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    if (waiters_.load (std::memory_order_relaxed) != 0) {
+      std::lock_guard<std::mutex> lock (wait_mutex_);
+      changed_.notify_all ();
+    }
+  }
+
+  VirtualClock *clock_;
+  uint64_t byte_time_ns_;
+  uint64_t last_arrival_ns_;    // writer only
+  std::vector<uint8_t> bytes_;
+  std::vector<uint64_t> arrival_ns_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+  std::atomic<uint32_t> waiters_;
+  std::mutex wait_mutex_;
+  std::condition_variable changed_;
+};
+
+/*!
+ * One end of a memory link, reading from one pipe and writing to another.
+ *
+ * With a virtual clock a blocking read does not sleep, it advances the
+ * clock to the arrival of the next byte or to the timeout, whichever comes
+ * first.  Bytes the peer writes later, from another thread, are only seen
+ * if they were written before the clock got there, so reproducible runs
+ * drive both ends from one thread.  With the steady clock the transport
+ * sleeps until the next byte arrives, or blocks until the peer writes or,
+ * with a full pipe, reads.
+ */
+class MemoryTransport : public Transport {
+public:
+  MemoryTransport (MemoryPipe &rx, MemoryPipe &tx) : rx_(rx), tx_(tx) {}
+
+  virtual size_t
+  read (uint8_t *buffer, size_t size, const Timeout &timeout)
+  {
+    uint64_t now = rx_.now ();
+    const uint64_t total_deadline = now + milliseconds (
+      timeout.read_timeout_constant +
+      static_cast<uint64_t> (timeout.read_timeout_multiplier) * size);
+    uint64_t deadline = total_deadline;
+    size_t bytes_read = 0;
+    while (true) {
+      const size_t bytes_read_now =
+        rx_.read (buffer + bytes_read, size - bytes_read, now);
+      if (bytes_read_now != 0 && timeout.inter_byte_timeout != Timeout::max ()) {
+        deadline = std::min (total_deadline,
+                             now + milliseconds (timeout.inter_byte_timeout));
+      }
+      bytes_read += bytes_read_now;
+      if (bytes_read == size || !waitUntil (deadline, now)) {
+        break;
+      }
+    }
+    return bytes_read;
+  }
+
+  virtual size_t
+  write (const uint8_t *data, size_t size, const Timeout &timeout)
+  {
+    uint64_t now = tx_.now ();
+    const uint64_t deadline = now + milliseconds (
+      timeout.write_timeout_constant +
+      static_cast<uint64_t> (timeout.write_timeout_multiplier) * size);
+    size_t written = tx_.write (data, size);
+    // a full pipe only drains while the peer reads, which with a virtual
+    // clock cannot happen while this thread waits
+    while (written < size && tx_.clock () == NULL && now < deadline) {
+      tx_.waitWhilePending (tx_.capacity (), deadline - now);
+      written += tx_.write (data + written, size - written);
+      now = tx_.now ();
+    }
+    return written;
+  }
+
+  virtual size_t
+  available ()
+  {
+    return rx_.readable (rx_.now ());
+  }
+
+  virtual bool
+  waitReadable (uint32_t timeout)
+  {
+    uint64_t now = rx_.now ();
+    const uint64_t deadline = now + milliseconds (timeout);
+    while (rx_.readable (now) == 0) {
+      if (!waitUntil (deadline, now)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  virtual void
+  waitByteTimes (size_t count)
+  {
+    const uint64_t ns = rx_.byteTime () * count;
+    if (rx_.clock ()) {
+      rx_.clock ()->advance (ns);
+    } else {
+      std::this_thread::sleep_for (std::chrono::nanoseconds (ns));
+    }
+  }
+
+  virtual void
+  flush ()
+  {
+  }
+
+  virtual void
+  flushInput ()
+  {
+    rx_.clear ();
+  }
+
+  virtual void
+  flushOutput ()
+  {
+  }
+
+  virtual ModemStatus
+  getModemStatus ()
+  {
+    std::lock_guard<std::mutex> lock (modem_mutex_);
+    return modem_;
+  }
+
+  /*!
+   * Sets the modem lines this end reports, e.g. to drive a
+   * serial::ModemWatcher.  Every changed line counts one transition.
+   */
+  void
+  setModemLines (bool cts, bool dsr, bool ri, bool cd)
+  {
+    std::lock_guard<std::mutex> lock (modem_mutex_);
+    modem_.cts_count += modem_.cts != cts;
+    modem_.dsr_count += modem_.dsr != dsr;
+    modem_.ri_count += modem_.ri != ri;
+    modem_.cd_count += modem_.cd != cd;
+    modem_.cts = cts;
+    modem_.dsr = dsr;
+    modem_.ri = ri;
+    modem_.cd = cd;
+  }
+
+private:
+  static uint64_t
+  milliseconds (uint64_t ms)
+  {
+    return ms * 1000000ULL;
+  }
+
+  // Waits until the next byte arrives or the deadline passes, updating now.
+  // Returns false once the deadline has passed.
+  bool
+  waitUntil (uint64_t deadline, uint64_t &now)
+  {
+    if (now >= deadline) {
+      return false;
+    }
+    uint64_t arrival = deadline;
+    const bool in_flight = rx_.nextArrival (now, arrival);
+    const uint64_t until = std::min (arrival, deadline);
+    if (rx_.clock ()) {
+      rx_.clock ()->advanceTo (until);
+    } else if (in_flight) {
+      if (until > now) {
+        std::this_thread::sleep_for (std::chrono::nanoseconds (until - now));
+      }
+    } else {
+      // everything written was read, wait for the peer to write
+      rx_.waitWhilePending (0, until - now);
+    }
+    now = rx_.now ();
+    return true;
+  }
+
+  MemoryPipe &rx_;
+  MemoryPipe &tx_;
+  std::mutex modem_mutex_;
+  ModemStatus modem_;
+};
+
+/*!
+ * Two memory transports connected to each other, e.g. a host and a
+ * simulated device:
+ *
+ *   serial::VirtualClock clock;
+ *   serial::MemoryLink link (19200, &clock);
+ *   serial::Serial host (&link.a (), serial::Timeout::simpleTimeout (100));
+ *   serial::Serial device (&link.b (), serial::Timeout::simpleTimeout (100));
+ */
+class MemoryLink {
+public:
+  explicit MemoryLink (uint32_t baudrate = 0, VirtualClock *clock = NULL,
+                       size_t capacity = 65536)
+  : a_to_b_(capacity, baudrate, clock), b_to_a_(capacity, baudrate, clock),
+    a_(b_to_a_, a_to_b_), b_(a_to_b_, b_to_a_)
+  {
+  }
+
+  MemoryTransport &
+  a ()
+  {
+    return a_;
+  }
+
+  MemoryTransport &
+  b ()
+  {
+    return b_;
+  }
+
+private:
+  MemoryPipe a_to_b_;
+  MemoryPipe b_to_a_;
+  MemoryTransport a_;
+  MemoryTransport b_;
+};
+
+} // namespace serial
+
+#endif // SERIAL_MEMORY_TRANSPORT_H
@@ -0,0 +1,196 @@
+/*!
+ * \file serial/modem_watcher.h
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2012 William Woodall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides a watcher which supervises the modem status lines of any
+ * number of open serial ports from a single helper thread.
+ *
+ */
+
+#if !defined(_WIN32)
+
+#ifndef SERIAL_MODEM_WATCHER_H
+#define SERIAL_MODEM_WATCHER_H
+
+#include "serial/serial.h"
+
+#include <pthread.h>
+
+namespace serial {
+
+/*!
+ * Enumeration defines the modem status lines reported by the watcher.
+ */
+typedef enum {
+  modem_line_cts = 0,
+  modem_line_dsr,
+  modem_line_ri,
+  modem_line_cd
+} modem_line_t;
+
+/*!
+ * Structure describing one change on a modem status line.
+ */
+struct ModemEvent {
+  /*! The port on which the change was seen. */
+  Serial *port;
+  /*! The line which changed. */
+  modem_line_t line;
+  /*! Level of the line after the change. */
+  bool level;
+  /*! Number of transitions the driver counted since the previous check,
+   *  this is larger than one if short pulses happened between two checks.
+   *  Always one where the platform does not provide counters.
+   */
+  uint32_t transitions;
+  /*! CLOCK_MONOTONIC time in nanoseconds at which the change was seen. */
+  uint64_t timestamp_ns;
+  /*! Complete status of the port at the time of the change. */
+  ModemStatus status;
+};
+
+/*!
+ * Interface for receiving modem line changes from a serial::ModemWatcher.
+ *
+ * Callbacks are made from the watcher thread, so they should return quickly.
+ * A callback may call serial::ModemWatcher::watch and
+ * serial::ModemWatcher::unwatch, also for its own port.
+ */
+class ModemEventListener {
+public:
+  virtual ~ModemEventListener () {}
+
+  virtual void
+  onModemEvent (const ModemEvent &event) = 0;
+};
+
+/*!
+ * Supervises the CTS, DSR, RI and CD lines of all registered ports from
+ * one helper thread.
+ *
+ * Every poll interval the watcher queries each port once with
+ * serial::Serial::getModemStatus, compares the result against the cached
+ * snapshot and reports every line that changed.  On Linux the transition
+ * counters are used as well, so pulses shorter than the poll interval are
+ * still reported instead of being lost.
+ *
+ * The last snapshot of each port is cached and can be read with
+ * serial::ModemWatcher::getStatus without touching the driver.
+ */
+class ModemWatcher {
+public:
+  /*!
+   * Creates a watcher, the helper thread is started with the first port.
+   *
+   * \param poll_interval_ms Milliseconds between two checks of the lines.
+   */
+  explicit ModemWatcher (uint32_t poll_interval_ms = 10);
+
+  /*! Stops the helper thread. */
+  virtual ~ModemWatcher ();
+
+  /*!
+   * Starts watching the given port.  The port has to stay valid until it is
+   * removed with serial::ModemWatcher::unwatch or the watcher is destroyed.
+   *
+   * \param port An open serial port.
+   * \param listener Receives the changes of this port, may be NULL if only
+   * the cached status is of interest.
+   *
+   * \throw serial::PortNotOpenedException
+   * \throw serial::SerialException
+   */
+  void
+  watch (Serial &port, ModemEventListener *listener);
+
+  /*!
+   * Stops watching the given port.  Once this returns no more callbacks
+   * for the port are in progress and the port is not queried anymore,
+   * unless it is called from a callback, which then is the one in
+   * progress.
+   */
+  void
+  unwatch (Serial &port);
+
+  /*!
+   * Copies the cached status of a watched port.  This never waits for
+   * the driver.
+   *
+   * \return false if the port is not watched.
+   */
+  bool
+  getStatus (const Serial &port, ModemStatus &status);
+
+  /*! Returns the number of watched ports. */
+  size_t
+  size ();
+
+private:
+  // Disable copy constructors
+  ModemWatcher (const ModemWatcher&);
+  ModemWatcher& operator=(const ModemWatcher&);
+
+  struct Entry {
+    Serial *port;
+    ModemEventListener *listener;
+    ModemStatus status;
+    // Set by watch, so the helper thread can tell its copy is stale
+    uint64_t generation;
+  };
+
+  static void *
+  run_ (void *watcher);
+
+  void
+  run ();
+
+  void
+  check (Entry &entry, std::vector<ModemEvent> &events);
+
+  uint32_t poll_interval_ms_;
+  std::vector<Entry> entries_;
+  uint64_t generation_;
+
+  bool running_;
+  bool stop_;
+  pthread_t thread_;
+
+  // Protects entries_, running_ and stop_
+  pthread_mutex_t mutex_;
+  // Used to wake the helper thread up for shutdown
+  pthread_cond_t cond_;
+  // Held while ports are queried and callbacks are made, so unwatch can
+  // wait for them
+  pthread_mutex_t dispatch_mutex_;
+};
+
+} // namespace serial
+
+#endif // SERIAL_MODEM_WATCHER_H
+
+#endif // !defined(_WIN32)
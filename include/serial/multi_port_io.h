@@ -0,0 +1,218 @@
+/*!
+ * \file serial/multi_port_io.h
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2012 William Woodall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides batched, event driven reads and writes for many open serial
+ * ports from one thread, using io_uring on Linux where available and epoll
+ * (poll on other systems) otherwise.
+ *
+ */
+
+#if !defined(_WIN32)
+
+#ifndef SERIAL_MULTI_PORT_IO_H
+#define SERIAL_MULTI_PORT_IO_H
+
+#include "serial/serial.h"
+
+namespace serial {
+
+/*!
+ * Enumeration defines the mechanisms serial::MultiPortIO can use.
+ */
+typedef enum {
+  /*! io_uring if the kernel supports it, epoll otherwise. */
+  multiport_auto = 0,
+  /*! Multishot reads and batched writes through io_uring, Linux 6.7 or
+   *  newer. */
+  multiport_io_uring,
+  /*! Readiness notification with epoll, or poll where epoll is missing,
+   *  and one read or write call per ready port. */
+  multiport_epoll
+} multiport_backend_t;
+
+/*!
+ * Receives the results of a serial::MultiPortIO.  Callbacks are made from
+ * MultiPortIO::run.
+ */
+class MultiPortListener {
+public:
+  virtual ~MultiPortListener () {}
+
+  /*! Bytes were read from the port, data is only valid during the call. */
+  virtual void
+  onRead (Serial &port, const uint8_t *data, size_t size) = 0;
+
+  /*! A write queued with MultiPortIO::write has been written completely. */
+  virtual void
+  onWritten (Serial &port, size_t size)
+  {
+    (void) port;
+    (void) size;
+  }
+
+  /*! Everything written to a port watched with MultiPortIO::watchDrain
+   *  has left the device. */
+  virtual void
+  onDrained (Serial &port)
+  {
+    (void) port;
+  }
+
+  /*! Reading or writing failed with the given errno, 0 means the device
+   *  reported end of file.  The port is no longer read from. */
+  virtual void
+  onError (Serial &port, int error)
+  {
+    (void) port;
+    (void) error;
+  }
+};
+
+/*!
+ * Counters of a serial::MultiPortIO.
+ */
+struct MultiPortStats {
+  /*! System calls issued, setup excluded. */
+  uint64_t syscalls;
+  /*! Read completions delivered to the listener. */
+  uint64_t reads;
+  /*! Write requests completed. */
+  uint64_t writes;
+  /*! Bytes read. */
+  uint64_t bytes_read;
+  /*! Bytes written. */
+  uint64_t bytes_written;
+
+  MultiPortStats ()
+  : syscalls(0), reads(0), writes(0), bytes_read(0), bytes_written(0)
+  {}
+};
+
+/*!
+ * Reads from and writes to any number of open ports from one thread.
+ *
+ * With io_uring every port has a multishot read armed permanently, which
+ * delivers data into buffers the kernel picks from a ring registered per
+ * port, and writes are queued as submissions.  One MultiPortIO::run call
+ * then submits all queued writes and reaps all completions with a single
+ * system call, instead of a select and a read per port and wake up.
+ *
+ * Ports are read behind the back of their serial::Serial object, so do not
+ * call read on a port that is added here.  The io_uring backend also sets
+ * VMIN to 1 while a port is added, so do not reconfigure it meanwhile.
+ * The object is not thread safe, all calls have to come from the thread
+ * calling run.
+ */
+class MultiPortIO {
+public:
+  /*!
+   * \param listener Receives data, completed writes and errors.
+   * \param backend The mechanism to use.
+   * \param buffer_size Size of a read buffer, io_uring keeps 16 of them
+   * per port.
+   *
+   * \throw serial::IOException if io_uring was requested explicitly but is
+   * not available.
+   */
+  explicit MultiPortIO (MultiPortListener *listener,
+                        multiport_backend_t backend = multiport_auto,
+                        size_t buffer_size = 4096);
+
+  virtual ~MultiPortIO ();
+
+  /*!
+   * Starts reading from an open port.  The port has to stay open until it
+   * is removed or this object is destroyed.
+   *
+   * \throw serial::PortNotOpenedException
+   * \throw serial::IOException
+   */
+  void
+  add (Serial &port);
+
+  /*! Stops reading from the port, queued writes are abandoned. */
+  void
+  remove (Serial &port);
+
+  /*!
+   * Queues a write, the data is copied.  It is submitted by the next call
+   * to run.
+   */
+  void
+  write (Serial &port, const uint8_t *data, size_t size);
+
+  /*!
+   * Asks for one MultiPortListener::onDrained call once the writes queued
+   * for the port are complete and the device sent the last byte, see
+   * Serial::outputPending.  Call it after queuing the writes.
+   *
+   * There is no event for an empty output queue, so while a port is
+   * watched run wakes up when the bytes still queued should have been
+   * sent at the baudrate of the port and checks it again.
+   */
+  void
+  watchDrain (Serial &port);
+
+  /*!
+   * Submits the queued writes and waits up to timeout milliseconds for
+   * completions, then hands all of them to the listener.
+   *
+   * \return The number of completions handled.
+   *
+   * \throw serial::IOException
+   */
+  size_t
+  run (uint32_t timeout);
+
+  /*! Returns the mechanism in use, never multiport_auto. */
+  multiport_backend_t
+  getBackend () const;
+
+  /*! Returns a copy of the counters. */
+  MultiPortStats
+  getStats () const;
+
+  class Backend;
+
+private:
+  // Disable copy constructors
+  MultiPortIO (const MultiPortIO&);
+  MultiPortIO& operator=(const MultiPortIO&);
+
+  size_t
+  checkDrains ();
+
+  Backend *backend_;
+};
+
+} // namespace serial
+
+#endif // SERIAL_MULTI_PORT_IO_H
+
+#endif // !defined(_WIN32)
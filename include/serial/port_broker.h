@@ -0,0 +1,280 @@
+/*!
+ * \file serial/port_broker.h
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2012 William Woodall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides a broker which owns one serial port and shares it with any
+ * number of local processes over a Unix domain socket, and the transport
+ * clients use to talk to it through the regular serial::Serial API.
+ *
+ */
+
+#if !defined(_WIN32)
+
+#ifndef SERIAL_PORT_BROKER_H
+#define SERIAL_PORT_BROKER_H
+
+#include "serial/serial.h"
+#include "serial/transport.h"
+
+#include <pthread.h>
+
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace serial {
+
+/*!
+ * Counters of a serial::PortBroker.
+ */
+struct BrokerStats {
+  /*! Bytes read from the port. */
+  uint64_t bytes_received;
+  /*! Bytes written to the port on behalf of clients. */
+  uint64_t bytes_written;
+  /*! Write requests served. */
+  uint64_t writes;
+  /*! Bytes not delivered to clients which did not keep up. */
+  uint64_t bytes_dropped;
+  /*! Clients connected right now. */
+  uint32_t clients;
+
+  BrokerStats ()
+  : bytes_received(0), bytes_written(0), writes(0), bytes_dropped(0),
+    clients(0)
+  {}
+};
+
+/*!
+ * Shares one open serial::Serial with local clients.
+ *
+ * Every byte read from the port is sent to every connected client.  Writes
+ * of the clients are queued and written one at a time in order of the
+ * client's priority, higher first and in arrival order for equal
+ * priorities, so a control client is not held up behind a bulk transfer of
+ * a diagnostics tool: it waits at most for the one write on the port when
+ * its own arrives.  Each client write reaches the port in one piece, no
+ * other write gets between its bytes, so bulk clients should write in
+ * moderate pieces.
+ *
+ * The port stays open and configured for the lifetime of the broker, so
+ * clients can come and go without reopening it.  A client which does not
+ * read fast enough loses data once its queue exceeds client_buffer bytes,
+ * instead of stalling the others.
+ *
+ * Clients connect with serial::BrokerTransport.  The broker runs two
+ * helper threads, one reading the port and one serving the socket.  The
+ * reader waits for the port's descriptor to become readable, so the read
+ * timeout of the port does not matter, except for a serial::Serial on a
+ * serial::Transport, which is read with its timeout: that must be neither
+ * zero nor infinite.
+ */
+class PortBroker {
+public:
+  /*!
+   * \param port An open port, it is not owned and has to outlive the broker.
+   * \param socket_path Path of the Unix domain socket to listen on, an old
+   * socket file at that path is removed.
+   * \param client_buffer Bytes queued per client before data is dropped.
+   */
+  PortBroker (Serial &port, const std::string &socket_path,
+              size_t client_buffer = 65536);
+
+  /*! Stops the broker. */
+  virtual ~PortBroker ();
+
+  /*!
+   * Starts listening and the helper threads.  The port is switched to
+   * serial::readpolicy_low_latency while the broker runs, stop puts the
+   * previous policy back.
+   *
+   * \throw serial::IOException
+   */
+  void
+  start ();
+
+  /*! Disconnects all clients and stops the helper threads. */
+  void
+  stop ();
+
+  /*! Returns a copy of the counters. */
+  BrokerStats
+  getStats ();
+
+private:
+  // Disable copy constructors
+  PortBroker (const PortBroker&);
+  PortBroker& operator=(const PortBroker&);
+
+  struct Client {
+    int fd;
+    uint8_t priority;
+    std::string inbound;      // partial messages from the client
+    std::string outbound;     // messages not yet taken by the socket
+    std::string write;        // parts of a write not complete yet
+  };
+
+  struct WriteRequest {
+    uint8_t priority;
+    uint64_t sequence;
+    std::string data;
+
+    bool operator< (const WriteRequest &other) const {
+      if (priority != other.priority) {
+        return priority < other.priority;
+      }
+      return sequence > other.sequence;
+    }
+  };
+
+  static void *
+  readLoop_ (void *broker);
+
+  static void *
+  serveLoop_ (void *broker);
+
+  void
+  readLoop ();
+
+  void
+  serveLoop ();
+
+  void
+  accept ();
+
+  bool
+  receive (Client &client);
+
+  void
+  queue (Client &client, uint8_t type, const uint8_t *data, size_t size);
+
+  void
+  send (Client &client);
+
+  void
+  dropClient (size_t index);
+
+  Serial &port_;
+  std::string socket_path_;
+  size_t client_buffer_;
+  int listen_fd_;
+  int wake_pipe_[2];
+  int stop_pipe_[2];          // readable once stop was called
+
+  readpolicy_t saved_policy_; // read policy of the port before start
+  bool running_;
+  bool stop_;
+  pthread_t reader_;
+  pthread_t server_;
+
+  std::vector<Client> clients_;
+  std::priority_queue<WriteRequest> writes_;
+  uint64_t write_sequence_;
+  BrokerStats stats_;
+
+  // Protects clients_, writes_, stats_ and stop_
+  pthread_mutex_t mutex_;
+};
+
+/*!
+ * Client side of a serial::PortBroker, use it with
+ * serial::Serial::Serial(Transport*, Timeout) to get the usual API:
+ *
+ *   serial::BrokerTransport transport ("/tmp/ttyUSB0.sock", 10);
+ *   serial::Serial port (&transport, serial::Timeout::simpleTimeout (100));
+ *
+ * The settings of the port itself belong to the broker, setting them on
+ * the client has no effect.
+ */
+class BrokerTransport : public Transport {
+public:
+  /*!
+   * Connects to the broker.
+   *
+   * \param socket_path The path the broker listens on.
+   * \param priority Priority of this client's writes, higher goes first.
+   *
+   * \throw serial::IOException
+   */
+  explicit BrokerTransport (const std::string &socket_path,
+                            uint8_t priority = 0);
+
+  virtual ~BrokerTransport ();
+
+  virtual size_t
+  read (uint8_t *buffer, size_t size, const Timeout &timeout);
+
+  virtual size_t
+  write (const uint8_t *data, size_t size, const Timeout &timeout);
+
+  virtual size_t
+  available ();
+
+  virtual bool
+  waitReadable (uint32_t timeout);
+
+  virtual void
+  waitByteTimes (size_t count);
+
+  virtual void
+  flush ();
+
+  virtual void
+  flushInput ();
+
+  virtual void
+  flushOutput ();
+
+private:
+  // Disable copy constructors
+  BrokerTransport (const BrokerTransport&);
+  BrokerTransport& operator=(const BrokerTransport&);
+
+  // Waits up to timeout milliseconds for messages from the broker,
+  // returns false if no data arrived.
+  bool
+  receive (int timeout);
+
+  // Sends outbound_ for up to timeout milliseconds, a negative timeout
+  // waits until it is sent.  Returns false if bytes are left.
+  bool
+  sendOutbound (int64_t timeout);
+
+  int fd_;
+  uint32_t byte_time_ns_;
+  std::string inbound_;   // partial messages from the broker
+  std::string data_;      // received bytes not read yet
+  size_t data_pos_;
+  std::string outbound_;  // rest of a message a write timeout cut off
+};
+
+} // namespace serial
+
+#endif // SERIAL_PORT_BROKER_H
+
+#endif // !defined(_WIN32)
@@ -0,0 +1,111 @@
+/*!
+ * \file serial/realtime.h
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2012 William Woodall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides an opt-in real-time profile for threads doing serial I/O:
+ * CPU affinity, a real-time scheduling priority, locked memory and
+ * pre-faulted stack and heap.
+ *
+ */
+
+#ifndef SERIAL_REALTIME_H
+#define SERIAL_REALTIME_H
+
+#include <string>
+
+#include "serial/v8stdint.h"
+
+namespace serial {
+
+/*!
+ * What serial::applyRealtimeProfile should change.  The defaults change
+ * nothing.
+ */
+struct RealtimeProfile {
+  /*! CPU to pin the thread to, -1 leaves the affinity alone. */
+  int cpu;
+  /*! SCHED_FIFO priority from 1 to 99, 0 keeps the normal scheduling.  On
+   *  Windows any value above 0 selects THREAD_PRIORITY_TIME_CRITICAL. */
+  int priority;
+  /*! Lock all current and future pages of the process into memory.  On
+   *  Windows the working set is raised instead, by heap_prefault and
+   *  stack_prefault. */
+  bool lock_memory;
+  /*! Bytes of stack to touch now, so the thread does not take page faults
+   *  when its stack grows later. */
+  size_t stack_prefault;
+  /*! Bytes of heap to allocate, touch and free now.  With glibc the heap is
+   *  then kept instead of trimmed, so later allocations up to this size
+   *  do not fault in pages. */
+  size_t heap_prefault;
+
+  RealtimeProfile ()
+  : cpu(-1), priority(0), lock_memory(false), stack_prefault(0),
+    heap_prefault(0)
+  {}
+};
+
+/*!
+ * What serial::applyRealtimeProfile achieved.
+ */
+struct RealtimeStatus {
+  /*! The thread is pinned to the requested CPU. */
+  bool affinity;
+  /*! The thread runs with the requested priority. */
+  bool priority;
+  /*! The memory is locked. */
+  bool memory_locked;
+  /*! One line for each part which could not be applied, empty if all of
+   *  the profile is in effect. */
+  std::string warnings;
+
+  RealtimeStatus ()
+  : affinity(false), priority(false), memory_locked(false)
+  {}
+};
+
+/*!
+ * Applies the profile to the calling thread, locking memory affects the
+ * whole process.
+ *
+ * Missing privileges or unsupported features do not fail the call, every
+ * part is tried on its own and a part which cannot be applied is skipped
+ * and reported in RealtimeStatus::warnings.  Linux needs CAP_SYS_NICE for
+ * the priority and CAP_IPC_LOCK, or a large enough RLIMIT_MEMLOCK, to lock
+ * memory.
+ *
+ * \param profile What to change.
+ *
+ * \return What was changed.
+ */
+RealtimeStatus
+applyRealtimeProfile (const RealtimeProfile &profile);
+
+} // namespace serial
+
+#endif // SERIAL_REALTIME_H
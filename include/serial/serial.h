@@ -89,6 +89,24 @@ typedef enum {
   flowcontrol_hardware
 } flowcontrol_t;
 
+/*!
+ * Enumeration defines how serial::Serial::read waits for the rest of a
+ * request once the port has become readable.
+ */
+typedef enum {
+  /*! Wait the byte times of the missing bytes before reading, but only if
+   *  the inter byte timeout is disabled.  This is the historic behaviour. */
+  readpolicy_default = 0,
+  /*! Return as soon as at least one byte has been read. */
+  readpolicy_low_latency,
+  /*! Always wait the byte times of the missing bytes, bounded by the total
+   *  timeout, so that a request is usually served by one read call. */
+  readpolicy_min_syscalls,
+  /*! Wait only while the observed arrival rate is close to the line rate,
+   *  for the time the missing bytes are expected to take. */
+  readpolicy_adaptive
+} readpolicy_t;
+
 /*!
  * Structure for setting the timeout of the serial port, times are
  * in milliseconds.
@@ -141,6 +159,114 @@ struct Timeout {
   {}
 };
 
+/*!
+ * Structure that holds the state of the modem status lines, as returned by
+ * serial::Serial::getModemStatus.
+ *
+ * The counters hold the number of transitions the driver has seen on each
+ * line since the port was opened.  They are only maintained where the
+ * platform supports it (TIOCGICOUNT on Linux) and stay zero otherwise.
+ */
+struct ModemStatus {
+  /*! Level of the CTS line. */
+  bool cts;
+  /*! Level of the DSR line. */
+  bool dsr;
+  /*! Level of the RI line. */
+  bool ri;
+  /*! Level of the CD line. */
+  bool cd;
+  /*! Number of transitions counted on the CTS line. */
+  uint32_t cts_count;
+  /*! Number of transitions counted on the DSR line. */
+  uint32_t dsr_count;
+  /*! Number of transitions counted on the RI line. */
+  uint32_t ri_count;
+  /*! Number of transitions counted on the CD line. */
+  uint32_t cd_count;
+
+  ModemStatus ()
+  : cts(false), dsr(false), ri(false), cd(false),
+    cts_count(0), dsr_count(0), ri_count(0), cd_count(0)
+  {}
+};
+
+/*!
+ * Structure that holds the read counters of a port, as returned by
+ * serial::Serial::getReadStats.
+ *
+ * Comparing syscalls and busy_ns per byte between the read policies shows
+ * which one suits a workload.
+ */
+struct ReadStats {
+  /*! Number of calls to read. */
+  uint64_t reads;
+  /*! Number of reads which returned fewer bytes than requested. */
+  uint64_t short_reads;
+  /*! Number of bytes returned by read. */
+  uint64_t bytes;
+  /*! Number of read system calls issued. */
+  uint64_t syscalls;
+  /*! Number of times read blocked until the port became readable. */
+  uint64_t waits;
+  /*! Number of byte time waits inserted to coalesce a request. */
+  uint64_t coalesce_waits;
+  /*! Time spent inside read, in nanoseconds. */
+  uint64_t busy_ns;
+  /*! Current estimate of the nanoseconds between two arriving bytes. */
+  uint32_t arrival_ns_per_byte;
+
+  ReadStats ()
+  : reads(0), short_reads(0), bytes(0), syscalls(0), waits(0),
+    coalesce_waits(0), busy_ns(0), arrival_ns_per_byte(0)
+  {}
+};
+
+/*!
+ * Structure that holds when the bytes of the last read arrived, as returned
+ * by serial::Serial::getReadTimestamps.
+ *
+ * The times are taken when the system call which delivered the bytes
+ * returned, from CLOCK_MONOTONIC on Unix and QueryPerformanceCounter on
+ * Windows, the clocks behind std::chrono::steady_clock, in nanoseconds.
+ */
+struct ReadTimestamps {
+  /*! Return of the system call which delivered the first byte. */
+  uint64_t first_ns;
+  /*! Return of the system call which delivered the last byte. */
+  uint64_t last_ns;
+
+  ReadTimestamps () : first_ns(0), last_ns(0) {}
+};
+
+/*!
+ * Structure that holds the line settings of a port, applied together by
+ * serial::Serial::configure.
+ */
+struct PortSettings {
+  /*! Baudrate, \see serial::Serial::setBaudrate */
+  uint32_t baudrate;
+  /*! Size of each byte, \see serial::Serial::setBytesize */
+  bytesize_t bytesize;
+  /*! Method of parity, \see serial::Serial::setParity */
+  parity_t parity;
+  /*! Number of stop bits, \see serial::Serial::setStopbits */
+  stopbits_t stopbits;
+  /*! Type of flow control, \see serial::Serial::setFlowcontrol */
+  flowcontrol_t flowcontrol;
+
+  explicit PortSettings (uint32_t baudrate_ = 9600,
+                         bytesize_t bytesize_ = eightbits,
+                         parity_t parity_ = parity_none,
+                         stopbits_t stopbits_ = stopbits_one,
+                         flowcontrol_t flowcontrol_ = flowcontrol_none)
+  : baudrate(baudrate_), bytesize(bytesize_), parity(parity_),
+    stopbits(stopbits_), flowcontrol(flowcontrol_)
+  {}
+};
+
+class Transport;
+
 /*!
  * Class that provides a portable serial port interface.
  */
@@ -185,6 +311,28 @@ public:
           stopbits_t stopbits = stopbits_one,
           flowcontrol_t flowcontrol = flowcontrol_none);
 
+  /*!
+   * Creates a Serial object which reads and writes through the given
+   * transport instead of a serial port of the system.
+   *
+   * Reads, writes, available, waitReadable, waitByteTimes, the flush
+   * functions and getModemStatus with getCTS, getDSR, getRI and getCD are
+   * served by the transport, the timeouts are applied as for a port.  The
+   * object counts as open, open and close do nothing.  The read policy,
+   * read statistics, configure and getSettings throw
+   * serial::SerialException, the other modem line functions throw
+   * serial::PortNotOpenedException.
+   *
+   * \param transport The transport, it is not owned and has to outlive
+   * this object.  \see serial::Transport
+   *
+   * \param timeout A serial::Timeout struct that defines the timeout
+   * conditions. \see serial::Timeout
+   *
+   * \throw std::invalid_argument
+   */
+  Serial (Transport *transport, Timeout timeout = Timeout());
+
   /*! Destructor */
   virtual ~Serial ();
 
@@ -219,6 +367,19 @@ public:
   size_t
   available ();
 
+  /*! Returns the number of written bytes the device has not sent yet,
+   * without blocking.  TIOCOUTQ on Unix, the output queue of
+   * ClearCommError on Windows.  A pty and a port on a serial::Transport
+   * always report 0, as does a closed port.
+   *
+   * Unlike flush it does not wait for the bytes, use it to throttle a
+   * sender or to tell when the last byte of a request left.
+   *
+   * \throw serial::IOException
+   */
+  size_t
+  outputPending ();
+
   /*! Block until there is serial data to read or read_timeout_constant
    * number of milliseconds have elapsed. The return value is true when
    * the function exits with the port in a readable state, false otherwise
@@ -480,6 +641,75 @@ public:
   Timeout
   getTimeout () const;
 
+  /*! Sets how read waits for the rest of a request.
+   *
+   * The policy trades latency against the number of system calls: the
+   * low latency policy hands out the first bytes immediately, the minimum
+   * syscalls policy waits until the request can be served at once, and
+   * the adaptive policy decides per wait from the observed arrival rate.
+   * All policies honour the timeouts set with Serial::setTimeout.
+   *
+   * On Windows reads are timed by the driver through the timeouts and the
+   * policy has no effect, only the statistics are kept.
+   *
+   * \param policy A serial::readpolicy_t.
+   *
+   * \see serial::readpolicy_t, Serial::getReadStats
+   */
+  void
+  setReadPolicy (readpolicy_t policy);
+
+  /*! Gets the read policy.
+   *
+   * \see Serial::setReadPolicy
+   */
+  readpolicy_t
+  getReadPolicy () const;
+
+  /*! Gets the read counters collected since the port was created or the
+   * counters were last reset.  Call it from the reading thread or while no
+   * read is in progress.
+   *
+   * \see serial::ReadStats
+   */
+  ReadStats
+  getReadStats () const;
+
+  /*! Resets the read counters to zero. */
+  void
+  resetReadStats ();
+
+  /*! Gets when the bytes returned by the last read arrived.  Call it from
+   * the reading thread.  Both times are 0 if the last read returned no
+   * bytes or the port runs on a serial::Transport.
+   *
+   * \see serial::ReadTimestamps
+   */
+  ReadTimestamps
+  getReadTimestamps () const;
+
+  /*! Sets all line settings at once.
+   *
+   * An open port is reconfigured once, instead of once per setter, and
+   * not at all if the settings are already in effect.  A closed port
+   * takes them when it is opened.
+   *
+   * \param settings The baudrate, bytesize, parity, stopbits and flow
+   * control to use. \see serial::PortSettings
+   *
+   * \throw std::invalid_argument
+   * \throw serial::IOException
+   */
+  void
+  configure (const PortSettings &settings);
+
+  /*! Gets the line settings of the port.
+   *
+   * \see Serial::configure
+   */
+  PortSettings
+  getSettings () const;
+
   /*! Sets the baudrate for the serial port.
    *
    * Possible baudrates depends on the system but some safe baudrates include:
@@ -645,6 +875,31 @@ public:
   bool
   getCD ();
 
+  /*!
+   * Returns the status of all four modem lines, and their transition
+   * counters where available, using a single query of the driver.
+   *
+   * \see serial::ModemStatus
+   *
+   * \throw serial::PortNotOpenedException
+   * \throw serial::SerialException
+   */
+  ModemStatus
+  getModemStatus ();
+
+#if !defined(_WIN32)
+  /*!
+   * Returns the file descriptor of the open port, or -1 if the port is
+   * closed or the object runs on a serial::Transport.
+   *
+   * The descriptor is non-blocking.  It is meant for multiplexing many
+   * ports, e.g. with serial::MultiPortIO; reading or writing it directly
+   * bypasses the locks of this object.
+   */
+  int
+  getFd () const;
+#endif
+
 private:
   // Disable copy constructors
   Serial(const Serial&);
@@ -654,6 +909,9 @@ private:
   class SerialImpl;
   SerialImpl *pimpl_;
 
+  // Used instead of the port if set, not owned
+  Transport *transport_;
+
   // Scoped Lock Classes
   class ScopedReadLock;
   class ScopedWriteLock;
@@ -768,6 +1026,23 @@ struct PortInfo {
 std::vector<PortInfo>
 list_ports();
 
+/*!
+ * Opens several ports in parallel, each on its own thread, so opening N
+ * ports takes about as long as opening the slowest one.
+ *
+ * Set the port and the settings of each object first (setPort and
+ * configure), it is then opened with a single reconfiguration.
+ *
+ * \param ports Closed ports to open.
+ * \param errors If not NULL, receives one entry per port, empty if it was
+ * opened and the message of the exception otherwise.
+ *
+ * \return The number of ports opened.
+ */
+size_t
+openPorts (const std::vector<Serial *> &ports,
+           std::vector<std::string> *errors = NULL);
+
 } // namespace serial
 
 #endif
@@ -0,0 +1,98 @@
+/*!
+ * \file serial/transport.h
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2012 William Woodall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides the interface through which serial::Serial can read and
+ * write instead of using a serial port of the system.
+ *
+ */
+
+#ifndef SERIAL_TRANSPORT_H
+#define SERIAL_TRANSPORT_H
+
+#include "serial/serial.h"
+
+namespace serial {
+
+/*!
+ * A byte stream serial::Serial can run on, see Serial::Serial(Transport*,
+ * Timeout).  Implementations apply the timeouts they are given the same way
+ * a port does: a read returns once size bytes were read, the total timeout
+ * expired or, after the first byte, the inter byte timeout expired.
+ *
+ * Serial serializes reads and writes with its locks, a transport only has
+ * to allow one reader and one writer at the same time.
+ */
+class Transport {
+public:
+  virtual ~Transport () {}
+
+  /*! Reads up to size bytes, blocking as the read timeouts allow. */
+  virtual size_t
+  read (uint8_t *buffer, size_t size, const Timeout &timeout) = 0;
+
+  /*! Writes up to size bytes, blocking as the write timeouts allow. */
+  virtual size_t
+  write (const uint8_t *data, size_t size, const Timeout &timeout) = 0;
+
+  /*! Number of bytes which can be read without blocking. */
+  virtual size_t
+  available () = 0;
+
+  /*! Blocks until bytes can be read or timeout milliseconds passed. */
+  virtual bool
+  waitReadable (uint32_t timeout) = 0;
+
+  /*! Blocks for the time count bytes take to transmit. */
+  virtual void
+  waitByteTimes (size_t count) = 0;
+
+  /*! Blocks until all written bytes were handed to the peer. */
+  virtual void
+  flush () = 0;
+
+  /*! Drops the bytes received but not read yet. */
+  virtual void
+  flushInput () = 0;
+
+  /*! Drops the bytes written but not handed to the peer yet. */
+  virtual void
+  flushOutput () = 0;
+
+  /*! Levels of the modem status lines.  A transport without lines keeps
+   * this default, which throws serial::SerialException. */
+  virtual ModemStatus
+  getModemStatus ()
+  {
+    throw SerialException ("Transport::getModemStatus (no modem lines)");
+  }
+};
+
+} // namespace serial
+
+#endif // SERIAL_TRANSPORT_H
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sstream>
+#include <algorithm>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -96,6 +97,25 @@ MillisecondTimer::timespec_now ()
   return time;
 }
 
+static uint64_t
+monotonic_ns ()
+{
+  timespec time;
+# ifdef __MACH__ // OS X does not have clock_gettime, use clock_get_time
+  clock_serv_t cclock;
+  mach_timespec_t mts;
+  host_get_clock_service(mach_host_self(), SYSTEM_CLOCK, &cclock);
+  clock_get_time(cclock, &mts);
+  mach_port_deallocate(mach_task_self(), cclock);
+  time.tv_sec = mts.tv_sec;
+  time.tv_nsec = mts.tv_nsec;
+# else
+  clock_gettime(CLOCK_MONOTONIC, &time);
+# endif
+  return static_cast<uint64_t> (time.tv_sec) * 1000000000ULL +
+         static_cast<uint64_t> (time.tv_nsec);
+}
+
 timespec
 timespec_from_ms (const uint32_t millis)
 {
@@ -111,7 +131,8 @@ Serial::SerialImpl::SerialImpl (const string &port, unsigned long baudrate,
                                 flowcontrol_t flowcontrol)
   : port_ (port), fd_ (-1), is_open_ (false), xonxoff_ (false), rtscts_ (false),
     baudrate_ (baudrate), parity_ (parity),
-    bytesize_ (bytesize), stopbits_ (stopbits), flowcontrol_ (flowcontrol)
+    bytesize_ (bytesize), stopbits_ (stopbits), flowcontrol_ (flowcontrol),
+    read_policy_ (readpolicy_default)
 {
   pthread_mutex_init(&this->read_mutex, NULL);
   pthread_mutex_init(&this->write_mutex, NULL);
@@ -169,6 +190,7 @@ Serial::SerialImpl::reconfigurePort ()
   if (tcgetattr(fd_, &options) == -1) {
     THROW (IOException, "::tcgetattr");
   }
+  const struct termios current = options;
 
   // set up raw mode / no echo / binary
   options.c_cflag |= (tcflag_t)  (CLOCAL | CREAD);
@@ -437,8 +459,10 @@ Serial::SerialImpl::reconfigurePort ()
   options.c_cc[VMIN] = 0;
   options.c_cc[VTIME] = 0;
 
-  // activate settings
-  ::tcsetattr (fd_, TCSANOW, &options);
+  // activate settings, unless they are in effect already
+  if (memcmp (&current, &options, sizeof (options)) != 0) {
+    ::tcsetattr (fd_, TCSANOW, &options);
+  }
 
   // Update byte_time_ based on the new settings.
   uint32_t bit_time_ns = 1e9 / baudrate_;
@@ -474,6 +498,12 @@ Serial::SerialImpl::isOpen () const
   return is_open_;
 }
 
+int
+Serial::SerialImpl::getFd () const
+{
+  return is_open_ ? fd_ : -1;
+}
+
 size_t
 Serial::SerialImpl::available ()
 {
@@ -488,6 +518,19 @@ Serial::SerialImpl::available ()
   }
 }
 
+size_t
+Serial::SerialImpl::outputPending ()
+{
+  if (!is_open_) {
+    return 0;
+  }
+  int count = 0;
+  if (-1 == ioctl (fd_, TIOCOUTQ, &count)) {
+    THROW (IOException, errno);
+  }
+  return static_cast<size_t> (count);
+}
+
 bool
 Serial::SerialImpl::waitReadable (uint32_t timeout)
 {
@@ -526,6 +569,50 @@ Serial::SerialImpl::waitByteTimes (size_t count)
   pselect (0, NULL, NULL, NULL, &wait_time, NULL);
 }
 
+bool
+Serial::SerialImpl::coalesces () const
+{
+  switch (read_policy_) {
+  case readpolicy_low_latency:
+    return false;
+  case readpolicy_min_syscalls:
+    return true;
+  case readpolicy_adaptive:
+    // Bytes trickling in slower than the line rate would make the wait
+    // too short anyway, read what is there and block in select again.
+    return read_stats_.arrival_ns_per_byte != 0 &&
+           read_stats_.arrival_ns_per_byte <= 4 * static_cast<uint64_t> (byte_time_ns_);
+  default:
+    return timeout_.inter_byte_timeout == Timeout::max();
+  }
+}
+
+void
+Serial::SerialImpl::coalesceRead (size_t missing, int64_t timeout_remaining_ms)
+{
+  uint64_t ns_per_byte = byte_time_ns_;
+  if (read_policy_ == readpolicy_adaptive) {
+    ns_per_byte = std::max<uint64_t> (ns_per_byte,
+        static_cast<uint64_t> (read_stats_.arrival_ns_per_byte));
+  } else if (read_policy_ == readpolicy_default) {
+    ++read_stats_.coalesce_waits;
+    waitByteTimes (missing);
+    return;
+  }
+  // Never wait past the total timeout of the read, waitReadable may have
+  // used it up already.
+  if (timeout_remaining_ms <= 0) {
+    return;
+  }
+  uint64_t wait_ns = std::min<uint64_t> (ns_per_byte * static_cast<uint64_t> (missing),
+      static_cast<uint64_t> (timeout_remaining_ms) * 1000000ULL);
+  timespec wait_time;
+  wait_time.tv_sec = static_cast<time_t> (wait_ns / 1000000000ULL);
+  wait_time.tv_nsec = static_cast<long> (wait_ns % 1000000000ULL);
+  ++read_stats_.coalesce_waits;
+  pselect (0, NULL, NULL, NULL, &wait_time, NULL);
+}
+
 size_t
 Serial::SerialImpl::read (uint8_t *buf, size_t size)
 {
@@ -534,6 +621,14 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
     throw PortNotOpenedException ("Serial::read");
   }
   size_t bytes_read = 0;
+  // Bytes read after the first chunk without a coalescing wait, and when
+  // the last of them was read, for the arrival estimate.
+  size_t burst_bytes = 0;
+  uint64_t burst_end_ns = 0;
+  bool burst_open = true;
+  const uint64_t start_ns = monotonic_ns ();
+  ++read_stats_.reads;
+  read_stamps_ = ReadTimestamps ();
 
   // Calculate total timeout in milliseconds t_c + (t_m * N)
   long total_timeout_ms = timeout_.read_timeout_constant;
@@ -543,12 +638,17 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
   // Pre-fill buffer with available bytes
   {
     ssize_t bytes_read_now = ::read (fd_, buf, size);
+    ++read_stats_.syscalls;
     if (bytes_read_now > 0) {
       bytes_read = bytes_read_now;
+      read_stamps_.first_ns = read_stamps_.last_ns = monotonic_ns ();
     }
   }
 
   while (bytes_read < size) {
+    if (read_policy_ == readpolicy_low_latency && bytes_read > 0) {
+      break;
+    }
     int64_t timeout_remaining_ms = total_timeout.remaining();
     if (timeout_remaining_ms <= 0) {
       // Timed out
@@ -559,20 +659,25 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
     uint32_t timeout = std::min(static_cast<uint32_t> (timeout_remaining_ms),
                                 timeout_.inter_byte_timeout);
     // Wait for the device to be readable, and then attempt to read.
+    ++read_stats_.waits;
     if (waitReadable(timeout)) {
-      // If it's a fixed-length multi-byte read, insert a wait here so that
-      // we can attempt to grab the whole thing in a single IO call. Skip
-      // this wait if a non-max inter_byte_timeout is specified.
-      if (size > 1 && timeout_.inter_byte_timeout == Timeout::max()) {
+      // If it's a fixed-length multi-byte read, the read policy may insert
+      // a wait here so that we can attempt to grab the whole thing in a
+      // single IO call.
+      bool coalesced = false;
+      if (size > 1 && coalesces ()) {
         size_t bytes_available = available();
         if (bytes_available + bytes_read < size) {
-          waitByteTimes(size - (bytes_available + bytes_read));
+          coalesceRead (size - (bytes_available + bytes_read),
+                        total_timeout.remaining());
+          coalesced = true;
         }
       }
       // This should be non-blocking returning only what is available now
       //  Then returning so that select can block again.
       ssize_t bytes_read_now =
         ::read (fd_, buf + bytes_read, size - bytes_read);
+      ++read_stats_.syscalls;
       // read should always return some data as select reported it was
       // ready to read when we get to this point.
       if (bytes_read_now < 1) {
@@ -582,6 +687,16 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
         throw SerialException ("device reports readiness to read but "
                                "returned no data (device disconnected?)");
       }
+      read_stamps_.last_ns = monotonic_ns ();
+      if (read_stamps_.first_ns == 0) {
+        read_stamps_.first_ns = read_stamps_.last_ns;
+      } else if (coalesced) {
+        // the wait is the policy's own, not the pace of the device
+        burst_open = false;
+      } else if (burst_open) {
+        burst_bytes += static_cast<size_t> (bytes_read_now);
+        burst_end_ns = read_stamps_.last_ns;
+      }
       // Update bytes_read
       bytes_read += static_cast<size_t> (bytes_read_now);
       // If bytes_read == size then we have read everything we need
@@ -600,6 +715,26 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
       }
     }
   }
+  // Track the arrival rate for the adaptive policy from the first chunk to
+  // the last of this burst, the wait for the first byte is idle time.  A
+  // moving average over roughly the last eight reads.
+  if (burst_bytes != 0) {
+    uint64_t sample = (burst_end_ns - read_stamps_.first_ns) /
+                      static_cast<uint64_t> (burst_bytes);
+    uint64_t estimate = read_stats_.arrival_ns_per_byte;
+    if (estimate == 0) {
+      estimate = sample;
+    } else {
+      estimate = estimate - estimate / 8 + sample / 8;
+    }
+    read_stats_.arrival_ns_per_byte = static_cast<uint32_t> (
+      std::min<uint64_t> (estimate, 0xffffffffULL));
+  }
+  read_stats_.bytes += bytes_read;
+  if (bytes_read < size) {
+    ++read_stats_.short_reads;
+  }
+  read_stats_.busy_ns += monotonic_ns () - start_ns;
   return bytes_read;
 }
 
@@ -710,6 +845,36 @@ Serial::SerialImpl::getTimeout () const
   return timeout_;
 }
 
+void
+Serial::SerialImpl::setReadPolicy (serial::readpolicy_t policy)
+{
+  read_policy_ = policy;
+}
+
+serial::readpolicy_t
+Serial::SerialImpl::getReadPolicy () const
+{
+  return read_policy_;
+}
+
+serial::ReadStats
+Serial::SerialImpl::getReadStats () const
+{
+  return read_stats_;
+}
+
+void
+Serial::SerialImpl::resetReadStats ()
+{
+  read_stats_ = ReadStats ();
+}
+
+serial::ReadTimestamps
+Serial::SerialImpl::getReadTimestamps () const
+{
+  return read_stamps_;
+}
+
 void
 Serial::SerialImpl::setBaudrate (unsigned long baudrate)
 {
@@ -780,6 +945,25 @@ Serial::SerialImpl::getFlowcontrol () const
   return flowcontrol_;
 }
 
+void
+Serial::SerialImpl::configure (const serial::PortSettings &settings)
+{
+  baudrate_ = settings.baudrate;
+  bytesize_ = settings.bytesize;
+  parity_ = settings.parity;
+  stopbits_ = settings.stopbits;
+  flowcontrol_ = settings.flowcontrol;
+  if (is_open_)
+    reconfigurePort ();
+}
+
+serial::PortSettings
+Serial::SerialImpl::getSettings () const
+{
+  return serial::PortSettings (static_cast<uint32_t> (baudrate_), bytesize_,
+                               parity_, stopbits_, flowcontrol_);
+}
+
 void
 Serial::SerialImpl::flush ()
 {
@@ -1019,6 +1203,42 @@ Serial::SerialImpl::getCD ()
   }
 }
 
+serial::ModemStatus
+Serial::SerialImpl::getModemStatus ()
+{
+  if (is_open_ == false) {
+    throw PortNotOpenedException ("Serial::getModemStatus");
+  }
+
+  int status;
+
+  if (-1 == ioctl (fd_, TIOCMGET, &status))
+  {
+    stringstream ss;
+    ss << "getModemStatus failed on a call to ioctl(TIOCMGET): " << errno << " " << strerror(errno);
+    throw(SerialException(ss.str().c_str()));
+  }
+
+  ModemStatus modem_status;
+  modem_status.cts = 0 != (status & TIOCM_CTS);
+  modem_status.dsr = 0 != (status & TIOCM_DSR);
+  modem_status.ri = 0 != (status & TIOCM_RI);
+  modem_status.cd = 0 != (status & TIOCM_CD);
+
+#if defined(__linux__) && defined(TIOCGICOUNT)
+  // Not every driver keeps interrupt counters, leave them at zero if not.
+  struct serial_icounter_struct icount;
+  if (0 == ioctl (fd_, TIOCGICOUNT, &icount)) {
+    modem_status.cts_count = static_cast<uint32_t> (icount.cts);
+    modem_status.dsr_count = static_cast<uint32_t> (icount.dsr);
+    modem_status.ri_count = static_cast<uint32_t> (icount.rng);
+    modem_status.cd_count = static_cast<uint32_t> (icount.dcd);
+  }
+#endif
+
+  return modem_status;
+}
+
 void
 Serial::SerialImpl::readLock ()
 {
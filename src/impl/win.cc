@@ -3,6 +3,7 @@
 /* Copyright 2012 William Woodall and John Harrison */
 
 #include <sstream>
+#include <string.h>
 
 #include "serial/impl/win.h"
 
@@ -30,13 +31,26 @@ _prefix_port_if_needed(const wstring &input)
   }
 }
 
+// QueryPerformanceCounter in nanoseconds, the clock of std::chrono::steady_clock
+static uint64_t
+monotonic_ns ()
+{
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  const uint64_t ticks = static_cast<uint64_t> (counter.QuadPart);
+  const uint64_t rate = static_cast<uint64_t> (frequency.QuadPart);
+  return ticks / rate * 1000000000ull + ticks % rate * 1000000000ull / rate;
+}
+
 Serial::SerialImpl::SerialImpl (const string &port, unsigned long baudrate,
                                 bytesize_t bytesize,
                                 parity_t parity, stopbits_t stopbits,
                                 flowcontrol_t flowcontrol)
   : port_ (port.begin(), port.end()), fd_ (INVALID_HANDLE_VALUE), is_open_ (false),
     baudrate_ (baudrate), parity_ (parity),
-    bytesize_ (bytesize), stopbits_ (stopbits), flowcontrol_ (flowcontrol)
+    bytesize_ (bytesize), stopbits_ (stopbits), flowcontrol_ (flowcontrol),
+    read_policy_ (readpolicy_default)
 {
   read_mutex = CreateMutex(NULL, false, NULL);
   write_mutex = CreateMutex(NULL, false, NULL);
@@ -106,6 +120,7 @@ Serial::SerialImpl::reconfigurePort ()
     //error getting state
     THROW (IOException, "Error getting the serial port state.");
   }
+  const DCB current = dcbSerialParams;
 
   // setup baud rate
   switch (baudrate_) {
@@ -255,8 +270,9 @@ Serial::SerialImpl::reconfigurePort ()
     dcbSerialParams.fInX = false;
   }
 
-  // activate settings
-  if (!SetCommState(fd_, &dcbSerialParams)){
+  // activate settings, unless they are in effect already
+  if (memcmp(&current, &dcbSerialParams, sizeof(dcbSerialParams)) != 0 &&
+      !SetCommState(fd_, &dcbSerialParams)){
     CloseHandle(fd_);
     THROW (IOException, "Error setting serial port settings.");
   }
@@ -313,6 +329,21 @@ Serial::SerialImpl::available ()
   return static_cast<size_t>(cs.cbInQue);
 }
 
+size_t
+Serial::SerialImpl::outputPending ()
+{
+  if (!is_open_) {
+    return 0;
+  }
+  COMSTAT cs;
+  if (!ClearCommError(fd_, NULL, &cs)) {
+    stringstream ss;
+    ss << "Error while checking status of the serial port: " << GetLastError();
+    THROW (IOException, ss.str().c_str());
+  }
+  return static_cast<size_t>(cs.cbOutQue);
+}
+
 bool
 Serial::SerialImpl::waitReadable (uint32_t timeout)
 {
@@ -333,11 +364,21 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
     throw PortNotOpenedException ("Serial::read");
   }
   DWORD bytes_read;
+  ++read_stats_.reads;
+  ++read_stats_.syscalls;
+  read_stamps_ = ReadTimestamps ();
   if (!ReadFile(fd_, buf, static_cast<DWORD>(size), &bytes_read, NULL)) {
     stringstream ss;
     ss << "Error while reading from the serial port: " << GetLastError();
     THROW (IOException, ss.str().c_str());
   }
+  if (bytes_read > 0) {
+    read_stamps_.first_ns = read_stamps_.last_ns = monotonic_ns ();
+  }
+  read_stats_.bytes += bytes_read;
+  if (bytes_read < size) {
+    ++read_stats_.short_reads;
+  }
   return (size_t) (bytes_read);
 }
 
@@ -383,6 +424,36 @@ Serial::SerialImpl::getTimeout () const
   return timeout_;
 }
 
+void
+Serial::SerialImpl::setReadPolicy (serial::readpolicy_t policy)
+{
+  read_policy_ = policy;
+}
+
+serial::readpolicy_t
+Serial::SerialImpl::getReadPolicy () const
+{
+  return read_policy_;
+}
+
+serial::ReadStats
+Serial::SerialImpl::getReadStats () const
+{
+  return read_stats_;
+}
+
+void
+Serial::SerialImpl::resetReadStats ()
+{
+  read_stats_ = ReadStats ();
+}
+
+serial::ReadTimestamps
+Serial::SerialImpl::getReadTimestamps () const
+{
+  return read_stamps_;
+}
+
 void
 Serial::SerialImpl::setBaudrate (unsigned long baudrate)
 {
@@ -458,6 +529,25 @@ Serial::SerialImpl::getFlowcontrol () const
   return flowcontrol_;
 }
 
+void
+Serial::SerialImpl::configure (const serial::PortSettings &settings)
+{
+  baudrate_ = settings.baudrate;
+  bytesize_ = settings.bytesize;
+  parity_ = settings.parity;
+  stopbits_ = settings.stopbits;
+  flowcontrol_ = settings.flowcontrol;
+  if (is_open_)
+    reconfigurePort ();
+}
+
+serial::PortSettings
+Serial::SerialImpl::getSettings () const
+{
+  return serial::PortSettings (static_cast<uint32_t> (baudrate_), bytesize_,
+                               parity_, stopbits_, flowcontrol_);
+}
+
 void
 Serial::SerialImpl::flush ()
 {
@@ -603,6 +693,26 @@ Serial::SerialImpl::getCD()
   return (MS_RLSD_ON & dwModemStatus) != 0;
 }
 
+serial::ModemStatus
+Serial::SerialImpl::getModemStatus()
+{
+  if (is_open_ == false) {
+    throw PortNotOpenedException ("Serial::getModemStatus");
+  }
+  DWORD dwModemStatus;
+  if (!GetCommModemStatus(fd_, &dwModemStatus)) {
+    THROW (IOException, "Error getting the status of the modem lines.");
+  }
+
+  // Windows does not expose transition counters, they stay at zero.
+  ModemStatus modem_status;
+  modem_status.cts = (MS_CTS_ON & dwModemStatus) != 0;
+  modem_status.dsr = (MS_DSR_ON & dwModemStatus) != 0;
+  modem_status.ri = (MS_RING_ON & dwModemStatus) != 0;
+  modem_status.cd = (MS_RLSD_ON & dwModemStatus) != 0;
+  return modem_status;
+}
+
 void
 Serial::SerialImpl::readLock()
 {
@@ -0,0 +1,291 @@
+/* Copyright 2012 William Woodall and John Harrison */
+
+#if !defined(_WIN32)
+
+#include <errno.h>
+#include <sys/time.h>
+#include <time.h>
+#ifdef __MACH__
+#include <mach/clock.h>
+#include <mach/mach.h>
+#endif
+
+#include "serial/modem_watcher.h"
+
+using std::vector;
+using serial::ModemEvent;
+using serial::ModemStatus;
+using serial::ModemWatcher;
+using serial::Serial;
+using serial::IOException;
+
+namespace {
+
+uint64_t
+monotonic_ns ()
+{
+# ifdef __MACH__ // OS X does not have clock_gettime, use clock_get_time
+  clock_serv_t cclock;
+  mach_timespec_t mts;
+  host_get_clock_service(mach_host_self(), SYSTEM_CLOCK, &cclock);
+  clock_get_time(cclock, &mts);
+  mach_port_deallocate(mach_task_self(), cclock);
+  return static_cast<uint64_t> (mts.tv_sec) * 1000000000ull + mts.tv_nsec;
+# else
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<uint64_t> (time.tv_sec) * 1000000000ull + time.tv_nsec;
+# endif
+}
+
+timespec
+deadline_from_ms (uint32_t millis)
+{
+  timeval now;
+  gettimeofday(&now, NULL);
+  timespec deadline;
+  int64_t nsec = static_cast<int64_t> (now.tv_usec) * 1000 +
+                 static_cast<int64_t> (millis % 1000) * 1000000;
+  deadline.tv_sec = now.tv_sec + millis / 1000 + nsec / 1000000000;
+  deadline.tv_nsec = nsec % 1000000000;
+  return deadline;
+}
+
+void
+add_event (vector<ModemEvent> &events, Serial *port, serial::modem_line_t line,
+           bool old_level, bool new_level, uint32_t old_count,
+           uint32_t new_count, uint64_t now, const ModemStatus &status)
+{
+  uint32_t transitions = new_count - old_count;
+  if (old_level == new_level && transitions == 0) {
+    return;
+  }
+  ModemEvent event;
+  event.port = port;
+  event.line = line;
+  event.level = new_level;
+  // Without counters a level change is all we know about.
+  event.transitions = transitions == 0 ? 1 : transitions;
+  event.timestamp_ns = now;
+  event.status = status;
+  events.push_back(event);
+}
+
+} // namespace
+
+ModemWatcher::ModemWatcher (uint32_t poll_interval_ms)
+  : poll_interval_ms_ (poll_interval_ms == 0 ? 1 : poll_interval_ms),
+    generation_ (0), running_ (false), stop_ (false)
+{
+  pthread_mutex_init(&this->mutex_, NULL);
+  pthread_mutex_init(&this->dispatch_mutex_, NULL);
+  pthread_cond_init(&this->cond_, NULL);
+}
+
+ModemWatcher::~ModemWatcher ()
+{
+  pthread_mutex_lock(&this->mutex_);
+  bool was_running = running_;
+  stop_ = true;
+  pthread_cond_signal(&this->cond_);
+  pthread_mutex_unlock(&this->mutex_);
+  if (was_running) {
+    pthread_join(thread_, NULL);
+  }
+  pthread_cond_destroy(&this->cond_);
+  pthread_mutex_destroy(&this->dispatch_mutex_);
+  pthread_mutex_destroy(&this->mutex_);
+}
+
+void
+ModemWatcher::watch (Serial &port, ModemEventListener *listener)
+{
+  // Take the first snapshot outside of the lock, this throws if the port
+  // is not usable and prevents reporting the initial levels as changes.
+  Entry entry;
+  entry.port = &port;
+  entry.listener = listener;
+  entry.status = port.getModemStatus ();
+
+  pthread_mutex_lock(&this->mutex_);
+  entry.generation = ++generation_;
+  bool replaced = false;
+  for (size_t i = 0; i < entries_.size (); ++i) {
+    if (entries_[i].port == &port) {
+      entries_[i] = entry;
+      replaced = true;
+      break;
+    }
+  }
+  if (!replaced) {
+    entries_.push_back(entry);
+  }
+  if (!running_) {
+    int result = pthread_create(&thread_, NULL, &ModemWatcher::run_, this);
+    if (result) {
+      pthread_mutex_unlock(&this->mutex_);
+      THROW (IOException, result);
+    }
+    running_ = true;
+  }
+  pthread_mutex_unlock(&this->mutex_);
+}
+
+void
+ModemWatcher::unwatch (Serial &port)
+{
+  // A listener calling this from its callback runs on the helper thread,
+  // which holds dispatch_mutex_ already.
+  pthread_mutex_lock(&this->mutex_);
+  bool on_helper = running_ && pthread_equal(thread_, pthread_self());
+  pthread_mutex_unlock(&this->mutex_);
+  if (!on_helper) {
+    pthread_mutex_lock(&this->dispatch_mutex_);
+  }
+  pthread_mutex_lock(&this->mutex_);
+  for (vector<Entry>::iterator it = entries_.begin (); it != entries_.end ();
+       ++it) {
+    if (it->port == &port) {
+      entries_.erase(it);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&this->mutex_);
+  if (!on_helper) {
+    pthread_mutex_unlock(&this->dispatch_mutex_);
+  }
+}
+
+bool
+ModemWatcher::getStatus (const Serial &port, ModemStatus &status)
+{
+  bool found = false;
+  pthread_mutex_lock(&this->mutex_);
+  for (size_t i = 0; i < entries_.size (); ++i) {
+    if (entries_[i].port == &port) {
+      status = entries_[i].status;
+      found = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&this->mutex_);
+  return found;
+}
+
+size_t
+ModemWatcher::size ()
+{
+  pthread_mutex_lock(&this->mutex_);
+  size_t count = entries_.size ();
+  pthread_mutex_unlock(&this->mutex_);
+  return count;
+}
+
+void *
+ModemWatcher::run_ (void *watcher)
+{
+  static_cast<ModemWatcher*> (watcher)->run ();
+  return NULL;
+}
+
+void
+ModemWatcher::check (Entry &entry, vector<ModemEvent> &events)
+{
+  ModemStatus status;
+  try {
+    status = entry.port->getModemStatus ();
+  } catch (std::exception &) {
+    // The port was closed or vanished, keep the last known snapshot and
+    // let the owner decide what to do with it.
+    return;
+  }
+  uint64_t now = monotonic_ns ();
+  const ModemStatus &old = entry.status;
+  add_event(events, entry.port, modem_line_cts, old.cts, status.cts,
+            old.cts_count, status.cts_count, now, status);
+  add_event(events, entry.port, modem_line_dsr, old.dsr, status.dsr,
+            old.dsr_count, status.dsr_count, now, status);
+  add_event(events, entry.port, modem_line_ri, old.ri, status.ri,
+            old.ri_count, status.ri_count, now, status);
+  add_event(events, entry.port, modem_line_cd, old.cd, status.cd,
+            old.cd_count, status.cd_count, now, status);
+  entry.status = status;
+}
+
+void
+ModemWatcher::run ()
+{
+  vector<Entry> entries;
+  vector<ModemEvent> events;
+  vector<ModemEventListener*> listeners;
+  pthread_mutex_lock(&this->mutex_);
+  while (!stop_) {
+    // The driver is queried without mutex_, so getStatus never waits for
+    // it.  dispatch_mutex_ keeps unwatch from returning while a port is
+    // still in use.
+    pthread_mutex_unlock(&this->mutex_);
+    pthread_mutex_lock(&this->dispatch_mutex_);
+    pthread_mutex_lock(&this->mutex_);
+    entries = entries_;
+    pthread_mutex_unlock(&this->mutex_);
+
+    events.clear ();
+    listeners.clear ();
+    for (size_t i = 0; i < entries.size (); ++i) {
+      size_t before = events.size ();
+      check(entries[i], events);
+      for (size_t j = before; j < events.size (); ++j) {
+        listeners.push_back(entries[i].listener);
+      }
+    }
+
+    // Publish the new snapshots, unless the port was removed or watched
+    // again meanwhile.
+    pthread_mutex_lock(&this->mutex_);
+    for (size_t i = 0; i < entries.size (); ++i) {
+      for (size_t j = 0; j < entries_.size (); ++j) {
+        if (entries_[j].generation == entries[i].generation) {
+          entries_[j].status = entries[i].status;
+          break;
+        }
+      }
+    }
+    pthread_mutex_unlock(&this->mutex_);
+
+    if (!events.empty ()) {
+      for (size_t i = 0; i < events.size (); ++i) {
+        if (listeners[i] == NULL) {
+          continue;
+        }
+        // Skip ports which were removed while the lines were checked.
+        pthread_mutex_lock(&this->mutex_);
+        bool watched = false;
+        for (size_t j = 0; j < entries_.size (); ++j) {
+          if (entries_[j].port == events[i].port &&
+              entries_[j].listener == listeners[i]) {
+            watched = true;
+            break;
+          }
+        }
+        pthread_mutex_unlock(&this->mutex_);
+        if (watched) {
+          listeners[i]->onModemEvent (events[i]);
+        }
+      }
+    }
+    pthread_mutex_unlock(&this->dispatch_mutex_);
+
+    pthread_mutex_lock(&this->mutex_);
+    timespec deadline (deadline_from_ms (poll_interval_ms_));
+    while (!stop_) {
+      int r = pthread_cond_timedwait(&this->cond_, &this->mutex_, &deadline);
+      if (r == ETIMEDOUT) {
+        break;
+      }
+    }
+  }
+  running_ = false;
+  pthread_mutex_unlock(&this->mutex_);
+}
+
+#endif // !defined(_WIN32)
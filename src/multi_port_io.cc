@@ -0,0 +1,1067 @@
+/* Copyright 2012 William Woodall and John Harrison */
+
+#if !defined(_WIN32)
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+# include <sys/epoll.h>
+# include <sys/syscall.h>
+# if defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#   include <linux/io_uring.h>
+#   include <linux/time_types.h>
+#  endif
+# endif
+// Buffer rings and multishot receives arrived in the same header release.
+# if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#  define SERIAL_HAVE_IO_URING
+# endif
+#endif
+
+#include "serial/multi_port_io.h"
+
+using std::map;
+using std::string;
+using std::vector;
+using serial::IOException;
+using serial::MultiPortIO;
+using serial::MultiPortListener;
+using serial::MultiPortStats;
+using serial::PortNotOpenedException;
+using serial::PortSettings;
+using serial::Serial;
+
+namespace serial {
+
+class MultiPortIO::Backend {
+public:
+  Backend (MultiPortListener *listener, size_t buffer_size,
+           serial::multiport_backend_t type)
+  : listener_ (listener), buffer_size_ (buffer_size), type_ (type),
+    drain_wait_ (0) {}
+
+  virtual ~Backend () {}
+
+  virtual void
+  add (Serial &port, int fd) = 0;
+
+  virtual void
+  remove (Serial &port) = 0;
+
+  virtual void
+  write (Serial &port, const uint8_t *data, size_t size) = 0;
+
+  virtual size_t
+  run (uint32_t timeout) = 0;
+
+  // True while writes queued for the port are not complete.
+  virtual bool
+  writing (Serial &port) const = 0;
+
+  MultiPortListener *listener_;
+  size_t buffer_size_;
+  serial::multiport_backend_t type_;
+  MultiPortStats stats_;
+  vector<Serial *> drains_;       // ports watched with watchDrain
+  uint32_t drain_wait_;           // milliseconds until one should be empty
+};
+
+} // namespace serial
+
+namespace {
+
+/*
+ * Readiness based backend: wait for any port to become readable or
+ * writable, then read or write each ready port.
+ */
+class EpollBackend : public MultiPortIO::Backend {
+public:
+  EpollBackend (MultiPortListener *listener, size_t buffer_size)
+  : Backend (listener, buffer_size, serial::multiport_epoll),
+    buffer_ (buffer_size), epoll_fd_ (-1)
+  {
+#if defined(__linux__)
+    epoll_fd_ = epoll_create1 (EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1) {
+      THROW (IOException, errno);
+    }
+#endif
+  }
+
+  virtual ~EpollBackend ()
+  {
+    purge ();
+    for (map<Serial *, Port *>::iterator it = ports_.begin ();
+         it != ports_.end (); ++it) {
+      delete it->second;
+    }
+    if (epoll_fd_ != -1) {
+      ::close (epoll_fd_);
+    }
+  }
+
+  virtual void
+  add (Serial &port, int fd)
+  {
+    if (ports_.count (&port)) {
+      return;
+    }
+    Port *entry = new Port;
+    entry->port = &port;
+    entry->fd = fd;
+    entry->failed = false;
+    entry->want_write = false;
+#if defined(__linux__)
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = entry;
+    if (epoll_ctl (epoll_fd_, EPOLL_CTL_ADD, fd, &event) == -1) {
+      int error = errno;
+      delete entry;
+      THROW (IOException, error);
+    }
+#endif
+    ports_[&port] = entry;
+  }
+
+  virtual void
+  remove (Serial &port)
+  {
+    map<Serial *, Port *>::iterator it = ports_.find (&port);
+    if (it == ports_.end ()) {
+      return;
+    }
+    Port *entry = it->second;
+    ports_.erase (it);
+    if (!entry->failed) {
+      entry->failed = true;
+#if defined(__linux__)
+      epoll_ctl (epoll_fd_, EPOLL_CTL_DEL, entry->fd, NULL);
+      ++stats_.syscalls;
+#endif
+    }
+    // run may still hold the entry when called from the listener
+    removed_.push_back (entry);
+  }
+
+  virtual void
+  write (Serial &port, const uint8_t *data, size_t size)
+  {
+    map<Serial *, Port *>::iterator it = ports_.find (&port);
+    if (it == ports_.end () || size == 0) {
+      return;
+    }
+    Port &entry = *it->second;
+    entry.pending.append (reinterpret_cast<const char *> (data), size);
+    entry.queued.push_back (std::make_pair (size, size));
+  }
+
+  virtual size_t
+  run (uint32_t timeout)
+  {
+    size_t handled = 0;
+    // Writes go out right away, a port only waits for POLLOUT once its
+    // output buffer is full.
+    for (map<Serial *, Port *>::iterator it = ports_.begin ();
+         it != ports_.end (); ++it) {
+      if (!it->second->pending.empty () && !it->second->want_write &&
+          !it->second->failed) {
+        handled += flush (*it->second);
+      }
+    }
+    ready_.clear ();
+    wait (handled == 0 ? static_cast<int> (timeout) : 0);
+    for (size_t i = 0; i < ready_.size (); ++i) {
+      Port &entry = *ready_[i].first;
+      short events = ready_[i].second;
+      if ((events & POLLOUT) && !entry.failed) {
+        handled += flush (entry);
+      }
+      if (events & (POLLIN | POLLERR | POLLHUP)) {
+        handled += drain (entry, (events & POLLHUP) != 0);
+      }
+    }
+    purge ();
+    return handled;
+  }
+
+  virtual bool
+  writing (Serial &port) const
+  {
+    map<Serial *, Port *>::const_iterator it = ports_.find (&port);
+    return it != ports_.end () && !it->second->queued.empty ();
+  }
+
+private:
+  struct Port {
+    Serial *port;
+    int fd;
+    bool failed;
+    bool want_write;
+    string pending;               // bytes of queued writes not written yet
+    // size and bytes left of the queued writes, in order
+    vector<std::pair<size_t, size_t> > queued;
+  };
+
+  void
+  purge ()
+  {
+    for (size_t i = 0; i < removed_.size (); ++i) {
+      delete removed_[i];
+    }
+    removed_.clear ();
+  }
+
+  void
+  wait (int timeout)
+  {
+#if defined(__linux__)
+    epoll_event events[64];
+    int count = epoll_wait (epoll_fd_, events, 64, timeout);
+    ++stats_.syscalls;
+    for (int i = 0; i < count; ++i) {
+      short revents = 0;
+      revents |= (events[i].events & EPOLLIN) ? POLLIN : 0;
+      revents |= (events[i].events & EPOLLOUT) ? POLLOUT : 0;
+      revents |= (events[i].events & EPOLLERR) ? POLLERR : 0;
+      revents |= (events[i].events & EPOLLHUP) ? POLLHUP : 0;
+      ready_.push_back (std::make_pair (static_cast<Port *> (events[i].data.ptr),
+                                        revents));
+    }
+#else
+    vector<pollfd> fds;
+    vector<Port *> entries;
+    for (map<Serial *, Port *>::iterator it = ports_.begin ();
+         it != ports_.end (); ++it) {
+      if (it->second->failed) {
+        continue;
+      }
+      pollfd fd;
+      fd.fd = it->second->fd;
+      fd.events = POLLIN | (it->second->want_write ? POLLOUT : 0);
+      fd.revents = 0;
+      fds.push_back (fd);
+      entries.push_back (it->second);
+    }
+    int count = poll (fds.empty () ? NULL : &fds[0], fds.size (), timeout);
+    ++stats_.syscalls;
+    for (size_t i = 0; count > 0 && i < fds.size (); ++i) {
+      if (fds[i].revents) {
+        ready_.push_back (std::make_pair (entries[i], fds[i].revents));
+      }
+    }
+#endif
+  }
+
+  size_t
+  drain (Port &entry, bool hangup)
+  {
+    size_t handled = 0;
+    bool data = false;
+    while (!entry.failed) {
+      ssize_t count = ::read (entry.fd, &buffer_[0], buffer_.size ());
+      ++stats_.syscalls;
+      if (count > 0) {
+        ++stats_.reads;
+        stats_.bytes_read += static_cast<size_t> (count);
+        ++handled;
+        data = true;
+        listener_->onRead (*entry.port, &buffer_[0], static_cast<size_t> (count));
+        continue;
+      }
+      if (count < 0 && errno == EINTR) {
+        continue;
+      }
+      if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        fail (entry, errno);
+        ++handled;
+      } else if (count == 0 && hangup && !data) {
+        // With VMIN 0 a tty reads 0 bytes when it is empty, only a hang
+        // up without data is the end of file.
+        fail (entry, 0);
+        ++handled;
+      }
+      break;
+    }
+    return handled;
+  }
+
+  size_t
+  flush (Port &entry)
+  {
+    size_t handled = 0;
+    size_t written = 0;
+    while (written < entry.pending.size ()) {
+      ssize_t count = ::write (entry.fd, entry.pending.data () + written,
+                               entry.pending.size () - written);
+      ++stats_.syscalls;
+      if (count > 0) {
+        written += static_cast<size_t> (count);
+        continue;
+      }
+      if (count < 0 && errno == EINTR) {
+        continue;
+      }
+      if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+      entry.pending.clear ();
+      entry.queued.clear ();
+      fail (entry, errno);
+      return 1;
+    }
+    entry.pending.erase (0, written);
+    stats_.bytes_written += written;
+    // report every queued write which is now complete
+    while (!entry.queued.empty () && written >= entry.queued.front ().second) {
+      written -= entry.queued.front ().second;
+      ++stats_.writes;
+      ++handled;
+      listener_->onWritten (*entry.port, entry.queued.front ().first);
+      entry.queued.erase (entry.queued.begin ());
+    }
+    if (!entry.queued.empty ()) {
+      entry.queued.front ().second -= written;
+    }
+    setWantWrite (entry, !entry.pending.empty ());
+    return handled;
+  }
+
+  void
+  setWantWrite (Port &entry, bool want_write)
+  {
+    if (entry.want_write == want_write || entry.failed) {
+      return;
+    }
+    entry.want_write = want_write;
+#if defined(__linux__)
+    epoll_event event;
+    event.events = want_write ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.ptr = &entry;
+    epoll_ctl (epoll_fd_, EPOLL_CTL_MOD, entry.fd, &event);
+    ++stats_.syscalls;
+#endif
+  }
+
+  void
+  fail (Port &entry, int error)
+  {
+    entry.failed = true;
+#if defined(__linux__)
+    epoll_ctl (epoll_fd_, EPOLL_CTL_DEL, entry.fd, NULL);
+    ++stats_.syscalls;
+#endif
+    listener_->onError (*entry.port, error);
+  }
+
+  vector<uint8_t> buffer_;
+  int epoll_fd_;
+  map<Serial *, Port *> ports_;
+  vector<Port *> removed_;
+  vector<std::pair<Port *, short> > ready_;
+};
+
+#if defined(SERIAL_HAVE_IO_URING)
+
+// The installed headers may predate these, the values are kernel ABI.
+const uint8_t OP_READ_MULTISHOT = 49;   // Linux 6.7
+const uint32_t BUFFERS_PER_PORT = 16;
+
+// The low bits of the user data tell what a completion belongs to.
+const uint64_t KIND_READ = 0;
+const uint64_t KIND_WRITE = 1;
+const uint64_t KIND_POLL = 2;
+const uint64_t KIND_CANCEL = 3;
+const uint64_t KIND_MASK = 7;
+
+int
+io_uring_setup (unsigned entries, io_uring_params *params)
+{
+  return static_cast<int> (syscall (__NR_io_uring_setup, entries, params));
+}
+
+int
+io_uring_enter (int fd, unsigned to_submit, unsigned min_complete,
+                unsigned flags, const void *arg, size_t size)
+{
+  return static_cast<int> (syscall (__NR_io_uring_enter, fd, to_submit,
+                                    min_complete, flags, arg, size));
+}
+
+int
+io_uring_register (int fd, unsigned opcode, const void *arg, unsigned count)
+{
+  return static_cast<int> (syscall (__NR_io_uring_register, fd, opcode, arg,
+                                    count));
+}
+
+/*
+ * io_uring backend.  Every port has a multishot read armed which picks
+ * buffers from a ring registered for that port; writes, re-arms and cancels
+ * are collected as submissions and handed to the kernel together with the
+ * wait for completions, one io_uring_enter per run.
+ */
+class IoUringBackend : public MultiPortIO::Backend {
+public:
+  IoUringBackend (MultiPortListener *listener, size_t buffer_size)
+  : Backend (listener, buffer_size, serial::multiport_io_uring),
+    ring_fd_ (-1), sq_ring_ (NULL), cq_ring_ (NULL), sqes_ (NULL),
+    sq_ring_size_ (0), cq_ring_size_ (0), to_submit_ (0), next_group_ (1)
+  {
+    io_uring_params params;
+    memset (&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 1024;
+    ring_fd_ = io_uring_setup (256, &params);
+    if (ring_fd_ < 0) {
+      THROW (IOException, errno);
+    }
+    params_ = params;
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !supportsMultishotRead ()) {
+      ::close (ring_fd_);
+      THROW (IOException, "io_uring lacks multishot reads or timed waits");
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      sq_ring_size_ = cq_ring_size_ = std::max (sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap (NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      int error = errno;
+      ::close (ring_fd_);
+      THROW (IOException, error);
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = mmap (NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    }
+    sqes_ = static_cast<io_uring_sqe *> (
+      mmap (NULL, params.sq_entries * sizeof(io_uring_sqe),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+            IORING_OFF_SQES));
+    if (cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+      int error = errno;
+      unmap ();
+      ::close (ring_fd_);
+      THROW (IOException, error);
+    }
+    char *sq = static_cast<char *> (sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *> (sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *> (sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *> (sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *> (sq + params.sq_off.array);
+    char *cq = static_cast<char *> (cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned *> (cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *> (cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *> (cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *> (cq + params.cq_off.cqes);
+  }
+
+  virtual ~IoUringBackend ()
+  {
+    // Cancel everything and wait for the kernel to let go of the buffers.
+    for (map<Serial *, Port *>::iterator it = ports_.begin ();
+         it != ports_.end (); ++it) {
+      cancel (*it->second);
+      restore (*it->second);
+    }
+    for (int i = 0; i < 100 && outstanding () != 0; ++i) {
+      try {
+        run (10);
+      } catch (const std::exception &) {
+        break;
+      }
+    }
+    unmap ();
+    ::close (ring_fd_);
+    for (std::set<Port *>::iterator it = retired_.begin ();
+         it != retired_.end (); ++it) {
+      release (*it);
+    }
+    for (map<Serial *, Port *>::iterator it = ports_.begin ();
+         it != ports_.end (); ++it) {
+      release (it->second);
+    }
+  }
+
+  virtual void
+  add (Serial &port, int fd)
+  {
+    if (ports_.count (&port)) {
+      return;
+    }
+    Port *entry = new Port;
+    entry->port = &port;
+    entry->fd = fd;
+    entry->active = true;
+    entry->outstanding = 0;
+    entry->writes = 0;
+    entry->group = next_group_++;
+    entry->buffers.resize (BUFFERS_PER_PORT * buffer_size_);
+    entry->ring_size = BUFFERS_PER_PORT * sizeof(io_uring_buf);
+    void *ring = mmap (NULL, entry->ring_size, PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring == MAP_FAILED) {
+      int error = errno;
+      delete entry;
+      THROW (IOException, error);
+    }
+    entry->ring = static_cast<io_uring_buf_ring *> (ring);
+    io_uring_buf_reg reg;
+    memset (&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t> (ring);
+    reg.ring_entries = BUFFERS_PER_PORT;
+    reg.bgid = entry->group;
+    if (io_uring_register (ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+      int error = errno;
+      munmap (ring, entry->ring_size);
+      delete entry;
+      THROW (IOException, error);
+    }
+    entry->tail = 0;
+    for (uint16_t i = 0; i < BUFFERS_PER_PORT; ++i) {
+      recycle (*entry, i);
+    }
+    // Serial leaves VMIN at 0, where reading an empty tty returns 0 rather
+    // than EAGAIN and would end the multishot read as end of file.
+    entry->restore = false;
+    if (tcgetattr (fd, &entry->options) == 0 && entry->options.c_cc[VMIN] == 0) {
+      termios options = entry->options;
+      options.c_cc[VMIN] = 1;
+      options.c_cc[VTIME] = 0;
+      entry->restore = tcsetattr (fd, TCSANOW, &options) == 0;
+    }
+    ports_[&port] = entry;
+    arm (*entry);
+  }
+
+  virtual void
+  remove (Serial &port)
+  {
+    map<Serial *, Port *>::iterator it = ports_.find (&port);
+    if (it == ports_.end ()) {
+      return;
+    }
+    Port *entry = it->second;
+    ports_.erase (it);
+    cancel (*entry);
+    restore (*entry);
+    retire (entry);
+  }
+
+  virtual void
+  write (Serial &port, const uint8_t *data, size_t size)
+  {
+    map<Serial *, Port *>::iterator it = ports_.find (&port);
+    if (it == ports_.end () || size == 0) {
+      return;
+    }
+    Write *op = new Write;
+    op->entry = it->second;
+    op->data.assign (data, data + size);
+    op->done = 0;
+    ++it->second->writes;
+    submitWrite (op, false);
+  }
+
+  virtual size_t
+  run (uint32_t timeout)
+  {
+    bool ready = __atomic_load_n (cq_tail_, __ATOMIC_ACQUIRE) != *cq_head_;
+    unsigned flags = 0;
+    unsigned min_complete = 0;
+    if (!ready && timeout != 0) {
+      flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+      min_complete = 1;
+    }
+    if (to_submit_ != 0 || min_complete != 0) {
+      __kernel_timespec ts;
+      ts.tv_sec = timeout / 1000;
+      ts.tv_nsec = (timeout % 1000) * 1000000;
+      io_uring_getevents_arg arg;
+      memset (&arg, 0, sizeof(arg));
+      arg.sigmask_sz = _NSIG / 8;
+      arg.ts = reinterpret_cast<uint64_t> (&ts);
+      int result = io_uring_enter (ring_fd_, to_submit_, min_complete, flags,
+                                   flags ? &arg : NULL, flags ? sizeof(arg) : 0);
+      ++stats_.syscalls;
+      if (result >= 0) {
+        to_submit_ -= std::min<unsigned> (to_submit_, result);
+      } else if (errno != ETIME && errno != EINTR && errno != EBUSY) {
+        THROW (IOException, errno);
+      }
+    }
+    return reap ();
+  }
+
+  virtual bool
+  writing (Serial &port) const
+  {
+    map<Serial *, Port *>::const_iterator it = ports_.find (&port);
+    return it != ports_.end () && it->second->writes != 0;
+  }
+
+private:
+  struct Port {
+    Serial *port;
+    int fd;
+    bool active;            // false once removed or failed
+    uint32_t outstanding;   // operations the kernel still holds
+    uint32_t writes;        // queued writes not complete yet
+    uint16_t group;
+    uint16_t tail;
+    io_uring_buf_ring *ring;
+    size_t ring_size;
+    vector<uint8_t> buffers;
+    bool restore;           // options holds the termios to put back
+    termios options;
+  };
+
+  struct Write {
+    Port *entry;
+    vector<uint8_t> data;
+    size_t done;
+  };
+
+  bool
+  supportsMultishotRead ()
+  {
+    size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    vector<uint8_t> storage (size);
+    io_uring_probe *probe = reinterpret_cast<io_uring_probe *> (&storage[0]);
+    if (io_uring_register (ring_fd_, IORING_REGISTER_PROBE, probe, 256) < 0) {
+      return false;
+    }
+    return probe->last_op >= OP_READ_MULTISHOT &&
+           (probe->ops[OP_READ_MULTISHOT].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  void
+  unmap ()
+  {
+    if (sqes_ != NULL && sqes_ != MAP_FAILED) {
+      munmap (sqes_, params_.sq_entries * sizeof(io_uring_sqe));
+    }
+    if (cq_ring_ != NULL && cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap (cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != NULL && sq_ring_ != MAP_FAILED) {
+      munmap (sq_ring_, sq_ring_size_);
+    }
+    sqes_ = NULL;
+    cq_ring_ = sq_ring_ = NULL;
+  }
+
+  uint32_t
+  outstanding () const
+  {
+    uint32_t count = 0;
+    for (map<Serial *, Port *>::const_iterator it = ports_.begin ();
+         it != ports_.end (); ++it) {
+      count += it->second->outstanding;
+    }
+    for (std::set<Port *>::const_iterator it = retired_.begin ();
+         it != retired_.end (); ++it) {
+      count += (*it)->outstanding;
+    }
+    return count;
+  }
+
+  io_uring_sqe *
+  nextSqe ()
+  {
+    unsigned tail = *sq_tail_;
+    if (tail - __atomic_load_n (sq_head_, __ATOMIC_ACQUIRE) > sq_mask_) {
+      // The queue is full, hand it to the kernel first.
+      int result = io_uring_enter (ring_fd_, to_submit_, 0, 0, NULL, 0);
+      ++stats_.syscalls;
+      if (result < 0) {
+        THROW (IOException, errno);
+      }
+      to_submit_ -= std::min<unsigned> (to_submit_, result);
+    }
+    io_uring_sqe *sqe = &sqes_[tail & sq_mask_];
+    memset (sqe, 0, sizeof(*sqe));
+    sq_array_[tail & sq_mask_] = tail & sq_mask_;
+    __atomic_store_n (sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++to_submit_;
+    return sqe;
+  }
+
+  void
+  arm (Port &entry)
+  {
+    io_uring_sqe *sqe = nextSqe ();
+    sqe->opcode = OP_READ_MULTISHOT;
+    sqe->fd = entry.fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = entry.group;
+    sqe->user_data = reinterpret_cast<uint64_t> (&entry) | KIND_READ;
+    ++entry.outstanding;
+  }
+
+  void
+  cancel (Port &entry)
+  {
+    io_uring_sqe *sqe = nextSqe ();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = entry.fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_FD;
+    sqe->user_data = KIND_CANCEL;
+    entry.active = false;
+  }
+
+  void
+  restore (Port &entry)
+  {
+    if (entry.restore) {
+      tcsetattr (entry.fd, TCSANOW, &entry.options);
+      entry.restore = false;
+    }
+  }
+
+  void
+  submitWrite (Write *op, bool wait_writable)
+  {
+    Port &entry = *op->entry;
+    if (wait_writable) {
+      // The output buffer was full, only write once it has room.
+      io_uring_sqe *poll = nextSqe ();
+      poll->opcode = IORING_OP_POLL_ADD;
+      poll->fd = entry.fd;
+      poll->poll32_events = POLLOUT;
+      poll->flags = IOSQE_IO_LINK;
+      poll->user_data = reinterpret_cast<uint64_t> (&entry) | KIND_POLL;
+      ++entry.outstanding;
+    }
+    io_uring_sqe *sqe = nextSqe ();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = entry.fd;
+    sqe->addr = reinterpret_cast<uint64_t> (&op->data[op->done]);
+    sqe->len = static_cast<uint32_t> (op->data.size () - op->done);
+    sqe->off = static_cast<uint64_t> (-1);
+    sqe->user_data = reinterpret_cast<uint64_t> (op) | KIND_WRITE;
+    ++entry.outstanding;
+  }
+
+  void
+  recycle (Port &entry, uint16_t id)
+  {
+    // Not ring->bufs, the empty struct of __DECLARE_FLEX_ARRAY has a size
+    // in C++ and moves it off the start of the ring.
+    io_uring_buf *bufs = reinterpret_cast<io_uring_buf *> (entry.ring);
+    io_uring_buf &buf = bufs[entry.tail & (BUFFERS_PER_PORT - 1)];
+    buf.addr = reinterpret_cast<uint64_t> (&entry.buffers[id * buffer_size_]);
+    buf.len = static_cast<uint32_t> (buffer_size_);
+    buf.bid = id;
+    ++entry.tail;
+    __atomic_store_n (&entry.ring->tail, entry.tail, __ATOMIC_RELEASE);
+  }
+
+  size_t
+  reap ()
+  {
+    size_t handled = 0;
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n (cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      io_uring_cqe cqe = cqes_[head & cq_mask_];
+      ++head;
+      // Free the slot before calling out, the listener may queue writes.
+      __atomic_store_n (cq_head_, head, __ATOMIC_RELEASE);
+      handled += complete (cqe);
+      if (head == tail) {
+        tail = __atomic_load_n (cq_tail_, __ATOMIC_ACQUIRE);
+      }
+    }
+    return handled;
+  }
+
+  size_t
+  complete (const io_uring_cqe &cqe)
+  {
+    const uint64_t kind = cqe.user_data & KIND_MASK;
+    if (kind == KIND_CANCEL) {
+      return 0;
+    }
+    if (kind == KIND_WRITE) {
+      return completeWrite (reinterpret_cast<Write *> (cqe.user_data & ~KIND_MASK),
+                            cqe.res);
+    }
+    Port *entry = reinterpret_cast<Port *> (cqe.user_data & ~KIND_MASK);
+    if (kind == KIND_POLL) {
+      --entry->outstanding;
+      retire (entry);
+      return 0;
+    }
+    size_t handled = 0;
+    if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+      uint16_t id = static_cast<uint16_t> (cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+      if (entry->active) {
+        ++stats_.reads;
+        stats_.bytes_read += static_cast<size_t> (cqe.res);
+        ++handled;
+        listener_->onRead (*entry->port, &entry->buffers[id * buffer_size_],
+                           static_cast<size_t> (cqe.res));
+      }
+      recycle (*entry, id);
+    }
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+      // The multishot read ended, because it ran out of buffers, was
+      // cancelled or failed.  The entry is released only after the
+      // listener returns, it may remove the port from the callback.
+      if (entry->active) {
+        if (cqe.res > 0 || cqe.res == -ENOBUFS || cqe.res == -EAGAIN ||
+            cqe.res == -EINTR) {
+          arm (*entry);
+        } else {
+          entry->active = false;
+          ++handled;
+          listener_->onError (*entry->port, cqe.res == 0 ? 0 : -cqe.res);
+        }
+      }
+      --entry->outstanding;
+      retire (entry);
+    }
+    return handled;
+  }
+
+  size_t
+  completeWrite (Write *op, int res)
+  {
+    Port *entry = op->entry;
+    --entry->outstanding;
+    if (!entry->active) {
+      delete op;
+      retire (entry);
+      return 0;
+    }
+    if (res > 0) {
+      op->done += static_cast<size_t> (res);
+      stats_.bytes_written += static_cast<size_t> (res);
+    }
+    if (res == -EAGAIN || res == -EINTR ||
+        (res > 0 && op->done < op->data.size ())) {
+      submitWrite (op, res == -EAGAIN);
+      return 0;
+    }
+    --entry->writes;
+    ++stats_.writes;
+    if (res < 0) {
+      listener_->onError (*entry->port, -res);
+    } else {
+      listener_->onWritten (*entry->port, op->data.size ());
+    }
+    delete op;
+    return 1;
+  }
+
+  // Frees a removed port once the kernel has returned all its operations.
+  void
+  retire (Port *entry)
+  {
+    if (ports_.count (entry->port) && ports_[entry->port] == entry) {
+      return;
+    }
+    if (entry->outstanding != 0) {
+      retired_.insert (entry);
+      return;
+    }
+    retired_.erase (entry);
+    io_uring_buf_reg reg;
+    memset (&reg, 0, sizeof(reg));
+    reg.bgid = entry->group;
+    io_uring_register (ring_fd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    ++stats_.syscalls;
+    release (entry);
+  }
+
+  void
+  release (Port *entry)
+  {
+    munmap (entry->ring, entry->ring_size);
+    delete entry;
+  }
+
+  int ring_fd_;
+  io_uring_params params_;
+  void *sq_ring_;
+  void *cq_ring_;
+  io_uring_sqe *sqes_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  unsigned *sq_head_;
+  unsigned *sq_tail_;
+  unsigned sq_mask_;
+  unsigned *sq_array_;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe *cqes_;
+  unsigned to_submit_;
+  uint16_t next_group_;
+  map<Serial *, Port *> ports_;
+  std::set<Port *> retired_;
+};
+
+#endif // SERIAL_HAVE_IO_URING
+
+} // namespace
+
+MultiPortIO::MultiPortIO (MultiPortListener *listener,
+                          multiport_backend_t backend, size_t buffer_size)
+  : backend_ (NULL)
+{
+  if (listener == NULL || buffer_size == 0) {
+    throw std::invalid_argument ("MultiPortIO needs a listener and buffers.");
+  }
+#if defined(SERIAL_HAVE_IO_URING)
+  if (backend != multiport_epoll) {
+    try {
+      backend_ = new IoUringBackend (listener, buffer_size);
+    } catch (const IOException &) {
+      if (backend == multiport_io_uring) {
+        throw;
+      }
+    }
+  }
+#else
+  if (backend == multiport_io_uring) {
+    THROW (IOException, "io_uring is not available on this system");
+  }
+#endif
+  if (backend_ == NULL) {
+    backend_ = new EpollBackend (listener, buffer_size);
+  }
+}
+
+MultiPortIO::~MultiPortIO ()
+{
+  delete backend_;
+}
+
+void
+MultiPortIO::add (Serial &port)
+{
+  int fd = port.getFd ();
+  if (fd == -1) {
+    throw PortNotOpenedException ("MultiPortIO::add");
+  }
+  backend_->add (port, fd);
+}
+
+void
+MultiPortIO::remove (Serial &port)
+{
+  vector<Serial *> &drains = backend_->drains_;
+  drains.erase (std::remove (drains.begin (), drains.end (), &port),
+                drains.end ());
+  backend_->remove (port);
+}
+
+void
+MultiPortIO::write (Serial &port, const uint8_t *data, size_t size)
+{
+  backend_->write (port, data, size);
+}
+
+void
+MultiPortIO::watchDrain (Serial &port)
+{
+  vector<Serial *> &drains = backend_->drains_;
+  if (std::find (drains.begin (), drains.end (), &port) == drains.end ()) {
+    drains.push_back (&port);
+  }
+  backend_->drain_wait_ = 0;
+}
+
+size_t
+MultiPortIO::run (uint32_t timeout)
+{
+  if (!backend_->drains_.empty ()) {
+    timeout = std::min (timeout, backend_->drain_wait_);
+  }
+  size_t handled = backend_->run (timeout);
+  if (!backend_->drains_.empty ()) {
+    handled += checkDrains ();
+  }
+  return handled;
+}
+
+size_t
+MultiPortIO::checkDrains ()
+{
+  // A write completion wakes run by itself, only ports whose writes are
+  // done need the device asked and a deadline to ask again.
+  vector<Serial *> &drains = backend_->drains_;
+  vector<Serial *> drained;
+  uint32_t wait = std::numeric_limits<uint32_t>::max ();
+  for (size_t i = 0; i < drains.size (); ) {
+    Serial *port = drains[i];
+    if (backend_->writing (*port)) {
+      ++i;
+      continue;
+    }
+    size_t pending = 0;
+    try {
+      pending = port->outputPending ();
+      ++backend_->stats_.syscalls;
+    } catch (const IOException &) {
+      // the failed write was reported to onError already
+      drains.erase (drains.begin () + i);
+      continue;
+    }
+    if (pending == 0) {
+      drained.push_back (port);
+      drains.erase (drains.begin () + i);
+      continue;
+    }
+    PortSettings settings = port->getSettings ();
+    uint64_t bits = 1 + settings.bytesize +
+                    (settings.parity == serial::parity_none ? 0 : 1) +
+                    (settings.stopbits == serial::stopbits_one ? 1 : 2);
+    uint64_t ms = (pending * bits * 1000 + settings.baudrate - 1) /
+                  std::max<uint32_t> (settings.baudrate, 1);
+    wait = std::min<uint64_t> (wait, std::max<uint64_t> (ms, 1));
+    ++i;
+  }
+  backend_->drain_wait_ = wait;
+  // the listener may watch or remove ports again
+  for (size_t i = 0; i < drained.size (); ++i) {
+    backend_->listener_->onDrained (*drained[i]);
+  }
+  return drained.size ();
+}
+
+serial::multiport_backend_t
+MultiPortIO::getBackend () const
+{
+  return backend_->type_;
+}
+
+MultiPortStats
+MultiPortIO::getStats () const
+{
+  return backend_->stats_;
+}
+
+#endif // !defined(_WIN32)
@@ -0,0 +1,751 @@
+/* Copyright 2012 William Woodall and John Harrison */
+
+#if !defined(_WIN32)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "serial/port_broker.h"
+#include "serial/impl/unix.h"
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+using std::string;
+using std::vector;
+using serial::BrokerStats;
+using serial::BrokerTransport;
+using serial::IOException;
+using serial::MillisecondTimer;
+using serial::PortBroker;
+using serial::Serial;
+using serial::SerialException;
+using serial::Timeout;
+
+namespace {
+
+// Every message on the socket is a 4 byte header followed by the payload:
+// type, flags, payload length (little endian, 16 bit).
+const uint8_t MESSAGE_HELLO = 1;  // client: priority, broker: byte time in ns
+const uint8_t MESSAGE_DATA = 2;   // client: bytes to write, broker: bytes read
+// A client's write longer than one message continues in the next one, the
+// broker queues it once the last part arrived.
+const uint8_t FLAG_MORE = 1;
+const size_t HEADER_SIZE = 4;
+const size_t MAX_PAYLOAD = 4096;
+
+void
+append_message (string &out, uint8_t type, const uint8_t *data, size_t size,
+                uint8_t flags = 0)
+{
+  char header[HEADER_SIZE] = { static_cast<char> (type),
+                               static_cast<char> (flags),
+                               static_cast<char> (size & 0xff),
+                               static_cast<char> ((size >> 8) & 0xff) };
+  out.append (header, HEADER_SIZE);
+  out.append (reinterpret_cast<const char *> (data), size);
+}
+
+// Splits off the next complete message, returns false if there is none.
+bool
+next_message (string &in, uint8_t &type, uint8_t &flags, string &payload)
+{
+  if (in.size () < HEADER_SIZE) {
+    return false;
+  }
+  size_t size = static_cast<uint8_t> (in[2]) |
+                (static_cast<size_t> (static_cast<uint8_t> (in[3])) << 8);
+  if (in.size () < HEADER_SIZE + size) {
+    return false;
+  }
+  type = static_cast<uint8_t> (in[0]);
+  flags = static_cast<uint8_t> (in[1]);
+  payload.assign (in, HEADER_SIZE, size);
+  in.erase (0, HEADER_SIZE + size);
+  return true;
+}
+
+void
+set_options (int fd)
+{
+  int flags = fcntl (fd, F_GETFL, 0);
+  fcntl (fd, F_SETFL, flags | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  setsockopt (fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+sockaddr_un
+socket_address (const string &path)
+{
+  sockaddr_un address;
+  memset (&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size () >= sizeof(address.sun_path)) {
+    throw std::invalid_argument ("The socket path is too long.");
+  }
+  strncpy (address.sun_path, path.c_str (), sizeof(address.sun_path) - 1);
+  return address;
+}
+
+uint32_t
+byte_time_ns (Serial &port)
+{
+  uint32_t baudrate = port.getBaudrate ();
+  if (baudrate == 0) {
+    return 0;
+  }
+  uint32_t bits = 1 + static_cast<uint32_t> (port.getBytesize ());
+  bits += port.getParity () == serial::parity_none ? 0 : 1;
+  bits += port.getStopbits () == serial::stopbits_one ? 1 : 2;
+  return static_cast<uint32_t> (1000000000ull * bits / baudrate);
+}
+
+} // namespace
+
+PortBroker::PortBroker (Serial &port, const string &socket_path,
+                        size_t client_buffer)
+  : port_ (port), socket_path_ (socket_path), client_buffer_ (client_buffer),
+    listen_fd_ (-1), saved_policy_ (readpolicy_default), running_ (false),
+    stop_ (false), write_sequence_ (0)
+{
+  wake_pipe_[0] = wake_pipe_[1] = -1;
+  stop_pipe_[0] = stop_pipe_[1] = -1;
+  pthread_mutex_init(&this->mutex_, NULL);
+}
+
+PortBroker::~PortBroker ()
+{
+  stop ();
+  pthread_mutex_destroy(&this->mutex_);
+}
+
+void
+PortBroker::start ()
+{
+  if (running_) {
+    return;
+  }
+  sockaddr_un address = socket_address (socket_path_);
+  unlink (socket_path_.c_str ());
+  listen_fd_ = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd_ == -1) {
+    THROW (IOException, errno);
+  }
+  if (bind (listen_fd_, reinterpret_cast<sockaddr *> (&address),
+            sizeof(address)) == -1 || listen (listen_fd_, 16) == -1 ||
+      pipe (wake_pipe_) == -1) {
+    int error = errno;
+    ::close (listen_fd_);
+    listen_fd_ = -1;
+    THROW (IOException, error);
+  }
+  if (pipe (stop_pipe_) == -1) {
+    int error = errno;
+    ::close (listen_fd_);
+    ::close (wake_pipe_[0]);
+    ::close (wake_pipe_[1]);
+    listen_fd_ = wake_pipe_[0] = wake_pipe_[1] = -1;
+    THROW (IOException, error);
+  }
+  set_options (listen_fd_);
+  set_options (wake_pipe_[0]);
+  set_options (wake_pipe_[1]);
+  set_options (stop_pipe_[0]);
+  set_options (stop_pipe_[1]);
+
+  // Hand out every chunk as soon as it arrives instead of waiting to fill
+  // the read buffer.  stop restores the policy of the caller.
+  saved_policy_ = port_.getReadPolicy ();
+  port_.setReadPolicy (readpolicy_low_latency);
+
+  stop_ = false;
+  int result = pthread_create(&reader_, NULL, &PortBroker::readLoop_, this);
+  if (result == 0) {
+    result = pthread_create(&server_, NULL, &PortBroker::serveLoop_, this);
+    if (result) {
+      pthread_mutex_lock(&this->mutex_);
+      stop_ = true;
+      pthread_mutex_unlock(&this->mutex_);
+      char wake = 0;
+      ssize_t ignored = ::write (stop_pipe_[1], &wake, 1);
+      (void) ignored;
+      pthread_join(reader_, NULL);
+    }
+  }
+  if (result) {
+    ::close (listen_fd_);
+    ::close (wake_pipe_[0]);
+    ::close (wake_pipe_[1]);
+    ::close (stop_pipe_[0]);
+    ::close (stop_pipe_[1]);
+    listen_fd_ = wake_pipe_[0] = wake_pipe_[1] = -1;
+    stop_pipe_[0] = stop_pipe_[1] = -1;
+    port_.setReadPolicy (saved_policy_);
+    THROW (IOException, result);
+  }
+  running_ = true;
+}
+
+void
+PortBroker::stop ()
+{
+  if (!running_) {
+    return;
+  }
+  pthread_mutex_lock(&this->mutex_);
+  stop_ = true;
+  pthread_mutex_unlock(&this->mutex_);
+  // The stop pipe stays readable, the reader's wait ends whenever it looks.
+  char wake = 0;
+  ssize_t ignored = ::write (wake_pipe_[1], &wake, 1);
+  ignored = ::write (stop_pipe_[1], &wake, 1);
+  (void) ignored;
+  pthread_join(reader_, NULL);
+  pthread_join(server_, NULL);
+
+  for (size_t i = 0; i < clients_.size (); ++i) {
+    ::close (clients_[i].fd);
+  }
+  clients_.clear ();
+  writes_ = std::priority_queue<WriteRequest> ();
+  stats_.clients = 0;
+  ::close (listen_fd_);
+  ::close (wake_pipe_[0]);
+  ::close (wake_pipe_[1]);
+  ::close (stop_pipe_[0]);
+  ::close (stop_pipe_[1]);
+  listen_fd_ = wake_pipe_[0] = wake_pipe_[1] = -1;
+  stop_pipe_[0] = stop_pipe_[1] = -1;
+  unlink (socket_path_.c_str ());
+  port_.setReadPolicy (saved_policy_);
+  running_ = false;
+}
+
+BrokerStats
+PortBroker::getStats ()
+{
+  pthread_mutex_lock(&this->mutex_);
+  BrokerStats stats = stats_;
+  pthread_mutex_unlock(&this->mutex_);
+  return stats;
+}
+
+void *
+PortBroker::readLoop_ (void *broker)
+{
+  static_cast<PortBroker *> (broker)->readLoop ();
+  return NULL;
+}
+
+void *
+PortBroker::serveLoop_ (void *broker)
+{
+  static_cast<PortBroker *> (broker)->serveLoop ();
+  return NULL;
+}
+
+void
+PortBroker::readLoop ()
+{
+  uint8_t buffer[MAX_PAYLOAD];
+  while (true) {
+    pthread_mutex_lock(&this->mutex_);
+    bool stop = stop_;
+    pthread_mutex_unlock(&this->mutex_);
+    if (stop) {
+      break;
+    }
+    // Block until the port has data or stop is called, so neither a zero
+    // nor an infinite read timeout of the port matters.  On a transport
+    // there is no descriptor and the read timeout paces the loop.
+    int fd = port_.getFd ();
+    if (fd != -1 || !port_.isOpen ()) {
+      pollfd fds[2];
+      fds[0].fd = stop_pipe_[0];
+      fds[0].events = POLLIN;
+      fds[1].fd = fd;
+      fds[1].events = POLLIN;
+      // A closed port is polled every 10 ms, the owner may reopen it.
+      int r = poll (fds, fd != -1 ? 2 : 1, fd != -1 ? -1 : 10);
+      if (r <= 0 || (fds[0].revents & POLLIN)) {
+        continue;
+      }
+    }
+    size_t bytes_read = 0;
+    try {
+      bytes_read = port_.read (buffer, sizeof(buffer));
+    } catch (const std::exception &) {
+      // Keep the clients connected, the owner may reopen the port.
+      pollfd stop;
+      stop.fd = stop_pipe_[0];
+      stop.events = POLLIN;
+      poll (&stop, 1, 10);
+      continue;
+    }
+    if (bytes_read == 0) {
+      continue;
+    }
+    bool backlog = false;
+    pthread_mutex_lock(&this->mutex_);
+    stats_.bytes_received += bytes_read;
+    for (size_t i = 0; i < clients_.size (); ++i) {
+      queue (clients_[i], MESSAGE_DATA, buffer, bytes_read);
+      send (clients_[i]);
+      backlog = backlog || !clients_[i].outbound.empty ();
+    }
+    pthread_mutex_unlock(&this->mutex_);
+    if (backlog) {
+      // Let the server thread wait for the sockets to take more.
+      char wake = 0;
+      ssize_t ignored = ::write (wake_pipe_[1], &wake, 1);
+      (void) ignored;
+    }
+  }
+}
+
+void
+PortBroker::serveLoop ()
+{
+  vector<pollfd> fds;
+  WriteRequest request;
+  while (true) {
+    pthread_mutex_lock(&this->mutex_);
+    if (stop_) {
+      pthread_mutex_unlock(&this->mutex_);
+      break;
+    }
+    // With writes waiting only look for new requests, do not block.
+    const int timeout = writes_.empty () ? -1 : 0;
+    fds.resize (2 + clients_.size ());
+    fds[0].fd = wake_pipe_[0];
+    fds[1].fd = listen_fd_;
+    for (size_t i = 0; i < clients_.size (); ++i) {
+      fds[2 + i].fd = clients_[i].fd;
+      fds[2 + i].events = POLLIN;
+      if (!clients_[i].outbound.empty ()) {
+        fds[2 + i].events |= POLLOUT;
+      }
+    }
+    pthread_mutex_unlock(&this->mutex_);
+    fds[0].events = fds[1].events = POLLIN;
+
+    if (poll (&fds[0], fds.size (), timeout) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[0].revents & POLLIN) {
+      char drain[64];
+      while (::read (wake_pipe_[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      accept ();
+    }
+
+    pthread_mutex_lock(&this->mutex_);
+    // Only this thread adds or removes clients, the first entries still
+    // match the polled descriptors.
+    for (size_t i = fds.size () - 2; i-- > 0;) {
+      short revents = fds[2 + i].revents;
+      if ((revents & (POLLERR | POLLNVAL)) ||
+          ((revents & (POLLIN | POLLHUP)) && !receive (clients_[i]))) {
+        dropClient (i);
+        continue;
+      }
+      if (revents & POLLOUT) {
+        send (clients_[i]);
+      }
+    }
+    // One request per pass, a request which arrives while it is written
+    // is queued before the next one is chosen.
+    bool write = !writes_.empty ();
+    if (write) {
+      request = writes_.top ();
+      writes_.pop ();
+    }
+    pthread_mutex_unlock(&this->mutex_);
+    if (!write) {
+      continue;
+    }
+
+    // Outside of the lock so the reader keeps serving the clients.
+    size_t written = 0;
+    try {
+      written = port_.write (reinterpret_cast<const uint8_t *> (
+                               request.data.data ()), request.data.size ());
+    } catch (const std::exception &) {
+    }
+    pthread_mutex_lock(&this->mutex_);
+    stats_.bytes_written += written;
+    ++stats_.writes;
+    pthread_mutex_unlock(&this->mutex_);
+  }
+}
+
+void
+PortBroker::accept ()
+{
+  while (true) {
+    int fd = ::accept (listen_fd_, NULL, NULL);
+    if (fd == -1) {
+      return;
+    }
+    set_options (fd);
+    Client client;
+    client.fd = fd;
+    client.priority = 0;
+    uint32_t byte_time = byte_time_ns (port_);
+    uint8_t hello[4] = { static_cast<uint8_t> (byte_time & 0xff),
+                         static_cast<uint8_t> ((byte_time >> 8) & 0xff),
+                         static_cast<uint8_t> ((byte_time >> 16) & 0xff),
+                         static_cast<uint8_t> ((byte_time >> 24) & 0xff) };
+    append_message (client.outbound, MESSAGE_HELLO, hello, sizeof(hello));
+    pthread_mutex_lock(&this->mutex_);
+    clients_.push_back (client);
+    send (clients_.back ());
+    stats_.clients = static_cast<uint32_t> (clients_.size ());
+    pthread_mutex_unlock(&this->mutex_);
+  }
+}
+
+bool
+PortBroker::receive (Client &client)
+{
+  char buffer[MAX_PAYLOAD];
+  while (true) {
+    ssize_t r = recv (client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (r == 0) {
+      return false;
+    }
+    if (r < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        break;
+      }
+      return false;
+    }
+    client.inbound.append (buffer, static_cast<size_t> (r));
+  }
+  uint8_t type;
+  uint8_t flags;
+  string payload;
+  while (next_message (client.inbound, type, flags, payload)) {
+    if (type == MESSAGE_HELLO && !payload.empty ()) {
+      client.priority = static_cast<uint8_t> (payload[0]);
+    } else if (type == MESSAGE_DATA) {
+      // The parts of one write are queued together, so no other write gets
+      // between them on the port.
+      client.write.append (payload);
+      if ((flags & FLAG_MORE) == 0 && !client.write.empty ()) {
+        WriteRequest request;
+        request.priority = client.priority;
+        request.sequence = write_sequence_++;
+        request.data.swap (client.write);
+        writes_.push (request);
+      }
+    }
+  }
+  return true;
+}
+
+void
+PortBroker::queue (Client &client, uint8_t type, const uint8_t *data,
+                   size_t size)
+{
+  if (client.outbound.size () + HEADER_SIZE + size > client_buffer_) {
+    stats_.bytes_dropped += size;
+    return;
+  }
+  append_message (client.outbound, type, data, size);
+}
+
+void
+PortBroker::send (Client &client)
+{
+  size_t sent = 0;
+  while (sent < client.outbound.size ()) {
+    ssize_t r = ::send (client.fd, client.outbound.data () + sent,
+                        client.outbound.size () - sent,
+                        MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (r <= 0) {
+      // Full or gone, the server thread finds out which.
+      break;
+    }
+    sent += static_cast<size_t> (r);
+  }
+  client.outbound.erase (0, sent);
+}
+
+void
+PortBroker::dropClient (size_t index)
+{
+  ::close (clients_[index].fd);
+  clients_.erase (clients_.begin () + index);
+  stats_.clients = static_cast<uint32_t> (clients_.size ());
+}
+
+BrokerTransport::BrokerTransport (const string &socket_path, uint8_t priority)
+  : fd_ (-1), byte_time_ns_ (0), data_pos_ (0)
+{
+  sockaddr_un address = socket_address (socket_path);
+  fd_ = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd_ == -1) {
+    THROW (IOException, errno);
+  }
+  if (connect (fd_, reinterpret_cast<sockaddr *> (&address),
+               sizeof(address)) == -1) {
+    int error = errno;
+    ::close (fd_);
+    fd_ = -1;
+    THROW (IOException, error);
+  }
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  setsockopt (fd_, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+  string hello;
+  append_message (hello, MESSAGE_HELLO, &priority, 1);
+  if (::send (fd_, hello.data (), hello.size (), MSG_NOSIGNAL) !=
+      static_cast<ssize_t> (hello.size ())) {
+    int error = errno;
+    ::close (fd_);
+    fd_ = -1;
+    THROW (IOException, error);
+  }
+  // The broker greets with the byte time of the port.
+  MillisecondTimer timer (1000);
+  while (byte_time_ns_ == 0 && timer.remaining () > 0) {
+    receive (static_cast<int> (timer.remaining ()));
+  }
+}
+
+BrokerTransport::~BrokerTransport ()
+{
+  if (fd_ != -1) {
+    ::close (fd_);
+  }
+}
+
+bool
+BrokerTransport::receive (int timeout)
+{
+  pollfd fd;
+  fd.fd = fd_;
+  fd.events = POLLIN;
+  int r = poll (&fd, 1, timeout);
+  if (r < 0) {
+    if (errno == EINTR) {
+      return false;
+    }
+    THROW (IOException, errno);
+  }
+  if (r == 0) {
+    return false;
+  }
+  char buffer[MAX_PAYLOAD];
+  ssize_t bytes = recv (fd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+  if (bytes == 0) {
+    throw SerialException ("the port broker closed the connection");
+  }
+  if (bytes < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return false;
+    }
+    THROW (IOException, errno);
+  }
+  inbound_.append (buffer, static_cast<size_t> (bytes));
+
+  if (data_pos_ == data_.size ()) {
+    data_.clear ();
+    data_pos_ = 0;
+  }
+  size_t before = data_.size ();
+  uint8_t type;
+  uint8_t flags;
+  string payload;
+  while (next_message (inbound_, type, flags, payload)) {
+    if (type == MESSAGE_DATA) {
+      data_.append (payload);
+    } else if (type == MESSAGE_HELLO && payload.size () == 4) {
+      byte_time_ns_ = static_cast<uint8_t> (payload[0]) |
+        (static_cast<uint32_t> (static_cast<uint8_t> (payload[1])) << 8) |
+        (static_cast<uint32_t> (static_cast<uint8_t> (payload[2])) << 16) |
+        (static_cast<uint32_t> (static_cast<uint8_t> (payload[3])) << 24);
+    }
+  }
+  return data_.size () != before;
+}
+
+size_t
+BrokerTransport::read (uint8_t *buffer, size_t size, const Timeout &timeout)
+{
+  long total_timeout_ms = timeout.read_timeout_constant;
+  total_timeout_ms += timeout.read_timeout_multiplier * static_cast<long> (size);
+  MillisecondTimer total_timeout (total_timeout_ms);
+  // Once bytes arrived the read also ends when none follow within the
+  // inter byte timeout, as on a port.
+  MillisecondTimer inter_byte_timeout (0);
+  bool inter_byte = false;
+  size_t bytes_read = 0;
+  while (true) {
+    size_t count = std::min (size - bytes_read, data_.size () - data_pos_);
+    memcpy (buffer + bytes_read, data_.data () + data_pos_, count);
+    data_pos_ += count;
+    bytes_read += count;
+    if (bytes_read == size) {
+      break;
+    }
+    if (count != 0 && timeout.inter_byte_timeout != Timeout::max ()) {
+      inter_byte_timeout = MillisecondTimer (timeout.inter_byte_timeout);
+      inter_byte = true;
+    }
+    int64_t timeout_remaining_ms = total_timeout.remaining ();
+    if (inter_byte) {
+      timeout_remaining_ms = std::min (timeout_remaining_ms,
+                                       inter_byte_timeout.remaining ());
+    }
+    if (timeout_remaining_ms <= 0) {
+      break;
+    }
+    receive (static_cast<int> (timeout_remaining_ms));
+  }
+  return bytes_read;
+}
+
+size_t
+BrokerTransport::write (const uint8_t *data, size_t size, const Timeout &timeout)
+{
+  long total_timeout_ms = timeout.write_timeout_constant;
+  total_timeout_ms += timeout.write_timeout_multiplier * static_cast<long> (size);
+  MillisecondTimer total_timeout (total_timeout_ms);
+  // A message is sent whole or the stream to the broker is broken, so the
+  // rest of one cut off by the last timeout goes first and a message that
+  // was started counts as written.
+  if (!sendOutbound (std::max<int64_t> (total_timeout.remaining (), 0))) {
+    return 0;
+  }
+  // The parts of the write are flagged, the broker writes them to the port
+  // in one piece.  A write cut off by the timeout is ended with an empty
+  // last part, which goes out before the next write.
+  size_t written = 0;
+  while (written < size) {
+    size_t count = std::min (MAX_PAYLOAD, size - written);
+    bool last = written + count == size;
+    append_message (outbound_, MESSAGE_DATA, data + written, count,
+                    last ? 0 : FLAG_MORE);
+    const size_t message_size = outbound_.size ();
+    if (!sendOutbound (std::max<int64_t> (total_timeout.remaining (), 0))) {
+      if (outbound_.size () == message_size) {
+        outbound_.clear ();
+      } else {
+        written += count;
+      }
+      if (written != 0 && written != size) {
+        append_message (outbound_, MESSAGE_DATA, data, 0);
+      }
+      break;
+    }
+    written += count;
+  }
+  return written;
+}
+
+bool
+BrokerTransport::sendOutbound (int64_t timeout)
+{
+  MillisecondTimer deadline (timeout < 0 ? 0 : static_cast<uint32_t> (timeout));
+  while (!outbound_.empty ()) {
+    ssize_t r = ::send (fd_, outbound_.data (), outbound_.size (),
+                        MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (r > 0) {
+      outbound_.erase (0, static_cast<size_t> (r));
+      continue;
+    }
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      THROW (IOException, errno);
+    }
+    int remaining = -1;
+    if (timeout >= 0) {
+      remaining = static_cast<int> (std::max<int64_t> (deadline.remaining (), 0));
+      if (remaining == 0) {
+        return false;
+      }
+    }
+    pollfd fd;
+    fd.fd = fd_;
+    fd.events = POLLOUT;
+    if (poll (&fd, 1, remaining) < 0 && errno != EINTR) {
+      THROW (IOException, errno);
+    }
+  }
+  return true;
+}
+
+size_t
+BrokerTransport::available ()
+{
+  while (receive (0)) {
+  }
+  return data_.size () - data_pos_;
+}
+
+bool
+BrokerTransport::waitReadable (uint32_t timeout)
+{
+  MillisecondTimer timer (timeout);
+  while (available () == 0) {
+    int64_t remaining = timer.remaining ();
+    if (remaining <= 0) {
+      return false;
+    }
+    receive (static_cast<int> (remaining));
+  }
+  return true;
+}
+
+void
+BrokerTransport::waitByteTimes (size_t count)
+{
+  uint64_t ns = static_cast<uint64_t> (byte_time_ns_) * count;
+  timespec wait_time;
+  wait_time.tv_sec = static_cast<time_t> (ns / 1000000000ull);
+  wait_time.tv_nsec = static_cast<long> (ns % 1000000000ull);
+  nanosleep (&wait_time, NULL);
+}
+
+void
+BrokerTransport::flush ()
+{
+  sendOutbound (-1);
+}
+
+void
+BrokerTransport::flushInput ()
+{
+  available ();
+  data_.clear ();
+  data_pos_ = 0;
+}
+
+void
+BrokerTransport::flushOutput ()
+{
+}
+
+#endif // !defined(_WIN32)
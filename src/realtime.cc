@@ -0,0 +1,174 @@
+/* Copyright 2012 William Woodall and John Harrison */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sstream>
+
+#if defined(_WIN32)
+# include <malloc.h>
+# include <windows.h>
+#else
+# include <alloca.h>
+# include <errno.h>
+# include <pthread.h>
+# include <sched.h>
+# include <sys/mman.h>
+# if defined(__GLIBC__)
+#  include <malloc.h>
+# endif
+#endif
+
+#include "serial/realtime.h"
+
+using std::string;
+using std::stringstream;
+using serial::RealtimeProfile;
+using serial::RealtimeStatus;
+
+namespace {
+
+void
+warn (RealtimeStatus &status, const string &what, const string &why)
+{
+  status.warnings += what + ": " + why + "\n";
+}
+
+#if defined(_WIN32)
+
+string
+error_text (DWORD error)
+{
+  stringstream ss;
+  ss << "error " << error;
+  return ss.str ();
+}
+
+#else
+
+string
+error_text (int error)
+{
+  string text = strerror (error);
+  if (error == EPERM) {
+    text += ", missing privileges";
+  }
+  return text;
+}
+
+#endif
+
+// Touches size bytes below the current stack frame.
+void
+prefault_stack (size_t size)
+{
+#if defined(_WIN32)
+  volatile char *stack = static_cast<volatile char *> (_alloca (size));
+#else
+  volatile char *stack = static_cast<volatile char *> (alloca (size));
+#endif
+  for (size_t i = 0; i < size; i += 1024) {
+    stack[i] = 0;
+  }
+}
+
+void
+prefault_heap (size_t size, RealtimeStatus &status)
+{
+#if defined(__GLIBC__)
+  // Keep freed memory in the heap instead of returning it to the system,
+  // and serve large blocks from the heap instead of separate mappings.
+  mallopt (M_TRIM_THRESHOLD, -1);
+  mallopt (M_MMAP_MAX, 0);
+#endif
+  char *heap = static_cast<char *> (malloc (size));
+  if (heap == NULL) {
+    warn (status, "heap prefault", "out of memory");
+    return;
+  }
+  memset (heap, 0, size);
+  free (heap);
+}
+
+} // namespace
+
+RealtimeStatus
+serial::applyRealtimeProfile (const RealtimeProfile &profile)
+{
+  RealtimeStatus status;
+#if defined(_WIN32)
+  HANDLE thread = GetCurrentThread ();
+  if (profile.cpu >= 0) {
+    if (profile.cpu >= static_cast<int> (sizeof(DWORD_PTR) * 8)) {
+      warn (status, "affinity", "CPU out of range");
+    } else if (SetThreadAffinityMask (thread, DWORD_PTR (1) << profile.cpu) == 0) {
+      warn (status, "affinity", error_text (GetLastError ()));
+    } else {
+      status.affinity = true;
+    }
+  }
+  if (profile.priority > 0) {
+    if (!SetThreadPriority (thread, THREAD_PRIORITY_TIME_CRITICAL)) {
+      warn (status, "priority", error_text (GetLastError ()));
+    } else {
+      status.priority = true;
+    }
+  }
+  if (profile.lock_memory) {
+    // Windows cannot lock all pages, make room in the working set so the
+    // prefaulted pages are not trimmed.
+    SIZE_T minimum, maximum;
+    HANDLE process = GetCurrentProcess ();
+    SIZE_T extra = profile.stack_prefault + profile.heap_prefault;
+    if (!GetProcessWorkingSetSize (process, &minimum, &maximum) ||
+        !SetProcessWorkingSetSize (process, minimum + extra,
+                                   maximum > minimum + extra ? maximum : minimum + extra)) {
+      warn (status, "memory lock", error_text (GetLastError ()));
+    } else {
+      status.memory_locked = true;
+    }
+  }
+#else
+  if (profile.cpu >= 0) {
+# if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    CPU_SET (profile.cpu, &set);
+    int result = pthread_setaffinity_np (pthread_self (), sizeof(set), &set);
+    if (result != 0) {
+      warn (status, "affinity", error_text (result));
+    } else {
+      status.affinity = true;
+    }
+# else
+    warn (status, "affinity", "not supported on this system");
+# endif
+  }
+  if (profile.priority > 0) {
+    sched_param param;
+    memset (&param, 0, sizeof(param));
+    param.sched_priority = profile.priority;
+    int result = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+    if (result != 0) {
+      warn (status, "priority", error_text (result));
+    } else {
+      status.priority = true;
+    }
+  }
+  if (profile.lock_memory) {
+    if (mlockall (MCL_CURRENT | MCL_FUTURE) != 0) {
+      warn (status, "memory lock", error_text (errno));
+    } else {
+      status.memory_locked = true;
+    }
+  }
+#endif
+  // After locking, so the touched pages stay resident.
+  if (profile.heap_prefault > 0) {
+    prefault_heap (profile.heap_prefault, status);
+  }
+  if (profile.stack_prefault > 0) {
+    prefault_stack (profile.stack_prefault);
+  }
+  return status;
+}
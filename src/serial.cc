@@ -10,6 +10,7 @@
 #endif
 
 #include "serial/serial.h"
+#include "serial/transport.h"
 
 #ifdef _WIN32
 #include "serial/impl/win.h"
@@ -67,11 +68,24 @@ Serial::Serial (const string &port, uint32_t baudrate, serial::Timeout timeout,
                 bytesize_t bytesize, parity_t parity, stopbits_t stopbits,
                 flowcontrol_t flowcontrol)
  : pimpl_(new SerialImpl (port, baudrate, bytesize, parity,
-                                           stopbits, flowcontrol))
+                                           stopbits, flowcontrol)),
+   transport_(NULL)
 {
   pimpl_->setTimeout(timeout);
 }
 
+Serial::Serial (serial::Transport *transport, serial::Timeout timeout)
+ : pimpl_(NULL), transport_(transport)
+{
+  if (transport_ == NULL) {
+    throw invalid_argument ("The transport must not be NULL.");
+  }
+  // The implementation only keeps the settings, it is never opened.
+  pimpl_ = new SerialImpl ("", 9600, eightbits, parity_none, stopbits_one,
+                           flowcontrol_none);
+  pimpl_->setTimeout(timeout);
+}
+
 Serial::~Serial ()
 {
   delete pimpl_;
@@ -80,43 +94,74 @@ Serial::~Serial ()
 void
 Serial::open ()
 {
+  if (transport_) {
+    return;
+  }
   pimpl_->open ();
 }
 
 void
 Serial::close ()
 {
+  if (transport_) {
+    return;
+  }
   pimpl_->close ();
 }
 
 bool
 Serial::isOpen () const
 {
+  if (transport_) {
+    return true;
+  }
   return pimpl_->isOpen ();
 }
 
 size_t
 Serial::available ()
 {
+  if (transport_) {
+    return transport_->available ();
+  }
   return pimpl_->available ();
 }
 
+size_t
+Serial::outputPending ()
+{
+  if (transport_) {
+    return 0;
+  }
+  return pimpl_->outputPending ();
+}
+
 bool
 Serial::waitReadable ()
 {
   serial::Timeout timeout(pimpl_->getTimeout ());
+  if (transport_) {
+    return transport_->waitReadable(timeout.read_timeout_constant);
+  }
   return pimpl_->waitReadable(timeout.read_timeout_constant);
 }
 
 void
 Serial::waitByteTimes (size_t count)
 {
+  if (transport_) {
+    transport_->waitByteTimes(count);
+    return;
+  }
   pimpl_->waitByteTimes(count);
 }
 
 size_t
 Serial::read_ (uint8_t *buffer, size_t size)
 {
+  if (transport_) {
+    return transport_->read (buffer, size, pimpl_->getTimeout ());
+  }
   return this->pimpl_->read (buffer, size);
 }
 
@@ -124,7 +169,7 @@ size_t
 Serial::read (uint8_t *buffer, size_t size)
 {
   ScopedReadLock lock(this->pimpl_);
-  return this->pimpl_->read (buffer, size);
+  return this->read_ (buffer, size);
 }
 
 size_t
@@ -135,7 +180,7 @@ Serial::read (std::vector<uint8_t> &buffer, size_t size)
   // uint8_t *buffer_ = new uint8_t[size]
 
   uint8_t *buffer_ = new uint8_t[size]();
-  size_t bytes_read = this->pimpl_->read (buffer_, size);
+  size_t bytes_read = this->read_ (buffer_, size);
   buffer.insert (buffer.end (), buffer_, buffer_+bytes_read);
   delete[] buffer_;
   return bytes_read;
@@ -146,7 +191,7 @@ Serial::read (std::string &buffer, size_t size)
 {
   ScopedReadLock lock(this->pimpl_);
   uint8_t *buffer_ = new uint8_t[size];
-  size_t bytes_read = this->pimpl_->read (buffer_, size);
+  size_t bytes_read = this->read_ (buffer_, size);
   buffer.append (reinterpret_cast<const char*>(buffer_), bytes_read);
   delete[] buffer_;
   return bytes_read;
@@ -261,6 +306,9 @@ Serial::write (const uint8_t *data, size_t size)
 size_t
 Serial::write_ (const uint8_t *data, size_t length)
 {
+  if (transport_) {
+    return transport_->write (data, length, pimpl_->getTimeout ());
+  }
   return pimpl_->write (data, length);
 }
 
@@ -292,6 +340,69 @@ Serial::getTimeout () const {
   return pimpl_->getTimeout ();
 }
 
+void
+Serial::setReadPolicy (serial::readpolicy_t policy)
+{
+  if (transport_) {
+    throw SerialException ("Serial::setReadPolicy (not supported on a transport)");
+  }
+  pimpl_->setReadPolicy (policy);
+}
+
+serial::readpolicy_t
+Serial::getReadPolicy () const
+{
+  if (transport_) {
+    throw SerialException ("Serial::getReadPolicy (not supported on a transport)");
+  }
+  return pimpl_->getReadPolicy ();
+}
+
+serial::ReadStats
+Serial::getReadStats () const
+{
+  if (transport_) {
+    throw SerialException ("Serial::getReadStats (not supported on a transport)");
+  }
+  return pimpl_->getReadStats ();
+}
+
+void
+Serial::resetReadStats ()
+{
+  if (transport_) {
+    throw SerialException ("Serial::resetReadStats (not supported on a transport)");
+  }
+  pimpl_->resetReadStats ();
+}
+
+serial::ReadTimestamps
+Serial::getReadTimestamps () const
+{
+  if (transport_) {
+    return ReadTimestamps ();
+  }
+  return pimpl_->getReadTimestamps ();
+}
+
+void
+Serial::configure (const serial::PortSettings &settings)
+{
+  if (transport_) {
+    throw SerialException ("Serial::configure (not supported on a transport)");
+  }
+  pimpl_->configure (settings);
+}
+
+serial::PortSettings
+Serial::getSettings () const
+{
+  if (transport_) {
+    throw SerialException ("Serial::getSettings (not supported on a transport)");
+  }
+  return pimpl_->getSettings ();
+}
+
 void
 Serial::setBaudrate (uint32_t baudrate)
 {
@@ -356,18 +467,30 @@ void Serial::flush ()
 {
   ScopedReadLock rlock(this->pimpl_);
   ScopedWriteLock wlock(this->pimpl_);
+  if (transport_) {
+    transport_->flush ();
+    return;
+  }
   pimpl_->flush ();
 }
 
 void Serial::flushInput ()
 {
   ScopedReadLock lock(this->pimpl_);
+  if (transport_) {
+    transport_->flushInput ();
+    return;
+  }
   pimpl_->flushInput ();
 }
 
 void Serial::flushOutput ()
 {
   ScopedWriteLock lock(this->pimpl_);
+  if (transport_) {
+    transport_->flushOutput ();
+    return;
+  }
   pimpl_->flushOutput ();
 }
 
@@ -398,20 +521,138 @@ bool Serial::waitForChange()
 
 bool Serial::getCTS ()
 {
+  if (transport_) {
+    return transport_->getModemStatus ().cts;
+  }
   return pimpl_->getCTS ();
 }
 
 bool Serial::getDSR ()
 {
+  if (transport_) {
+    return transport_->getModemStatus ().dsr;
+  }
   return pimpl_->getDSR ();
 }
 
 bool Serial::getRI ()
 {
+  if (transport_) {
+    return transport_->getModemStatus ().ri;
+  }
   return pimpl_->getRI ();
 }
 
 bool Serial::getCD ()
 {
+  if (transport_) {
+    return transport_->getModemStatus ().cd;
+  }
   return pimpl_->getCD ();
 }
+
+serial::ModemStatus Serial::getModemStatus ()
+{
+  if (transport_) {
+    return transport_->getModemStatus ();
+  }
+  return pimpl_->getModemStatus ();
+}
+
+#if !defined(_WIN32)
+int Serial::getFd () const
+{
+  if (transport_) {
+    return -1;
+  }
+  return pimpl_->getFd ();
+}
+#endif
+
+namespace {
+
+struct OpenJob {
+  Serial *port;
+  string error;
+  bool opened;
+};
+
+void
+runOpenJob (OpenJob &job)
+{
+  try {
+    job.port->open ();
+    job.opened = true;
+  } catch (const std::exception &e) {
+    job.error = e.what ();
+  }
+}
+
+#ifdef _WIN32
+DWORD WINAPI
+openThread (LPVOID job)
+{
+  runOpenJob (*static_cast<OpenJob *> (job));
+  return 0;
+}
+#else
+void *
+openThread (void *job)
+{
+  runOpenJob (*static_cast<OpenJob *> (job));
+  return NULL;
+}
+#endif
+
+} // namespace
+
+size_t
+serial::openPorts (const vector<Serial *> &ports, vector<string> *errors)
+{
+  vector<OpenJob> jobs (ports.size ());
+#ifdef _WIN32
+  vector<HANDLE> threads (ports.size (), (HANDLE) NULL);
+#else
+  vector<pthread_t> threads (ports.size ());
+  vector<bool> started (ports.size (), false);
+#endif
+  for (size_t i = 0; i < ports.size (); ++i) {
+    jobs[i].port = ports[i];
+    jobs[i].opened = false;
+    // Without a thread the port is opened here, only slower.
+#ifdef _WIN32
+    threads[i] = CreateThread (NULL, 0, openThread, &jobs[i], 0, NULL);
+    if (threads[i] == NULL) {
+      runOpenJob (jobs[i]);
+    }
+#else
+    started[i] = pthread_create (&threads[i], NULL, openThread, &jobs[i]) == 0;
+    if (!started[i]) {
+      runOpenJob (jobs[i]);
+    }
+#endif
+  }
+  size_t opened = 0;
+  for (size_t i = 0; i < ports.size (); ++i) {
+#ifdef _WIN32
+    if (threads[i] != NULL) {
+      WaitForSingleObject (threads[i], INFINITE);
+      CloseHandle (threads[i]);
+    }
+#else
+    if (started[i]) {
+      pthread_join (threads[i], NULL);
+    }
+#endif
+    if (jobs[i].opened) {
+      ++opened;
+    }
+  }
+  if (errors) {
+    errors->resize (ports.size ());
+    for (size_t i = 0; i < ports.size (); ++i) {
+      (*errors)[i] = jobs[i].error;
+    }
+  }
+  return opened;
+}
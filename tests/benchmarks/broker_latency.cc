@@ -0,0 +1,82 @@
+/* Compares the latency of reading from a port directly and through a
+ * serial::PortBroker.  A pty stands in for the device: one byte is written
+ * to the master side and the time until the reader has it is measured.
+ *
+ * usage: broker_latency [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <pty.h>
+#else
+#include <util.h>
+#endif
+
+#include "serial/port_broker.h"
+
+using serial::BrokerTransport;
+using serial::PortBroker;
+using serial::Serial;
+using serial::Timeout;
+
+static uint64_t
+now_ns ()
+{
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<uint64_t> (time.tv_sec) * 1000000000ull + time.tv_nsec;
+}
+
+static void
+measure (const char *name, int master_fd, Serial &reader, int iterations)
+{
+  std::vector<uint64_t> samples;
+  uint8_t byte;
+  for (int i = 0; i < iterations; ++i) {
+    uint64_t start = now_ns ();
+    if (write(master_fd, "x", 1) != 1 || reader.read(&byte, 1) != 1) {
+      fprintf(stderr, "%s: lost a byte\n", name);
+      continue;
+    }
+    samples.push_back(now_ns () - start);
+  }
+  if (samples.empty ()) {
+    return;
+  }
+  std::sort(samples.begin (), samples.end ());
+  printf("%-8s median %7.1f us  p99 %7.1f us  max %7.1f us\n", name,
+         samples[samples.size () / 2] / 1000.0,
+         samples[samples.size () * 99 / 100] / 1000.0,
+         samples.back () / 1000.0);
+}
+
+int
+main (int argc, char **argv)
+{
+  int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+  int master_fd, slave_fd;
+  char name[100];
+  if (openpty(&master_fd, &slave_fd, name, NULL, NULL) == -1) {
+    perror("openpty");
+    return 1;
+  }
+  Serial port(name, 115200, Timeout::simpleTimeout(1000));
+  port.setReadPolicy(serial::readpolicy_low_latency);
+  measure("direct", master_fd, port, iterations);
+
+  std::string path = "/tmp/serial_broker_latency.sock";
+  PortBroker broker(port, path);
+  broker.start();
+  BrokerTransport transport(path);
+  Serial client(&transport, Timeout::simpleTimeout(1000));
+  measure("broker", master_fd, client, iterations);
+  return 0;
+}
@@ -0,0 +1,219 @@
+/* Compares reading many ports with a thread per port calling Serial::read
+ * against one serial::MultiPortIO thread, with io_uring and with epoll.
+ * Ptys stand in for the devices: a feeder thread writes the same amount of
+ * data into every master side while the readers drain the slave sides.
+ * Reported are the system calls per second and the CPU time of the reading
+ * threads per MB received.
+ *
+ * usage: multi_port_io [ports] [kilobytes per port] [chunk bytes]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <pty.h>
+#else
+#include <util.h>
+#endif
+
+#include "serial/multi_port_io.h"
+
+using serial::MultiPortIO;
+using serial::MultiPortListener;
+using serial::Serial;
+using serial::Timeout;
+
+#if defined(RUSAGE_THREAD)
+static const int USAGE_WHO = RUSAGE_THREAD;
+#else
+// Includes the feeder thread, the numbers are only comparable on one system.
+static const int USAGE_WHO = RUSAGE_SELF;
+#endif
+
+static uint64_t
+now_ns ()
+{
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<uint64_t> (time.tv_sec) * 1000000000ull + time.tv_nsec;
+}
+
+static uint64_t
+cpu_ns ()
+{
+  rusage usage;
+  getrusage(USAGE_WHO, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ull +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ull;
+}
+
+struct Bench {
+  std::vector<int> masters;
+  std::vector<int> slaves;
+  std::vector<Serial *> ports;
+  size_t per_port;
+  size_t chunk;
+};
+
+static void *
+feed (void *arg)
+{
+  Bench &bench = *static_cast<Bench *> (arg);
+  std::string data(bench.chunk, 'x');
+  for (size_t done = 0; done < bench.per_port; done += bench.chunk) {
+    for (size_t i = 0; i < bench.masters.size (); ++i) {
+      if (write(bench.masters[i], data.data (), data.size ()) !=
+          static_cast<ssize_t> (data.size ())) {
+        perror("write");
+      }
+    }
+  }
+  return NULL;
+}
+
+struct Reader {
+  Serial *port;
+  size_t expected;
+  uint64_t cpu;
+};
+
+static void *
+read_port (void *arg)
+{
+  Reader &reader = *static_cast<Reader *> (arg);
+  uint64_t start = cpu_ns ();
+  std::vector<uint8_t> buffer(4096);
+  size_t received = 0;
+  while (received < reader.expected) {
+    size_t count = reader.port->read(&buffer[0], buffer.size ());
+    if (count == 0) {
+      break;
+    }
+    received += count;
+  }
+  reader.cpu = cpu_ns () - start;
+  return NULL;
+}
+
+static void
+report (const char *name, const Bench &bench, uint64_t wall, uint64_t cpu,
+        uint64_t syscalls)
+{
+  double mb = bench.per_port * bench.ports.size () / 1e6;
+  printf("%-10s %8.0f syscalls/s  %8.1f syscalls/MB  %7.2f ms CPU/MB  %7.1f MB/s\n",
+         name, syscalls / (wall / 1e9), syscalls / mb, cpu / 1e6 / mb,
+         mb / (wall / 1e9));
+}
+
+static void
+run_threads (Bench &bench)
+{
+  std::vector<Reader> readers(bench.ports.size ());
+  std::vector<pthread_t> threads(bench.ports.size ());
+  for (size_t i = 0; i < bench.ports.size (); ++i) {
+    bench.ports[i]->resetReadStats();
+    readers[i].port = bench.ports[i];
+    readers[i].expected = bench.per_port;
+    pthread_create(&threads[i], NULL, read_port, &readers[i]);
+  }
+  uint64_t start = now_ns ();
+  pthread_t feeder;
+  pthread_create(&feeder, NULL, feed, &bench);
+  uint64_t cpu = 0;
+  uint64_t syscalls = 0;
+  for (size_t i = 0; i < bench.ports.size (); ++i) {
+    pthread_join(threads[i], NULL);
+    cpu += readers[i].cpu;
+    serial::ReadStats stats = bench.ports[i]->getReadStats();
+    syscalls += stats.syscalls + stats.waits;
+  }
+  uint64_t wall = now_ns () - start;
+  pthread_join(feeder, NULL);
+  report("threads", bench, wall, cpu, syscalls);
+}
+
+class Counter : public MultiPortListener {
+public:
+  Counter () : received (0) {}
+
+  virtual void
+  onRead (Serial &port, const uint8_t *data, size_t size)
+  {
+    (void) port;
+    (void) data;
+    received += size;
+  }
+
+  size_t received;
+};
+
+static void
+run_multi (const char *name, serial::multiport_backend_t backend, Bench &bench)
+{
+  Counter counter;
+  MultiPortIO *io;
+  try {
+    io = new MultiPortIO(&counter, backend);
+  } catch (const serial::IOException &e) {
+    printf("%-10s not available: %s\n", name, e.what ());
+    return;
+  }
+  for (size_t i = 0; i < bench.ports.size (); ++i) {
+    io->add(*bench.ports[i]);
+  }
+  uint64_t start = now_ns ();
+  uint64_t cpu = cpu_ns ();
+  pthread_t feeder;
+  pthread_create(&feeder, NULL, feed, &bench);
+  const size_t total = bench.per_port * bench.ports.size ();
+  while (counter.received < total) {
+    if (io->run(1000) == 0) {
+      break;
+    }
+  }
+  cpu = cpu_ns () - cpu;
+  uint64_t wall = now_ns () - start;
+  pthread_join(feeder, NULL);
+  report(name, bench, wall, cpu, io->getStats().syscalls);
+  delete io;
+}
+
+int
+main (int argc, char **argv)
+{
+  Bench bench;
+  size_t count = argc > 1 ? atoi(argv[1]) : 32;
+  bench.per_port = (argc > 2 ? atoi(argv[2]) : 1024) * 1024;
+  bench.chunk = argc > 3 ? atoi(argv[3]) : 64;
+  for (size_t i = 0; i < count; ++i) {
+    int master_fd, slave_fd;
+    char name[100];
+    if (openpty(&master_fd, &slave_fd, name, NULL, NULL) == -1) {
+      perror("openpty");
+      return 1;
+    }
+    bench.masters.push_back(master_fd);
+    bench.slaves.push_back(slave_fd);
+    bench.ports.push_back(new Serial(name, 115200, Timeout::simpleTimeout(1000)));
+    bench.ports.back ()->setReadPolicy(serial::readpolicy_low_latency);
+  }
+  printf("%zu ports, %zu KB each in %zu byte writes\n", count,
+         bench.per_port / 1024, bench.chunk);
+  run_threads(bench);
+  run_multi("io_uring", serial::multiport_io_uring, bench);
+  run_multi("epoll", serial::multiport_epoll, bench);
+  for (size_t i = 0; i < count; ++i) {
+    delete bench.ports[i];
+    close(bench.masters[i]);
+    close(bench.slaves[i]);
+  }
+  return 0;
+}
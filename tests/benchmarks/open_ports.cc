@@ -0,0 +1,150 @@
+/* Measures the time until N ports are open and configured.  Compared are
+ * opening each port and then calling the five setters, as code did before
+ * serial::Serial::configure, opening each port with its settings applied
+ * by configure beforehand, and serial::openPorts opening all at once.
+ * Ptys stand in for the devices, USB adapters take longer per open and
+ * reconfiguration, which widens the differences.
+ *
+ * usage: open_ports [ports] [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <pty.h>
+#else
+#include <util.h>
+#endif
+
+#include "serial/serial.h"
+
+using serial::PortSettings;
+using serial::Serial;
+
+static uint64_t
+now_ns ()
+{
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<uint64_t> (time.tv_sec) * 1000000000ull + time.tv_nsec;
+}
+
+static const PortSettings settings(19200, serial::eightbits,
+                                   serial::parity_even, serial::stopbits_one,
+                                   serial::flowcontrol_none);
+
+static std::vector<Serial *>
+make_ports (const std::vector<std::string> &names, bool configure)
+{
+  std::vector<Serial *> ports;
+  for (size_t i = 0; i < names.size (); ++i) {
+    ports.push_back(new Serial());
+    ports.back()->setPort(names[i]);
+    if (configure) {
+      ports.back()->configure(settings);
+    }
+  }
+  return ports;
+}
+
+static void
+close_ports (std::vector<Serial *> &ports)
+{
+  for (size_t i = 0; i < ports.size (); ++i) {
+    delete ports[i];
+  }
+  ports.clear ();
+}
+
+static uint64_t
+run_setters (const std::vector<std::string> &names)
+{
+  std::vector<Serial *> ports = make_ports(names, false);
+  uint64_t start = now_ns ();
+  for (size_t i = 0; i < ports.size (); ++i) {
+    ports[i]->open();
+    ports[i]->setBaudrate(settings.baudrate);
+    ports[i]->setBytesize(settings.bytesize);
+    ports[i]->setParity(settings.parity);
+    ports[i]->setStopbits(settings.stopbits);
+    ports[i]->setFlowcontrol(settings.flowcontrol);
+  }
+  uint64_t elapsed = now_ns () - start;
+  close_ports(ports);
+  return elapsed;
+}
+
+static uint64_t
+run_configure (const std::vector<std::string> &names)
+{
+  std::vector<Serial *> ports = make_ports(names, true);
+  uint64_t start = now_ns ();
+  for (size_t i = 0; i < ports.size (); ++i) {
+    ports[i]->open();
+  }
+  uint64_t elapsed = now_ns () - start;
+  close_ports(ports);
+  return elapsed;
+}
+
+static uint64_t
+run_parallel (const std::vector<std::string> &names)
+{
+  std::vector<Serial *> ports = make_ports(names, true);
+  uint64_t start = now_ns ();
+  if (serial::openPorts(ports) != ports.size ()) {
+    fprintf(stderr, "not all ports opened\n");
+  }
+  uint64_t elapsed = now_ns () - start;
+  close_ports(ports);
+  return elapsed;
+}
+
+static void
+report (const char *name, uint64_t total, size_t ports, size_t rounds)
+{
+  printf("%-10s %9.1f us to ready  %7.1f us per port\n", name,
+         total / 1e3 / rounds, total / 1e3 / rounds / ports);
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t count = argc > 1 ? atoi(argv[1]) : 32;
+  size_t rounds = argc > 2 ? atoi(argv[2]) : 20;
+  std::vector<std::string> names;
+  std::vector<int> fds;
+  for (size_t i = 0; i < count; ++i) {
+    int master_fd, slave_fd;
+    char name[100];
+    if (openpty(&master_fd, &slave_fd, name, NULL, NULL) == -1) {
+      perror("openpty");
+      return 1;
+    }
+    names.push_back(name);
+    fds.push_back(master_fd);
+    fds.push_back(slave_fd);
+  }
+
+  uint64_t setters = 0, configure = 0, parallel = 0;
+  for (size_t round = 0; round < rounds; ++round) {
+    setters += run_setters(names);
+    configure += run_configure(names);
+    parallel += run_parallel(names);
+  }
+  printf("%zu ports, %zu rounds\n", count, rounds);
+  report("setters", setters, count, rounds);
+  report("configure", configure, count, rounds);
+  report("openPorts", parallel, count, rounds);
+
+  for (size_t i = 0; i < fds.size (); ++i) {
+    close(fds[i]);
+  }
+  return 0;
+}
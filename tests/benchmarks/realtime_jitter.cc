@@ -0,0 +1,157 @@
+/* Measures the wakeup latency of a thread reading a port, once with the
+ * default scheduling and once with a serial::RealtimeProfile.  A pty stands
+ * in for the device: every millisecond one byte is written to the master
+ * side and the time until the reading thread has it is recorded.  Busy
+ * threads on every CPU provide the load.
+ *
+ * usage: realtime_jitter [samples] [cpu] [load threads]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__linux__)
+#include <pty.h>
+#else
+#include <util.h>
+#endif
+
+#include "serial/realtime.h"
+#include "serial/serial.h"
+
+using serial::RealtimeProfile;
+using serial::RealtimeStatus;
+using serial::Serial;
+using serial::Timeout;
+
+static volatile bool running = true;
+
+static uint64_t
+now_ns ()
+{
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<uint64_t> (time.tv_sec) * 1000000000ull + time.tv_nsec;
+}
+
+static void *
+spin (void *)
+{
+  volatile uint64_t counter = 0;
+  while (running) {
+    ++counter;
+  }
+  return NULL;
+}
+
+struct Run {
+  int master_fd;
+  Serial *port;
+  const RealtimeProfile *profile;
+  size_t samples;
+  volatile uint64_t sent_ns;
+  std::vector<uint64_t> latencies;
+};
+
+static void *
+receive (void *arg)
+{
+  Run &run = *static_cast<Run *> (arg);
+  if (run.profile) {
+    RealtimeStatus status = serial::applyRealtimeProfile(*run.profile);
+    if (!status.warnings.empty ()) {
+      fprintf(stderr, "profile not fully applied:\n%s", status.warnings.c_str ());
+    }
+  }
+  run.latencies.reserve(run.samples);
+  uint8_t byte;
+  while (run.latencies.size () < run.samples) {
+    if (run.port->read(&byte, 1) == 1) {
+      run.latencies.push_back(now_ns () - run.sent_ns);
+    }
+  }
+  return NULL;
+}
+
+static void
+measure (const char *name, Run &run)
+{
+  pthread_t reader;
+  run.latencies.clear();
+  pthread_create(&reader, NULL, receive, &run);
+  // let the reader apply the profile, locking memory takes a while
+  usleep(200000);
+  timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (size_t i = 0; i < run.samples; ++i) {
+    next.tv_nsec += 1000000;
+    if (next.tv_nsec >= 1000000000) {
+      next.tv_nsec -= 1000000000;
+      ++next.tv_sec;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    run.sent_ns = now_ns ();
+    if (write(run.master_fd, "x", 1) != 1) {
+      perror("write");
+    }
+  }
+  pthread_join(reader, NULL);
+  std::vector<uint64_t> &samples = run.latencies;
+  std::sort(samples.begin (), samples.end ());
+  printf("%-9s p50 %7.1f us  p99 %7.1f us  p99.9 %7.1f us  max %7.1f us\n",
+         name, samples[samples.size () / 2] / 1000.0,
+         samples[samples.size () * 99 / 100] / 1000.0,
+         samples[samples.size () * 999 / 1000] / 1000.0,
+         samples.back () / 1000.0);
+}
+
+int
+main (int argc, char **argv)
+{
+  Run run;
+  run.samples = argc > 1 ? atoi(argv[1]) : 5000;
+  int cpu = argc > 2 ? atoi(argv[2]) : 0;
+  long load = argc > 3 ? atol(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  int slave_fd;
+  char name[100];
+  if (openpty(&run.master_fd, &slave_fd, name, NULL, NULL) == -1) {
+    perror("openpty");
+    return 1;
+  }
+  Serial port(name, 115200, Timeout::simpleTimeout(1000));
+  port.setReadPolicy(serial::readpolicy_low_latency);
+  run.port = &port;
+
+  std::vector<pthread_t> spinners(load);
+  for (long i = 0; i < load; ++i) {
+    pthread_create(&spinners[i], NULL, spin, NULL);
+  }
+  printf("%zu samples, %ld busy threads\n", run.samples, load);
+
+  run.profile = NULL;
+  measure("default", run);
+
+  RealtimeProfile profile;
+  profile.cpu = cpu;
+  profile.priority = 80;
+  profile.lock_memory = true;
+  profile.stack_prefault = 256 * 1024;
+  profile.heap_prefault = 1024 * 1024;
+  run.profile = &profile;
+  measure("realtime", run);
+
+  running = false;
+  for (long i = 0; i < load; ++i) {
+    pthread_join(spinners[i], NULL);
+  }
+  close(run.master_fd);
+  close(slave_fd);
+  return 0;
+}
@@ -0,0 +1,201 @@
+#include "gtest/gtest.h"
+#include "serial/frame_reader.h"
+
+#include <string>
+
+using serial::CobsFramer;
+using serial::DelimiterFramer;
+using serial::FixedLengthFramer;
+using serial::FrameReader;
+using serial::FrameView;
+using serial::LengthFieldFramer;
+using serial::SlipFramer;
+
+namespace {
+
+size_t
+feed (FrameReader<DelimiterFramer> &reader, const std::string &data)
+{
+  return reader.feed (reinterpret_cast<const uint8_t *> (data.data ()), data.size ());
+}
+
+std::string
+str (const FrameView &frame)
+{
+  return std::string (reinterpret_cast<const char *> (frame.data), frame.size);
+}
+
+TEST(frame_reader_tests, delimiter) {
+  FrameReader<DelimiterFramer> reader (DelimiterFramer ("\r\n"));
+  FrameView frame;
+  feed (reader, "abc\r");
+  EXPECT_FALSE(reader.next (frame));
+  feed (reader, "\ndef\r\nxy");
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(str (frame), "abc");
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(str (frame), "def");
+  EXPECT_FALSE(reader.next (frame));
+  EXPECT_EQ(reader.buffered (), 2u);
+}
+
+TEST(frame_reader_tests, fixed_length) {
+  FrameReader<FixedLengthFramer> reader (FixedLengthFramer (3));
+  const uint8_t data[] = { 1, 2, 3, 4, 5, 6, 7 };
+  reader.feed (data, sizeof(data));
+  FrameView frame;
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(frame[0], 1);
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(frame[0], 4);
+  EXPECT_EQ(frame.size, 3u);
+  EXPECT_FALSE(reader.next (frame));
+}
+
+TEST(frame_reader_tests, medibus_length_field) {
+  // 06 CMD LEN data CS, LEN counts the data bytes only
+  FrameReader<LengthFieldFramer> reader (LengthFieldFramer (2, 1, 4));
+  const uint8_t data[] = { 0x06, 0x12, 0x02, 0xaa, 0xbb, 0x7f, 0x15, 0x2c, 0x00 };
+  reader.feed (data, 4);
+  FrameView frame;
+  EXPECT_FALSE(reader.next (frame));
+  reader.feed (data + 4, sizeof(data) - 4);
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(frame.size, 6u);
+  EXPECT_EQ(frame[4], 0xbb);
+  EXPECT_FALSE(reader.next (frame));
+  const uint8_t cs = 0x41;
+  reader.feed (&cs, 1);
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(frame[0], 0x15);
+  EXPECT_EQ(frame.size, 4u);
+}
+
+TEST(frame_reader_tests, length_field_big_endian) {
+  FrameReader<LengthFieldFramer> reader (LengthFieldFramer (0, 2, 2, true, 16));
+  const uint8_t data[] = { 0xff, 0x00, 0x02, 'h', 'i' };
+  reader.feed (data, sizeof(data));
+  FrameView frame;
+  // 0xff00 is larger than max_frame, the first byte is skipped as noise
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(frame.size, 4u);
+  EXPECT_EQ(frame[3], 'i');
+  EXPECT_EQ(reader.discarded (), 1u);
+}
+
+TEST(frame_reader_tests, slip) {
+  FrameReader<SlipFramer> reader;
+  const uint8_t data[] = { 0xC0, 0x01, 0xDB, 0xDC, 0x02, 0xDB, 0xDD, 0xC0, 0x03, 0xC0 };
+  reader.feed (data, sizeof(data));
+  FrameView frame;
+  ASSERT_TRUE(reader.next (frame));
+  ASSERT_EQ(frame.size, 4u);
+  EXPECT_EQ(frame[0], 0x01);
+  EXPECT_EQ(frame[1], 0xC0);
+  EXPECT_EQ(frame[2], 0x02);
+  EXPECT_EQ(frame[3], 0xDB);
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(frame.size, 1u);
+  EXPECT_EQ(frame[0], 0x03);
+  EXPECT_FALSE(reader.next (frame));
+  // the leading END produced an empty frame
+  EXPECT_EQ(reader.discarded (), 1u);
+}
+
+TEST(frame_reader_tests, cobs) {
+  FrameReader<CobsFramer> reader;
+  // 11 22 00 33 and 00, encoded
+  const uint8_t data[] = { 0x03, 0x11, 0x22, 0x02, 0x33, 0x00, 0x01, 0x01, 0x00 };
+  reader.feed (data, sizeof(data));
+  FrameView frame;
+  ASSERT_TRUE(reader.next (frame));
+  ASSERT_EQ(frame.size, 4u);
+  EXPECT_EQ(frame[0], 0x11);
+  EXPECT_EQ(frame[1], 0x22);
+  EXPECT_EQ(frame[2], 0x00);
+  EXPECT_EQ(frame[3], 0x33);
+  ASSERT_TRUE(reader.next (frame));
+  ASSERT_EQ(frame.size, 1u);
+  EXPECT_EQ(frame[0], 0x00);
+}
+
+TEST(frame_reader_tests, oversized_frame_is_dropped) {
+  FrameReader<DelimiterFramer> reader (DelimiterFramer ("\n"), 8);
+  FrameView frame;
+  EXPECT_EQ(feed (reader, "0123456789"), 8u);
+  // a full buffer takes nothing until next drops it
+  EXPECT_EQ(feed (reader, "x"), 0u);
+  EXPECT_FALSE(reader.next (frame));
+  EXPECT_EQ(reader.discarded (), 8u);
+  feed (reader, "ok\n");
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(str (frame), "ok");
+}
+
+TEST(frame_reader_tests, compacts_buffer) {
+  FrameReader<DelimiterFramer> reader (DelimiterFramer ("\n"), 8);
+  FrameView frame;
+  for (int i = 0; i < 10; ++i) {
+    feed (reader, "abcde\n");
+    ASSERT_TRUE(reader.next (frame));
+    EXPECT_EQ(str (frame), "abcde");
+  }
+  EXPECT_EQ(reader.discarded (), 0u);
+}
+
+TEST(frame_reader_tests, frame_times) {
+  FrameReader<DelimiterFramer> reader (DelimiterFramer ("\n"), 8);
+  const uint8_t data[] = "ab" "c\nde" "f\n";
+  FrameView frame;
+  reader.feed (data, 2, 10, 20);
+  EXPECT_FALSE(reader.next (frame));
+  reader.feed (data + 2, 4, 30, 40);
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(str (frame), "abc");
+  EXPECT_EQ(frame.first_ns, 10u);
+  EXPECT_EQ(frame.last_ns, 40u);
+  // the buffer is compacted before the last chunk goes in
+  reader.feed (data + 6, 2, 50, 60);
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(str (frame), "def");
+  EXPECT_EQ(frame.first_ns, 30u);
+  EXPECT_EQ(frame.last_ns, 60u);
+  reader.feed (data, 3, 70, 80);
+  reader.clear ();
+  reader.feed (data + 2, 2, 90, 100);
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(frame.first_ns, 90u);
+}
+
+// A user framer, MEDIBUS responses start with ACK or NAK
+struct AckFramer {
+  LengthFieldFramer length;
+  AckFramer () : length (2, 1, 4) {}
+
+  serial::FrameMatch
+  find (uint8_t *data, size_t size)
+  {
+    if (data[0] != 0x06 && data[0] != 0x15) {
+      return serial::FrameMatch (1, data, 0);
+    }
+    return length.find (data, size);
+  }
+};
+
+TEST(frame_reader_tests, custom_framer) {
+  FrameReader<AckFramer> reader;
+  const uint8_t data[] = { 0x00, 0x11, 0x06, 0x0a, 0x00, 0x10 };
+  reader.feed (data, sizeof(data));
+  FrameView frame;
+  ASSERT_TRUE(reader.next (frame));
+  EXPECT_EQ(frame[0], 0x06);
+  EXPECT_EQ(frame.size, 4u);
+  EXPECT_EQ(reader.discarded (), 2u);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,163 @@
+#include "gtest/gtest.h"
+#include "serial/memory_transport.h"
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <thread>
+
+using serial::MemoryLink;
+using serial::Serial;
+using serial::Timeout;
+using serial::VirtualClock;
+
+namespace {
+
+TEST(memory_transport_tests, loopback) {
+  MemoryLink link;
+  Serial host (&link.a (), Timeout::simpleTimeout (100));
+  Serial device (&link.b (), Timeout::simpleTimeout (100));
+  EXPECT_TRUE(host.isOpen ());
+  EXPECT_EQ(host.write ("abc\n"), 4u);
+  EXPECT_EQ(device.available (), 4u);
+  EXPECT_EQ(device.readline (), "abc\n");
+  device.write ("ok");
+  EXPECT_EQ(host.read (2), "ok");
+}
+
+TEST(memory_transport_tests, virtual_baud_rate) {
+  VirtualClock clock;
+  // 10 bits per byte at 10000 baud, one byte per millisecond
+  MemoryLink link (10000, &clock);
+  Serial host (&link.a (), Timeout::simpleTimeout (100));
+  Serial device (&link.b (), Timeout::simpleTimeout (100));
+
+  host.write ("0123456789");
+  EXPECT_EQ(device.available (), 0u);
+  clock.advance (3500000);
+  EXPECT_EQ(device.available (), 3u);
+
+  // The read waits exactly until the last byte has arrived.
+  EXPECT_EQ(device.read (10), "0123456789");
+  EXPECT_EQ(clock.now (), 10000000u);
+}
+
+TEST(memory_transport_tests, virtual_timeout) {
+  VirtualClock clock;
+  MemoryLink link (0, &clock);
+  Serial host (&link.a (), Timeout::simpleTimeout (250));
+  Serial device (&link.b (), Timeout::simpleTimeout (250));
+
+  EXPECT_EQ(device.read (4), "");
+  EXPECT_EQ(clock.now (), 250000000u);
+
+  host.write ("ab");
+  EXPECT_EQ(device.read (4), "ab");
+  EXPECT_EQ(clock.now (), 500000000u);
+}
+
+TEST(memory_transport_tests, inter_byte_timeout) {
+  VirtualClock clock;
+  MemoryLink link (10000, &clock);
+  Serial host (&link.a (), Timeout (5, 1000, 0, 1000, 0));
+  Serial device (&link.b (), Timeout (5, 1000, 0, 1000, 0));
+
+  host.write ("ab");
+  // b arrives after 2 ms, the read gives up 5 ms later
+  EXPECT_EQ(device.read (4), "ab");
+  EXPECT_EQ(clock.now (), 7000000u);
+}
+
+TEST(memory_transport_tests, flush_input) {
+  MemoryLink link;
+  Serial host (&link.a (), Timeout::simpleTimeout (10));
+  Serial device (&link.b (), Timeout::simpleTimeout (10));
+  host.write ("junk");
+  device.flushInput ();
+  EXPECT_EQ(device.available (), 0u);
+}
+
+TEST(memory_transport_tests, modem_lines) {
+  MemoryLink link;
+  Serial host (&link.a (), Timeout::simpleTimeout (10));
+  link.a ().setModemLines (true, false, false, true);
+  EXPECT_TRUE(host.getCTS ());
+  EXPECT_TRUE(host.getCD ());
+  serial::ModemStatus status = host.getModemStatus ();
+  EXPECT_FALSE(status.dsr);
+  EXPECT_EQ(status.cts_count, 1u);
+  EXPECT_EQ(status.dsr_count, 0u);
+}
+
+TEST(memory_transport_tests, port_functions_throw) {
+  MemoryLink link;
+  Serial host (&link.a (), Timeout::simpleTimeout (10));
+  EXPECT_THROW(host.configure (serial::PortSettings (19200)),
+               serial::SerialException);
+  EXPECT_THROW(host.getSettings (), serial::SerialException);
+  EXPECT_THROW(host.setReadPolicy (serial::readpolicy_low_latency),
+               serial::SerialException);
+  EXPECT_THROW(host.getReadStats (), serial::SerialException);
+}
+
+TEST(memory_transport_tests, threads) {
+  MemoryLink link (0, NULL, 64);
+  Serial host (&link.a (), Timeout::simpleTimeout (1000));
+  Serial device (&link.b (), Timeout::simpleTimeout (1000));
+  const size_t total = 100000;
+  std::thread writer ([&host, total] () {
+    uint8_t data[100];
+    for (size_t i = 0; i < total; i += sizeof(data)) {
+      for (size_t j = 0; j < sizeof(data); ++j) {
+        data[j] = static_cast<uint8_t> (i + j);
+      }
+      host.write (data, sizeof(data));
+    }
+  });
+  size_t received = 0;
+  bool in_order = true;
+  uint8_t buffer[256];
+  while (received < total) {
+    size_t n = device.read (buffer, std::min (sizeof(buffer), total - received));
+    ASSERT_NE(n, 0u);
+    for (size_t j = 0; j < n; ++j) {
+      in_order = in_order && buffer[j] == static_cast<uint8_t> (received + j);
+    }
+    received += n;
+  }
+  writer.join ();
+  EXPECT_TRUE(in_order);
+}
+
+TEST(memory_transport_tests, blocked_ends_sleep) {
+  MemoryLink link (0, NULL, 16);
+  Serial host (&link.a (), Timeout::simpleTimeout (200));
+  Serial device (&link.b (), Timeout::simpleTimeout (200));
+  const std::clock_t cpu_start = std::clock ();
+  // nothing is written, the read waits out its timeout
+  EXPECT_EQ(device.read (1), "");
+  // the pipe holds 16 bytes, the rest of the write times out
+  EXPECT_EQ(host.write (std::string (32, 'x')), 16u);
+  const double cpu_ms = 1000.0 * (std::clock () - cpu_start) / CLOCKS_PER_SEC;
+  EXPECT_LT(cpu_ms, 100.0);
+
+  // a blocked read wakes as soon as the peer writes
+  device.read (16);
+  std::thread writer ([&host] () {
+    std::this_thread::sleep_for (std::chrono::milliseconds (20));
+    host.write ("y");
+  });
+  const std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now ();
+  EXPECT_EQ(device.read (1), "y");
+  writer.join ();
+  EXPECT_LT(std::chrono::steady_clock::now () - start,
+            std::chrono::milliseconds (150));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
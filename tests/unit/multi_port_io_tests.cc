@@ -0,0 +1,190 @@
+#include "gtest/gtest.h"
+#include "serial/multi_port_io.h"
+
+#include <unistd.h>
+
+#include <map>
+#include <string>
+
+#if defined(__linux__)
+#include <pty.h>
+#else
+#include <util.h>
+#endif
+
+using serial::IOException;
+using serial::MultiPortIO;
+using serial::MultiPortListener;
+using serial::Serial;
+using serial::Timeout;
+using std::string;
+
+namespace {
+
+const size_t PORTS = 3;
+
+class Recorder : public MultiPortListener {
+public:
+  Recorder () : written (0), errors (0), last_error (-1) {}
+
+  virtual void
+  onRead (Serial &port, const uint8_t *data, size_t size)
+  {
+    received[&port].append (reinterpret_cast<const char *> (data), size);
+  }
+
+  virtual void
+  onWritten (Serial &port, size_t size)
+  {
+    (void) port;
+    written += size;
+  }
+
+  virtual void
+  onDrained (Serial &port)
+  {
+    ++drained[&port];
+  }
+
+  virtual void
+  onError (Serial &port, int error)
+  {
+    (void) port;
+    ++errors;
+    last_error = error;
+  }
+
+  std::map<Serial *, string> received;
+  std::map<Serial *, int> drained;
+  size_t written;
+  int errors;
+  int last_error;
+};
+
+class MultiPortIOTests
+  : public ::testing::TestWithParam<serial::multiport_backend_t> {
+protected:
+  virtual void SetUp() {
+    for (size_t i = 0; i < PORTS; ++i) {
+      char name[100];
+      ASSERT_NE(openpty(&master_fd[i], &slave_fd[i], name, NULL, NULL), -1);
+      port[i] = new Serial(string(name), 115200, Timeout::simpleTimeout(20));
+    }
+    io = NULL;
+    try {
+      io = new MultiPortIO(&recorder, GetParam(), 256);
+    } catch (const IOException &) {
+      // io_uring is not available on this kernel
+    }
+  }
+
+  virtual void TearDown() {
+    delete io;
+    for (size_t i = 0; i < PORTS; ++i) {
+      delete port[i];
+      close(master_fd[i]);
+      close(slave_fd[i]);
+    }
+  }
+
+  void runUntil(size_t bytes, Serial *which) {
+    for (int i = 0; i < 100 && recorder.received[which].size() < bytes; ++i) {
+      io->run(10);
+    }
+  }
+
+  int master_fd[PORTS];
+  int slave_fd[PORTS];
+  Serial *port[PORTS];
+  Recorder recorder;
+  MultiPortIO *io;
+};
+
+TEST_P(MultiPortIOTests, readsAllPorts) {
+  if (io == NULL) {
+    return;
+  }
+  EXPECT_EQ(io->getBackend(), GetParam());
+  for (size_t i = 0; i < PORTS; ++i) {
+    io->add(*port[i]);
+  }
+  ASSERT_EQ(write(master_fd[0], "zero", 4), 4);
+  ASSERT_EQ(write(master_fd[2], "two", 3), 3);
+  runUntil(4, port[0]);
+  runUntil(3, port[2]);
+  EXPECT_EQ(recorder.received[port[0]], "zero");
+  EXPECT_EQ(recorder.received[port[1]], "");
+  EXPECT_EQ(recorder.received[port[2]], "two");
+
+  // more data than the buffers of one port hold, multishot reads re-arm
+  string big(256 * 40, 'x');
+  for (size_t done = 0; done < big.size(); done += 512) {
+    ASSERT_EQ(write(master_fd[1], big.data() + done, 512), 512);
+    io->run(0);
+  }
+  runUntil(big.size(), port[1]);
+  EXPECT_EQ(recorder.received[port[1]].size(), big.size());
+  EXPECT_EQ(io->getStats().bytes_read, 7 + big.size());
+}
+
+TEST_P(MultiPortIOTests, batchesWrites) {
+  if (io == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < PORTS; ++i) {
+    io->add(*port[i]);
+    io->write(*port[i], reinterpret_cast<const uint8_t *>("ping"), 4);
+  }
+  for (int i = 0; i < 100 && recorder.written < 4 * PORTS; ++i) {
+    io->run(10);
+  }
+  EXPECT_EQ(recorder.written, 4 * PORTS);
+  for (size_t i = 0; i < PORTS; ++i) {
+    char buffer[8];
+    EXPECT_EQ(read(master_fd[i], buffer, sizeof(buffer)), 4);
+  }
+  EXPECT_EQ(io->getStats().writes, PORTS);
+}
+
+TEST_P(MultiPortIOTests, notifiesDrainOnce) {
+  if (io == NULL) {
+    return;
+  }
+  io->add(*port[0]);
+  io->add(*port[1]);
+  io->write(*port[0], reinterpret_cast<const uint8_t *>("ping"), 4);
+  io->watchDrain(*port[0]);
+  for (int i = 0; i < 100 && recorder.drained[port[0]] == 0; ++i) {
+    io->run(10);
+  }
+  EXPECT_EQ(recorder.written, 4u);
+  EXPECT_EQ(recorder.drained[port[0]], 1);
+  io->run(10);
+  EXPECT_EQ(recorder.drained[port[0]], 1);
+  EXPECT_EQ(recorder.drained[port[1]], 0);
+}
+
+TEST_P(MultiPortIOTests, removeStopsReading) {
+  if (io == NULL) {
+    return;
+  }
+  io->add(*port[0]);
+  io->remove(*port[0]);
+  io->run(10);
+  ASSERT_EQ(write(master_fd[0], "late", 4), 4);
+  io->run(20);
+  EXPECT_EQ(recorder.received[port[0]], "");
+  // the data is still there for a plain read
+  EXPECT_EQ(port[0]->read(4), "late");
+}
+
+INSTANTIATE_TEST_CASE_P(backends, MultiPortIOTests,
+                        ::testing::Values(serial::multiport_epoll,
+                                          serial::multiport_io_uring));
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
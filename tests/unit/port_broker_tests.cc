@@ -0,0 +1,241 @@
+#include "gtest/gtest.h"
+#include "serial/port_broker.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <pty.h>
+#else
+#include <util.h>
+#endif
+
+using serial::BrokerTransport;
+using serial::PortBroker;
+using serial::readpolicy_default;
+using serial::readpolicy_low_latency;
+using serial::Serial;
+using serial::Timeout;
+using std::string;
+
+namespace {
+
+class PortBrokerTests : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    char name[100];
+    ASSERT_NE(openpty(&master_fd, &slave_fd, name, NULL, NULL), -1);
+    // writes may wait for a stalled port, see stallPort
+    Timeout timeout(Timeout::max(), 20, 0, 2000, 0);
+    port = new Serial(string(name), 115200, timeout);
+    path = "/tmp/serial_broker_test.sock";
+    broker = new PortBroker(*port, path);
+    broker->start();
+  }
+
+  virtual void TearDown() {
+    delete broker;
+    delete port;
+    close(master_fd);
+    close(slave_fd);
+  }
+
+  // Stops or resumes the output of the port, its writes block meanwhile.
+  void stallPort(bool stall) {
+    ASSERT_EQ(tcflow(slave_fd, stall ? TCOOFF : TCOON), 0);
+  }
+
+  string readMaster(size_t size) {
+    string data;
+    char buffer[4096];
+    for (int i = 0; i < 100 && data.size() < size; ++i) {
+      ssize_t r = read(master_fd, buffer, sizeof(buffer));
+      if (r > 0) {
+        data.append(buffer, r);
+      }
+    }
+    return data;
+  }
+
+  int master_fd;
+  int slave_fd;
+  Serial *port;
+  PortBroker *broker;
+  string path;
+};
+
+TEST_F(PortBrokerTests, fansOutReceivedData) {
+  BrokerTransport transport1(path);
+  BrokerTransport transport2(path);
+  Serial client1(&transport1, Timeout::simpleTimeout(500));
+  Serial client2(&transport2, Timeout::simpleTimeout(500));
+
+  ASSERT_EQ(write(master_fd, "abc\n", 4), 4);
+  EXPECT_EQ(client1.readline(), "abc\n");
+  EXPECT_EQ(client2.read(4), "abc\n");
+  EXPECT_EQ(broker->getStats().clients, 2u);
+}
+
+TEST_F(PortBrokerTests, forwardsWrites) {
+  BrokerTransport transport(path, 5);
+  Serial client(&transport, Timeout::simpleTimeout(500));
+  EXPECT_EQ(client.write("hello"), 5u);
+  EXPECT_EQ(readMaster(5), "hello");
+}
+
+TEST_F(PortBrokerTests, clientsComeAndGo) {
+  {
+    BrokerTransport transport(path);
+    Serial client(&transport, Timeout::simpleTimeout(500));
+    client.write("a");
+    EXPECT_EQ(readMaster(1), "a");
+  }
+  BrokerTransport transport(path);
+  Serial client(&transport, Timeout::simpleTimeout(500));
+  ASSERT_EQ(write(master_fd, "xy", 2), 2);
+  EXPECT_EQ(client.read(2), "xy");
+  // The broker notices the closed connection asynchronously.
+  for (int i = 0; i < 100 && broker->getStats().clients != 1; ++i) {
+    usleep(10000);
+  }
+  EXPECT_EQ(broker->getStats().clients, 1u);
+}
+
+double
+elapsedMs(const timeval &start) {
+  timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - start.tv_sec) * 1000.0 +
+         (now.tv_usec - start.tv_usec) / 1000.0;
+}
+
+TEST_F(PortBrokerTests, writesByPriority) {
+  BrokerTransport bulk_transport(path, 0);
+  BrokerTransport control_transport(path, 9);
+  Serial bulk(&bulk_transport, Timeout::simpleTimeout(500));
+  Serial control(&control_transport, Timeout::simpleTimeout(500));
+  stallPort(true);
+  // The broker takes the first write and waits for the port, the next
+  // two queue up behind it.
+  bulk.write("1");
+  usleep(50000);
+  bulk.write("2");
+  control.write("9");
+  usleep(50000);
+  stallPort(false);
+  EXPECT_EQ(readMaster(3), "192");
+}
+
+TEST_F(PortBrokerTests, writeIsNotInterleaved) {
+  BrokerTransport bulk_transport(path, 0);
+  BrokerTransport control_transport(path, 9);
+  Serial bulk(&bulk_transport, Timeout::simpleTimeout(500));
+  Serial control(&control_transport, Timeout::simpleTimeout(500));
+  stallPort(true);
+  // Longer than one message to the broker, still one write on the port.
+  const string data(3 * 4096, 'a');
+  EXPECT_EQ(bulk.write(data), data.size());
+  usleep(50000);
+  control.write("9");
+  usleep(50000);
+  stallPort(false);
+  EXPECT_EQ(readMaster(data.size() + 1), data + "9");
+}
+
+TEST_F(PortBrokerTests, stopsWithoutReadTimeout) {
+  // The reader waits for data instead of the read timeout, neither an
+  // infinite nor a zero timeout holds it up or makes it spin.
+  broker->stop();
+  Timeout timeout(Timeout::max(), Timeout::max(), 0, 2000, 0);
+  port->setTimeout(timeout);
+  broker->start();
+  BrokerTransport transport(path);
+  Serial client(&transport, Timeout::simpleTimeout(500));
+  ASSERT_EQ(write(master_fd, "ab", 2), 2);
+  EXPECT_EQ(client.read(2), "ab");
+  timeval start;
+  gettimeofday(&start, NULL);
+  broker->stop();
+  EXPECT_LT(elapsedMs(start), 100.0);
+
+  timeout = Timeout(0, 0, 0, 2000, 0);
+  port->setTimeout(timeout);
+  clock_t cpu = clock();
+  broker->start();
+  usleep(100000);
+  broker->stop();
+  EXPECT_LT(clock() - cpu, CLOCKS_PER_SEC / 50);
+}
+
+TEST_F(PortBrokerTests, restoresReadPolicy) {
+  EXPECT_EQ(port->getReadPolicy(), readpolicy_low_latency);
+  broker->stop();
+  EXPECT_EQ(port->getReadPolicy(), readpolicy_default);
+}
+
+TEST_F(PortBrokerTests, interByteTimeoutEndsRead) {
+  BrokerTransport transport(path);
+  // inter byte timeout 0, total read timeout 500 ms
+  Serial client(&transport, Timeout(0, 500, 0, 500, 0));
+  ASSERT_EQ(write(master_fd, "ab", 2), 2);
+  timeval start;
+  gettimeofday(&start, NULL);
+  EXPECT_EQ(client.read(10), "ab");
+  EXPECT_LT(elapsedMs(start), 250.0);
+}
+
+// Accepts one client and greets it with a byte time of 100 us, then
+// never reads.
+void *
+greetAndStall(void *fds)
+{
+  int *fd = static_cast<int *>(fds);
+  fd[1] = accept(fd[0], NULL, NULL);
+  const char hello[] = { 1, 0, 4, 0, 0x10, 0x27, 0, 0 };
+  ssize_t ignored = write(fd[1], hello, sizeof(hello));
+  (void) ignored;
+  return NULL;
+}
+
+TEST(BrokerTransportTests, writeTimesOut) {
+  const string path = "/tmp/serial_broker_stalled.sock";
+  unlink(path.c_str());
+  int fd[2] = { socket(AF_UNIX, SOCK_STREAM, 0), -1 };
+  ASSERT_NE(fd[0], -1);
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  ASSERT_EQ(bind(fd[0], reinterpret_cast<sockaddr *>(&address),
+                 sizeof(address)), 0);
+  ASSERT_EQ(listen(fd[0], 1), 0);
+  pthread_t server;
+  ASSERT_EQ(pthread_create(&server, NULL, greetAndStall, fd), 0);
+  {
+    BrokerTransport transport(path);
+    pthread_join(server, NULL);
+    Serial client(&transport, Timeout(Timeout::max(), 100, 0, 100, 0));
+    std::vector<uint8_t> data(16 * 1024 * 1024, 'x');
+    timeval start;
+    gettimeofday(&start, NULL);
+    EXPECT_LT(client.write(data), data.size());
+    EXPECT_LT(elapsedMs(start), 1000.0);
+  }
+  close(fd[1]);
+  close(fd[0]);
+  unlink(path.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -18,6 +18,8 @@ void loop()
 */
 
 #include <string>
+#include <vector>
+#include <time.h>
 #include "gtest/gtest.h"
 
 #include <boost/bind.hpp>
@@ -28,6 +30,8 @@ void loop()
 // #define protected public
 
 #include "serial/serial.h"
+#include "serial/modem_watcher.h"
+#include "serial/transport.h"
 
 #if defined(__linux__)
 #include <pty.h>
@@ -105,6 +109,321 @@ TEST_F(SerialTests, partialRead) {
   EXPECT_EQ(r, string("abc\n"));
 }
 
+TEST_F(SerialTests, lowLatencyReturnsFirstBytes) {
+  port1->setReadPolicy(readpolicy_low_latency);
+  EXPECT_EQ(port1->getReadPolicy(), readpolicy_low_latency);
+  write(master_fd, "ab", 2);
+
+  // Returns what is there instead of waiting for the timeout.
+  string r = port1->read(10);
+  EXPECT_EQ(r, string("ab"));
+  ReadStats stats = port1->getReadStats();
+  EXPECT_EQ(stats.reads, 1u);
+  EXPECT_EQ(stats.bytes, 2u);
+  EXPECT_EQ(stats.short_reads, 1u);
+  EXPECT_EQ(stats.waits, 0u);
+  EXPECT_LT(stats.busy_ns, 200000000u);
+}
+
+TEST_F(SerialTests, minSyscallsCoalescesRead) {
+  port1->setReadPolicy(readpolicy_min_syscalls);
+  write(master_fd, "abc\n", 4);
+  string r = port1->read(4);
+  EXPECT_EQ(r, string("abc\n"));
+
+  // A short read waits for the missing bytes but not past the timeout.
+  write(master_fd, "abc\n", 4);
+  r = port1->read(10);
+  EXPECT_EQ(r, string("abc\n"));
+  ReadStats stats = port1->getReadStats();
+  EXPECT_EQ(stats.reads, 2u);
+  EXPECT_EQ(stats.bytes, 8u);
+  EXPECT_EQ(stats.short_reads, 1u);
+
+  port1->resetReadStats();
+  EXPECT_EQ(port1->getReadStats().reads, 0u);
+}
+
+TEST_F(SerialTests, adaptiveReadsEverything) {
+  port1->setReadPolicy(readpolicy_adaptive);
+  for (int i = 0; i < 4; ++i) {
+    write(master_fd, "abc\n", 4);
+    string r = port1->read(4);
+    EXPECT_EQ(r, string("abc\n"));
+  }
+  EXPECT_EQ(port1->getReadStats().bytes, 16u);
+}
+
+void *
+writeAfterIdleGap(void *fd)
+{
+  usleep(30000);
+  write(*static_cast<int *>(fd), "ab", 2);
+  usleep(1000);
+  write(*static_cast<int *>(fd), "cdefgh", 6);
+  return NULL;
+}
+
+TEST_F(SerialTests, adaptiveIgnoresIdleTime) {
+  port1->setReadPolicy(readpolicy_adaptive);
+  pthread_t writer;
+  ASSERT_EQ(pthread_create(&writer, NULL, writeAfterIdleGap, &master_fd), 0);
+  string r = port1->read(8);
+  pthread_join(writer, NULL);
+  EXPECT_EQ(r, string("abcdefgh"));
+  // The 30 ms before the first byte are not the pace of the device.
+  uint32_t estimate = port1->getReadStats().arrival_ns_per_byte;
+  EXPECT_GT(estimate, 0u);
+  EXPECT_LT(estimate, 5000000u);
+}
+
+TEST_F(SerialTests, defaultHonoursInterByteTimeout) {
+  Timeout timeout(10, 250, 0, 250, 0);
+  port1->setTimeout(timeout);
+  write(master_fd, "ab", 2);
+  string r = port1->read(4);
+  EXPECT_EQ(r, string("ab"));
+  EXPECT_EQ(port1->getReadStats().coalesce_waits, 0u);
+}
+
+void *
+trickleBytes(void *fd)
+{
+  for (int i = 0; i < 60; ++i) {
+    write(*static_cast<int *>(fd), "a", 1);
+    usleep(1000);
+  }
+  return NULL;
+}
+
+TEST_F(SerialTests, coalescingStopsAtTotalTimeout) {
+  // At 9600 baud waiting for the missing bytes of a 4096 byte read would
+  // take 4 s, the read must still end with its 20 ms timeout.
+  port1->setBaudrate(9600);
+  Timeout timeout(Timeout::max(), 20, 0, 250, 0);
+  port1->setTimeout(timeout);
+  port1->setReadPolicy(readpolicy_min_syscalls);
+  pthread_t writer;
+  ASSERT_EQ(pthread_create(&writer, NULL, trickleBytes, &master_fd), 0);
+  timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  string r = port1->read(4096);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  pthread_join(writer, NULL);
+  EXPECT_FALSE(r.empty());
+  EXPECT_LT(r.size(), 60u);
+  long elapsed_ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+  EXPECT_LT(elapsed_ms, 60);
+}
+
+TEST_F(SerialTests, readTimestamps) {
+  timespec before;
+  clock_gettime(CLOCK_MONOTONIC, &before);
+  write(master_fd, "abc\n", 4);
+  string r = port1->read(4);
+  EXPECT_EQ(r, string("abc\n"));
+  ReadTimestamps stamps = port1->getReadTimestamps();
+  EXPECT_GE(stamps.first_ns, before.tv_sec * 1000000000ull + before.tv_nsec);
+  EXPECT_LE(stamps.first_ns, stamps.last_ns);
+
+  // A read which times out has no times.
+  r = port1->read(1);
+  EXPECT_EQ(port1->getReadTimestamps().last_ns, 0u);
+}
+
+TEST_F(SerialTests, outputPendingDoesNotBlock) {
+  // A pty passes written bytes on at once.
+  port1->write("abc\n");
+  EXPECT_EQ(port1->outputPending(), 0u);
+  char buf[4];
+  EXPECT_EQ(read(master_fd, buf, 4), 4);
+  port1->close();
+  EXPECT_EQ(port1->outputPending(), 0u);
+}
+
+TEST_F(SerialTests, getModemStatusOnPty) {
+  // A pty has no modem lines, TIOCMGET fails with ENOTTY.
+  EXPECT_THROW(port1->getModemStatus(), SerialException);
+  port1->close();
+  EXPECT_THROW(port1->getModemStatus(), PortNotOpenedException);
+}
+
+TEST_F(SerialTests, modemWatcherRejectsPty) {
+  ModemWatcher watcher;
+  EXPECT_THROW(watcher.watch(*port1, NULL), SerialException);
+  EXPECT_EQ(watcher.size(), 0u);
+  ModemStatus status;
+  EXPECT_FALSE(watcher.getStatus(*port1, status));
+  watcher.unwatch(*port1);
+}
+
+// Modem lines set by the test, as a pty has none.
+class LineTransport : public Transport {
+public:
+  LineTransport () { pthread_mutex_init(&mutex_, NULL); }
+  ~LineTransport () { pthread_mutex_destroy(&mutex_); }
+
+  size_t read (uint8_t *, size_t, const Timeout &) { return 0; }
+  size_t write (const uint8_t *, size_t size, const Timeout &) { return size; }
+  size_t available () { return 0; }
+  bool waitReadable (uint32_t) { return false; }
+  void waitByteTimes (size_t) {}
+  void flush () {}
+  void flushInput () {}
+  void flushOutput () {}
+
+  ModemStatus getModemStatus () {
+    pthread_mutex_lock(&mutex_);
+    ModemStatus status = status_;
+    pthread_mutex_unlock(&mutex_);
+    return status;
+  }
+
+  void setCTS (bool level) {
+    pthread_mutex_lock(&mutex_);
+    status_.cts_count += status_.cts != level;
+    status_.cts = level;
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  void setCD (bool level) {
+    pthread_mutex_lock(&mutex_);
+    status_.cd_count += status_.cd != level;
+    status_.cd = level;
+    pthread_mutex_unlock(&mutex_);
+  }
+
+private:
+  pthread_mutex_t mutex_;
+  ModemStatus status_;
+};
+
+class EventRecorder : public ModemEventListener {
+public:
+  EventRecorder (ModemWatcher *unwatch_from = NULL)
+  : unwatch_from_(unwatch_from) { pthread_mutex_init(&mutex_, NULL); }
+  ~EventRecorder () { pthread_mutex_destroy(&mutex_); }
+
+  void onModemEvent (const ModemEvent &event) {
+    if (unwatch_from_) {
+      unwatch_from_->unwatch(*event.port);
+    }
+    pthread_mutex_lock(&mutex_);
+    events_.push_back(event);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  std::vector<ModemEvent> events () {
+    pthread_mutex_lock(&mutex_);
+    std::vector<ModemEvent> events = events_;
+    pthread_mutex_unlock(&mutex_);
+    return events;
+  }
+
+  bool waitFor (size_t count) {
+    for (int i = 0; i < 1000 && events().size() < count; ++i) {
+      usleep(1000);
+    }
+    return events().size() >= count;
+  }
+
+private:
+  ModemWatcher *unwatch_from_;
+  pthread_mutex_t mutex_;
+  std::vector<ModemEvent> events_;
+};
+
+TEST(ModemWatcherTests, deliversLineChanges) {
+  LineTransport lines;
+  Serial port(&lines);
+  EventRecorder recorder;
+  ModemWatcher watcher(1);
+  watcher.watch(port, &recorder);
+  EXPECT_EQ(watcher.size(), 1u);
+
+  lines.setCTS(true);
+  ASSERT_TRUE(recorder.waitFor(1));
+  ModemEvent event = recorder.events()[0];
+  EXPECT_EQ(event.port, &port);
+  EXPECT_EQ(event.line, modem_line_cts);
+  EXPECT_TRUE(event.level);
+  EXPECT_EQ(event.transitions, 1u);
+  ModemStatus status;
+  ASSERT_TRUE(watcher.getStatus(port, status));
+  EXPECT_TRUE(status.cts);
+
+  watcher.unwatch(port);
+  EXPECT_EQ(watcher.size(), 0u);
+  lines.setCD(true);
+  usleep(20000);
+  EXPECT_EQ(recorder.events().size(), 1u);
+  EXPECT_FALSE(watcher.getStatus(port, status));
+}
+
+TEST(ModemWatcherTests, listenerMayUnwatch) {
+  LineTransport lines;
+  Serial port(&lines);
+  ModemWatcher watcher(1);
+  EventRecorder recorder(&watcher);
+  watcher.watch(port, &recorder);
+  lines.setCD(true);
+  ASSERT_TRUE(recorder.waitFor(1));
+  EXPECT_EQ(watcher.size(), 0u);
+  EXPECT_EQ(recorder.events()[0].line, modem_line_cd);
+}
+
+TEST_F(SerialTests, configureAppliesAllSettings) {
+  port1->configure(PortSettings(9600, sevenbits, parity_even, stopbits_two));
+  PortSettings settings = port1->getSettings();
+  EXPECT_EQ(settings.baudrate, 9600u);
+  EXPECT_EQ(settings.bytesize, sevenbits);
+  EXPECT_EQ(settings.parity, parity_even);
+  EXPECT_EQ(settings.stopbits, stopbits_two);
+  EXPECT_EQ(settings.flowcontrol, flowcontrol_none);
+
+  // A pty always keeps eight bits without parity.
+  struct termios options;
+  ASSERT_EQ(tcgetattr(slave_fd, &options), 0);
+  EXPECT_EQ(cfgetospeed(&options), static_cast<speed_t>(B9600));
+  EXPECT_TRUE(options.c_cflag & CSTOPB);
+}
+
+TEST(OpenPortsTests, opensAllAndReportsFailures) {
+  const size_t count = 4;
+  std::vector<int> fds;
+  std::vector<Serial *> ports;
+  for (size_t i = 0; i < count; ++i) {
+    int master_fd, slave_fd;
+    char name[100];
+    ASSERT_NE(openpty(&master_fd, &slave_fd, name, NULL, NULL), -1);
+    fds.push_back(master_fd);
+    fds.push_back(slave_fd);
+    ports.push_back(new Serial());
+    ports.back()->setPort(name);
+    ports.back()->configure(PortSettings(19200, eightbits, parity_even));
+  }
+  ports.push_back(new Serial());
+  ports.back()->setPort("/dev/serial_no_such_port");
+
+  std::vector<string> errors;
+  EXPECT_EQ(openPorts(ports, &errors), count);
+  ASSERT_EQ(errors.size(), count + 1);
+  for (size_t i = 0; i < count; ++i) {
+    EXPECT_TRUE(ports[i]->isOpen());
+    EXPECT_TRUE(errors[i].empty());
+    EXPECT_EQ(ports[i]->getBaudrate(), 19200u);
+  }
+  EXPECT_FALSE(ports[count]->isOpen());
+  EXPECT_FALSE(errors[count].empty());
+
+  for (size_t i = 0; i < ports.size(); ++i) {
+    delete ports[i];
+  }
+  for (size_t i = 0; i < fds.size(); ++i) {
+    close(fds[i]);
+  }
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {
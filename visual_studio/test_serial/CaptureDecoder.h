@@ -0,0 +1,495 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MEDIBUS_CAPTURE_SSE2 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#include "PatientDataStore.h"
+
+/**
+ * @brief Offline decoder for recorded MEDIBUS responses.
+ *
+ * Two inputs are understood:
+ *  - binary captures, the raw bytes received from the module
+ *  - logs written through LogProvider, where State::PrintData dumps every
+ *    response as a line of hex bytes after the "[date time] [logger]
+ *    [level]" prefix
+ *
+ * The input is split into chunks which are decoded on a pool of threads.
+ * In a binary capture frame starts are found with an SSE2 scan for ACK
+ * (0x06) and NAK (0x15) and are accepted if the length fits and the bytes
+ * sum to 0 modulo 256. A frame may run past the end of its chunk; the
+ * next chunk is then rescanned serially from the frame's end until it
+ * meets a frame its own scan found, from where both agree. Log chunks are
+ * cut at line ends.
+ *
+ * The report counts ACK and NAK responses per command, NAK error codes and
+ * bytes that are not part of a frame, and optionally holds the samples of
+ * all continuous data (0x12) frames in file order.
+ */
+namespace MedibusServer
+{
+    enum class CaptureFormat : uint8_t
+    {
+        Binary,
+        Log,
+    };
+
+    struct CaptureCommandStats
+    {
+        uint64_t acks{ 0 };
+        uint64_t naks{ 0 };
+        uint64_t bytes{ 0 };
+    };
+
+    struct CaptureSample
+    {
+        int64_t timeMs{ -1 };       // time of the log line, -1 in binary captures
+        uint64_t offset{ 0 };       // of the frame, or of its line in a log
+        PatientChannel channel{ PatientChannel::CO2 };
+        int32_t value{ 0 };
+    };
+
+    struct CaptureReport
+    {
+        std::array<CaptureCommandStats, 256> commands{};
+        std::array<uint64_t, 256> errors{};     // NAK responses by error code
+        uint64_t frames{ 0 };
+        uint64_t unframedBytes{ 0 };            // binary: bytes outside frames
+        uint64_t lines{ 0 };                    // log: lines read
+        uint64_t badDumps{ 0 };                 // log: hex dumps which are no valid frame
+        std::vector<CaptureSample> samples;
+
+        void Merge(const CaptureReport& other)
+        {
+            for (size_t i = 0; i < commands.size(); ++i)
+            {
+                commands[i].acks += other.commands[i].acks;
+                commands[i].naks += other.commands[i].naks;
+                commands[i].bytes += other.commands[i].bytes;
+                errors[i] += other.errors[i];
+            }
+            frames += other.frames;
+            unframedBytes += other.unframedBytes;
+            lines += other.lines;
+            badDumps += other.badDumps;
+            samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+        }
+    };
+
+    class CaptureDecoder
+    {
+    public:
+        struct Options
+        {
+            CaptureFormat format{ CaptureFormat::Binary };
+            size_t threads{ 0 };                // 0 for one per core
+            size_t chunkBytes{ 4 << 20 };
+            bool extractChannels{ false };
+        };
+
+        // Logs start with the bracketed time stamp.
+        static CaptureFormat Detect(const uint8_t* data, size_t size)
+        {
+            return size != 0 && data[0] == '[' ? CaptureFormat::Log : CaptureFormat::Binary;
+        }
+
+        static CaptureReport Decode(const uint8_t* data, size_t size, const Options& options)
+        {
+            const size_t chunkBytes = std::max<size_t>(options.chunkBytes, 4096);
+            const size_t chunks = std::max<size_t>(1, (size + chunkBytes - 1) / chunkBytes);
+            size_t threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+            threads = std::max<size_t>(1, std::min(threads, chunks));
+            std::vector<CaptureReport> reports(chunks);
+
+            if (options.format == CaptureFormat::Log)
+            {
+                RunParallel(chunks, threads, [&](size_t chunk)
+                {
+                    DecodeLog(data, size, LineStart(data, size, chunk * chunkBytes),
+                        LineStart(data, size, std::min(size, (chunk + 1) * chunkBytes)), options.extractChannels, reports[chunk]);
+                });
+            }
+            else
+            {
+                std::vector<std::vector<uint64_t>> frames(chunks);
+                RunParallel(chunks, threads, [&](size_t chunk)
+                {
+                    const size_t begin = chunk * chunkBytes;
+                    ScanFrames(data, size, begin, std::min(size, begin + chunkBytes), frames[chunk]);
+                });
+                uint64_t end = 0;
+                for (size_t chunk = 0; chunk < chunks; ++chunk)
+                {
+                    end = Resync(data, size, chunk * chunkBytes, std::min(size, (chunk + 1) * chunkBytes), end, frames[chunk]);
+                }
+                RunParallel(chunks, threads, [&](size_t chunk)
+                {
+                    CaptureReport& report = reports[chunk];
+                    for (const uint64_t offset : frames[chunk])
+                    {
+                        const size_t length = data[offset + 2] + 4u;
+                        DecodeFrame(data + offset, length, -1, offset, options.extractChannels, report);
+                    }
+                });
+            }
+
+            CaptureReport total;
+            for (const CaptureReport& report : reports)
+            {
+                total.Merge(report);
+            }
+            if (options.format == CaptureFormat::Binary)
+            {
+                uint64_t framed = 0;
+                for (const CaptureCommandStats& command : total.commands)
+                {
+                    framed += command.bytes;
+                }
+                total.unframedBytes = size - framed;
+            }
+            return total;
+        }
+
+        // First ACK or NAK byte in [from, to), to if there is none.
+        static size_t FindHeader(const uint8_t* data, size_t from, size_t to)
+        {
+            size_t i = from;
+#if defined(MEDIBUS_CAPTURE_SSE2)
+            const __m128i ack = _mm_set1_epi8(0x06);
+            const __m128i nak = _mm_set1_epi8(0x15);
+            for (; i + 16 <= to; i += 16)
+            {
+                const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, ack), _mm_cmpeq_epi8(bytes, nak)));
+                if (mask != 0)
+                {
+                    return i + LowestBit(static_cast<unsigned>(mask));
+                }
+            }
+#endif
+            for (; i < to; ++i)
+            {
+                if (data[i] == 0x06 || data[i] == 0x15)
+                {
+                    return i;
+                }
+            }
+            return to;
+        }
+
+        // Length of the frame at pos, 0 if it is cut off or its checksum is wrong.
+        static size_t FrameLength(const uint8_t* data, size_t pos, size_t size)
+        {
+            if (size - pos < 4 || (data[pos] != 0x06 && data[pos] != 0x15))
+            {
+                return 0;
+            }
+            const size_t length = data[pos + 2] + 4u;
+            if (size - pos < length)
+            {
+                return 0;
+            }
+            uint8_t sum = 0;
+            for (size_t i = 0; i < length; ++i)
+            {
+                sum = static_cast<uint8_t>(sum + data[pos + i]);
+            }
+            return sum == 0 ? length : 0;
+        }
+
+    private:
+#if defined(MEDIBUS_CAPTURE_SSE2)
+        static unsigned LowestBit(unsigned mask)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return static_cast<unsigned>(index);
+#else
+            return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+        }
+#endif
+
+        template <typename Task>
+        static void RunParallel(size_t tasks, size_t threads, Task&& task)
+        {
+            std::atomic<size_t> next{ 0 };
+            auto work = [&]()
+            {
+                for (size_t i = next++; i < tasks; i = next++)
+                {
+                    task(i);
+                }
+            };
+            std::vector<std::thread> pool;
+            for (size_t i = 1; i < threads; ++i)
+            {
+                pool.emplace_back(work);
+            }
+            work();
+            for (std::thread& thread : pool)
+            {
+                thread.join();
+            }
+        }
+
+        // Greedy scan: a valid frame is taken whole, anything else skips a byte.
+        static void ScanFrames(const uint8_t* data, size_t size, size_t from, size_t to, std::vector<uint64_t>& frames)
+        {
+            size_t pos = from;
+            while ((pos = FindHeader(data, pos, to)) < to)
+            {
+                const size_t length = FrameLength(data, pos, size);
+                if (length != 0)
+                {
+                    frames.push_back(pos);
+                    pos += length;
+                }
+                else
+                {
+                    ++pos;
+                }
+            }
+        }
+
+        // Makes the frames of the chunk [from, to) agree with a serial scan
+        // which left the previous chunk at end. Returns where this chunk's
+        // frames end.
+        static uint64_t Resync(const uint8_t* data, size_t size, size_t from, size_t to, uint64_t end, std::vector<uint64_t>& frames)
+        {
+            if (end > from)
+            {
+                std::vector<uint64_t> fixed;
+                size_t pos = static_cast<size_t>(end);
+                size_t k = 0;
+                while (pos < to)
+                {
+                    while (k < frames.size() && frames[k] < pos)
+                    {
+                        ++k;
+                    }
+                    pos = FindHeader(data, pos, to);
+                    if (pos == to)
+                    {
+                        break;
+                    }
+                    if (k < frames.size() && frames[k] == pos)
+                    {
+                        // the same position gives the same frames from here on
+                        fixed.insert(fixed.end(), frames.begin() + k, frames.end());
+                        break;
+                    }
+                    const size_t length = FrameLength(data, pos, size);
+                    if (length != 0)
+                    {
+                        fixed.push_back(pos);
+                        pos += length;
+                    }
+                    else
+                    {
+                        ++pos;
+                    }
+                }
+                frames.swap(fixed);
+            }
+            if (frames.empty())
+            {
+                return std::max<uint64_t>(end, from);
+            }
+            return frames.back() + data[frames.back() + 2] + 4u;
+        }
+
+        static void DecodeFrame(const uint8_t* frame, size_t length, int64_t timeMs, uint64_t offset, bool extract, CaptureReport& report)
+        {
+            CaptureCommandStats& command = report.commands[frame[1]];
+            command.bytes += length;
+            ++report.frames;
+            if (frame[0] == 0x15)
+            {
+                ++command.naks;
+                if (frame[2] != 0)
+                {
+                    ++report.errors[frame[3]];
+                }
+                return;
+            }
+            ++command.acks;
+            if (extract && frame[1] == 0x12)
+            {
+                PatientFrameDecoder::Decode(frame, length, [&](PatientChannel channel, int32_t value)
+                {
+                    CaptureSample sample;
+                    sample.timeMs = timeMs;
+                    sample.offset = offset;
+                    sample.channel = channel;
+                    sample.value = value;
+                    report.samples.push_back(sample);
+                });
+            }
+        }
+
+        // Start of the first line at or after pos.
+        static size_t LineStart(const uint8_t* data, size_t size, size_t pos)
+        {
+            if (pos == 0 || pos >= size)
+            {
+                return std::min(pos, size);
+            }
+            const void* newline = std::memchr(data + pos - 1, '\n', size - pos + 1);
+            return newline ? static_cast<const uint8_t*>(newline) - data + 1 : size;
+        }
+
+        static void DecodeLog(const uint8_t* data, size_t size, size_t from, size_t to, bool extract, CaptureReport& report)
+        {
+            std::vector<uint8_t> bytes;
+            bytes.reserve(300);
+            size_t line = from;
+            while (line < to)
+            {
+                const void* newline = std::memchr(data + line, '\n', size - line);
+                const size_t end = newline ? static_cast<const uint8_t*>(newline) - data : size;
+                ++report.lines;
+                int64_t timeMs = -1;
+                size_t message = line;
+                // "[2024-11-26 15:08:04.383] [rotatelog] [debug]   6  2 ..."
+                while (message < end && data[message] == '[')
+                {
+                    const void* close = std::memchr(data + message, ']', end - message);
+                    if (!close)
+                    {
+                        break;
+                    }
+                    if (timeMs < 0)
+                    {
+                        timeMs = ParseTime(data + message + 1, static_cast<const uint8_t*>(close) - data - message - 1);
+                    }
+                    message = static_cast<const uint8_t*>(close) - data + 1;
+                    while (message < end && data[message] == ' ')
+                    {
+                        ++message;
+                    }
+                }
+                if (ParseHexDump(data + message, end - message, bytes))
+                {
+                    size_t pos = 0;
+                    while (pos < bytes.size())
+                    {
+                        const size_t length = FrameLength(bytes.data(), pos, bytes.size());
+                        if (length == 0)
+                        {
+                            ++report.badDumps;
+                            break;
+                        }
+                        DecodeFrame(bytes.data() + pos, length, timeMs, line, extract, report);
+                        pos += length;
+                    }
+                }
+                line = end + 1;
+            }
+        }
+
+        // A line of hex bytes as State::PrintData writes them, "  6 1e  0 dc".
+        // Lines with anything else or fewer than four bytes are no dump.
+        static bool ParseHexDump(const uint8_t* text, size_t length, std::vector<uint8_t>& bytes)
+        {
+            bytes.clear();
+            size_t i = 0;
+            while (i < length)
+            {
+                if (text[i] == ' ' || text[i] == '\r')
+                {
+                    ++i;
+                    continue;
+                }
+                int value = 0;
+                size_t digits = 0;
+                for (; i < length && digits < 3; ++i, ++digits)
+                {
+                    const int digit = HexDigit(text[i]);
+                    if (digit < 0)
+                    {
+                        break;
+                    }
+                    value = value * 16 + digit;
+                }
+                if (digits == 0 || digits > 2 || (i < length && text[i] != ' ' && text[i] != '\r'))
+                {
+                    return false;
+                }
+                bytes.push_back(static_cast<uint8_t>(value));
+            }
+            return bytes.size() >= 4;
+        }
+
+        static int HexDigit(uint8_t c)
+        {
+            if (c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f')
+            {
+                return c - 'a' + 10;
+            }
+            if (c >= 'A' && c <= 'F')
+            {
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+
+        // "2024-11-26 15:08:04.383" to milliseconds since 1970, as written
+        // (the logger's local time). -1 if the text is no time stamp.
+        static int64_t ParseTime(const uint8_t* text, size_t length)
+        {
+            static const char pattern[] = "dddd-dd-dd dd:dd:dd.ddd";
+            if (length != sizeof(pattern) - 1)
+            {
+                return -1;
+            }
+            for (size_t i = 0; i < length; ++i)
+            {
+                if (pattern[i] == 'd' ? (text[i] < '0' || text[i] > '9') : text[i] != static_cast<uint8_t>(pattern[i]))
+                {
+                    return -1;
+                }
+            }
+            auto number = [&](size_t at, size_t digits)
+            {
+                int64_t value = 0;
+                for (size_t i = 0; i < digits; ++i)
+                {
+                    value = value * 10 + (text[at + i] - '0');
+                }
+                return value;
+            };
+            const int64_t days = DaysFromCivil(number(0, 4), number(5, 2), number(8, 2));
+            return ((days * 24 + number(11, 2)) * 60 + number(14, 2)) * 60000 + number(17, 2) * 1000 + number(20, 3);
+        }
+
+        // days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant)
+        static int64_t DaysFromCivil(int64_t year, int64_t month, int64_t day)
+        {
+            year -= month <= 2;
+            const int64_t era = (year >= 0 ? year : year - 399) / 400;
+            const int64_t yoe = year - era * 400;
+            const int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+            const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+            return era * 146097 + doe - 719468;
+        }
+    };
+}
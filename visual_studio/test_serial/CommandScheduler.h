@@ -0,0 +1,212 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Orders outgoing MEDIBUS commands by priority class and deadline.
+ *
+ * States queue their command instead of writing it, the actor dispatches
+ * one command whenever the line is free. A command whose deadline passed
+ * goes first, earliest deadline first. Otherwise the class decides, aged by
+ * the time spent waiting: every AGINGNS of waiting moves a command up one
+ * class, so informational queries still get out while alarms keep coming.
+ * The queue is a fixed array, queueing and dispatching never allocate.
+ */
+namespace MedibusServer
+{
+    enum class CommandClass : uint8_t
+    {
+        Alarm = 0,  // supervision of the module status, occlusion
+        Zero,       // zero request handling and zeroing
+        Control,    // modes, valves, pump, agent, continuous data
+        Info,       // identity, units, time and feature queries
+        Count
+    };
+
+    inline const char* CommandClassName(CommandClass commandClass)
+    {
+        static const char* const names[] = { "alarm", "zero", "control", "info" };
+        return names[static_cast<size_t>(commandClass)];
+    }
+
+    // How long a command of the class may wait before it is late.
+    constexpr int64_t DefaultDeadlineNs(CommandClass commandClass)
+    {
+        return commandClass == CommandClass::Alarm ? 50000000
+            : commandClass == CommandClass::Zero ? 100000000
+            : commandClass == CommandClass::Control ? 500000000
+            : 2000000000;
+    }
+
+    struct DelayMetrics
+    {
+        uint64_t count{ 0 };
+        int64_t totalNs{ 0 };
+        int64_t maxNs{ 0 };
+
+        void Record(int64_t delayNs)
+        {
+            ++count;
+            totalNs += delayNs;
+            if (delayNs > maxNs)
+            {
+                maxNs = delayNs;
+            }
+        }
+
+        int64_t AverageNs() const
+        {
+            return count != 0 ? totalNs / static_cast<int64_t>(count) : 0;
+        }
+    };
+
+    struct CommandClassMetrics
+    {
+        DelayMetrics queueDelay;    // from queueing to dispatch
+        uint64_t deadlineMisses{ 0 };
+        uint64_t rejected{ 0 };     // the queue was full
+    };
+
+    template <typename Command, size_t Capacity = 16>
+    class CommandScheduler
+    {
+    public:
+        struct Entry
+        {
+            Command* command{ nullptr };
+            CommandClass commandClass{ CommandClass::Info };
+            bool sync{ false };         // the caller waits for the read result
+            int64_t queuedNs{ 0 };
+            int64_t deadlineNs{ 0 };
+        };
+
+        static constexpr int64_t AGINGNS = 250000000;
+
+        // Queues the command. A command already waiting keeps its place and
+        // gets the earlier deadline. Returns false if the queue is full.
+        bool Push(Command* command, CommandClass commandClass, bool sync, int64_t nowNs)
+        {
+            return Push(command, commandClass, sync, nowNs, nowNs + DefaultDeadlineNs(commandClass));
+        }
+
+        bool Push(Command* command, CommandClass commandClass, bool sync, int64_t nowNs, int64_t deadlineNs)
+        {
+            for (size_t i = 0; i < m_size; ++i)
+            {
+                Entry& entry = m_entries[i];
+                if (entry.command == command)
+                {
+                    entry.sync = entry.sync || sync;
+                    entry.deadlineNs = deadlineNs < entry.deadlineNs ? deadlineNs : entry.deadlineNs;
+                    return true;
+                }
+            }
+            if (m_size == Capacity)
+            {
+                ++m_metrics[static_cast<size_t>(commandClass)].rejected;
+                return false;
+            }
+            Entry& entry = m_entries[m_size++];
+            entry.command = command;
+            entry.commandClass = commandClass;
+            entry.sync = sync;
+            entry.queuedNs = nowNs;
+            entry.deadlineNs = deadlineNs;
+            return true;
+        }
+
+        // Takes the command to send next and records its queueing delay.
+        bool Pop(int64_t nowNs, Entry& next)
+        {
+            if (m_size == 0)
+            {
+                return false;
+            }
+            size_t best = 0;
+            for (size_t i = 1; i < m_size; ++i)
+            {
+                if (Before(m_entries[i], m_entries[best], nowNs))
+                {
+                    best = i;
+                }
+            }
+            next = m_entries[best];
+            m_entries[best] = m_entries[--m_size];
+
+            CommandClassMetrics& metrics = m_metrics[static_cast<size_t>(next.commandClass)];
+            metrics.queueDelay.Record(nowNs - next.queuedNs);
+            if (nowNs > next.deadlineNs)
+            {
+                ++metrics.deadlineMisses;
+            }
+            if (m_eventNs != 0 && next.commandClass <= CommandClass::Zero)
+            {
+                m_reaction.Record(nowNs - m_eventNs);
+                m_eventNs = 0;
+            }
+            return true;
+        }
+
+        // A supervision event was raised, the next alarm or zero command
+        // counts as the reaction to it.
+        void NoteEvent(int64_t nowNs)
+        {
+            if (m_eventNs == 0)
+            {
+                m_eventNs = nowNs;
+            }
+        }
+
+        void Clear()
+        {
+            m_size = 0;
+            m_eventNs = 0;
+        }
+
+        size_t Size() const
+        {
+            return m_size;
+        }
+
+        const CommandClassMetrics& Metrics(CommandClass commandClass) const
+        {
+            return m_metrics[static_cast<size_t>(commandClass)];
+        }
+
+        // from a supervision event to the dispatch of the command handling it
+        const DelayMetrics& ReactionTime() const
+        {
+            return m_reaction;
+        }
+
+    private:
+        static bool Before(const Entry& a, const Entry& b, int64_t nowNs)
+        {
+            const bool aLate = nowNs >= a.deadlineNs;
+            const bool bLate = nowNs >= b.deadlineNs;
+            if (aLate != bLate)
+            {
+                return aLate;
+            }
+            if (aLate)
+            {
+                return a.deadlineNs < b.deadlineNs;
+            }
+            return Rank(a) < Rank(b);
+        }
+
+        // class in units of the aging step plus the time of queueing, the
+        // smallest rank goes first
+        static int64_t Rank(const Entry& entry)
+        {
+            return static_cast<int64_t>(entry.commandClass) * AGINGNS + entry.queuedNs;
+        }
+
+        std::array<Entry, Capacity> m_entries{};
+        size_t m_size{ 0 };
+        std::array<CommandClassMetrics, static_cast<size_t>(CommandClass::Count)> m_metrics{};
+        DelayMetrics m_reaction;
+        int64_t m_eventNs{ 0 };
+    };
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "PatientDataStore.h"
+
+/**
+ * @brief Chooses the continuous data (CMD_$12) frames from what consumers
+ * subscribed to.
+ *
+ * The module cycles through the frames selected by bytes 8..12 of CMD_$12,
+ * so every frame nobody needs lowers the rate of the ones that are needed.
+ * Consumers subscribe to channels; the selector is the union of the frames
+ * carrying them plus FRAME_$12$0E, which the state machine always needs.
+ * Whenever the union changes the actor issues the command again.
+ *
+ * The selector bits are taken from the two requests known to work: "all
+ * data" (0f 68 18 40 1f) and CO2/N2O with status (00 40 00 40 05). They only
+ * fix the bits of the O2, Agent1 and Agent2 frames together (0x1a of the last
+ * byte); which of those bits selects which frame is not documented here, so
+ * any of these channels selects all three until a module confirms the split.
+ * The bits of the all data request which select no decoded channel are kept
+ * together with the module status word.
+ */
+namespace MedibusServer
+{
+    typedef std::bitset<kPatientChannelCount> PatientChannelSet;
+
+    class ContinuousSubscription
+    {
+    public:
+        static constexpr size_t SELECTORBYTES = 5;      // command bytes 8..12
+        static constexpr size_t MAXCONSUMERS = 16;
+        typedef std::array<uint8_t, SELECTORBYTES> Selector;
+
+        // FRAME_$12$0E, status of the module
+        static Selector Required()
+        {
+            return Selector{ { 0x00, 0x40, 0x00, 0x40, 0x00 } };
+        }
+
+        static Selector ChannelBits(PatientChannel channel)
+        {
+            switch (channel)
+            {
+            case PatientChannel::CO2:
+            case PatientChannel::CO2Status:
+            case PatientChannel::N2O:
+            case PatientChannel::N2OStatus:
+                return Selector{ { 0x00, 0x00, 0x00, 0x00, 0x05 } };    // FRAME_$12$03
+            case PatientChannel::O2:
+            case PatientChannel::O2Status:
+            case PatientChannel::Agent1:
+            case PatientChannel::Agent1Status:
+            case PatientChannel::Agent1Identity:
+            case PatientChannel::Agent2:
+            case PatientChannel::Agent2Status:
+                // the split of 0x1a between these frames is unverified
+                return Selector{ { 0x00, 0x00, 0x00, 0x00, 0x1a } };
+            case PatientChannel::ModuleStatusWord:
+                return Selector{ { 0x0f, 0x28, 0x18, 0x00, 0x00 } };
+            default:
+                return Required();
+            }
+        }
+
+        // Returns a handle, or -1 if there are MAXCONSUMERS already.
+        int Subscribe(const PatientChannelSet& channels)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t i = 0; i < MAXCONSUMERS; ++i)
+            {
+                if (!m_used[i])
+                {
+                    m_used[i] = true;
+                    m_consumers[i] = channels;
+                    Recompute();
+                    return static_cast<int>(i);
+                }
+            }
+            return -1;
+        }
+
+        void Change(int handle, const PatientChannelSet& channels)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (handle >= 0 && static_cast<size_t>(handle) < MAXCONSUMERS && m_used[handle])
+            {
+                m_consumers[handle] = channels;
+                Recompute();
+            }
+        }
+
+        void Unsubscribe(int handle)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (handle >= 0 && static_cast<size_t>(handle) < MAXCONSUMERS)
+            {
+                m_used[handle] = false;
+                m_consumers[handle].reset();
+                Recompute();
+            }
+        }
+
+        PatientChannelSet Channels() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_channels;
+        }
+
+        Selector Current() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_selector;
+        }
+
+        // Actor thread. True if the selector differs from the one last
+        // issued, which it then counts as issued.
+        bool TakeChanged(Selector& selector)
+        {
+            if (!m_changed.exchange(false, std::memory_order_acquire))
+            {
+                return false;
+            }
+            selector = Current();
+            if (selector == m_issued)
+            {
+                return false;
+            }
+            m_issued = selector;
+            return true;
+        }
+
+        // Actor thread. The command for the current selector, counted as issued.
+        std::vector<uint8_t> IssueCommand()
+        {
+            m_changed.store(false, std::memory_order_relaxed);
+            m_issued = Current();
+            return Command(m_issued);
+        }
+
+        // 10 0d 12 00 00 00 00 00 <selector> 00 3c CS
+        static std::vector<uint8_t> Command(const Selector& selector)
+        {
+            std::vector<uint8_t> command{ 0x10, 0x0d, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00 };
+            command.insert(command.end(), selector.begin(), selector.end());
+            command.push_back(0x00);
+            command.push_back(0x3c);
+            uint8_t sum = 0;
+            for (const uint8_t byte : command)
+            {
+                sum = static_cast<uint8_t>(sum + byte);
+            }
+            command.push_back(static_cast<uint8_t>(0 - sum));
+            return command;
+        }
+
+    private:
+        void Recompute()
+        {
+            m_channels.reset();
+            for (size_t i = 0; i < MAXCONSUMERS; ++i)
+            {
+                if (m_used[i])
+                {
+                    m_channels |= m_consumers[i];
+                }
+            }
+            Selector selector = Required();
+            for (size_t i = 0; i < kPatientChannelCount; ++i)
+            {
+                if (m_channels[i])
+                {
+                    const Selector bits = ChannelBits(static_cast<PatientChannel>(i));
+                    for (size_t b = 0; b < SELECTORBYTES; ++b)
+                    {
+                        selector[b] |= bits[b];
+                    }
+                }
+            }
+            if (selector != m_selector)
+            {
+                m_selector = selector;
+                m_changed.store(true, std::memory_order_release);
+            }
+        }
+
+        mutable std::mutex m_mutex;
+        std::array<PatientChannelSet, MAXCONSUMERS> m_consumers{};
+        std::array<bool, MAXCONSUMERS> m_used{};
+        PatientChannelSet m_channels;
+        Selector m_selector{ Required() };
+        std::atomic<bool> m_changed{ false };
+        Selector m_issued{};                // actor thread
+    };
+}
@@ -0,0 +1,273 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+/**
+ * @brief Device identity remembered across restarts.
+ *
+ * The answers of CMD_$0A (vendor code, serial number, revisions, product
+ * name, part number) and the feature byte of CMD_$2C are kept per port in a
+ * small text file. On the next start only the serial number is queried; if
+ * it matches the cached one the rest is reused, otherwise the entry is
+ * dropped and the full handshake runs again.
+ *
+ * Entries which do not parse are ignored. Save merges the ports stored or
+ * invalidated since the last Save into the file as it is then, so servers
+ * on different ports share the file without dropping each other's entries.
+ */
+namespace MedibusServer
+{
+    // sub ids of CMD_$0A, also the index into DeviceIdentity::fields
+    enum class IdentityField : uint8_t
+    {
+        VendorCode = 0x00,
+        SerialNumber = 0x01,
+        HardwareRevision = 0x02,
+        SoftwareRevision = 0x03,
+        ProductName = 0x05,
+        PartNumber = 0x06,
+    };
+
+    struct DeviceIdentity
+    {
+        static constexpr size_t FIELDS = 7;
+        static constexpr size_t FIELDLENGTH = 10;   // rddata[11..20]
+
+        std::string port;
+        std::string hardwareId;     // serial::PortInfo::hardware_id, only a hint
+        std::array<std::string, FIELDS> fields;
+        bool featuresKnown{ false };
+        uint8_t features{ 0 };      // CMD_$2C, rddata[6]
+
+        const std::string& Field(IdentityField field) const
+        {
+            return fields[static_cast<size_t>(field)];
+        }
+
+        std::string& Field(IdentityField field)
+        {
+            return fields[static_cast<size_t>(field)];
+        }
+
+        // All CMD_$0A answers are known; the features are queried anyway if
+        // the module did not answer CMD_$2C.
+        bool Complete() const
+        {
+            const IdentityField queried[] = { IdentityField::VendorCode, IdentityField::SerialNumber,
+                IdentityField::HardwareRevision, IdentityField::SoftwareRevision, IdentityField::ProductName,
+                IdentityField::PartNumber };
+            for (IdentityField field : queried)
+            {
+                if (Field(field).empty())
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    class DeviceIdentityCache
+    {
+    public:
+        explicit DeviceIdentityCache(std::string path = "device_identity.cache") : m_path(std::move(path))
+        {
+        }
+
+        bool Load()
+        {
+            m_changed.clear();
+            return Read(m_entries);
+        }
+
+        bool Save()
+        {
+            std::map<std::string, DeviceIdentity> entries;
+            Read(entries);
+            for (const std::string& port : m_changed)
+            {
+                auto fnd = m_entries.find(port);
+                if (fnd == m_entries.end())
+                {
+                    entries.erase(port);
+                }
+                else
+                {
+                    entries[port] = fnd->second;
+                }
+            }
+            m_changed.clear();
+
+            std::ofstream file(m_path, std::ios::trunc);
+            if (!file)
+            {
+                return false;
+            }
+            for (const auto& item : entries)
+            {
+                const DeviceIdentity& entry = item.second;
+                file << '[' << entry.port << "]\n";
+                file << "hardware_id=" << entry.hardwareId << '\n';
+                for (size_t i = 0; i < DeviceIdentity::FIELDS; ++i)
+                {
+                    if (!entry.fields[i].empty())
+                    {
+                        file << "field_" << i << '=' << ToHex(entry.fields[i]) << '\n';
+                    }
+                }
+                if (entry.featuresKnown)
+                {
+                    file << "features=" << ToHex(std::string(1, static_cast<char>(entry.features))) << '\n';
+                }
+            }
+            return static_cast<bool>(file);
+        }
+
+        // Cached identity of the port. A different hardware id means another
+        // adapter or module sits on that port now, the entry is not used.
+        const DeviceIdentity* Find(const std::string& port, const std::string& hardwareId) const
+        {
+            auto fnd = m_entries.find(port);
+            if (fnd == m_entries.end() || !fnd->second.Complete())
+            {
+                return nullptr;
+            }
+            if (!hardwareId.empty() && !fnd->second.hardwareId.empty() && hardwareId != fnd->second.hardwareId)
+            {
+                return nullptr;
+            }
+            return &fnd->second;
+        }
+
+        void Store(const DeviceIdentity& identity)
+        {
+            m_entries[identity.port] = identity;
+            m_changed.insert(identity.port);
+        }
+
+        void Invalidate(const std::string& port)
+        {
+            m_entries.erase(port);
+            m_changed.insert(port);
+        }
+
+    private:
+        bool Read(std::map<std::string, DeviceIdentity>& entries) const
+        {
+            entries.clear();
+            std::ifstream file(m_path);
+            if (!file)
+            {
+                return false;
+            }
+            std::set<std::string> corrupt;
+            std::string line;
+            DeviceIdentity* entry = nullptr;
+            while (std::getline(file, line))
+            {
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.pop_back();
+                }
+                if (line.size() > 2 && line.front() == '[' && line.back() == ']')
+                {
+                    const std::string port = line.substr(1, line.size() - 2);
+                    entry = &entries[port];
+                    entry->port = port;
+                    continue;
+                }
+                const size_t eq = line.find('=');
+                if (entry == nullptr || eq == std::string::npos)
+                {
+                    continue;
+                }
+                const std::string key = line.substr(0, eq);
+                const std::string value = line.substr(eq + 1);
+                bool valid = true;
+                if (key == "hardware_id")
+                {
+                    entry->hardwareId = value;
+                }
+                else if (key == "features")
+                {
+                    std::string bytes;
+                    valid = FromHex(value, bytes) && bytes.size() == 1;
+                    entry->featuresKnown = valid;
+                    entry->features = valid ? static_cast<uint8_t>(bytes[0]) : 0;
+                }
+                else if (key.size() == 7 && key.compare(0, 6, "field_") == 0)
+                {
+                    const size_t index = static_cast<size_t>(key[6] - '0');
+                    valid = index < DeviceIdentity::FIELDS && FromHex(value, entry->fields[index]);
+                }
+                if (!valid)
+                {
+                    corrupt.insert(entry->port);
+                }
+            }
+            for (const std::string& port : corrupt)
+            {
+                entries.erase(port);
+            }
+            return true;
+        }
+
+        static std::string ToHex(const std::string& bytes)
+        {
+            static const char digits[] = "0123456789abcdef";
+            std::string hex;
+            for (unsigned char c : bytes)
+            {
+                hex += digits[c >> 4];
+                hex += digits[c & 0x0f];
+            }
+            return hex;
+        }
+
+        static int HexDigit(char c)
+        {
+            if (c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f')
+            {
+                return c - 'a' + 10;
+            }
+            if (c >= 'A' && c <= 'F')
+            {
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+
+        static bool FromHex(const std::string& hex, std::string& bytes)
+        {
+            bytes.clear();
+            if (hex.size() % 2 != 0)
+            {
+                return false;
+            }
+            for (size_t i = 0; i < hex.size(); i += 2)
+            {
+                const int high = HexDigit(hex[i]);
+                const int low = HexDigit(hex[i + 1]);
+                if (high < 0 || low < 0)
+                {
+                    return false;
+                }
+                bytes += static_cast<char>(high << 4 | low);
+            }
+            return true;
+        }
+
+        std::string m_path;
+        std::map<std::string, DeviceIdentity> m_entries;
+        std::set<std::string> m_changed;    // ports stored or invalidated since the last Save
+    };
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MedibusServer
+{
+    namespace detail
+    {
+        // A read only mapping of a whole file.
+        class FileMapping
+        {
+        public:
+            FileMapping() = default;
+            FileMapping(const FileMapping&) = delete;
+            FileMapping& operator=(const FileMapping&) = delete;
+
+            ~FileMapping()
+            {
+                Close();
+            }
+
+            bool Open(const std::string& path)
+            {
+                Close();
+#if defined(_WIN32)
+                m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                LARGE_INTEGER size;
+                if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+                {
+                    Close();
+                    return false;
+                }
+                m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (m_mapping == nullptr)
+                {
+                    Close();
+                    return false;
+                }
+                m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+                m_size = static_cast<size_t>(size.QuadPart);
+#else
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0)
+                {
+                    return false;
+                }
+                struct stat st;
+                if (fstat(fd, &st) != 0 || st.st_size <= 0)
+                {
+                    ::close(fd);
+                    return false;
+                }
+                m_size = static_cast<size_t>(st.st_size);
+                m_data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (m_data == MAP_FAILED)
+                {
+                    m_data = nullptr;
+                }
+#endif
+                return m_data != nullptr;
+            }
+
+            void Close()
+            {
+#if defined(_WIN32)
+                if (m_data != nullptr)
+                {
+                    UnmapViewOfFile(m_data);
+                }
+                if (m_mapping != nullptr)
+                {
+                    CloseHandle(m_mapping);
+                }
+                if (m_file != INVALID_HANDLE_VALUE)
+                {
+                    CloseHandle(m_file);
+                }
+                m_mapping = nullptr;
+                m_file = INVALID_HANDLE_VALUE;
+#else
+                if (m_data != nullptr)
+                {
+                    munmap(m_data, m_size);
+                }
+#endif
+                m_data = nullptr;
+                m_size = 0;
+            }
+
+            const uint8_t* Data() const
+            {
+                return static_cast<const uint8_t*>(m_data);
+            }
+
+            size_t Size() const
+            {
+                return m_size;
+            }
+
+        private:
+            void* m_data{ nullptr };
+            size_t m_size{ 0 };
+#if defined(_WIN32)
+            HANDLE m_file{ INVALID_HANDLE_VALUE };
+            HANDLE m_mapping{ nullptr };
+#endif
+        };
+    }
+}
@@ -0,0 +1,168 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief Detects a MEDIBUS module which stopped answering.
+ *
+ * A deadline on the steady clock, no thread: the actor loop sleeps until the
+ * earlier of its tick and DeadlineNs() and then asks Expired(). Two
+ * deadlines are kept:
+ *
+ * - Answers: armed when a command goes out while none is waiting for its
+ *   answer, pushed forward by every answer as long as others are still
+ *   missing and disarmed when all are in. Only a frame which echoes the
+ *   command byte of an outstanding command is taken as its answer, so
+ *   streamed data does not hide a missing one.
+ * - Stream: while continuous data is requested, every frame of the stream
+ *   pushes it forward, so a module which goes silent in the middle of the
+ *   stream is reported although nothing was asked.
+ */
+namespace MedibusServer
+{
+    class LivenessWatchdog
+    {
+    public:
+        static constexpr int64_t DEFAULTTIMEOUTNS = 500000000;
+
+        explicit LivenessWatchdog(int64_t timeoutNs = DEFAULTTIMEOUTNS) : m_timeoutNs(timeoutNs)
+        {
+        }
+
+        // A command expecting an answer which echoes its command byte was written.
+        void NoteSent(uint8_t command, int64_t sentNs)
+        {
+            ++m_outstanding[command];
+            if (m_awaiting++ == 0)
+            {
+                m_answerDeadlineNs = sentNs + m_timeoutNs;
+            }
+        }
+
+        // Frames echoing command arrive continuously from nowNs on, until
+        // StopStream.
+        void StartStream(uint8_t command, int64_t nowNs)
+        {
+            m_streaming = true;
+            m_streamCommand = command;
+            m_streamDeadlineNs = nowNs + m_timeoutNs;
+        }
+
+        void StopStream()
+        {
+            m_streaming = false;
+            m_streamDeadlineNs = 0;
+        }
+
+        // A complete response echoing command arrived at arrivalNs. Returns
+        // true if it ends a loss of the connection, LostAtNs() still tells
+        // when it was detected.
+        bool NoteFrame(uint8_t command, int64_t arrivalNs)
+        {
+            m_lastFrameNs = arrivalNs;
+            if (m_outstanding[command] != 0)
+            {
+                --m_outstanding[command];
+                --m_awaiting;
+                m_answerDeadlineNs = m_awaiting != 0 ? arrivalNs + m_timeoutNs : 0;
+            }
+            if (m_streaming && command == m_streamCommand)
+            {
+                m_streamDeadlineNs = arrivalNs + m_timeoutNs;
+            }
+            return m_lost;
+        }
+
+        bool Expired(int64_t nowNs) const
+        {
+            const int64_t deadlineNs = DeadlineNs();
+            return deadlineNs != 0 && nowNs >= deadlineNs;
+        }
+
+        // Gives up on the missing answers and the stream. Returns true on the
+        // first expiry since the last response, the start of a loss.
+        bool Expire(int64_t nowNs)
+        {
+            Disarm();
+            ++m_expiries;
+            if (m_lost)
+            {
+                return false;
+            }
+            m_lost = true;
+            m_lostAtNs = nowNs;
+            ++m_losses;
+            return true;
+        }
+
+        // Call after the regained connection was reported.
+        void Acknowledge()
+        {
+            m_lost = false;
+        }
+
+        // The answers in flight and the stream are lost with the port.
+        void Disarm()
+        {
+            m_outstanding.fill(0);
+            m_awaiting = 0;
+            m_answerDeadlineNs = 0;
+            StopStream();
+        }
+
+        bool Awaiting() const
+        {
+            return m_awaiting != 0;
+        }
+
+        // the earlier deadline, 0 if no answer is missing and no stream runs
+        int64_t DeadlineNs() const
+        {
+            if (m_answerDeadlineNs == 0 || m_streamDeadlineNs == 0)
+            {
+                return m_answerDeadlineNs + m_streamDeadlineNs;
+            }
+            return m_answerDeadlineNs < m_streamDeadlineNs ? m_answerDeadlineNs : m_streamDeadlineNs;
+        }
+
+        int64_t TimeoutNs() const
+        {
+            return m_timeoutNs;
+        }
+
+        int64_t LastFrameNs() const
+        {
+            return m_lastFrameNs;
+        }
+
+        int64_t LostAtNs() const
+        {
+            return m_lostAtNs;
+        }
+
+        uint64_t Losses() const
+        {
+            return m_losses;
+        }
+
+        // every expired deadline, including the retries during a loss
+        uint64_t Expiries() const
+        {
+            return m_expiries;
+        }
+
+    private:
+        int64_t m_timeoutNs;
+        int64_t m_answerDeadlineNs{ 0 };
+        int64_t m_streamDeadlineNs{ 0 };
+        std::array<uint16_t, 256> m_outstanding{};  // answers missing per command byte
+        int64_t m_lastFrameNs{ 0 };
+        int64_t m_lostAtNs{ 0 };
+        uint32_t m_awaiting{ 0 };
+        bool m_streaming{ false };
+        uint8_t m_streamCommand{ 0 };
+        bool m_lost{ false };
+        uint64_t m_losses{ 0 };
+        uint64_t m_expiries{ 0 };
+    };
+}
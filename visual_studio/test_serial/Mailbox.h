@@ -0,0 +1,137 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+/**
+ * @brief Bounded lock-free mailbox, many producers and one consumer.
+ *
+ * Messages are copied into preallocated cells, so posting never allocates.
+ * Every cell carries a sequence number which tells producers and the
+ * consumer whether it is free or filled (the bounded queue of D. Vyukov).
+ * The consumer only falls back to a condition variable when the mailbox is
+ * empty; producers take the mutex only if the consumer is actually asleep.
+ */
+namespace MedibusServer
+{
+    template <typename T, size_t Capacity>
+    class Mailbox
+    {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+        static_assert(std::is_trivially_copyable<T>::value, "messages are copied into the cells");
+
+    public:
+        Mailbox() : m_cells(new Cell[Capacity])
+        {
+            for (size_t i = 0; i < Capacity; ++i)
+            {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        Mailbox(const Mailbox&) = delete;
+        Mailbox& operator=(const Mailbox&) = delete;
+
+        // Any thread. Returns false if the mailbox is full.
+        bool TryPost(const T& message)
+        {
+            size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true)
+            {
+                cell = &m_cells[pos & (Capacity - 1)];
+                const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+                if (diff == 0)
+                {
+                    if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    m_full.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+            cell->message = message;
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            WakeConsumer();
+            return true;
+        }
+
+        // Consumer thread only.
+        bool TryReceive(T& message)
+        {
+            Cell* cell = &m_cells[m_dequeuePos & (Capacity - 1)];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            if (sequence != m_dequeuePos + 1)
+            {
+                return false;
+            }
+            message = cell->message;
+            cell->sequence.store(m_dequeuePos + Capacity, std::memory_order_release);
+            ++m_dequeuePos;
+            return true;
+        }
+
+        // Consumer thread only. Sleeps until a message is posted or the deadline passes.
+        void WaitUntil(std::chrono::steady_clock::time_point deadline)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (Empty())
+            {
+                m_wakeup.wait_until(lock, deadline);
+            }
+            m_sleeping.store(false, std::memory_order_relaxed);
+        }
+
+        // Number of posts rejected because the mailbox was full.
+        uint64_t FullCount() const
+        {
+            return m_full.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T message;
+        };
+
+        bool Empty() const
+        {
+            const Cell& cell = m_cells[m_dequeuePos & (Capacity - 1)];
+            return cell.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1;
+        }
+
+        void WakeConsumer()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_sleeping.load(std::memory_order_relaxed))
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_wakeup.notify_one();
+            }
+        }
+
+        std::unique_ptr<Cell[]> m_cells;
+        alignas(64) std::atomic<size_t> m_enqueuePos{ 0 };
+        alignas(64) size_t m_dequeuePos{ 0 };
+        std::atomic<bool> m_sleeping{ false };
+        std::atomic<uint64_t> m_full{ 0 };
+        std::mutex m_mutex;
+        std::condition_variable m_wakeup;
+    };
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CaptureDecoder.h"
+#include "serial/serial.h"
+
+/**
+ * @brief Finds the ports a MEDIBUS module is connected to.
+ *
+ * Every candidate port is probed on its own thread: it is opened, the stop
+ * continuous data command (CMD_$19) is written and a port counts as a module
+ * if a checksummed ACK of it comes back. Frames of a module which was still
+ * sending continuous data are skipped. A module is then asked for its serial
+ * number (CMD_$0A, sub id 1). All probes share one deadline, so discovery
+ * takes one timeout however many adapters there are; a module whose serial
+ * number did not arrive in time is reported without it.
+ */
+namespace MedibusServer
+{
+    struct DiscoveredModule
+    {
+        std::string port;
+        std::string description;    // serial::PortInfo
+        std::string hardwareId;     // serial::PortInfo
+        std::string serialNumber;   // empty if it did not answer in time
+        int64_t responseNs{ 0 };    // from writing the probe to its ACK
+    };
+
+    class ModuleDiscovery
+    {
+    public:
+        static constexpr uint32_t DEFAULTTIMEOUTMS = 200;
+
+        explicit ModuleDiscovery(uint32_t baudrate = 19200, uint32_t timeoutMs = DEFAULTTIMEOUTMS)
+            : m_baudrate(baudrate), m_timeoutMs(timeoutMs)
+        {
+        }
+
+        std::map<std::string, DiscoveredModule> Discover() const
+        {
+            return Discover(serial::list_ports());
+        }
+
+        std::map<std::string, DiscoveredModule> Discover(const std::vector<serial::PortInfo>& ports) const
+        {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_timeoutMs);
+            std::vector<DiscoveredModule> modules(ports.size());
+            std::vector<char> found(ports.size(), 0);
+            std::vector<std::thread> probes;
+            probes.reserve(ports.size());
+            for (size_t i = 0; i < ports.size(); ++i)
+            {
+                probes.emplace_back([&, i]()
+                {
+                    found[i] = Probe(ports[i], deadline, modules[i]);
+                });
+            }
+            std::map<std::string, DiscoveredModule> result;
+            for (size_t i = 0; i < probes.size(); ++i)
+            {
+                probes[i].join();
+                if (found[i])
+                {
+                    result[modules[i].port] = modules[i];
+                }
+            }
+            return result;
+        }
+
+    private:
+        typedef std::chrono::steady_clock::time_point TimePoint;
+
+        bool Probe(const serial::PortInfo& info, TimePoint deadline, DiscoveredModule& module) const
+        {
+            static const uint8_t stopContinuousData[] = { 0x10, 0x01, 0x19, 0xd6 };
+            static const uint8_t serialNumber[] = { 0x10, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xdb };
+
+            module.port = info.port;
+            module.description = info.description;
+            module.hardwareId = info.hardware_id;
+            try
+            {
+                serial::Serial port("", m_baudrate, serial::Timeout::simpleTimeout(m_timeoutMs));
+                port.setPort(info.port);
+                port.open();
+                port.flushInput();
+
+                const auto sentAt = std::chrono::steady_clock::now();
+                port.write(stopContinuousData, sizeof(stopContinuousData));
+                std::vector<uint8_t> received;
+                size_t at = 0;
+                if (!Receive(port, deadline, 0x19, 0x00, received, at))
+                {
+                    return false;
+                }
+                module.responseNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sentAt).count();
+
+                port.write(serialNumber, sizeof(serialNumber));
+                received.clear();
+                // data in [11..20], sub id in [21]
+                if (Receive(port, deadline, 0x0a, 0x14, received, at) && received[at + 21] == 0x01)
+                {
+                    module.serialNumber.assign(received.begin() + at + 11, received.begin() + at + 21);
+                }
+                port.close();
+                return true;
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        }
+
+        // Reads until an ACK of the command with the given length arrives or
+        // the deadline passes. The frame starts at received[at].
+        static bool Receive(serial::Serial& port, TimePoint deadline, uint8_t command, uint8_t length,
+            std::vector<uint8_t>& received, size_t& at)
+        {
+            uint8_t buffer[256];
+            for (;;)
+            {
+                const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (remaining <= 0)
+                {
+                    return false;
+                }
+                serial::Timeout timeout = serial::Timeout::simpleTimeout(static_cast<uint32_t>(remaining));
+                port.setTimeout(timeout);
+                const size_t wanted = std::min(sizeof(buffer), std::max<size_t>(1, port.available()));
+                received.insert(received.end(), buffer, buffer + port.read(buffer, wanted));
+
+                // any complete frame counts, one of continuous data may still
+                // be cut off in front of the answer
+                for (size_t pos = 0; (pos = CaptureDecoder::FindHeader(received.data(), pos, received.size())) < received.size(); ++pos)
+                {
+                    if (received[pos] == 0x06 && received.size() - pos >= 3 && received[pos + 1] == command
+                        && received[pos + 2] == length && CaptureDecoder::FrameLength(received.data(), pos, received.size()) != 0)
+                    {
+                        at = pos;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        uint32_t m_baudrate;
+        uint32_t m_timeoutMs;
+    };
+}
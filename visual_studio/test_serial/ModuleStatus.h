@@ -0,0 +1,166 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+/**
+ * @brief Module status shared between the response thread and readers.
+ *
+ * The status is published as one snapshot through a sequence lock: readers
+ * copy the snapshot and retry if a writer was active meanwhile, so they never
+ * take a lock and always see all fields from the same update. Writers only
+ * serialize among themselves and never wait for readers.
+ */
+namespace MedibusServer
+{
+    struct ModuleStatusSnapshot
+    {
+        uint64_t version{ 0 };              // incremented by every publish
+        uint32_t supervision{ 0 };          // active SupervisionEvent bits
+        uint32_t supervisionEvaluated{ 0 }; // SupervisionEvent bits received at least once
+        uint8_t hsp{ 0x00 };                // host selectable parameters, FRAME_$12$0E
+        bool pneumaticsEnabled{ false };
+        bool autoZeroCondition{ false };
+        bool paiAvailable{ false };
+        bool needsExternalData{ false };
+    };
+
+    template <typename T>
+    class SeqLockPublisher
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshots are copied word by word");
+
+    public:
+        SeqLockPublisher()
+        {
+            Publish(T());
+        }
+
+        // Consistent copy of the latest snapshot, wait free unless a writer is
+        // in the middle of a publish.
+        T Load() const
+        {
+            std::array<uint64_t, kWords> words;
+            while (true)
+            {
+                const uint64_t before = m_sequence.load(std::memory_order_acquire);
+                if (before & 1)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (size_t i = 0; i < kWords; ++i)
+                {
+                    words[i] = m_words[i].load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m_sequence.load(std::memory_order_relaxed) == before)
+                {
+                    break;
+                }
+            }
+            T value;
+            std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+            return value;
+        }
+
+        void Publish(const T& value)
+        {
+            Modify([&](T& current) { current = value; });
+        }
+
+        // Applies fn to a copy of the current snapshot and publishes the result.
+        // Returns whatever fn returns.
+        template <typename Fn>
+        auto Modify(Fn fn) -> decltype(fn(std::declval<T&>()))
+        {
+            WriterLock lock(m_writer);
+            T current = Current();
+            return Write(current, fn, std::is_void<decltype(fn(current))>());
+        }
+
+    private:
+        static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        class WriterLock
+        {
+        public:
+            explicit WriterLock(std::atomic_flag& flag) : m_flag(flag)
+            {
+                while (m_flag.test_and_set(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+            }
+            ~WriterLock()
+            {
+                m_flag.clear(std::memory_order_release);
+            }
+        private:
+            std::atomic_flag& m_flag;
+        };
+
+        // only called by the writer holding m_writer
+        T Current() const
+        {
+            std::array<uint64_t, kWords> words;
+            for (size_t i = 0; i < kWords; ++i)
+            {
+                words[i] = m_words[i].load(std::memory_order_relaxed);
+            }
+            T value;
+            std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+            return value;
+        }
+
+        template <typename Fn>
+        void Write(T& current, Fn& fn, std::true_type)
+        {
+            fn(current);
+            Store(current);
+        }
+
+        template <typename Fn>
+        auto Write(T& current, Fn& fn, std::false_type) -> decltype(fn(current))
+        {
+            auto result = fn(current);
+            Store(current);
+            return result;
+        }
+
+        void Store(T& value)
+        {
+            const uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+            StampVersion(value, sequence / 2 + 1);
+            std::array<uint64_t, kWords> words{};
+            std::memcpy(words.data(), static_cast<const void*>(&value), sizeof(T));
+
+            m_sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < kWords; ++i)
+            {
+                m_words[i].store(words[i], std::memory_order_relaxed);
+            }
+            m_sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        template <typename U>
+        static auto StampVersion(U& value, uint64_t version) -> decltype(value.version = version, void())
+        {
+            value.version = version;
+        }
+
+        static void StampVersion(...)
+        {
+        }
+
+        std::atomic<uint64_t> m_sequence{ 0 };
+        std::array<std::atomic<uint64_t>, kWords> m_words{};
+        std::atomic_flag m_writer = ATOMIC_FLAG_INIT;
+    };
+
+    using ModuleStatusPublisher = SeqLockPublisher<ModuleStatusSnapshot>;
+}
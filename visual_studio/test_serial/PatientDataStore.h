@@ -0,0 +1,370 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Decoded continuous patient data (FRAME_$12$xx responses).
+ *
+ * Every continuous frame is decoded once into typed samples which are kept
+ * in one ring buffer per channel. Timestamps and values are stored in
+ * separate arrays, so trend queries only touch the memory they need.
+ */
+namespace MedibusServer
+{
+    enum class PatientChannel : uint8_t
+    {
+        CO2 = 0,            // FRAME_$12$03
+        N2O,                // FRAME_$12$03
+        O2,                 // FRAME_$12$04
+        Agent1,             // FRAME_$12$10
+        Agent2,             // FRAME_$12$11
+        CO2Status,          // FRAME_$12$03, CO2_PS
+        N2OStatus,          // FRAME_$12$03, N2O_PS
+        O2Status,           // FRAME_$12$04, O2_PS
+        Agent1Status,       // FRAME_$12$10, A1_PS
+        Agent2Status,       // FRAME_$12$11, A2_PS
+        Agent1Identity,     // FRAME_$12$10, NAIF/DAIF
+        ModuleStatusWord,   // FRAME_$12$0B, MSW
+        ParameterAvailable, // FRAME_$12$0E, PAI
+        ParameterInop,      // FRAME_$12$0E, PII
+        HostSelectable,     // FRAME_$12$0E, HSP
+        OperatingMode,      // FRAME_$12$0E, OMS
+        ModuleStatus,       // FRAME_$12$0E, MS
+        Count
+    };
+
+    constexpr size_t kPatientChannelCount = static_cast<size_t>(PatientChannel::Count);
+
+    inline const char* PatientChannelName(PatientChannel channel)
+    {
+        static const char* const names[] = {
+            "CO2", "N2O", "O2", "Agent1", "Agent2",
+            "CO2Status", "N2OStatus", "O2Status", "Agent1Status", "Agent2Status",
+            "Agent1Identity", "ModuleStatusWord", "ParameterAvailable", "ParameterInop",
+            "HostSelectable", "OperatingMode", "ModuleStatus" };
+        static_assert(sizeof(names) / sizeof(names[0]) == kPatientChannelCount, "a name per channel");
+        return names[static_cast<size_t>(channel)];
+    }
+
+    // Monotonic time in nanoseconds, used for all sample timestamps.
+    inline int64_t PatientDataNow()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct PatientSample
+    {
+        int64_t timestampNs{ 0 };
+        int32_t value{ 0 };
+    };
+
+    // One bucket of a min/max decimated trend.
+    struct PatientTrendPoint
+    {
+        int64_t timestampNs{ 0 };
+        int32_t min{ 0 };
+        int32_t max{ 0 };
+    };
+
+    // Fixed capacity ring of samples of one channel, oldest samples are
+    // overwritten. Capacity is rounded up to a power of two.
+    class PatientChannelRing
+    {
+    public:
+        explicit PatientChannelRing(size_t capacity = 4096)
+        {
+            size_t cap = 1;
+            while (cap < capacity)
+            {
+                cap <<= 1;
+            }
+            m_times.resize(cap);
+            m_values.resize(cap);
+            m_mask = cap - 1;
+        }
+
+        void Push(int64_t timestampNs, int32_t value)
+        {
+            const size_t slot = m_head & m_mask;
+            m_times[slot] = timestampNs;
+            m_values[slot] = value;
+            ++m_head;
+        }
+
+        size_t Size() const
+        {
+            return std::min(m_head, m_mask + 1);
+        }
+
+        size_t Capacity() const
+        {
+            return m_mask + 1;
+        }
+
+        // Total number of samples ever pushed, useful to compute rates.
+        uint64_t Total() const
+        {
+            return m_head;
+        }
+
+        bool Latest(PatientSample& sample) const
+        {
+            if (m_head == 0)
+            {
+                return false;
+            }
+            return At(Size() - 1, sample);
+        }
+
+        // index 0 is the oldest sample still held
+        bool At(size_t index, PatientSample& sample) const
+        {
+            if (index >= Size())
+            {
+                return false;
+            }
+            const size_t slot = (m_head - Size() + index) & m_mask;
+            sample.timestampNs = m_times[slot];
+            sample.value = m_values[slot];
+            return true;
+        }
+
+        bool MinMax(int64_t fromNs, int64_t toNs, int32_t& min, int32_t& max) const
+        {
+            size_t first = LowerBound(fromNs);
+            size_t last = LowerBound(toNs + 1);
+            if (first >= last)
+            {
+                return false;
+            }
+            min = std::numeric_limits<int32_t>::max();
+            max = std::numeric_limits<int32_t>::min();
+            for (size_t i = first; i < last; ++i)
+            {
+                const int32_t value = m_values[Slot(i)];
+                min = std::min(min, value);
+                max = std::max(max, value);
+            }
+            return true;
+        }
+
+        // Splits [fromNs, toNs] into equal buckets and returns min/max of each
+        // non empty bucket, which is what a trend display draws per pixel column.
+        void Decimate(int64_t fromNs, int64_t toNs, size_t buckets, std::vector<PatientTrendPoint>& out) const
+        {
+            out.clear();
+            if (buckets == 0 || toNs < fromNs)
+            {
+                return;
+            }
+            const size_t first = LowerBound(fromNs);
+            const size_t last = LowerBound(toNs + 1);
+            const int64_t width = std::max<int64_t>(1, (toNs - fromNs + 1 + static_cast<int64_t>(buckets) - 1) / static_cast<int64_t>(buckets));
+            PatientTrendPoint point;
+            int64_t bucket = -1;
+            for (size_t i = first; i < last; ++i)
+            {
+                const size_t slot = Slot(i);
+                const int64_t b = (m_times[slot] - fromNs) / width;
+                if (b != bucket)
+                {
+                    if (bucket >= 0)
+                    {
+                        out.push_back(point);
+                    }
+                    bucket = b;
+                    point.timestampNs = fromNs + b * width;
+                    point.min = m_values[slot];
+                    point.max = m_values[slot];
+                }
+                else
+                {
+                    point.min = std::min(point.min, m_values[slot]);
+                    point.max = std::max(point.max, m_values[slot]);
+                }
+            }
+            if (bucket >= 0)
+            {
+                out.push_back(point);
+            }
+        }
+
+    private:
+        size_t Slot(size_t index) const
+        {
+            return (m_head - Size() + index) & m_mask;
+        }
+
+        // first logical index whose timestamp is >= t, timestamps are monotonic
+        size_t LowerBound(int64_t t) const
+        {
+            size_t lo = 0;
+            size_t hi = Size();
+            while (lo < hi)
+            {
+                const size_t mid = lo + (hi - lo) / 2;
+                if (m_times[Slot(mid)] < t)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+            return lo;
+        }
+
+        std::vector<int64_t> m_times;
+        std::vector<int32_t> m_values;
+        size_t m_mask{ 0 };
+        size_t m_head{ 0 };
+    };
+
+    class PatientDataStore
+    {
+    public:
+        explicit PatientDataStore(size_t capacityPerChannel = 4096)
+        {
+            for (auto& ring : m_rings)
+            {
+                ring = PatientChannelRing(capacityPerChannel);
+            }
+        }
+
+        void Append(PatientChannel channel, int64_t timestampNs, int32_t value)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_rings[Index(channel)].Push(timestampNs, value);
+        }
+
+        bool Latest(PatientChannel channel, PatientSample& sample) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_rings[Index(channel)].Latest(sample);
+        }
+
+        bool MinMax(PatientChannel channel, int64_t fromNs, int64_t toNs, int32_t& min, int32_t& max) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_rings[Index(channel)].MinMax(fromNs, toNs, min, max);
+        }
+
+        void Decimate(PatientChannel channel, int64_t fromNs, int64_t toNs, size_t buckets, std::vector<PatientTrendPoint>& out) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_rings[Index(channel)].Decimate(fromNs, toNs, buckets, out);
+        }
+
+        size_t Size(PatientChannel channel) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_rings[Index(channel)].Size();
+        }
+
+        uint64_t Total(PatientChannel channel) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_rings[Index(channel)].Total();
+        }
+
+    private:
+        static size_t Index(PatientChannel channel)
+        {
+            return static_cast<size_t>(channel);
+        }
+
+        mutable std::mutex m_mutex;
+        std::array<PatientChannelRing, kPatientChannelCount> m_rings;
+    };
+
+    /**
+     * Turns one continuous data response (06 12 LEN ... CS) into samples.
+     * The frame number is at offset 13, status bytes are read at the same
+     * offsets the State::Update overrides test; value words are the 16 bit
+     * big endian words at the start of the frame data.
+     */
+    class PatientFrameDecoder
+    {
+    public:
+        static constexpr size_t FRAMEID = 13;
+
+        // returns the number of samples appended
+        static size_t Decode(const uint8_t* rddata, size_t sz, int64_t timestampNs, PatientDataStore& store)
+        {
+            return Decode(rddata, sz, [&](PatientChannel channel, int32_t value)
+            {
+                store.Append(channel, timestampNs, value);
+            });
+        }
+
+        // Passes every sample to append(PatientChannel, int32_t), returns their number.
+        template <typename Append>
+        static size_t Decode(const uint8_t* rddata, size_t sz, Append&& append)
+        {
+            if (sz <= FRAMEID || rddata[0] != 0x06 || rddata[1] != 0x12)
+            {
+                return 0;
+            }
+            size_t count = 0;
+            auto byteAt = [&](PatientChannel channel, size_t offset)
+            {
+                if (offset < sz)
+                {
+                    append(channel, rddata[offset]);
+                    ++count;
+                }
+            };
+            auto wordAt = [&](PatientChannel channel, size_t offset)
+            {
+                if (offset + 1 < sz)
+                {
+                    append(channel, static_cast<int16_t>((rddata[offset] << 8) | rddata[offset + 1]));
+                    ++count;
+                }
+            };
+
+            switch (rddata[FRAMEID])
+            {
+            case 0x03:
+                wordAt(PatientChannel::CO2, 3);
+                wordAt(PatientChannel::N2O, 5);
+                byteAt(PatientChannel::CO2Status, 11);
+                byteAt(PatientChannel::N2OStatus, 12);
+                break;
+            case 0x04:
+                wordAt(PatientChannel::O2, 3);
+                byteAt(PatientChannel::O2Status, 11);
+                break;
+            case 0x0b:
+                byteAt(PatientChannel::ModuleStatusWord, 3);
+                break;
+            case 0x0e:
+                byteAt(PatientChannel::ParameterAvailable, 4);
+                byteAt(PatientChannel::ParameterInop, 6);
+                byteAt(PatientChannel::HostSelectable, 7);
+                byteAt(PatientChannel::OperatingMode, 12);
+                byteAt(PatientChannel::ModuleStatus, 14);
+                break;
+            case 0x10:
+                wordAt(PatientChannel::Agent1, 3);
+                byteAt(PatientChannel::Agent1Identity, 9);
+                byteAt(PatientChannel::Agent1Status, 11);
+                break;
+            case 0x11:
+                wordAt(PatientChannel::Agent2, 3);
+                byteAt(PatientChannel::Agent2Status, 12);
+                break;
+            default:
+                break;
+            }
+            return count;
+        }
+    };
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "CommandScheduler.h"
+
+/**
+ * @brief Splits the time from writing a MEDIBUS command to handling its
+ * response into stages.
+ *
+ * The actor notes when it wrote a command. The response thread stamps every
+ * frame with the arrival of its first and last byte, taken by the library
+ * when the read system call returned. From these the actor records, all on
+ * the steady clock:
+ *  - round trip per command, from the write to the last byte of the response
+ *  - wire, from the write to the first byte of the response
+ *  - transfer, from the first to the last byte of a frame
+ *  - handoff, from the last byte to the actor taking the frame
+ *  - processing, the time the actor spends on the frame
+ * Together with the queueing delay of the CommandScheduler this covers the
+ * whole path of a command. Recording never allocates.
+ */
+namespace MedibusServer
+{
+    class ResponseLatency
+    {
+    public:
+        static constexpr size_t COMMANDS = 256;
+
+        void NoteSent(uint8_t command, int64_t sentNs)
+        {
+            m_sentNs[command] = sentNs;
+        }
+
+        // A frame without byte times, from a transport, only counts as handed off.
+        void NoteFrame(uint8_t command, int64_t firstByteNs, int64_t lastByteNs, int64_t receivedNs)
+        {
+            if (firstByteNs == 0)
+            {
+                return;
+            }
+            const int64_t sentNs = m_sentNs[command];
+            if (sentNs != 0 && firstByteNs >= sentNs)
+            {
+                m_roundTrip[command].Record(lastByteNs - sentNs);
+                m_wire.Record(firstByteNs - sentNs);
+                m_sentNs[command] = 0;
+            }
+            m_transfer.Record(lastByteNs - firstByteNs);
+            m_handoff.Record(receivedNs - lastByteNs);
+        }
+
+        void NoteProcessing(int64_t processingNs)
+        {
+            m_processing.Record(processingNs);
+        }
+
+        // the answers in flight are lost with the port
+        void Clear()
+        {
+            m_sentNs.fill(0);
+        }
+
+        const DelayMetrics& RoundTrip(uint8_t command) const
+        {
+            return m_roundTrip[command];
+        }
+
+        const DelayMetrics& Wire() const
+        {
+            return m_wire;
+        }
+
+        const DelayMetrics& Transfer() const
+        {
+            return m_transfer;
+        }
+
+        const DelayMetrics& Handoff() const
+        {
+            return m_handoff;
+        }
+
+        const DelayMetrics& Processing() const
+        {
+            return m_processing;
+        }
+
+    private:
+        std::array<int64_t, COMMANDS> m_sentNs{};   // 0 if no answer is expected
+        std::array<DelayMetrics, COMMANDS> m_roundTrip{};
+        DelayMetrics m_wire;
+        DelayMetrics m_transfer;
+        DelayMetrics m_handoff;
+        DelayMetrics m_processing;
+    };
+}
@@ -0,0 +1,249 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+
+#include "CommandScheduler.h"
+#include "PatientDataStore.h"
+
+/**
+ * @brief Merges the continuous data of several modules into one stream
+ * ordered by time.
+ *
+ * Every module's thread pushes its decoded samples into its own single
+ * producer, single consumer ring, so the handoff takes no lock. One
+ * consumer polls the merger, which does a k-way merge of the ring heads with
+ * a binary heap. A sample is emitted once it can no longer be overtaken:
+ * every source without pending samples already went past its time, or it
+ * is older than the reorder window. A source which is silent thus holds the
+ * stream back by at most the window. A sample arriving after the stream
+ * went past it is counted as late and dropped, so the output stays ordered.
+ *
+ * All timestamps are steady clock nanoseconds (PatientDataNow). Rings, heap
+ * and statistics are allocated with the merger, pushing and polling never
+ * allocate.
+ */
+namespace MedibusServer
+{
+    struct MergedSample
+    {
+        int64_t timestampNs{ 0 };
+        int32_t value{ 0 };
+        PatientChannel channel{ PatientChannel::CO2 };
+        uint8_t source{ 0 };
+    };
+
+    struct MergeSourceStats
+    {
+        DelayMetrics lag;       // from the sample time to its emission
+        uint64_t merged{ 0 };
+        uint64_t late{ 0 };     // older than the merged stream, dropped
+        uint64_t dropped{ 0 };  // the ring was full
+    };
+
+    // Single producer, single consumer ring. Each side caches the other's
+    // index and only reloads it when the ring looks full or empty.
+    template <size_t Capacity>
+    class SampleRing
+    {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    public:
+        // Producer thread. Returns false if the ring is full.
+        bool TryPush(const MergedSample& sample)
+        {
+            const size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_headCache == Capacity)
+            {
+                m_headCache = m_head.load(std::memory_order_acquire);
+                if (tail - m_headCache == Capacity)
+                {
+                    return false;
+                }
+            }
+            m_samples[tail & (Capacity - 1)] = sample;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer thread. The oldest sample or nullptr, valid until Pop().
+        const MergedSample* Front()
+        {
+            const size_t head = m_head.load(std::memory_order_relaxed);
+            if (head == m_tailCache)
+            {
+                m_tailCache = m_tail.load(std::memory_order_acquire);
+                if (head == m_tailCache)
+                {
+                    return nullptr;
+                }
+            }
+            return &m_samples[head & (Capacity - 1)];
+        }
+
+        // Consumer thread, only after Front() returned a sample.
+        void Pop()
+        {
+            m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+    private:
+        std::array<MergedSample, Capacity> m_samples{};
+        alignas(64) std::atomic<size_t> m_tail{ 0 };
+        size_t m_headCache{ 0 };    // producer
+        alignas(64) std::atomic<size_t> m_head{ 0 };
+        size_t m_tailCache{ 0 };    // consumer
+    };
+
+    template <size_t MaxSources = 32, size_t RingCapacity = 1024>
+    class SampleMerger
+    {
+        static_assert(MaxSources <= 256, "the source index is a byte");
+
+    public:
+        static constexpr int64_t DEFAULTWINDOWNS = 200000000;
+
+        explicit SampleMerger(size_t sources, int64_t windowNs = DEFAULTWINDOWNS)
+            : m_sources(new Source[MaxSources]),
+              m_count(std::min(sources, MaxSources)),
+              m_windowNs(windowNs)
+        {
+        }
+
+        SampleMerger(const SampleMerger&) = delete;
+        SampleMerger& operator=(const SampleMerger&) = delete;
+
+        size_t Sources() const
+        {
+            return m_count;
+        }
+
+        // The thread of the source only. Timestamps of one source must not
+        // decrease. Returns false if the ring is full and the sample dropped.
+        bool Push(size_t source, PatientChannel channel, int64_t timestampNs, int32_t value)
+        {
+            MergedSample sample;
+            sample.timestampNs = timestampNs;
+            sample.value = value;
+            sample.channel = channel;
+            sample.source = static_cast<uint8_t>(source);
+            Source& from = m_sources[source];
+            if (!from.ring.TryPush(sample))
+            {
+                from.dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            return true;
+        }
+
+        // Consumer thread. Passes every sample which can be emitted at nowNs
+        // to sink(const MergedSample&), in time order, and returns their number.
+        template <typename Sink>
+        size_t Poll(int64_t nowNs, Sink&& sink)
+        {
+            // no sample may pass a source which has nothing pending
+            int64_t bound = std::numeric_limits<int64_t>::max();
+            size_t heapSize = 0;
+            for (size_t i = 0; i < m_count; ++i)
+            {
+                const MergedSample* front = m_sources[i].ring.Front();
+                if (front)
+                {
+                    m_heap[heapSize++] = Head{ front->timestampNs, i };
+                }
+                else
+                {
+                    bound = std::min(bound, m_sources[i].lastNs);
+                }
+            }
+            std::make_heap(m_heap.begin(), m_heap.begin() + heapSize, std::greater<Head>());
+
+            const int64_t forcedNs = nowNs - m_windowNs;
+            size_t emitted = 0;
+            while (heapSize != 0)
+            {
+                const Head head = m_heap[0];
+                if (head.timestampNs > bound && head.timestampNs > forcedNs)
+                {
+                    break;
+                }
+                std::pop_heap(m_heap.begin(), m_heap.begin() + heapSize, std::greater<Head>());
+                --heapSize;
+
+                Source& from = m_sources[head.source];
+                const MergedSample& sample = *from.ring.Front();
+                from.lastNs = sample.timestampNs;
+                if (sample.timestampNs < m_emittedNs)
+                {
+                    ++from.stats.late;
+                }
+                else
+                {
+                    sink(sample);
+                    from.stats.lag.Record(nowNs - sample.timestampNs);
+                    ++from.stats.merged;
+                    m_emittedNs = sample.timestampNs;
+                    ++emitted;
+                }
+                from.ring.Pop();
+
+                const MergedSample* next = from.ring.Front();
+                if (next)
+                {
+                    m_heap[heapSize++] = Head{ next->timestampNs, head.source };
+                    std::push_heap(m_heap.begin(), m_heap.begin() + heapSize, std::greater<Head>());
+                }
+                else
+                {
+                    bound = std::min(bound, from.lastNs);
+                }
+            }
+            return emitted;
+        }
+
+        // Consumer thread.
+        MergeSourceStats Stats(size_t source) const
+        {
+            MergeSourceStats stats = m_sources[source].stats;
+            stats.dropped = m_sources[source].dropped.load(std::memory_order_relaxed);
+            return stats;
+        }
+
+        // time of the last emitted sample
+        int64_t WatermarkNs() const
+        {
+            return m_emittedNs;
+        }
+
+    private:
+        struct Source
+        {
+            SampleRing<RingCapacity> ring;
+            std::atomic<uint64_t> dropped{ 0 };     // producer
+            int64_t lastNs{ std::numeric_limits<int64_t>::min() };  // consumer, last sample taken
+            MergeSourceStats stats;                 // consumer
+        };
+
+        struct Head
+        {
+            int64_t timestampNs;
+            size_t source;
+
+            bool operator>(const Head& other) const
+            {
+                return timestampNs != other.timestampNs ? timestampNs > other.timestampNs : source > other.source;
+            }
+        };
+
+        std::unique_ptr<Source[]> m_sources;
+        size_t m_count;
+        int64_t m_windowNs;
+        std::array<Head, MaxSources> m_heap{};
+        int64_t m_emittedNs{ std::numeric_limits<int64_t>::min() };
+    };
+}
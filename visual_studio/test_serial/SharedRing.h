@@ -0,0 +1,396 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Shared memory ring for publishing measurements to local processes.
+ *
+ * One writer appends fixed size entries, any number of readers in other
+ * processes follow it without locks. Every entry gets a sequence number;
+ * a slot is stamped odd while it is written and with the entry's even stamp
+ * once complete, so a reader which fell behind by more than the ring size
+ * notices the overrun, reports how many entries it lost and continues with
+ * the oldest entry still held.
+ *
+ * The mapping is a named file mapping on Windows and a POSIX shared memory
+ * object (shm_open) elsewhere. Each port gets its own ring, see
+ * SharedRingName, and creating a ring which already exists fails, so a
+ * second writer for the same port cannot take over or remove the first
+ * one's ring.
+ */
+namespace MedibusServer
+{
+    enum class SharedEntryKind : uint32_t
+    {
+        Frame = 1,          // one continuous data response, 06 12 LEN ... CS
+        ModuleStatus = 2,   // ModuleStatusSnapshot
+    };
+
+    struct SharedEntry
+    {
+        uint64_t sequence{ 0 };
+        SharedEntryKind kind{ SharedEntryKind::Frame };
+        uint32_t length{ 0 };
+        int64_t timestampNs{ 0 };
+        const uint8_t* payload{ nullptr };  // valid until the next Read
+    };
+
+    namespace detail
+    {
+        const uint32_t SHARED_RING_MAGIC = 0x4d425352; // "MBSR"
+        const uint32_t SHARED_RING_VERSION = 1;
+
+        struct SharedRingHeader
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t slotCount;     // power of two
+            uint32_t payloadSize;   // bytes of payload per slot
+            alignas(64) std::atomic<uint64_t> head;    // sequence of the next entry to write
+        };
+
+        struct SharedSlotHeader
+        {
+            std::atomic<uint64_t> stamp;    // 2 * sequence + 1 while written, 2 * sequence + 2 when complete
+            uint32_t kind;
+            uint32_t length;
+            int64_t timestampNs;
+        };
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring needs address free atomics");
+
+        inline size_t SlotStride(uint32_t payloadSize)
+        {
+            return (sizeof(SharedSlotHeader) + payloadSize + 63) & ~size_t(63);
+        }
+
+        inline size_t MappingSize(uint32_t slotCount, uint32_t payloadSize)
+        {
+            return sizeof(SharedRingHeader) + static_cast<size_t>(slotCount) * SlotStride(payloadSize);
+        }
+
+        // A named shared memory mapping.
+        class SharedMapping
+        {
+        public:
+            SharedMapping() = default;
+            SharedMapping(const SharedMapping&) = delete;
+            SharedMapping& operator=(const SharedMapping&) = delete;
+
+            ~SharedMapping()
+            {
+                Close();
+            }
+
+            bool Create(const std::string& name, size_t size)
+            {
+                Close();
+#if defined(_WIN32)
+                m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                    static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), name.c_str());
+                if (m_handle == nullptr)
+                {
+                    return false;
+                }
+                if (GetLastError() == ERROR_ALREADY_EXISTS)
+                {
+                    // another writer owns it
+                    CloseHandle(m_handle);
+                    m_handle = nullptr;
+                    return false;
+                }
+                m_data = MapViewOfFile(m_handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+                m_name = "/" + name;
+                // another writer owns it if it exists, or a crashed one left it in /dev/shm
+                int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+                if (fd < 0)
+                {
+                    return false;
+                }
+                m_owner = true;
+                if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+                {
+                    ::close(fd);
+                    return false;
+                }
+                m_data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (m_data == MAP_FAILED)
+                {
+                    m_data = nullptr;
+                }
+#endif
+                m_size = size;
+                return m_data != nullptr;
+            }
+
+            bool Open(const std::string& name)
+            {
+                Close();
+#if defined(_WIN32)
+                m_handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+                if (m_handle == nullptr)
+                {
+                    return false;
+                }
+                m_data = MapViewOfFile(m_handle, FILE_MAP_READ, 0, 0, 0);
+                MEMORY_BASIC_INFORMATION info;
+                if (m_data != nullptr && VirtualQuery(m_data, &info, sizeof(info)) != 0)
+                {
+                    m_size = info.RegionSize;
+                }
+#else
+                m_name = "/" + name;
+                int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+                if (fd < 0)
+                {
+                    return false;
+                }
+                struct stat st;
+                if (fstat(fd, &st) != 0 || st.st_size <= 0)
+                {
+                    ::close(fd);
+                    return false;
+                }
+                m_size = static_cast<size_t>(st.st_size);
+                m_data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (m_data == MAP_FAILED)
+                {
+                    m_data = nullptr;
+                }
+#endif
+                return m_data != nullptr;
+            }
+
+            void Close()
+            {
+#if defined(_WIN32)
+                if (m_data != nullptr)
+                {
+                    UnmapViewOfFile(m_data);
+                }
+                if (m_handle != nullptr)
+                {
+                    CloseHandle(m_handle);
+                }
+                m_handle = nullptr;
+#else
+                if (m_data != nullptr)
+                {
+                    munmap(m_data, m_size);
+                }
+                if (m_owner)
+                {
+                    shm_unlink(m_name.c_str());
+                }
+                m_owner = false;
+#endif
+                m_data = nullptr;
+                m_size = 0;
+            }
+
+            void* Data() const
+            {
+                return m_data;
+            }
+
+            size_t Size() const
+            {
+                return m_size;
+            }
+
+        private:
+            void* m_data{ nullptr };
+            size_t m_size{ 0 };
+#if defined(_WIN32)
+            HANDLE m_handle{ nullptr };
+#else
+            std::string m_name;
+            bool m_owner{ false };
+#endif
+        };
+    }
+
+    // The name of the ring of a port, e.g. MedibusPatientData_COM9.
+    inline std::string SharedRingName(const std::string& port)
+    {
+        std::string name = "MedibusPatientData_";
+        for (char c : port)
+        {
+            const bool plain = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+            name += plain ? c : '_';
+        }
+        return name;
+    }
+
+    // The single writer. Entries larger than the payload size are truncated.
+    class SharedRingWriter
+    {
+    public:
+        bool Create(const std::string& name, uint32_t slotCount = 1024, uint32_t payloadSize = 256)
+        {
+            uint32_t count = 2;
+            while (count < slotCount)
+            {
+                count <<= 1;
+            }
+            if (!m_mapping.Create(name, detail::MappingSize(count, payloadSize)))
+            {
+                return false;
+            }
+            m_header = new (m_mapping.Data()) detail::SharedRingHeader;
+            m_header->slotCount = count;
+            m_header->payloadSize = payloadSize;
+            m_header->version = detail::SHARED_RING_VERSION;
+            m_header->head.store(0, std::memory_order_relaxed);
+            m_slots = static_cast<uint8_t*>(m_mapping.Data()) + sizeof(detail::SharedRingHeader);
+            m_stride = detail::SlotStride(payloadSize);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                new (m_slots + i * m_stride) detail::SharedSlotHeader{};
+            }
+            // readers check the magic last
+            std::atomic_thread_fence(std::memory_order_release);
+            m_header->magic = detail::SHARED_RING_MAGIC;
+            return true;
+        }
+
+        bool IsOpen() const
+        {
+            return m_header != nullptr;
+        }
+
+        uint64_t Publish(SharedEntryKind kind, const void* payload, size_t length, int64_t timestampNs)
+        {
+            const uint64_t sequence = m_header->head.load(std::memory_order_relaxed);
+            uint8_t* slot = m_slots + (sequence & (m_header->slotCount - 1)) * m_stride;
+            auto* header = reinterpret_cast<detail::SharedSlotHeader*>(slot);
+
+            header->stamp.store(2 * sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            header->kind = static_cast<uint32_t>(kind);
+            header->length = static_cast<uint32_t>(std::min<size_t>(length, m_header->payloadSize));
+            header->timestampNs = timestampNs;
+            std::memcpy(slot + sizeof(detail::SharedSlotHeader), payload, header->length);
+            header->stamp.store(2 * sequence + 2, std::memory_order_release);
+            m_header->head.store(sequence + 1, std::memory_order_release);
+            return sequence;
+        }
+
+    private:
+        detail::SharedMapping m_mapping;
+        detail::SharedRingHeader* m_header{ nullptr };
+        uint8_t* m_slots{ nullptr };
+        size_t m_stride{ 0 };
+    };
+
+    // One reader, usually in another process. Starts at the newest entry.
+    class SharedRingReader
+    {
+    public:
+        bool Open(const std::string& name)
+        {
+            if (!m_mapping.Open(name) || m_mapping.Size() < sizeof(detail::SharedRingHeader))
+            {
+                return false;
+            }
+            m_header = static_cast<const detail::SharedRingHeader*>(m_mapping.Data());
+            if (m_header->magic != detail::SHARED_RING_MAGIC || m_header->version != detail::SHARED_RING_VERSION ||
+                m_mapping.Size() < detail::MappingSize(m_header->slotCount, m_header->payloadSize))
+            {
+                m_header = nullptr;
+                m_mapping.Close();
+                return false;
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            m_slots = static_cast<const uint8_t*>(m_mapping.Data()) + sizeof(detail::SharedRingHeader);
+            m_stride = detail::SlotStride(m_header->payloadSize);
+            m_buffer.resize(m_header->payloadSize);
+            m_next = m_header->head.load(std::memory_order_acquire);
+            return true;
+        }
+
+        // Copies the next entry. Returns false if the reader is up to date.
+        bool Read(SharedEntry& entry)
+        {
+            const uint32_t count = m_header->slotCount;
+            while (true)
+            {
+                const uint64_t head = m_header->head.load(std::memory_order_acquire);
+                if (m_next >= head)
+                {
+                    return false;
+                }
+                if (head - m_next > count)
+                {
+                    Skip(head - count);
+                }
+                const uint8_t* slot = m_slots + (m_next & (count - 1)) * m_stride;
+                const auto* header = reinterpret_cast<const detail::SharedSlotHeader*>(slot);
+                const uint64_t stamp = header->stamp.load(std::memory_order_acquire);
+                if (stamp != 2 * m_next + 2)
+                {
+                    // overwritten by the writer meanwhile
+                    Skip(m_next + 1);
+                    continue;
+                }
+                const SharedEntryKind kind = static_cast<SharedEntryKind>(header->kind);
+                const uint32_t length = std::min(header->length, m_header->payloadSize);
+                const int64_t timestampNs = header->timestampNs;
+                std::memcpy(m_buffer.data(), slot + sizeof(detail::SharedSlotHeader), length);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (header->stamp.load(std::memory_order_relaxed) != stamp)
+                {
+                    Skip(m_next + 1);
+                    continue;
+                }
+                entry.sequence = m_next++;
+                entry.kind = kind;
+                entry.length = length;
+                entry.timestampNs = timestampNs;
+                entry.payload = m_buffer.data();
+                return true;
+            }
+        }
+
+        // Entries overwritten before this reader got to them.
+        uint64_t Lost() const
+        {
+            return m_lost;
+        }
+
+    private:
+        void Skip(uint64_t next)
+        {
+            m_lost += next - m_next;
+            m_next = next;
+        }
+
+        detail::SharedMapping m_mapping;
+        const detail::SharedRingHeader* m_header{ nullptr };
+        const uint8_t* m_slots{ nullptr };
+        size_t m_stride{ 0 };
+        std::vector<uint8_t> m_buffer;
+        uint64_t m_next{ 0 };
+        uint64_t m_lost{ 0 };
+    };
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Single pass evaluation of module status bits.
+ *
+ * Every supervision condition is described by one StatusRule: the frame it
+ * lives in, the byte offset, a mask and the expected value after masking.
+ * The rules are compiled per frame number, so one continuous frame is
+ * checked against all of its rules in one pass with one AND and one
+ * compare per rule.
+ */
+namespace MedibusServer
+{
+    enum class SupervisionEvent : uint8_t
+    {
+        Occlusion = 0,          // FRAME_$12$0E, MS, Bit1
+        WatertrapCheck,         // FRAME_$12$0E, MS, Bit2
+        NoRespiration,          // FRAME_$12$0E, MS, Bit4
+        BreathPhaseData,        // FRAME_$12$0E, MS, Bit5
+        ComponentFail,          // FRAME_$12$0E, MS, Bit6
+        WatertrapDisconnected,  // FRAME_$12$0B, MSW, Bit5
+        WatertrapFull,          // FRAME_$12$0B, MSW, Bit6
+        WatertrapWarning,       // FRAME_$12$0B, MSW, Bit7
+        ZeroInProgressCO2,      // FRAME_$12$03, CO2_PS, Bit5
+        ZeroInProgressN2O,      // FRAME_$12$03, N2O_PS, Bit5
+        ZeroInProgressO2,       // FRAME_$12$04, O2_PS, Bit5
+        ZeroInProgressA1,       // FRAME_$12$10, A1_PS, Bit5
+        ZeroInProgressA2,       // FRAME_$12$11, A2_PS, Bit5
+        CO2NotAvailable,        // FRAME_$12$03, CO2_PS, parameter mode
+        N2ONotAvailable,        // FRAME_$12$03, N2O_PS, parameter mode
+        O2NotAvailable,         // FRAME_$12$04, O2_PS, parameter mode
+        A1NotAvailable,         // FRAME_$12$10, A1_PS, parameter mode
+        A2NotAvailable,         // FRAME_$12$11, A2_PS, parameter mode
+        Count
+    };
+
+    static_assert(static_cast<size_t>(SupervisionEvent::Count) <= 32, "supervision events must fit into one word");
+
+    constexpr uint32_t SupervisionBit(SupervisionEvent event)
+    {
+        return 1u << static_cast<uint32_t>(event);
+    }
+
+    constexpr uint32_t kZeroInProgressEvents =
+        SupervisionBit(SupervisionEvent::ZeroInProgressCO2) | SupervisionBit(SupervisionEvent::ZeroInProgressN2O) |
+        SupervisionBit(SupervisionEvent::ZeroInProgressO2) | SupervisionBit(SupervisionEvent::ZeroInProgressA1) |
+        SupervisionBit(SupervisionEvent::ZeroInProgressA2);
+
+    struct StatusRule
+    {
+        uint8_t frameId;        // rddata[13]
+        uint8_t offset;         // byte inside the response
+        uint8_t mask;
+        uint8_t expected;       // (rddata[offset] & mask) == expected fires the rule
+        SupervisionEvent event;
+        const char* message;    // shown when the condition becomes active
+    };
+
+    // The conditions the SuperviseModuleStatus, ZeroInProgress and ParameterMode
+    // states used to test one frame at a time.
+    inline const std::vector<StatusRule>& DefaultStatusRules()
+    {
+        static const std::vector<StatusRule> rules{
+            { 0x0e, 14, 0x02, 0x02, SupervisionEvent::Occlusion, "Occlusion detected." },
+            { 0x0e, 14, 0x04, 0x04, SupervisionEvent::WatertrapCheck, "Check watertrap." },
+            { 0x0e, 14, 0x10, 0x10, SupervisionEvent::NoRespiration, "No respiration / Apnea: no breathing cycles detectable." },
+            { 0x0e, 14, 0x20, 0x20, SupervisionEvent::BreathPhaseData, "Frame data contain breath phase related data which can be evaluated for e.g. alarm handling." },
+            { 0x0e, 14, 0x40, 0x40, SupervisionEvent::ComponentFail, "Display warning message, that a hardware failure is present." },
+            { 0x0b, 3, 0x20, 0x20, SupervisionEvent::WatertrapDisconnected, "Display warning message to check watertrap." },
+            { 0x0b, 3, 0x40, 0x40, SupervisionEvent::WatertrapFull, "Display warning message, that watertrap is full." },
+            { 0x0b, 3, 0x80, 0x80, SupervisionEvent::WatertrapWarning, "Display warning message to check watertrap level." },
+            { 0x03, 11, 0x20, 0x20, SupervisionEvent::ZeroInProgressCO2, "CO2 zero in progress." },
+            { 0x03, 12, 0x20, 0x20, SupervisionEvent::ZeroInProgressN2O, "N2O zero in progress." },
+            { 0x04, 11, 0x20, 0x20, SupervisionEvent::ZeroInProgressO2, "O2 zero in progress." },
+            { 0x10, 11, 0x20, 0x20, SupervisionEvent::ZeroInProgressA1, "Agent1 zero in progress." },
+            { 0x11, 12, 0x20, 0x20, SupervisionEvent::ZeroInProgressA2, "Agent2 zero in progress." },
+            { 0x03, 11, 0x03, 0x03, SupervisionEvent::CO2NotAvailable, "CO2_PS Parameter is not available." },
+            { 0x03, 12, 0x03, 0x03, SupervisionEvent::N2ONotAvailable, "N2O_PS Parameter is not available." },
+            { 0x04, 11, 0x03, 0x03, SupervisionEvent::O2NotAvailable, "O2_PS Parameter is not available." },
+            { 0x10, 12, 0x03, 0x03, SupervisionEvent::A1NotAvailable, "A1_PS Parameter is not available." },
+            { 0x11, 12, 0x03, 0x03, SupervisionEvent::A2NotAvailable, "A2_PS Parameter is not available." },
+        };
+        return rules;
+    }
+
+    class StatusRuleSet
+    {
+    public:
+        static constexpr size_t FRAMEID = 13;
+
+        explicit StatusRuleSet(const std::vector<StatusRule>& rules = DefaultStatusRules())
+        {
+            Compile(rules);
+        }
+
+        // Evaluates every rule of the frame's number. Returns the events which
+        // are active; 'evaluated' receives the events this frame can report.
+        uint32_t Evaluate(const uint8_t* rddata, size_t sz, uint32_t& evaluated) const
+        {
+            evaluated = 0;
+            if (sz <= FRAMEID || rddata[0] != 0x06 || rddata[1] != 0x12)
+            {
+                return 0;
+            }
+            const uint8_t frameId = rddata[FRAMEID];
+            uint32_t active = 0;
+            for (uint16_t i = m_begin[frameId]; i < m_begin[frameId + 1]; ++i)
+            {
+                const Op& op = m_ops[i];
+                if (op.offset < sz)
+                {
+                    active |= static_cast<uint32_t>((rddata[op.offset] & op.mask) == op.expected) << op.bit;
+                    evaluated |= 1u << op.bit;
+                }
+            }
+            return active;
+        }
+
+        const char* Message(SupervisionEvent event) const
+        {
+            return m_messages[static_cast<size_t>(event)];
+        }
+
+    private:
+        struct Op
+        {
+            uint8_t offset;
+            uint8_t mask;
+            uint8_t expected;
+            uint8_t bit;
+        };
+
+        void Compile(const std::vector<StatusRule>& rules)
+        {
+            m_messages.fill("");
+            // counting sort by frame number keeps the ops of one frame together
+            std::array<uint16_t, 257> counts{};
+            for (const auto& rule : rules)
+            {
+                ++counts[rule.frameId + 1];
+                m_messages[static_cast<size_t>(rule.event)] = rule.message;
+            }
+            for (size_t i = 1; i < counts.size(); ++i)
+            {
+                counts[i] += counts[i - 1];
+            }
+            m_begin = counts;
+            m_ops.resize(rules.size());
+            for (const auto& rule : rules)
+            {
+                m_ops[counts[rule.frameId]++] = Op{ rule.offset, rule.mask, rule.expected, static_cast<uint8_t>(rule.event) };
+            }
+        }
+
+        std::vector<Op> m_ops;
+        std::array<uint16_t, 257> m_begin{};
+        std::array<const char*, static_cast<size_t>(SupervisionEvent::Count)> m_messages{};
+    };
+}
@@ -0,0 +1,549 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FileMapping.h"
+#include "PatientDataStore.h"
+
+/**
+ * @brief Compressed long-term archive of decoded patient data.
+ *
+ * The writer collects the samples of every channel and writes them in
+ * blocks of up to BLOCKSAMPLES samples, one channel per block and two
+ * columns per block:
+ *  - timestamps in units of timeUnitNs (1 ms by default) as delta of delta,
+ *    so a steady sample rate costs one byte
+ *  - values as delta to the previous value, left out if all are equal
+ * both zigzag and varint coded. Every block starts with a header holding
+ * channel, count, time range and min/max, so range queries skip blocks by
+ * time and trend queries use min/max instead of decoding. On Close() the
+ * headers are repeated in an index at the end of the file. An archive
+ * without index, because the writer did not close it, is read by walking
+ * the block headers.
+ *
+ * The reader maps the file and decodes straight from the mapping. Layout is
+ * little endian, as on every platform the server runs on:
+ *
+ *   TrendFileHeader | block... | TrendIndexEntry... | TrendFooter
+ *   block: TrendBlockHeader | time column | value column
+ */
+namespace MedibusServer
+{
+    namespace detail
+    {
+        const uint32_t TREND_FILE_MAGIC = 0x4154424d;   // "MBTA"
+        const uint32_t TREND_BLOCK_MAGIC = 0x4254424d;  // "MBTB"
+        const uint32_t TREND_FOOTER_MAGIC = 0x4654424d; // "MBTF"
+        const uint32_t TREND_VERSION = 1;
+
+        struct TrendFileHeader
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t blockSamples;
+            uint32_t timeUnitNs;        // timestamps are multiples of it
+            int64_t wallClockOffsetNs;  // system clock minus steady clock when the archive was created
+        };
+
+        struct TrendBlockHeader
+        {
+            uint32_t magic;
+            uint8_t channel;
+            uint8_t reserved[3];
+            uint32_t count;
+            uint32_t timeBytes;
+            uint32_t valueBytes;
+            int32_t min;
+            int32_t max;
+            int32_t firstValue;
+            int64_t firstNs;
+            int64_t lastNs;
+        };
+
+        struct TrendIndexEntry
+        {
+            TrendBlockHeader block;
+            uint64_t offset;            // of the block header
+        };
+
+        struct TrendFooter
+        {
+            uint64_t indexOffset;
+            uint32_t blockCount;
+            uint32_t magic;
+        };
+
+        static_assert(sizeof(TrendFileHeader) == 24, "file layout");
+        static_assert(sizeof(TrendBlockHeader) == 48, "file layout");
+        static_assert(sizeof(TrendIndexEntry) == 56, "file layout");
+        static_assert(sizeof(TrendFooter) == 16, "file layout");
+
+        inline uint64_t ZigZag(int64_t value)
+        {
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+
+        inline int64_t UnZigZag(uint64_t value)
+        {
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        inline uint8_t* PutVarint(uint8_t* out, uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                *out++ = static_cast<uint8_t>(value) | 0x80;
+                value >>= 7;
+            }
+            *out++ = static_cast<uint8_t>(value);
+            return out;
+        }
+
+        // The block was checked to end within the file, a varint running
+        // past its column only yields garbage values.
+        inline uint64_t GetVarint(const uint8_t*& in)
+        {
+            uint64_t value = *in++;
+            if (value < 0x80)
+            {
+                return value;
+            }
+            value &= 0x7f;
+            for (unsigned shift = 7; shift < 64; shift += 7)
+            {
+                const uint64_t byte = *in++;
+                value |= (byte & 0x7f) << shift;
+                if (byte < 0x80)
+                {
+                    break;
+                }
+            }
+            return value;
+        }
+    }
+
+    // Appends samples of all channels, one thread only. Timestamps of one
+    // channel must not decrease.
+    class TrendArchiveWriter
+    {
+    public:
+        static constexpr uint32_t BLOCKSAMPLES = 1024;
+        static constexpr uint32_t DEFAULTTIMEUNITNS = 1000000;
+
+        TrendArchiveWriter() = default;
+        TrendArchiveWriter(const TrendArchiveWriter&) = delete;
+        TrendArchiveWriter& operator=(const TrendArchiveWriter&) = delete;
+
+        ~TrendArchiveWriter()
+        {
+            Close();
+        }
+
+        // Creates the file, an existing archive is replaced. Timestamps are
+        // rounded down to multiples of timeUnitNs.
+        bool Open(const std::string& path, uint32_t timeUnitNs = DEFAULTTIMEUNITNS)
+        {
+            Close();
+            m_file.open(path, std::ios::binary | std::ios::trunc);
+            if (!m_file)
+            {
+                return false;
+            }
+            m_pending.reset(new Pending[kPatientChannelCount]);
+            m_encoded.resize(sizeof(detail::TrendBlockHeader) + BLOCKSAMPLES * (10 + 5));
+            m_index.clear();
+            detail::TrendFileHeader header{};
+            header.magic = detail::TREND_FILE_MAGIC;
+            header.version = detail::TREND_VERSION;
+            header.blockSamples = BLOCKSAMPLES;
+            header.timeUnitNs = m_timeUnitNs = std::max<uint32_t>(1, timeUnitNs);
+            header.wallClockOffsetNs =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - PatientDataNow();
+            m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            m_offset = sizeof(header);
+            return static_cast<bool>(m_file);
+        }
+
+        bool IsOpen() const
+        {
+            return m_file.is_open();
+        }
+
+        void Append(PatientChannel channel, int64_t timestampNs, int32_t value)
+        {
+            Pending& pending = m_pending[static_cast<size_t>(channel)];
+            pending.times[pending.count] = timestampNs - timestampNs % m_timeUnitNs;
+            pending.values[pending.count] = value;
+            if (++pending.count == BLOCKSAMPLES)
+            {
+                WriteBlock(channel, pending);
+            }
+        }
+
+        // Writes the partly filled blocks, which bounds what a crash loses.
+        void Flush()
+        {
+            if (!IsOpen())
+            {
+                return;
+            }
+            for (size_t i = 0; i < kPatientChannelCount; ++i)
+            {
+                if (m_pending[i].count != 0)
+                {
+                    WriteBlock(static_cast<PatientChannel>(i), m_pending[i]);
+                }
+            }
+            m_file.flush();
+        }
+
+        // Flushes and writes the index.
+        void Close()
+        {
+            if (!IsOpen())
+            {
+                return;
+            }
+            Flush();
+            // the reader uses the index in place
+            static const char padding[alignof(detail::TrendIndexEntry)] = {};
+            const size_t pad = (alignof(detail::TrendIndexEntry) - m_offset % alignof(detail::TrendIndexEntry)) % alignof(detail::TrendIndexEntry);
+            m_file.write(padding, pad);
+            detail::TrendFooter footer{};
+            footer.indexOffset = m_offset + pad;
+            footer.blockCount = static_cast<uint32_t>(m_index.size());
+            footer.magic = detail::TREND_FOOTER_MAGIC;
+            if (!m_index.empty())
+            {
+                m_file.write(reinterpret_cast<const char*>(m_index.data()), m_index.size() * sizeof(detail::TrendIndexEntry));
+            }
+            m_file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+            m_file.close();
+        }
+
+        // bytes of blocks written so far
+        uint64_t BytesWritten() const
+        {
+            return m_offset;
+        }
+
+        uint64_t Samples() const
+        {
+            return m_samples;
+        }
+
+    private:
+        struct Pending
+        {
+            std::array<int64_t, BLOCKSAMPLES> times;
+            std::array<int32_t, BLOCKSAMPLES> values;
+            uint32_t count{ 0 };
+        };
+
+        void WriteBlock(PatientChannel channel, Pending& pending)
+        {
+            detail::TrendBlockHeader header{};
+            header.magic = detail::TREND_BLOCK_MAGIC;
+            header.channel = static_cast<uint8_t>(channel);
+            header.count = pending.count;
+            header.firstNs = pending.times[0];
+            header.lastNs = pending.times[pending.count - 1];
+            header.firstValue = pending.values[0];
+            header.min = header.max = pending.values[0];
+
+            uint8_t* const times = m_encoded.data() + sizeof(header);
+            uint8_t* out = times;
+            int64_t previousDelta = 0;
+            for (uint32_t i = 1; i < pending.count; ++i)
+            {
+                const int64_t delta = (pending.times[i] - pending.times[i - 1]) / m_timeUnitNs;
+                out = detail::PutVarint(out, detail::ZigZag(delta - previousDelta));
+                previousDelta = delta;
+            }
+            header.timeBytes = static_cast<uint32_t>(out - times);
+            uint8_t* const values = out;
+            for (uint32_t i = 1; i < pending.count; ++i)
+            {
+                const int32_t value = pending.values[i];
+                out = detail::PutVarint(out, detail::ZigZag(static_cast<int64_t>(value) - pending.values[i - 1]));
+                header.min = std::min(header.min, value);
+                header.max = std::max(header.max, value);
+            }
+            if (header.min == header.max)
+            {
+                // status channels rarely change
+                out = values;
+            }
+            header.valueBytes = static_cast<uint32_t>(out - values);
+            std::memcpy(m_encoded.data(), &header, sizeof(header));
+
+            const size_t size = out - m_encoded.data();
+            m_file.write(reinterpret_cast<const char*>(m_encoded.data()), size);
+            m_index.push_back(detail::TrendIndexEntry{ header, m_offset });
+            m_offset += size;
+            m_samples += pending.count;
+            pending.count = 0;
+        }
+
+        std::ofstream m_file;
+        std::unique_ptr<Pending[]> m_pending;
+        std::vector<uint8_t> m_encoded;
+        std::vector<detail::TrendIndexEntry> m_index;
+        uint64_t m_offset{ 0 };
+        uint64_t m_samples{ 0 };
+        uint32_t m_timeUnitNs{ DEFAULTTIMEUNITNS };
+    };
+
+    class TrendArchiveReader
+    {
+    public:
+        bool Open(const std::string& path)
+        {
+            m_recovered.clear();
+            for (auto& blocks : m_blocks)
+            {
+                blocks.clear();
+            }
+            if (!m_mapping.Open(path) || m_mapping.Size() < sizeof(detail::TrendFileHeader))
+            {
+                m_mapping.Close();
+                return false;
+            }
+            std::memcpy(&m_header, m_mapping.Data(), sizeof(m_header));
+            if (m_header.magic != detail::TREND_FILE_MAGIC || m_header.version != detail::TREND_VERSION || m_header.timeUnitNs == 0)
+            {
+                m_mapping.Close();
+                return false;
+            }
+            const detail::TrendIndexEntry* index = nullptr;
+            size_t count = 0;
+            if (!ReadIndex(index, count))
+            {
+                Recover();
+                index = m_recovered.data();
+                count = m_recovered.size();
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (index[i].block.channel < kPatientChannelCount)
+                {
+                    m_blocks[index[i].block.channel].push_back(&index[i]);
+                }
+            }
+            return true;
+        }
+
+        // The archive had no index and was read block by block.
+        bool Recovered() const
+        {
+            return !m_recovered.empty();
+        }
+
+        // Add to a timestamp to get nanoseconds since the epoch of the system clock.
+        int64_t WallClockOffsetNs() const
+        {
+            return m_header.wallClockOffsetNs;
+        }
+
+        size_t Blocks(PatientChannel channel) const
+        {
+            return m_blocks[static_cast<size_t>(channel)].size();
+        }
+
+        // Calls visit(timestampNs, value) for every sample in [fromNs, toNs]
+        // in time order and returns their number.
+        template <typename Visit>
+        size_t Scan(PatientChannel channel, int64_t fromNs, int64_t toNs, Visit&& visit) const
+        {
+            const auto& blocks = m_blocks[static_cast<size_t>(channel)];
+            size_t count = 0;
+            for (size_t i = FirstBlock(blocks, fromNs); i < blocks.size() && blocks[i]->block.firstNs <= toNs; ++i)
+            {
+                count += Decode(*blocks[i], fromNs, toNs, visit);
+            }
+            return count;
+        }
+
+        bool MinMax(PatientChannel channel, int64_t fromNs, int64_t toNs, int32_t& min, int32_t& max) const
+        {
+            min = std::numeric_limits<int32_t>::max();
+            max = std::numeric_limits<int32_t>::min();
+            bool found = false;
+            const auto& blocks = m_blocks[static_cast<size_t>(channel)];
+            for (size_t i = FirstBlock(blocks, fromNs); i < blocks.size() && blocks[i]->block.firstNs <= toNs; ++i)
+            {
+                const detail::TrendBlockHeader& block = blocks[i]->block;
+                if (block.firstNs >= fromNs && block.lastNs <= toNs)
+                {
+                    min = std::min(min, block.min);
+                    max = std::max(max, block.max);
+                    found = true;
+                    continue;
+                }
+                Decode(*blocks[i], fromNs, toNs, [&](int64_t, int32_t value)
+                {
+                    min = std::min(min, value);
+                    max = std::max(max, value);
+                    found = true;
+                });
+            }
+            return found;
+        }
+
+        // Same buckets as PatientChannelRing::Decimate. Blocks which fall
+        // into one bucket are taken from their min/max without decoding.
+        void Decimate(PatientChannel channel, int64_t fromNs, int64_t toNs, size_t buckets, std::vector<PatientTrendPoint>& out) const
+        {
+            out.clear();
+            if (buckets == 0 || toNs < fromNs)
+            {
+                return;
+            }
+            const int64_t width = std::max<int64_t>(1, (toNs - fromNs + 1 + static_cast<int64_t>(buckets) - 1) / static_cast<int64_t>(buckets));
+            int64_t bucketEndNs = std::numeric_limits<int64_t>::min();
+            // samples come in time order, only a new bucket needs a division
+            auto add = [&](int64_t timestampNs, int32_t min, int32_t max)
+            {
+                if (timestampNs >= bucketEndNs)
+                {
+                    PatientTrendPoint point;
+                    point.timestampNs = fromNs + (timestampNs - fromNs) / width * width;
+                    point.min = min;
+                    point.max = max;
+                    out.push_back(point);
+                    bucketEndNs = point.timestampNs + width;
+                }
+                else
+                {
+                    out.back().min = std::min(out.back().min, min);
+                    out.back().max = std::max(out.back().max, max);
+                }
+            };
+            const auto& blocks = m_blocks[static_cast<size_t>(channel)];
+            for (size_t i = FirstBlock(blocks, fromNs); i < blocks.size() && blocks[i]->block.firstNs <= toNs; ++i)
+            {
+                const detail::TrendBlockHeader& block = blocks[i]->block;
+                if (block.firstNs >= fromNs && block.lastNs <= toNs &&
+                    (block.firstNs - fromNs) / width == (block.lastNs - fromNs) / width)
+                {
+                    add(block.firstNs, block.min, block.max);
+                    continue;
+                }
+                Decode(*blocks[i], fromNs, toNs, [&](int64_t timestampNs, int32_t value)
+                {
+                    add(timestampNs, value, value);
+                });
+            }
+        }
+
+    private:
+        // Uses the index at the end of the file if it is complete.
+        bool ReadIndex(const detail::TrendIndexEntry*& index, size_t& count) const
+        {
+            const size_t size = m_mapping.Size();
+            if (size < sizeof(detail::TrendFileHeader) + sizeof(detail::TrendFooter))
+            {
+                return false;
+            }
+            detail::TrendFooter footer;
+            std::memcpy(&footer, m_mapping.Data() + size - sizeof(footer), sizeof(footer));
+            if (footer.magic != detail::TREND_FOOTER_MAGIC ||
+                footer.indexOffset + static_cast<uint64_t>(footer.blockCount) * sizeof(detail::TrendIndexEntry) + sizeof(footer) != size ||
+                footer.indexOffset % alignof(detail::TrendIndexEntry) != 0)
+            {
+                return false;
+            }
+            index = reinterpret_cast<const detail::TrendIndexEntry*>(m_mapping.Data() + footer.indexOffset);
+            count = footer.blockCount;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (!BlockFits(index[i].block, index[i].offset, footer.indexOffset))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Walks the block headers up to the first incomplete block.
+        void Recover()
+        {
+            uint64_t offset = sizeof(detail::TrendFileHeader);
+            detail::TrendIndexEntry entry;
+            while (offset + sizeof(detail::TrendBlockHeader) <= m_mapping.Size())
+            {
+                std::memcpy(&entry.block, m_mapping.Data() + offset, sizeof(entry.block));
+                if (entry.block.magic != detail::TREND_BLOCK_MAGIC || !BlockFits(entry.block, offset, m_mapping.Size()))
+                {
+                    break;
+                }
+                entry.offset = offset;
+                m_recovered.push_back(entry);
+                offset += sizeof(entry.block) + entry.block.timeBytes + entry.block.valueBytes;
+            }
+        }
+
+        bool BlockFits(const detail::TrendBlockHeader& block, uint64_t offset, uint64_t end) const
+        {
+            return block.count != 0 && block.count <= m_header.blockSamples &&
+                offset + sizeof(block) + block.timeBytes + block.valueBytes <= end;
+        }
+
+        // first block which may hold samples at or after fromNs
+        static size_t FirstBlock(const std::vector<const detail::TrendIndexEntry*>& blocks, int64_t fromNs)
+        {
+            return std::lower_bound(blocks.begin(), blocks.end(), fromNs,
+                [](const detail::TrendIndexEntry* entry, int64_t t) { return entry->block.lastNs < t; }) - blocks.begin();
+        }
+
+        template <typename Visit>
+        size_t Decode(const detail::TrendIndexEntry& entry, int64_t fromNs, int64_t toNs, Visit&& visit) const
+        {
+            const detail::TrendBlockHeader& block = entry.block;
+            const uint8_t* times = m_mapping.Data() + entry.offset + sizeof(block);
+            const uint8_t* values = times + block.timeBytes;
+            const bool constant = block.valueBytes == 0;
+            const int64_t unit = m_header.timeUnitNs;
+            int64_t timestampNs = block.firstNs;
+            int64_t delta = 0;
+            int64_t value = block.firstValue;
+            size_t count = 0;
+            for (uint32_t i = 0; ; )
+            {
+                if (timestampNs > toNs)
+                {
+                    break;
+                }
+                if (timestampNs >= fromNs)
+                {
+                    visit(timestampNs, static_cast<int32_t>(value));
+                    ++count;
+                }
+                if (++i == block.count)
+                {
+                    break;
+                }
+                delta += detail::UnZigZag(detail::GetVarint(times)) * unit;
+                timestampNs += delta;
+                if (!constant)
+                {
+                    value += detail::UnZigZag(detail::GetVarint(values));
+                }
+            }
+            return count;
+        }
+
+        detail::FileMapping m_mapping;
+        detail::TrendFileHeader m_header{};
+        std::vector<detail::TrendIndexEntry> m_recovered;
+        std::array<std::vector<const detail::TrendIndexEntry*>, kPatientChannelCount> m_blocks;
+    };
+}
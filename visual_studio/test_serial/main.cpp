@@ -1,14 +1,34 @@
+#include <cmath>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <list>
-#include <map>
+#include <memory>
 #include <mutex>
+#include <random>
 #include <semaphore>
 #include <stack>
 #include <thread>
+#include <tuple>
 #include <typeinfo>
 
+#include "CaptureDecoder.h"
+#include "CommandScheduler.h"
+#include "ContinuousSubscription.h"
+#include "DeviceIdentityCache.h"
+#include "LivenessWatchdog.h"
 #include "LogProvider.h"
+#include "Mailbox.h"
+#include "ModuleDiscovery.h"
+#include "PatientDataStore.h"
+#include "ResponseLatency.h"
+#include "SampleMerger.h"
+#include "SharedRing.h"
+#include "ModuleStatus.h"
+#include "StatusRules.h"
+#include "TrendArchive.h"
+#include "serial/frame_reader.h"
+#include "serial/realtime.h"
 #include "serial/serial.h"
 /**
  * The base State class declares methods that all Concrete State should
@@ -170,7 +190,7 @@ std::string GetErrorMessage(uint8_t errCode)
 class IObserver {
 public:
     virtual ~IObserver() {};
-    virtual void Update(std::vector<uint8_t> rddata, size_t sz) = 0;
+    virtual void Update(const std::vector<uint8_t>& rddata, size_t sz) = 0;
 };
 
 class ISubject {
@@ -180,11 +200,12 @@ public:
     virtual void Detach(IObserver* observer) = 0;
     virtual void AttachNeedResponse(IObserver* observer) = 0;
     virtual void DetachNeedResponse() = 0;
-    virtual void NotifyOne(std::vector<uint8_t> rddata, size_t sz) = 0;
-    virtual void Notify(std::vector<uint8_t> rddata, size_t sz) = 0;
+    virtual void NotifyOne(const std::vector<uint8_t>& rddata, size_t sz) = 0;
+    virtual void Notify(const std::vector<uint8_t>& rddata, size_t sz) = 0;
 };
 
 class Context;
+class StatePool;
 
 class State :public IObserver {
     /**
@@ -228,6 +249,11 @@ public:
     {
         return m_bIsDataReceived;
     }
+    // decides how soon the command is sent when several are queued
+    virtual MedibusServer::CommandClass GetPriority()
+    {
+        return MedibusServer::CommandClass::Control;
+    }
 
     virtual void SetDataReceived(bool bReceived)
     {
@@ -257,22 +283,58 @@ public:
 };
 
 
-class Context : public ISubject{
+// Everything the Context reacts to arrives as one of these messages and is
+// handled on the thread running Context::Run.
+struct ContextMessage
+{
+    enum class Type : uint8_t
+    {
+        ReadStatus,     // one read of the serial port finished, 'received' tells if it returned data
+        Frame,          // one complete response in data[0..length), its bytes arrived from firstByteNs to lastByteNs
+        Timer,          // let the current state send its command now
+        Call,           // API request, call(context, arg) runs on the actor thread
+        Disconnected,   // the port failed at timestampNs, the response thread reconnects
+        Reconnected,    // the port is open again, timestampNs is the time of the failure
+    };
+    static constexpr size_t MAXFRAME = 3 + 255 + 1;
+
+    Type type{ Type::Timer };
+    bool received{ false };
+    uint16_t length{ 0 };
+    int64_t timestampNs{ 0 };
+    int64_t firstByteNs{ 0 };
+    int64_t lastByteNs{ 0 };
+    uint8_t data[MAXFRAME];
+    void (*call)(Context&, void*){ nullptr };
+    void* arg{ nullptr };
+};
 
-public:
-    Context(State* state) : state_(nullptr) {
-        this->TransitionTo(state);
-    }
-    Context(uint16_t cmdId, std::shared_ptr<State> state) : state_(nullptr), m_state(state) {
-        this->TransitionTo(cmdId, state);
+// MEDIBUS responses, 06|15 CMD LEN data CS. Bytes in front of ACK/NAK are
+// skipped, so the reader resynchronizes after line noise.
+struct ResponseFramer
+{
+    serial::LengthFieldFramer length{ 2, 1, 4, false, ContextMessage::MAXFRAME };
 
+    serial::FrameMatch find(uint8_t* data, size_t size)
+    {
+        if (data[0] != 0x06 && data[0] != 0x15)
+        {
+            return serial::FrameMatch(1, data, 0);
+        }
+        return length.find(data, size);
     }
+};
 
+/**
+ * The Context is a single threaded actor: the response thread and other
+ * threads only post messages into its mailbox, states, transitions and
+ * observers are only touched by the thread running Run().
+ */
+class Context : public ISubject{
 
-    ~Context() {
-        t1.join();
-        delete state_;
-    }
+public:
+    Context();
+    ~Context();
 
     void Attach(IObserver* observer) override {
       
@@ -303,7 +365,7 @@ public:
         }
     }
 
-    void NotifyOne(std::vector<uint8_t> rddata, size_t sz) override {
+    void NotifyOne(const std::vector<uint8_t>& rddata, size_t sz) override {
         if (!m_StackResponse.empty())
         {
             m_StackResponse.top()->Update(rddata, sz);
@@ -311,7 +373,7 @@ public:
         
     }
 
-    void Notify(std::vector<uint8_t> rddata, size_t sz) override {
+    void Notify(const std::vector<uint8_t>& rddata, size_t sz) override {
         std::list<IObserver*>::iterator iterator = m_ListObservers.begin();
         while (iterator != m_ListObservers.end()) {
             if ((*iterator) != nullptr)
@@ -323,39 +385,44 @@ public:
         }
     }
 
-   /* void CheckModuleConnected(std::chrono::milliseconds lastTime)
-    {
-        auto t2 = std::thread(&Context::HandleModuleConnected, this, lastTime);
-        t2.detach();
-
-    }*/
-
     void Init()
     {
+        // read once, Resync works on the entries kept in memory
+        m_identityCache.Load();
+        ResetIdentity();
+        // local consumers follow frames and status through shared memory, see --follow
+        const std::string ringName = MedibusServer::SharedRingName(m_serial.getPort());
+        if (!m_sharedRing.Create(ringName))
+        {
+            std::stringstream msg;
+            msg << "Cannot create shared memory " << ringName
+                << " (another server on this port, or left by a crashed one), measurements are not published.\n";
+            std::cout << msg.str();
+            MedibusServer::LogProvider::Instance().LogFile(msg.str());
+        }
         t1 = std::thread(&Context::HandleResponseThread, this, 0);
 
     }
 
+    // Commands are queued by priority and written by the actor between
+    // frames, see DispatchCommand. Both return 0 if the queue is full.
+    // The state counts as sent once the read after the write returns data.
+    // Until that read is reported the state gets no timer calls.
     size_t SendCmdSync(State* state)
     {
-        size_t bytes_wrote = m_serial.write(state->GetCommand());
-        std::unique_lock<std::mutex> lock(mutex_condition);
-        condition.wait(lock);
-        if (this->m_state->IsDataReceived())
-        {
-            this->m_state->SetAlreadySent(true);
-        }
-        else
-        {
-            this->m_state->SetAlreadySent(false);
-        }
-        return bytes_wrote;
+        return Queue(state, true);
     }
 
     size_t SendCmd(State* state)
     {
-        size_t bytes_wrote = m_serial.write(state->GetCommand());
-        return bytes_wrote;
+        return Queue(state, false);
+    }
+
+    // An answer to a written command is still missing. The liveness watchdog
+    // resyncs if it does not come, states need not resend on their own.
+    bool IsAwaitingResponse() const
+    {
+        return m_watchdog.Awaiting();
     }
 
     size_t ReadRespond(State* state, std::vector<uint8_t>& rddata)
@@ -372,300 +439,911 @@ public:
 
     void SetAutoZeroCondition(bool bSet)
     {
-        m_bAutoZeroCondition = bSet;
+        m_moduleStatus.Modify([&](MedibusServer::ModuleStatusSnapshot& status) { status.autoZeroCondition = bSet; });
     }
 
     bool GetAutoZeroCondition()
     {
-        return m_bAutoZeroCondition;
+        return m_moduleStatus.Load().autoZeroCondition;
     }
 
     void SetPneumaticsEnabled(bool bAvailable)
     {
-        m_bPneumaticsEnabled = bAvailable;
+        m_moduleStatus.Modify([&](MedibusServer::ModuleStatusSnapshot& status) { status.pneumaticsEnabled = bAvailable; });
     }
 
     bool GetPneumaticsEnabled()
     {
-        return m_bPneumaticsEnabled;
+        return m_moduleStatus.Load().pneumaticsEnabled;
     }
 
     void SetPAIAvailable(bool bAvailable)
     {
-        m_bPAIAvailable = bAvailable;
+        m_moduleStatus.Modify([&](MedibusServer::ModuleStatusSnapshot& status) { status.paiAvailable = bAvailable; });
     }
 
     bool GetPAIAvailable()
     {
-        return m_bPAIAvailable;
+        return m_moduleStatus.Load().paiAvailable;
     }
 
     void SetNeedsExternalData(bool bNeed)
     {
-        m_bNeedsExternalData = bNeed;
+        m_moduleStatus.Modify([&](MedibusServer::ModuleStatusSnapshot& status) { status.needsExternalData = bNeed; });
     }
 
     bool GetNeedsExternalData()
     {
-        return m_bNeedsExternalData;
+        return m_moduleStatus.Load().needsExternalData;
     }
 
     void SetNeedsExternalDataValue(uint8_t hsp)
     {
-        m_bHSP = hsp;
+        m_moduleStatus.Modify([&](MedibusServer::ModuleStatusSnapshot& status) { status.hsp = hsp; });
     }
 
     uint8_t GetNeedsExternalDataValue()
     {
-        return m_bHSP;
+        return m_moduleStatus.Load().hsp;
+    }
+
+    // CMD_$2C feature byte: pneumatics and zero control
+    void ApplyModuleFeatures(uint8_t features)
+    {
+        // bit1, bit2: pneumatic component available
+        SetPneumaticsEnabled((features & 0x02) == 0x02 && (features & 0x04) == 0x04);
+        // bit0: ZERO_CTRL - Zero Control
+        SetAutoZeroCondition((features & 0x01) == 0x00);
     }
 
-    void TransitionTo(State* state) {
-        std::lock_guard<std::mutex> lock(m);
-        //std::cout << "Context: Transition to " << typeid(*state).name() << ".\n";
-        if (this->state_ != nullptr)
-            delete this->state_;
-        this->state_ = state;
-        this->state_->set_context(this);
+    // A cached identity exists for this port, only the serial number needs to be queried.
+    bool HasCachedIdentity() const
+    {
+        return m_cachedIdentity != nullptr;
     }
 
-    void TransitionTo(std::shared_ptr<State> state) {
-        std::lock_guard<std::mutex> lock(m);
-        //std::cout << "Context: Transition to " << typeid(state).name() << ".\n";
+    // The module answered with the cached serial number, the rest of the identity is reused.
+    bool IsIdentityConfirmed() const
+    {
+        return m_identityConfirmed;
+    }
 
-        this->m_state = state;
-        this->m_state->set_context(this);
+    const MedibusServer::DeviceIdentity& GetIdentity() const
+    {
+        return m_identity;
     }
-   
-    void TransitionTo(uint32_t cmdId, std::shared_ptr<State> state ) {
-        std::lock_guard<std::mutex> lock(m);
-        // first Detach the latest state, which saved in  this->m_state
-        // ignore the flag, because if it doesn't exist in the list, nothing will happen
-        if (this->m_state && this->m_state->IsSingleCommand())
+
+    // Records one CMD_$0A answer (data in rddata[11..20], sub id in rddata[21]).
+    // Returns false if it was the serial number and it does not match the cache.
+    bool RecordIdentity(const std::vector<uint8_t>& rddata)
+    {
+        const uint8_t sub = rddata[21];
+        if (sub >= MedibusServer::DeviceIdentity::FIELDS)
         {
-            DetachNeedResponse();
+            return true;
         }
-        // continuous commands don't need call detach, always attach until application exit.
-        std::cout << "Context: Transition to " << typeid(state).name() << ".\n";
-        auto fnd = m_mapStates.find(cmdId);
-        if (fnd == m_mapStates.end())
+        const std::string value(rddata.begin() + 11, rddata.begin() + 11 + MedibusServer::DeviceIdentity::FIELDLENGTH);
+        m_identity.fields[sub] = value;
+        if (sub != static_cast<uint8_t>(MedibusServer::IdentityField::SerialNumber) || m_cachedIdentity == nullptr)
         {
-            m_mapStates.emplace(std::make_pair(cmdId, state));
-            this->m_state = state;
-            // Attach the state according the flag
-            if (this->m_state && this->m_state->IsSingleCommand())
-            {
-                AttachNeedResponse(this->m_state.get());
-            }
-            if (this->m_state && this->m_state->IsContinuousCommand())
-            {
-                Attach(this->m_state.get());
-            }
+            return true;
+        }
+
+        std::stringstream msg;
+        const bool match = m_cachedIdentity->Field(MedibusServer::IdentityField::SerialNumber) == value;
+        if (match)
+        {
+            const std::string hardwareId = m_identity.hardwareId;
+            m_identity = *m_cachedIdentity;
+            m_identity.hardwareId = hardwareId;
+            m_identityConfirmed = true;
+            msg << "Device identity of " << m_identity.port << " taken from cache.\n";
         }
         else
         {
-            this->m_state = fnd->second;
-            if (this->m_state && this->m_state->IsSingleCommand() && !this->m_state->IsAlreadySent())
-            {
-                AttachNeedResponse(this->m_state.get());
-            }
-            
+            m_cachedIdentity = nullptr;
+            m_identityCache.Invalidate(m_identity.port);
+            m_identityCache.Save();
+            msg << "Serial number on " << m_identity.port << " changed, device identity cache invalidated.\n";
+        }
+        std::cout << msg.str();
+        MedibusServer::LogProvider::Instance().LogFile(msg.str());
+        return match;
+    }
+
+    // Completes the identity with the CMD_$2C answer and writes the cache.
+    void RecordModuleFeatures(bool known, uint8_t features)
+    {
+        m_identity.featuresKnown = known;
+        m_identity.features = features;
+        if (m_identity.Complete())
+        {
+            m_cachedIdentity = nullptr;
+            m_identityCache.Store(m_identity);
+            m_identityCache.Save();
+        }
+    }
+
+    // decoded continuous data, filled by the actor thread
+    const MedibusServer::PatientDataStore& GetPatientData() const
+    {
+        return m_patientData;
+    }
+
+    // supervision conditions latched from the last frame of each number,
+    // filled by the actor thread
+    bool IsSupervisionActive(MedibusServer::SupervisionEvent event) const
+    {
+        return (GetSupervision() & MedibusServer::SupervisionBit(event)) != 0;
+    }
+
+    uint32_t GetSupervision() const
+    {
+        return m_moduleStatus.Load().supervision;
+    }
+
+    // events whose frame has been received at least once
+    uint32_t GetSupervisionEvaluated() const
+    {
+        return m_moduleStatus.Load().supervisionEvaluated;
+    }
+
+    // all module status fields from the same update, without taking any lock;
+    // safe to call at high rate from UI or export threads
+    MedibusServer::ModuleStatusSnapshot GetModuleStatus() const
+    {
+        return m_moduleStatus.Load();
+    }
+
+    // Switches to the preallocated instance of T, no allocation takes place.
+    template <typename T>
+    void TransitionTo();
+
+    // Feeds the continuous data into a merger shared with other modules'
+    // contexts as the given source. Call before Init().
+    void SetSampleMerger(MedibusServer::SampleMerger<>* merger, size_t source)
+    {
+        m_merger = merger;
+        m_mergeSource = source;
+    }
+
+    // Keeps the continuous data in a compressed trend archive, see
+    // MedibusServer::TrendArchiveWriter. Call before Init().
+    bool OpenArchive(const std::string& path)
+    {
+        if (!m_archive.Open(path))
+        {
+            std::stringstream msg;
+            msg << "Cannot create the trend archive " << path << ".\n";
+            std::cout << msg.str();
+            MedibusServer::LogProvider::Instance().LogFile(msg.str());
+            return false;
         }
+        return true;
+    }
+
+    // Consumers subscribe to the channels they need here, the continuous
+    // data request follows the union of all subscriptions. Any thread.
+    MedibusServer::ContinuousSubscription& Subscriptions()
+    {
+        return m_subscription;
+    }
+
+    // Before Init(), e.g. with a port found by MedibusServer::ModuleDiscovery.
+    void SetPort(const std::string& port)
+    {
+        m_serial.close();
+        m_serial.setPort(port);
+        m_serial.open();
+    }
+
+    // Before Init(). The response thread applies the profile to itself when
+    // it starts, the default profile changes nothing.
+    void SetRealtimeProfile(const serial::RealtimeProfile& profile)
+    {
+        m_realtime = profile;
+    }
+
+    // Any thread. Blocks only while the mailbox is full.
+    void Post(const ContextMessage& message)
+    {
+        while (!m_mailbox.TryPost(message))
+        {
+            std::this_thread::yield();
+        }
+    }
 
-        this->m_state->set_context(this);
+    // Any thread. Runs fn on the actor thread.
+    void Call(void (*fn)(Context&, void*), void* arg)
+    {
+        ContextMessage message;
+        message.type = ContextMessage::Type::Call;
+        message.call = fn;
+        message.arg = arg;
+        Post(message);
+    }
+
+    // Any thread. Makes Run() return and stops reading from the port.
+    void Stop()
+    {
+        m_stopReading = true;
+        Call([](Context& context, void*) { context.m_running = false; }, nullptr);
     }
 
-    void Request1() {
-        std::lock_guard<std::mutex> lock(m);
-        //this->m_state->Register();
-        this->m_state->HandleData();
+    // Runs the actor loop on the calling thread until Stop() is called.
+    void Run()
+    {
+        m_running = true;
+        auto nextTick = std::chrono::steady_clock::now();
+        while (m_running)
+        {
+            while (m_running && m_mailbox.TryReceive(m_message))
+            {
+                Dispatch(m_message);
+            }
+            const auto now = std::chrono::steady_clock::now();
+            const int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+            if (m_watchdog.Expired(nowNs))
+            {
+                OnResponseTimeout(nowNs);
+            }
+            if (now >= nextTick)
+            {
+                OnTimer();
+                nextTick = now + TICK;
+            }
+            else
+            {
+                // wake for the tick or the missing answer, whichever is first
+                auto wakeup = nextTick;
+                if (m_watchdog.DeadlineNs() != 0)
+                {
+                    const auto deadline = std::chrono::steady_clock::time_point(
+                        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(m_watchdog.DeadlineNs())));
+                    wakeup = std::min(wakeup, deadline);
+                }
+                m_mailbox.WaitUntil(wakeup);
+            }
+        }
     }
 
     
 
 private:
 
-    // not use
-	//void HandleModuleConnected(std::chrono::milliseconds lastTime)
-	//{
-	//	while (true)
-	//	{
-	//		std::chrono::milliseconds now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-
-	//		auto diffmilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastTime);
-	//		if (diffmilliseconds.count() >= 150)
-	//		{
-	//			// no response from module
- //               std::unique_lock<std::mutex> lock(mutex_condition);
- //               condition.wait(lock);
-	//		}
-	//	}
-	//}
         void HandleResponseThread(int i)
         {
-            try
+            ApplyRealtimeProfile();
+            // return what arrived instead of waiting for the buffer to fill
+            // up or the read to time out, the framer joins the pieces
+            m_serial.setReadPolicy(serial::readpolicy_low_latency);
+            // frames are views into the reader's buffer, receiving does not allocate
+            serial::FrameReader<ResponseFramer> reader(ResponseFramer(), 4 * BUFSZ);
+            while (!m_stopReading)
             {
-                std::vector<uint8_t> data;
-                const size_t ACKHEADLENGTH = 3;
-                State* state;
-                uint8_t rddata[BUFSZ]{};
-                size_t sz;
-                size_t ackdatalength = 0;
-                size_t dataheadlength = 0;
-                while (true)
+                try
                 {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    size_t bytes_read = m_serial.read(rddata, BUFSZ - 1);
-                    if (bytes_read != 0)
-                    {
-                        // If there is any data come from serial, notify all mutex
-                        std::lock_guard<std::mutex> lock(mutex_condition);
-                        this->m_state->SetDataReceived(true);
-                        condition.notify_all();
-                    }
-                    else
-                    {
-                        // If there is no data come from serial, notify all mutex
-                        std::lock_guard<std::mutex> lock(mutex_condition);
-                        this->m_state->SetDataReceived(false);
-                        condition.notify_all();
-                    }
-                    data.insert(data.end(), rddata, rddata + bytes_read);
-                    // first check the ACK Header (3 bytes), if not , wait until receiving all ACK Header .
-                    dataheadlength += data.size();
-                    if (dataheadlength < ACKHEADLENGTH)
-                    {
-                        continue;
-                    }
-                    dataheadlength = 0;
-                    // second According to ACK Header (3 bytes), get parameter length(LB), wait until  receiving all parameter.
-                    ackdatalength = data[2];
-                    if (ackdatalength + ACKHEADLENGTH + 1 > data.size())
-                    {
-                        continue;
-                    }
+                    ReadResponses(reader);
+                }
+                catch (const std::exception& e)
+                {
+                    std::stringstream msg;
+                    msg << "Serial port " << m_serial.getPort() << " lost: " << e.what() << '\n';
+                    std::cout << msg.str();
+                    MedibusServer::LogProvider::Instance().LogFile(msg.str());
+                    // a partial response from before the disconnect is useless
+                    reader.clear();
+                    Reconnect();
+                }
+            }
+        }
+
+        void ApplyRealtimeProfile()
+        {
+            if (m_realtime.cpu < 0 && m_realtime.priority == 0 && !m_realtime.lock_memory &&
+                m_realtime.stack_prefault == 0 && m_realtime.heap_prefault == 0)
+            {
+                return;
+            }
+            const serial::RealtimeStatus status = serial::applyRealtimeProfile(m_realtime);
+            std::stringstream msg;
+            msg << "Response thread real-time profile: affinity " << (status.affinity ? "on" : "off")
+                << ", priority " << (status.priority ? "on" : "off")
+                << ", memory " << (status.memory_locked ? "locked" : "not locked") << ".\n";
+            if (!status.warnings.empty())
+            {
+                msg << "Real-time profile only partly applied:\n" << status.warnings;
+            }
+            std::cout << msg.str();
+            MedibusServer::LogProvider::Instance().LogFile(msg.str());
+        }
+
+        // Waits until the port is back and reopens it with the same settings.
+        // The Serial object keeps baudrate, timeouts and framing across close/open.
+        void Reconnect()
+        {
+            ContextMessage message;
+            message.type = ContextMessage::Type::Disconnected;
+            message.timestampNs = MedibusServer::PatientDataNow();
+            Post(message);
+            {
+                // the actor may be writing, see Write
+                std::lock_guard<std::mutex> lock(m_portMutex);
+                m_portOpen = false;
+                try
+                {
+                    m_serial.close();
+                }
+                catch (const std::exception&)
+                {
+                }
+            }
 
-                    // here, we can get one full ack response.
-                    // analysis the ack response to distribute it to observer
-                    //
-                    if (data[0] == 0x06)
+            // list_ports only reports nodes that exist, poll it with a short
+            // backoff so a replugged adapter is picked up within a few 10 ms
+            std::chrono::milliseconds backoff(RECONNECTMIN);
+            while (!m_stopReading)
+            {
+                if (IsPortPresent())
+                {
+                    std::lock_guard<std::mutex> lock(m_portMutex);
+                    try
                     {
-                        // success
-                        // send data from data to data + len(including cs)
-                        std::vector<uint8_t> datatosend;
-                        datatosend = std::vector<uint8_t>(data.begin(), data.begin() + ackdatalength + ACKHEADLENGTH + 1);
-
-                        //if (data[1] == 0x12)
-                        {
-                            Notify(datatosend, ackdatalength + ACKHEADLENGTH + 1);
-                        }
-                        //else
-                        {
-                            NotifyOne(datatosend, ackdatalength + ACKHEADLENGTH + 1);
-                        }
-
-                        // remove the read data from cache
-                        std::vector<uint8_t> tmp;
-                        if (ackdatalength + ACKHEADLENGTH + 1 < data.size())
-                        {
-                            tmp = std::vector<uint8_t>(data.begin() + ackdatalength + ACKHEADLENGTH + 1, data.end());
-                        }
-
-                        data = tmp;
+                        m_serial.open();
+                        m_portOpen = true;
+                        break;
                     }
-                    else if (data[0] == 0x15)
+                    catch (const std::exception&)
                     {
-                        // fail
-                        // send data from data to data + len(including cs)
-                        NotifyOne(data, ackdatalength + ACKHEADLENGTH + 1);
-                        Notify(data, ackdatalength + ACKHEADLENGTH + 1);
-                        // remove the read data from cache
-                        std::vector<uint8_t> tmp;
-                        if (ackdatalength + ACKHEADLENGTH + 1 < data.size())
-                        {
-                            tmp = std::vector<uint8_t>(data.begin() + ackdatalength + ACKHEADLENGTH + 1, data.end());
-                        }
-
-                        data = tmp;
+                        // node exists but is not ready yet
                     }
-
                 }
+                std::this_thread::sleep_for(backoff);
+                backoff = std::min(backoff * 2, RECONNECTMAX);
             }
-        	catch (...)
+            if (!m_stopReading)
             {
-                std::cout << "Handle Response Thread catch a exception. \n" << '\n';
+                message.type = ContextMessage::Type::Reconnected;
+                Post(message);
             }
-            
+        }
 
+        bool IsPortPresent() const
+        {
+            const std::string port = m_serial.getPort();
+            for (const auto& info : serial::list_ports())
+            {
+                if (info.port == port)
+                {
+                    return true;
+                }
+            }
+            return false;
         }
 
-private:
-    std::list<IObserver*> m_ListObservers;
-    std::stack<IObserver*> m_StackResponse;
-    int m_nNumThreads{ 1 };
-    bool m_bPneumaticsEnabled{ false };
-    bool m_bAutoZeroCondition{ false };
-    bool m_bPAIAvailable{ false };
-    bool m_bNeedsExternalData{ false };
-    uint8_t m_bHSP{ 0x00 };
-    std::shared_ptr<State> m_state;
-    State* state_;
-    std::map<uint16_t, std::shared_ptr<State>> m_mapStates;
-    std::thread t1;
-    serial::Serial m_serial{ "COM9", 19200, serial::Timeout::simpleTimeout(100) };
-    std::mutex m;
-    std::mutex mutex_condition;
-    std::condition_variable condition;
-};
+        void ReadResponses(serial::FrameReader<ResponseFramer>& reader)
+        {
+            ContextMessage status;
+            status.type = ContextMessage::Type::ReadStatus;
+            serial::FrameView frame;
+            while (!m_stopReading)
+            {
+                // blocks up to the 100 ms port timeout and returns with the
+                // first bytes, which are stamped when they arrive
+                size_t bytes_read = reader.read(m_serial);
+                // tell the actor whether the module answered at all
+                status.received = bytes_read != 0;
+                Post(status);
+                // distribute every complete ack response to the observers
+                while (reader.next(frame))
+                {
+                    PostFrame(frame);
+                }
+            }
+        }
 
-/**
- * Concrete States implement various behaviors, associated with a state of the
- * Context.
- */
+        void PostFrame(const serial::FrameView& view)
+        {
+            ContextMessage& frame = m_readerMessage;
+            frame.type = ContextMessage::Type::Frame;
+            frame.length = static_cast<uint16_t>(std::min(view.size, ContextMessage::MAXFRAME));
+            std::copy(view.data, view.data + frame.length, frame.data);
+            frame.firstByteNs = static_cast<int64_t>(view.first_ns);
+            frame.lastByteNs = static_cast<int64_t>(view.last_ns);
+            Post(frame);
+        }
 
-class StopContinuousDataState : public State {
-public:
-    ~StopContinuousDataState()
-    {
-        std::cout << "StopContinuousDataState Destructor" << '\n';
-    }
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-    std::chrono::milliseconds m_lastTime{ std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()) };
-};
+        // actor thread from here on
+        void Dispatch(const ContextMessage& message)
+        {
+            switch (message.type)
+            {
+            case ContextMessage::Type::ReadStatus:
+                OnReadStatus(message.received);
+                break;
+            case ContextMessage::Type::Frame:
+                OnFrame(message);
+                break;
+            case ContextMessage::Type::Timer:
+                OnTimer();
+                break;
+            case ContextMessage::Type::Call:
+                message.call(*this, message.arg);
+                break;
+            case ContextMessage::Type::Disconnected:
+                OnDisconnected();
+                break;
+            case ContextMessage::Type::Reconnected:
+                OnReconnected(message);
+                break;
+            }
+        }
 
+        void OnReadStatus(bool received)
+        {
+            if (this->m_state)
+            {
+                this->m_state->SetDataReceived(received);
+            }
+            if (m_pending)
+            {
+                m_pending->SetAlreadySent(received);
+                m_pending = nullptr;
+            }
+        }
 
-class GetIntervalBaseTimeState : public State {
-public:
+        void OnFrame(const ContextMessage& message)
+        {
+            m_frame.assign(message.data, message.data + message.length);
+            if (m_frame.size() < 2)
+            {
+                return;
+            }
+            const int64_t now = MedibusServer::PatientDataNow();
+            m_latency.NoteFrame(m_frame[1], message.firstByteNs, message.lastByteNs, now);
+            if (m_watchdog.NoteFrame(m_frame[1], message.lastByteNs != 0 ? message.lastByteNs : now))
+            {
+                ReportRegained(now);
+            }
+            if (m_frame[0] == 0x06)
+            {
+                if (m_frame[1] == 0x12)
+                {
+                    StoreSamples(message.firstByteNs != 0 ? message.firstByteNs : now);
+                    if (m_disconnectedAtNs != 0)
+                    {
+                        ReportRecovery("first measurement", now);
+                        m_disconnectedAtNs = 0;
+                    }
+                    Supervise(m_frame);
+                    Publish(MedibusServer::SharedEntryKind::Frame, m_frame.data(), m_frame.size(), now);
+                }
+                Notify(m_frame, m_frame.size());
+                NotifyOne(m_frame, m_frame.size());
+                PublishModuleStatus(now);
+            }
+            else
+            {
+                NotifyOne(m_frame, m_frame.size());
+                Notify(m_frame, m_frame.size());
+            }
+            m_latency.NoteProcessing(MedibusServer::PatientDataNow() - now);
+        }
 
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
+        // Decodes the continuous data frame once for the store, the archive
+        // and the merger. All three get the time the first byte arrived, when
+        // the module sent the frame; unlike the time the actor gets to it,
+        // this does not depend on the mailbox, so it is also the time the
+        // streams of several modules are aligned on.
+        void StoreSamples(int64_t sentNs)
+        {
+            const bool archive = m_archive.IsOpen();
+            MedibusServer::PatientFrameDecoder::Decode(m_frame.data(), m_frame.size(), [&](MedibusServer::PatientChannel channel, int32_t value)
+            {
+                m_patientData.Append(channel, sentNs, value);
+                ++m_sampleCounts[static_cast<size_t>(channel)];
+                if (archive)
+                {
+                    m_archive.Append(channel, sentNs, value);
+                }
+                if (m_merger)
+                {
+                    m_merger->Push(m_mergeSource, channel, sentNs, value);
+                }
+            });
+        }
 
+        void ReportRecovery(const char* what, int64_t nowNs)
+        {
+            std::stringstream msg;
+            msg << "Reconnect " << m_reconnects << ": " << what << " " << (nowNs - m_disconnectedAtNs) / 1000000 << " ms after the port was lost.\n";
+            std::cout << msg.str();
+            MedibusServer::LogProvider::Instance().LogFile(msg.str());
+        }
 
-// Transmit Device Component Information
-// Vendor Code
-class TransmitDeviceComponentInformation_VendorCode_State : public State {
-public:
+        // Starts a new handshake with the cached identity of the port, if any.
+        void ResetIdentity()
+        {
+            m_identity = MedibusServer::DeviceIdentity();
+            m_identityConfirmed = false;
+            m_identity.port = m_serial.getPort();
+            for (const auto& info : serial::list_ports())
+            {
+                if (info.port == m_identity.port)
+                {
+                    m_identity.hardwareId = info.hardware_id;
+                }
+            }
+            m_cachedIdentity = m_identityCache.Find(m_identity.port, m_identity.hardwareId);
+        }
 
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
+        // The actor learns of a disconnect only when the Disconnected message
+        // arrives, the response thread may have closed the port before that.
+        // The port mutex keeps the write off a port being closed or reopened;
+        // a write to a closed port is dropped, one which fails on a lost port
+        // is reported here while the response thread reconnects.
+        size_t Write(const std::vector<uint8_t>& command)
+        {
+            if (!m_connected)
+            {
+                return 0;
+            }
+            std::lock_guard<std::mutex> lock(m_portMutex);
+            if (!m_portOpen)
+            {
+                return 0;
+            }
+            try
+            {
+                return m_serial.write(command);
+            }
+            catch (const std::exception& e)
+            {
+                std::stringstream msg;
+                msg << "Write failed: " << e.what() << '\n';
+                std::cout << msg.str();
+                MedibusServer::LogProvider::Instance().LogFile(msg.str());
+                return 0;
+            }
+        }
 
-// Transmit Device Component Information
-// Serial Number
+        void Publish(MedibusServer::SharedEntryKind kind, const void* payload, size_t length, int64_t timestampNs)
+        {
+            if (m_sharedRing.IsOpen())
+            {
+                m_sharedRing.Publish(kind, payload, length, timestampNs);
+            }
+        }
+
+        // publishes the status only when supervision or a state changed it
+        void PublishModuleStatus(int64_t timestampNs)
+        {
+            const MedibusServer::ModuleStatusSnapshot status = m_moduleStatus.Load();
+            if (status.version != m_publishedStatusVersion)
+            {
+                m_publishedStatusVersion = status.version;
+                Publish(MedibusServer::SharedEntryKind::ModuleStatus, &status, sizeof(status), timestampNs);
+            }
+        }
+
+        void OnDisconnected()
+        {
+            m_connected = false;
+            m_pending = nullptr;
+            m_scheduler.Clear();
+            m_latency.Clear();
+            m_watchdog.Disarm();
+            m_continuous = false;
+        }
+
+        // The module did not answer in time: report the loss once and run the
+        // handshake again, every further timeout retries it.
+        void OnResponseTimeout(int64_t nowNs)
+        {
+            if (m_watchdog.Expire(nowNs))
+            {
+                std::stringstream msg;
+                msg << "Module on " << m_serial.getPort() << " lost: no answer for " << m_watchdog.TimeoutNs() / 1000000 << " ms";
+                if (m_watchdog.LastFrameNs() != 0)
+                {
+                    msg << ", last response " << (nowNs - m_watchdog.LastFrameNs()) / 1000000 << " ms ago";
+                }
+                msg << ".\n";
+                std::cout << msg.str();
+                MedibusServer::LogProvider::Instance().LogFile(msg.str());
+            }
+            m_pending = nullptr;
+            m_scheduler.Clear();
+            m_latency.Clear();
+            // the handshake requests the stream again
+            m_continuous = false;
+            Resync();
+        }
+
+        void ReportRegained(int64_t nowNs)
+        {
+            std::stringstream msg;
+            msg << "Module on " << m_serial.getPort() << " regained " << (nowNs - m_watchdog.LostAtNs()) / 1000000
+                << " ms after the loss was detected.\n";
+            std::cout << msg.str();
+            MedibusServer::LogProvider::Instance().LogFile(msg.str());
+            m_watchdog.Acknowledge();
+        }
+
+        // Restarts the state machine from StopContinuousDataState.
+        void Resync();
+
+        void OnReconnected(const ContextMessage& message);
+
+        void OnTimer()
+        {
+            // a command is still waiting for its read result
+            if (m_connected && this->m_state && !m_pending)
+            {
+                this->m_state->HandleData();
+            }
+            DispatchCommand();
+            ApplySubscription();
+            const int64_t now = MedibusServer::PatientDataNow();
+            if (now >= m_nextMetricsNs)
+            {
+                if (m_nextMetricsNs != 0)
+                {
+                    LogSchedulerMetrics();
+                    // a crash loses at most the last interval
+                    m_archive.Flush();
+                }
+                m_nextMetricsNs = now + METRICSINTERVALNS;
+            }
+        }
+
+        size_t Queue(State* state, bool sync)
+        {
+            if (!m_connected)
+            {
+                return 0;
+            }
+            return m_scheduler.Push(state, state->GetPriority(), sync, MedibusServer::PatientDataNow()) ? 1 : 0;
+        }
+
+        // Writes the most urgent queued command, one per tick and never while
+        // a synchronous command waits for its read result.
+        void DispatchCommand()
+        {
+            MedibusServer::CommandScheduler<State>::Entry next;
+            if (!m_connected || m_pending || !m_scheduler.Pop(MedibusServer::PatientDataNow(), next))
+            {
+                return;
+            }
+            const std::vector<uint8_t> command = next.command->GetCommand();
+            if (Write(command) == 0)
+            {
+                return;
+            }
+            // 10 LEN CMD ..., the response echoes CMD
+            const int64_t sentNs = MedibusServer::PatientDataNow();
+            m_latency.NoteSent(command[2], sentNs);
+            m_watchdog.NoteSent(command[2], sentNs);
+            if (next.sync)
+            {
+                m_pending = next.command;
+            }
+            if (command[2] == 0x12 || command[2] == 0x19)
+            {
+                // while the data streams its frames keep the watchdog armed
+                m_continuous = command[2] == 0x12;
+                if (m_continuous)
+                {
+                    m_watchdog.StartStream(0x12, sentNs);
+                }
+                else
+                {
+                    m_watchdog.StopStream();
+                }
+            }
+        }
+
+        // While continuous data runs, a changed subscription is requested at
+        // once. Otherwise TransmitPatientData_120E_State picks it up.
+        void ApplySubscription()
+        {
+            MedibusServer::ContinuousSubscription::Selector selector;
+            if (!m_connected || m_pending || !m_continuous || !m_subscription.TakeChanged(selector))
+            {
+                return;
+            }
+            const std::vector<uint8_t> command = MedibusServer::ContinuousSubscription::Command(selector);
+            if (Write(command) != 0)
+            {
+                const int64_t sentNs = MedibusServer::PatientDataNow();
+                m_latency.NoteSent(command[2], sentNs);
+                m_watchdog.NoteSent(command[2], sentNs);
+            }
+        }
+
+        void LogSchedulerMetrics()
+        {
+            std::stringstream msg;
+            for (size_t i = 0; i < static_cast<size_t>(MedibusServer::CommandClass::Count); ++i)
+            {
+                const auto commandClass = static_cast<MedibusServer::CommandClass>(i);
+                const MedibusServer::CommandClassMetrics& metrics = m_scheduler.Metrics(commandClass);
+                msg << "Commands " << MedibusServer::CommandClassName(commandClass) << ": " << std::dec << metrics.queueDelay.count
+                    << " sent, delay avg " << metrics.queueDelay.AverageNs() / 1000000 << " ms max " << metrics.queueDelay.maxNs / 1000000
+                    << " ms, " << metrics.deadlineMisses << " late, " << metrics.rejected << " rejected.\n";
+            }
+            const MedibusServer::DelayMetrics& reaction = m_scheduler.ReactionTime();
+            msg << "Supervision reaction: " << reaction.count << " events, avg " << reaction.AverageNs() / 1000000
+                << " ms max " << reaction.maxNs / 1000000 << " ms.\n";
+            LogLatency(msg, "Response wire", m_latency.Wire());
+            LogLatency(msg, "Response transfer", m_latency.Transfer());
+            LogLatency(msg, "Response handoff", m_latency.Handoff());
+            LogLatency(msg, "Response processing", m_latency.Processing());
+            msg << "Liveness: " << m_watchdog.Losses() << " losses, " << m_watchdog.Expiries() << " missed answers.\n";
+            // the effective rate of every channel in the continuous data
+            const MedibusServer::PatientChannelSet subscribed = m_subscription.Channels();
+            msg << "Samples per minute:";
+            for (size_t i = 0; i < MedibusServer::kPatientChannelCount; ++i)
+            {
+                if (subscribed[i] || m_sampleCounts[i] != 0)
+                {
+                    msg << ' ' << MedibusServer::PatientChannelName(static_cast<MedibusServer::PatientChannel>(i)) << ' '
+                        << m_sampleCounts[i] * 60000000000 / METRICSINTERVALNS;
+                }
+            }
+            msg << ".\n";
+            m_sampleCounts.fill(0);
+            for (size_t command = 0; command < MedibusServer::ResponseLatency::COMMANDS; ++command)
+            {
+                const MedibusServer::DelayMetrics& roundTrip = m_latency.RoundTrip(static_cast<uint8_t>(command));
+                if (roundTrip.count != 0)
+                {
+                    std::stringstream name;
+                    name << "Round trip 0x" << std::hex << std::setw(2) << std::setfill('0') << command;
+                    LogLatency(msg, name.str().c_str(), roundTrip);
+                }
+            }
+            std::cout << msg.str();
+            MedibusServer::LogProvider::Instance().LogFile(msg.str());
+        }
+
+        // in microseconds, the stages are much shorter than the queueing delays
+        static void LogLatency(std::stringstream& msg, const char* what, const MedibusServer::DelayMetrics& metrics)
+        {
+            msg << what << ": " << std::dec << metrics.count << " frames, avg " << metrics.AverageNs() / 1000
+                << " us max " << metrics.maxNs / 1000 << " us.\n";
+        }
+
+        // Runs all status rules of the frame at once and reports the conditions
+        // which became active. The states only read the latched result.
+        void Supervise(const std::vector<uint8_t>& rddata)
+        {
+            uint32_t evaluated = 0;
+            const uint32_t active = m_statusRules.Evaluate(rddata.data(), rddata.size(), evaluated);
+            if (evaluated == 0)
+            {
+                return;
+            }
+            uint32_t raised = m_moduleStatus.Modify([&](MedibusServer::ModuleStatusSnapshot& status)
+            {
+                const uint32_t rising = active & ~status.supervision;
+                status.supervision = (status.supervision & ~evaluated) | active;
+                status.supervisionEvaluated |= evaluated;
+                return rising;
+            });
+            if (raised != 0)
+            {
+                m_scheduler.NoteEvent(MedibusServer::PatientDataNow());
+            }
+            for (size_t i = 0; raised != 0; ++i, raised >>= 1)
+            {
+                if (raised & 1u)
+                {
+                    std::stringstream msg;
+                    msg << m_statusRules.Message(static_cast<MedibusServer::SupervisionEvent>(i)) << '\n';
+                    std::cout << msg.str();
+                    MedibusServer::LogProvider::Instance().LogFile(msg.str());
+                }
+            }
+        }
+
+private:
+    std::list<IObserver*> m_ListObservers;
+    std::stack<IObserver*> m_StackResponse;
+    int m_nNumThreads{ 1 };
+    MedibusServer::ModuleStatusPublisher m_moduleStatus;
+    std::unique_ptr<StatePool> m_pool;
+    State* m_state{ nullptr };
+    MedibusServer::PatientDataStore m_patientData;
+    const MedibusServer::StatusRuleSet m_statusRules;
+    std::thread t1;
+    serial::Serial m_serial{ "COM9", 19200, serial::Timeout::simpleTimeout(100) };
+    static constexpr std::chrono::milliseconds TICK{ 10 };
+    MedibusServer::Mailbox<ContextMessage, 256> m_mailbox;
+    ContextMessage m_message;           // actor thread
+    ContextMessage m_readerMessage;     // response thread
+    std::vector<uint8_t> m_frame;       // actor thread
+    MedibusServer::SharedRingWriter m_sharedRing;   // actor thread writes
+    uint64_t m_publishedStatusVersion{ 0 };
+    MedibusServer::DeviceIdentityCache m_identityCache;
+    MedibusServer::DeviceIdentity m_identity;
+    const MedibusServer::DeviceIdentity* m_cachedIdentity{ nullptr };
+    bool m_identityConfirmed{ false };
+    State* m_pending{ nullptr };        // actor thread
+    bool m_running{ false };            // actor thread
+    bool m_connected{ true };           // actor thread
+    std::mutex m_portMutex;             // Write against the response thread's close and open
+    bool m_portOpen{ true };            // m_portMutex
+    int64_t m_disconnectedAtNs{ 0 };    // actor thread, 0 once recovered
+    uint32_t m_reconnects{ 0 };         // actor thread
+    static constexpr std::chrono::milliseconds RECONNECTMIN{ 20 };
+    static constexpr std::chrono::milliseconds RECONNECTMAX{ 500 };
+    MedibusServer::CommandScheduler<State> m_scheduler;   // actor thread
+    MedibusServer::ResponseLatency m_latency;               // actor thread
+    MedibusServer::LivenessWatchdog m_watchdog;             // actor thread
+    MedibusServer::SampleMerger<>* m_merger{ nullptr };     // pushed to by the actor thread
+    MedibusServer::TrendArchiveWriter m_archive;            // actor thread
+    size_t m_mergeSource{ 0 };
+    int64_t m_nextMetricsNs{ 0 };       // actor thread
+    MedibusServer::ContinuousSubscription m_subscription;
+    bool m_continuous{ false };         // actor thread, CMD_$12 was the last of $12 and $19
+    std::array<uint64_t, MedibusServer::kPatientChannelCount> m_sampleCounts{};   // actor thread, per metrics interval
+    static constexpr int64_t METRICSINTERVALNS{ 60000000000 };
+    serial::RealtimeProfile m_realtime;  // read by the response thread once
+    std::atomic<bool> m_stopReading{ false };
+};
+
+/**
+ * Concrete States implement various behaviors, associated with a state of the
+ * Context.
+ */
+
+class StopContinuousDataState : public State {
+public:
+    ~StopContinuousDataState()
+    {
+        std::cout << "StopContinuousDataState Destructor" << '\n';
+    }
+    void HandleData() override;
+    std::vector<uint8_t> GetCommand() override;
+    size_t GetRespondBytes() override;
+    uint32_t GetCommandId() override;
+    void Register() override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
+};
+
+
+class GetIntervalBaseTimeState : public State {
+public:
+
+    void HandleData() override;
+    std::vector<uint8_t> GetCommand() override;
+    size_t GetRespondBytes() override;
+    uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
+    void Register() override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
+private:
+    void QueryIdentity();
+};
+
+
+// Transmit Device Component Information
+// Vendor Code
+class TransmitDeviceComponentInformation_VendorCode_State : public State {
+public:
+
+    void HandleData() override;
+    std::vector<uint8_t> GetCommand() override;
+    size_t GetRespondBytes() override;
+    uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
+    void Register() override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
+};
+
+// Transmit Device Component Information
+// Serial Number
 class TransmitDeviceComponentInformation_SerialNumber_State : public State {
 public:
 
@@ -673,8 +1351,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Transmit Device Component Information
@@ -686,8 +1365,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Transmit Device Component Information
@@ -699,8 +1379,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Transmit Device Component Information
@@ -712,8 +1393,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Transmit Device Component Information
@@ -725,8 +1407,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Adjust Time Information
@@ -737,8 +1420,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Transmit Generic Module Features
@@ -749,8 +1433,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 //// Transmit Generic Module Features
@@ -763,7 +1448,7 @@ public:
 //    size_t GetRespondBytes() override;
 //    uint16_t GetCommandId() override;
 //    void Register() override;
-//    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+//    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 //    void SetAlreadySent(bool bAlreadySent) override;
 //    bool IsAlreadySent() override;
 //};
@@ -778,7 +1463,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Switch Breath Detection Mode
@@ -791,7 +1476,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 
@@ -805,7 +1490,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Switch Breath Detection Mode
@@ -818,7 +1503,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Switch Breath Detection Mode
@@ -831,7 +1516,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Switch Breath Detection Mode
@@ -844,7 +1529,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 
@@ -858,7 +1543,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 
@@ -872,7 +1557,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
     bool IsSingleCommand() override;
     bool IsContinuousCommand() override;
 };
@@ -886,7 +1571,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
     std::chrono::milliseconds m_lastTime { std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()) };
 };
 
@@ -899,7 +1584,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Switch Valves
@@ -912,7 +1597,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 
@@ -926,7 +1611,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Select The Anesthetic Agent
@@ -939,7 +1624,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 
@@ -953,7 +1638,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Select Anesthetic Agent Type
@@ -967,7 +1652,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 
@@ -981,7 +1666,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 
@@ -996,7 +1681,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 
@@ -1009,88 +1694,11 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
-
-
-// Supervise Module Status
-// Watertrap disconnected?
-class  SuperviseModuleStatus_120B_MSWBit5_State : public State {
-public:
-
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
-
-// Supervise Module Status
-// Watertrap full?
-class  SuperviseModuleStatus_120B_MSWBit6_State : public State {
-public:
-
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
-
-// Supervise Module Status
-// Watertrap warning?
-class  SuperviseModuleStatus_120E_MSWBit7_State : public State {
-public:
-
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
-
-// Supervise Module Status
-// Any Componeny Fail
-class  SuperviseModuleStatus_120E_MSBit6_State : public State {
-public:
-
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
-
-// Supervise Module Status
-// Breath phase data available?
-class  SuperviseModuleStatus_120E_MSBit5_State : public State {
-public:
-
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
-// Supervise Module Status
-// No respiration / Apnea?
-class  SuperviseModuleStatus_120E_MSBit4_State : public State {
-public:
-
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
 
 // Supervise Zero Request State
 // Measurement Mode?
@@ -1101,8 +1709,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Zero In Progress State
@@ -1114,49 +1723,11 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
-
-// Zero In Progress State
-// FRAME_$12$04,O2_PS, Bit5
-class  ZeroInProgress_1204_O2PSBit5_State : public State {
-public:
-
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
-
-
-// Zero In Progress State
-// FRAME_$12$10,A1_PS, Bit5
-class  ZeroInProgress_1210_A1PSBit5_State : public State {
-public:
-
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
-// Zero In Progress State
-// FRAME_$12$11,A2_PS, Bit5
-class  ZeroInProgress_1211_A2PSBit5_State : public State {
-public:
-
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
 
 // Zero Request State
 // FRAME_$12$0E,MS, Bit0
@@ -1167,8 +1738,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Handle Zero Request State
@@ -1180,8 +1752,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Init Zero State
@@ -1194,8 +1767,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Get Units State
@@ -1207,8 +1781,9 @@ public:
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Evaluate Connection Established
@@ -1220,7 +1795,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Host Selectable Parameters
@@ -1233,7 +1808,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Parameter Availability Information
@@ -1246,7 +1821,7 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
 // Parameter Mode State
@@ -1259,25 +1834,15 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
-// Parameter Mode State
-// FRAME_$12$03,N2O_PS, Bit6-7
-class  ParameterMode_1203_N2OPSBit6Bit7_State : public State {
-public:
 
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
 
-// Parameter Mode State
-// FRAME_$12$04,O2_PS, Bit6-7
-class  ParameterMode_1204_O2PSBit6Bit7_State : public State {
+
+// Parameter Inop Information State
+// FRAME_$12$0E,PII
+class  ParameterInopInformation_120E_PII_State : public State {
 public:
 
     void HandleData() override;
@@ -1285,13 +1850,12 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
-
-// Parameter Mode State
-// FRAME_$12$10,A1_PS, Bit6-7
-class  ParameterMode_1210_A1PSBit6Bit7_State : public State {
+// Measurement Mode State
+// FRAME_$12$0E,OMS
+class  MeasurementMode_120E_OMS_State : public State {
 public:
 
     void HandleData() override;
@@ -1299,85 +1863,214 @@ public:
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
-// Parameter Mode State
-// FRAME_$12$11,A2_PS, Bit6-7
-class  ParameterMode_1211_A2PSBit6Bit7_State : public State {
+// Occlusion State
+// FRAME_$12$0E,MS, Bit1
+class  Occlusion_120E_MSBit1__State : public State {
 public:
 
     void HandleData() override;
     std::vector<uint8_t> GetCommand() override;
     size_t GetRespondBytes() override;
     uint32_t GetCommandId() override;
+    MedibusServer::CommandClass GetPriority() override;
     void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+    void Update(const std::vector<uint8_t>& rddata, size_t sz) override;
 };
 
-
-
-// Parameter Inop Information State
-// FRAME_$12$0E,PII
-class  ParameterInopInformation_120E_PII_State : public State {
+/**
+ * Every state of the machine, allocated once together with the Context.
+ * A transition only changes which of these objects is current.
+ */
+class StatePool {
 public:
+    using States = std::tuple<
+        StopContinuousDataState,
+        GetIntervalBaseTimeState,
+        TransmitDeviceComponentInformation_VendorCode_State,
+        TransmitDeviceComponentInformation_SerialNumber_State,
+        TransmitDeviceComponentInformation_HardwareRevision_State,
+        TransmitDeviceComponentInformation_SoftwareRevision_State,
+        TransmitDeviceComponentInformation_ProductName_State,
+        TransmitDeviceComponentInformation_PartNumber_State,
+        AdjustTimeInformationState,
+        TransmitGenericModuleFeaturesState,
+        SwitchBreathDetectionMode_PgmBreathDetection_State,
+        SwitchBreathDetectionMode_PgmBreathDetectionAutoWakeup_State,
+        SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State,
+        SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State,
+        SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State,
+        SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State,
+        SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State,
+        TransmitPatientData_120E_State,
+        MeasurementModeState,
+        OperatingModeState,
+        SwitchValvesState,
+        SwitchPumpState,
+        SelectTheAnestheticAgentState,
+        Evaluate_1210_State,
+        SelectAnestheticAgentType_Halothane_State,
+        ProvideTheSensorModuleWithRequiredData_State,
+        AcceptExternalParameterData_UnknownAccuracy_State,
+        SuperviseModuleStatus_120E_MSBit2_State,
+        SuperviseZeroRequest_120E_OMS_State,
+        ZeroInProgress_1203_CO2N2OPSBit5_State,
+        ZeroRequestState,
+        HandleZeroRequestState,
+        InitZeroState,
+        GetUnitsState,
+        EvaluateConnectionEstablishedState,
+        HostSelectableParameters_120E_HSP_State,
+        ParameterAvailabilityInformation_120E_PAI_State,
+        ParameterMode_1203_CO2PSBit6Bit7_State,
+        ParameterInopInformation_120E_PII_State,
+        MeasurementMode_120E_OMS_State,
+        Occlusion_120E_MSBit1__State>;
+
+    static constexpr size_t Count = std::tuple_size<States>::value;
+
+    explicit StatePool(Context* context)
+    {
+        std::apply([&](auto&... state) {
+            size_t i = 0;
+            ((m_table[i++] = &state), ...);
+        }, m_states);
+        for (auto state : m_table)
+        {
+            state->set_context(context);
+        }
+    }
 
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
+    template <typename T>
+    T& Get()
+    {
+        return std::get<T>(m_states);
+    }
 
-// Measurement Mode State
-// FRAME_$12$0E,OMS
-class  MeasurementMode_120E_OMS_State : public State {
-public:
+    template <typename T>
+    static constexpr size_t IndexOf()
+    {
+        return Index<T, States>::value;
+    }
 
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
-};
+    // forgets what was sent, used to restart the machine after a reconnect
+    void Reset()
+    {
+        for (auto state : m_table)
+        {
+            state->SetAlreadySent(false);
+            state->SetDataReceived(false);
+        }
+        m_visited.fill(false);
+    }
 
-// Occlusion State
-// FRAME_$12$0E,MS, Bit1
-class  Occlusion_120E_MSBit1__State : public State {
-public:
+    // returns false the first time a state is entered
+    bool MarkVisited(size_t index)
+    {
+        const bool visited = m_visited[index];
+        m_visited[index] = true;
+        return visited;
+    }
 
-    void HandleData() override;
-    std::vector<uint8_t> GetCommand() override;
-    size_t GetRespondBytes() override;
-    uint32_t GetCommandId() override;
-    void Register() override;
-    void Update(std::vector<uint8_t> rddata, size_t sz) override;
+private:
+    template <typename T, typename Tuple>
+    struct Index;
+
+    template <typename T, typename... Rest>
+    struct Index<T, std::tuple<T, Rest...>> : std::integral_constant<size_t, 0> {};
+
+    template <typename T, typename First, typename... Rest>
+    struct Index<T, std::tuple<First, Rest...>> : std::integral_constant<size_t, 1 + Index<T, std::tuple<Rest...>>::value> {};
+
+    States m_states;
+    std::array<State*, Count> m_table{};
+    std::array<bool, Count> m_visited{};
 };
 
+Context::Context() : m_pool(std::make_unique<StatePool>(this))
+{
+}
+
+Context::~Context()
+{
+    m_stopReading = true;
+    if (t1.joinable())
+    {
+        t1.join();
+    }
+}
+
+template <typename T>
+void Context::TransitionTo()
+{
+    // first Detach the latest state
+    // ignore the flag, because if it doesn't exist in the list, nothing will happen
+    if (this->m_state && this->m_state->IsSingleCommand())
+    {
+        DetachNeedResponse();
+    }
+    // continuous commands don't need call detach, always attach until application exit.
+    std::cout << "Context: Transition to " << typeid(T).name() << ".\n";
+    this->m_state = &m_pool->Get<T>();
+    if (!m_pool->MarkVisited(StatePool::IndexOf<T>()))
+    {
+        // Attach the state according the flag
+        if (this->m_state->IsSingleCommand())
+        {
+            AttachNeedResponse(this->m_state);
+        }
+        if (this->m_state->IsContinuousCommand())
+        {
+            Attach(this->m_state);
+        }
+    }
+    else if (this->m_state->IsSingleCommand() && !this->m_state->IsAlreadySent())
+    {
+        AttachNeedResponse(this->m_state);
+    }
+}
+
+void Context::OnReconnected(const ContextMessage& message)
+{
+    ++m_reconnects;
+    m_connected = true;
+    m_pending = nullptr;
+    m_disconnectedAtNs = message.timestampNs;
+    ReportRecovery("port reopened", MedibusServer::PatientDataNow());
+    Resync();
+}
+
+void Context::Resync()
+{
+    // the module lost its configuration with the link, run the handshake
+    // again; the identity cache keeps it short
+    m_ListObservers.clear();
+    while (!m_StackResponse.empty())
+    {
+        m_StackResponse.pop();
+    }
+    m_pool->Reset();
+    this->m_state = nullptr;
+    ResetIdentity();
+    TransitionTo<StopContinuousDataState>();
+}
+
 void StopContinuousDataState::HandleData() {
     {
-        if (IsAlreadySent())
+        // a missing answer is retried by the context's liveness watchdog
+        if (IsAlreadySent() || this->context_->IsAwaitingResponse())
         {
             return;
         }
         /*SetAlreadySent(true);*/
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles StopContinuousData.\n";
         std::stringstream msg;
         msg << "Handles StopContinuousData.\n";
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
-    	std::chrono::milliseconds now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-
-    	auto diffmilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastTime);
-    	if (diffmilliseconds.count() >= 150)
-    	{
-            m_lastTime = now;
-            size_t bytes_wrote = this->context_->SendCmdSync(this);
-    	}
+        size_t bytes_wrote = this->context_->SendCmdSync(this);
         
     }
 }
@@ -1402,7 +2095,7 @@ void StopContinuousDataState::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void StopContinuousDataState::Update(std::vector<uint8_t> rddata, size_t sz)
+void StopContinuousDataState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x19 && rddata[2] == 0x00)
 
@@ -1411,8 +2104,7 @@ void StopContinuousDataState::Update(std::vector<uint8_t> rddata, size_t sz)
         std::stringstream msg;
         msg << "Change to GetIntervalBaseTimeState.\n";
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
-        auto ptr = std::make_shared<GetIntervalBaseTimeState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<GetIntervalBaseTimeState>();
     }
 
 }
@@ -1425,8 +2117,6 @@ void GetIntervalBaseTimeState::HandleData() {
             return;
         }
         /*SetAlreadySent(true);*/
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles GetIntervalBaseTimeState.\n";
         std::stringstream msg;
         msg << "Handles GetIntervalBaseTimeState.\n";
@@ -1452,11 +2142,16 @@ uint32_t GetIntervalBaseTimeState::GetCommandId()
     return 0x02;
 }
 
+MedibusServer::CommandClass GetIntervalBaseTimeState::GetPriority()
+{
+    return MedibusServer::CommandClass::Info;
+}
+
 void GetIntervalBaseTimeState::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void GetIntervalBaseTimeState::Update(std::vector<uint8_t> rddata, size_t sz)
+void GetIntervalBaseTimeState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     size_t bytes_read = 0;
     if (rddata[0] == 0x06 && rddata[1] == 0x02 && rddata[2] == 0x02)
@@ -1470,8 +2165,7 @@ void GetIntervalBaseTimeState::Update(std::vector<uint8_t> rddata, size_t sz)
             std::cout << rddata[i];
         }
         std::cout << '\n';
-        auto ptr = std::make_shared<TransmitDeviceComponentInformation_VendorCode_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        QueryIdentity();
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x02 && rddata[2] == 0x01)
     {
@@ -1483,13 +2177,25 @@ void GetIntervalBaseTimeState::Update(std::vector<uint8_t> rddata, size_t sz)
         std::cout << "Skip to TransmitDeviceComponentInformation_VendorCode_State.\n";
         msg << "Skip to TransmitDeviceComponentInformation_VendorCode_State.\n";
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
-        auto ptr = std::make_shared<TransmitDeviceComponentInformation_VendorCode_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        QueryIdentity();
     }
 
     PrintData(rddata);
 }
 
+// With a cached identity only the serial number is queried to confirm it.
+void GetIntervalBaseTimeState::QueryIdentity()
+{
+    if (this->context_->HasCachedIdentity())
+    {
+        this->context_->TransitionTo<TransmitDeviceComponentInformation_SerialNumber_State>();
+    }
+    else
+    {
+        this->context_->TransitionTo<TransmitDeviceComponentInformation_VendorCode_State>();
+    }
+}
+
 void TransmitDeviceComponentInformation_VendorCode_State::HandleData() {
     {
         if (IsAlreadySent())
@@ -1497,8 +2203,6 @@ void TransmitDeviceComponentInformation_VendorCode_State::HandleData() {
             return;
         }
         /*SetAlreadySent(true);*/
-        uint8_t* rddata = new uint8_t[BUFSZ]();
-       // std::vector<uint8_t> rddata;
         std::cout << "Handles TransmitDeviceComponentInformation_VendorCode_State.\n";
         std::stringstream msg;
         msg << "Handles TransmitDeviceComponentInformation_VendorCode_State.\n";
@@ -1524,11 +2228,16 @@ uint32_t TransmitDeviceComponentInformation_VendorCode_State::GetCommandId()
     return 0x0a00;
 }
 
+MedibusServer::CommandClass TransmitDeviceComponentInformation_VendorCode_State::GetPriority()
+{
+    return MedibusServer::CommandClass::Info;
+}
+
 void TransmitDeviceComponentInformation_VendorCode_State::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void TransmitDeviceComponentInformation_VendorCode_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void TransmitDeviceComponentInformation_VendorCode_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     size_t bytes_read = 0;
     if (rddata[0] == 0x06 && rddata[1] == 0x0a && rddata[2] == 0x14)
@@ -1547,8 +2256,16 @@ void TransmitDeviceComponentInformation_VendorCode_State::Update(std::vector<uin
         // Is my response?
     	if ((GetCommandId() & 0x00ff) == rddata[21])
     	{
-            auto ptr = std::make_shared<TransmitDeviceComponentInformation_SerialNumber_State>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            this->context_->RecordIdentity(rddata);
+            if (this->context_->GetIdentity().Field(MedibusServer::IdentityField::SerialNumber).empty())
+            {
+                this->context_->TransitionTo<TransmitDeviceComponentInformation_SerialNumber_State>();
+            }
+            else
+            {
+                // serial number already queried to check the cache
+                this->context_->TransitionTo<TransmitDeviceComponentInformation_HardwareRevision_State>();
+            }
     	}
 
     }
@@ -1559,11 +2276,7 @@ void TransmitDeviceComponentInformation_VendorCode_State::Update(std::vector<uin
         std::stringstream msg;
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        // if second time to create a smart point with the same raw point
-        // TransitionTo will first find the command id related with last time smart point
-        // the new smart point will be released, when this function is end.
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -1576,8 +2289,6 @@ void TransmitDeviceComponentInformation_SerialNumber_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles TransmitDeviceComponentInformation_SerialNumber_State.\n";
         std::stringstream msg;
         msg << "Handles TransmitDeviceComponentInformation_SerialNumber_State.\n";
@@ -1603,12 +2314,17 @@ uint32_t TransmitDeviceComponentInformation_SerialNumber_State::GetCommandId()
     return 0x0a01;
 }
 
+MedibusServer::CommandClass TransmitDeviceComponentInformation_SerialNumber_State::GetPriority()
+{
+    return MedibusServer::CommandClass::Info;
+}
+
 
 void TransmitDeviceComponentInformation_SerialNumber_State::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void TransmitDeviceComponentInformation_SerialNumber_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void TransmitDeviceComponentInformation_SerialNumber_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     size_t bytes_read = 0;
     if (rddata[0] == 0x06 && rddata[1] == 0x0a && rddata[2] == 0x14)
@@ -1628,8 +2344,19 @@ void TransmitDeviceComponentInformation_SerialNumber_State::Update(std::vector<u
         // Is my response?
         if ((GetCommandId() & 0x00ff) == rddata[21])
         {
-            auto ptr = std::make_shared<TransmitDeviceComponentInformation_HardwareRevision_State>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            if (!this->context_->RecordIdentity(rddata))
+            {
+                // another module, query everything
+                this->context_->TransitionTo<TransmitDeviceComponentInformation_VendorCode_State>();
+            }
+            else if (this->context_->IsIdentityConfirmed())
+            {
+                this->context_->TransitionTo<AdjustTimeInformationState>();
+            }
+            else
+            {
+                this->context_->TransitionTo<TransmitDeviceComponentInformation_HardwareRevision_State>();
+            }
         }
       
     }
@@ -1640,8 +2367,7 @@ void TransmitDeviceComponentInformation_SerialNumber_State::Update(std::vector<u
         std::stringstream msg;
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -1654,8 +2380,6 @@ void TransmitDeviceComponentInformation_HardwareRevision_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles TransmitDeviceComponentInformation_HardwareRevision_State.\n";
         std::stringstream msg;
         msg << "Handles TransmitDeviceComponentInformation_HardwareRevision_State.\n";
@@ -1680,11 +2404,16 @@ uint32_t TransmitDeviceComponentInformation_HardwareRevision_State::GetCommandId
     return 0x0a02;
 }
 
+MedibusServer::CommandClass TransmitDeviceComponentInformation_HardwareRevision_State::GetPriority()
+{
+    return MedibusServer::CommandClass::Info;
+}
+
 void TransmitDeviceComponentInformation_HardwareRevision_State::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void TransmitDeviceComponentInformation_HardwareRevision_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void TransmitDeviceComponentInformation_HardwareRevision_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x0a && rddata[2] == 0x14)
     {
@@ -1703,8 +2432,8 @@ void TransmitDeviceComponentInformation_HardwareRevision_State::Update(std::vect
         // Is my response?
         if ((GetCommandId() & 0x00ff) == rddata[21])
         {
-            auto ptr = std::make_shared<TransmitDeviceComponentInformation_SoftwareRevision_State>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            this->context_->RecordIdentity(rddata);
+            this->context_->TransitionTo<TransmitDeviceComponentInformation_SoftwareRevision_State>();
         }
 
     }
@@ -1715,8 +2444,7 @@ void TransmitDeviceComponentInformation_HardwareRevision_State::Update(std::vect
         std::stringstream msg;
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -1730,8 +2458,6 @@ void TransmitDeviceComponentInformation_SoftwareRevision_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles TransmitDeviceComponentInformation_SoftwareRevision_State.\n";
         std::stringstream msg;
         msg << "Handles TransmitDeviceComponentInformation_SoftwareRevision_State.\n";
@@ -1756,11 +2482,16 @@ uint32_t TransmitDeviceComponentInformation_SoftwareRevision_State::GetCommandId
     return 0x0a03;
 }
 
+MedibusServer::CommandClass TransmitDeviceComponentInformation_SoftwareRevision_State::GetPriority()
+{
+    return MedibusServer::CommandClass::Info;
+}
+
 void TransmitDeviceComponentInformation_SoftwareRevision_State::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void TransmitDeviceComponentInformation_SoftwareRevision_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void TransmitDeviceComponentInformation_SoftwareRevision_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x0a && rddata[2] == 0x14)
     {
@@ -1779,8 +2510,8 @@ void TransmitDeviceComponentInformation_SoftwareRevision_State::Update(std::vect
         // Is my response?
         if ((GetCommandId() & 0x00ff) == rddata[21])
         {
-            auto ptr = std::make_shared<TransmitDeviceComponentInformation_ProductName_State>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            this->context_->RecordIdentity(rddata);
+            this->context_->TransitionTo<TransmitDeviceComponentInformation_ProductName_State>();
         }
         
     }
@@ -1791,8 +2522,7 @@ void TransmitDeviceComponentInformation_SoftwareRevision_State::Update(std::vect
         std::stringstream msg;
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -1806,8 +2536,6 @@ void TransmitDeviceComponentInformation_ProductName_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles TransmitDeviceComponentInformation_ProductName_State.\n";
         std::stringstream msg;
         msg << "Handles TransmitDeviceComponentInformation_ProductName_State.\n";
@@ -1833,11 +2561,16 @@ uint32_t TransmitDeviceComponentInformation_ProductName_State::GetCommandId()
     return 0x0a05;
 }
 
+MedibusServer::CommandClass TransmitDeviceComponentInformation_ProductName_State::GetPriority()
+{
+    return MedibusServer::CommandClass::Info;
+}
+
 void TransmitDeviceComponentInformation_ProductName_State::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void TransmitDeviceComponentInformation_ProductName_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void TransmitDeviceComponentInformation_ProductName_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x0a && rddata[2] == 0x14)
     {
@@ -1856,8 +2589,8 @@ void TransmitDeviceComponentInformation_ProductName_State::Update(std::vector<ui
         // Is my response?
         if ((GetCommandId() & 0x00ff) == rddata[21])
         {
-            auto ptr = std::make_shared<TransmitDeviceComponentInformation_PartNumber_State>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            this->context_->RecordIdentity(rddata);
+            this->context_->TransitionTo<TransmitDeviceComponentInformation_PartNumber_State>();
         }
 
     }
@@ -1873,8 +2606,7 @@ void TransmitDeviceComponentInformation_ProductName_State::Update(std::vector<ui
         msg << "Skip to TransmitDeviceComponentInformation_PartNumber_State.\n";
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
-        auto ptr = std::make_shared<TransmitDeviceComponentInformation_PartNumber_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<TransmitDeviceComponentInformation_PartNumber_State>();
     }
 }
 
@@ -1886,8 +2618,6 @@ void TransmitDeviceComponentInformation_PartNumber_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles TransmitDeviceComponentInformation_PartNumber_State.\n";
         std::stringstream msg;
         msg << "Handles TransmitDeviceComponentInformation_PartNumber_State.\n";
@@ -1913,11 +2643,16 @@ uint32_t TransmitDeviceComponentInformation_PartNumber_State::GetCommandId()
     return 0x0a06;
 }
 
+MedibusServer::CommandClass TransmitDeviceComponentInformation_PartNumber_State::GetPriority()
+{
+    return MedibusServer::CommandClass::Info;
+}
+
 void TransmitDeviceComponentInformation_PartNumber_State::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void TransmitDeviceComponentInformation_PartNumber_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void TransmitDeviceComponentInformation_PartNumber_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x0a && rddata[2] == 0x14)
     {
@@ -1937,8 +2672,8 @@ void TransmitDeviceComponentInformation_PartNumber_State::Update(std::vector<uin
         // Is my response?
         if ((GetCommandId() & 0x00ff) == rddata[21])
         {
-            auto ptr = std::make_shared<AdjustTimeInformationState>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            this->context_->RecordIdentity(rddata);
+            this->context_->TransitionTo<AdjustTimeInformationState>();
         }
         
     }
@@ -1949,8 +2684,7 @@ void TransmitDeviceComponentInformation_PartNumber_State::Update(std::vector<uin
         std::stringstream msg;
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -1964,8 +2698,6 @@ void AdjustTimeInformationState::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles AdjustTimeInformationState.\n";
         std::stringstream msg;
         msg << "Handles AdjustTimeInformationState.\n";
@@ -1991,11 +2723,16 @@ uint32_t AdjustTimeInformationState::GetCommandId()
     return 0x2b;
 }
 
+MedibusServer::CommandClass AdjustTimeInformationState::GetPriority()
+{
+    return MedibusServer::CommandClass::Info;
+}
+
 void AdjustTimeInformationState::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void AdjustTimeInformationState::Update(std::vector<uint8_t> rddata, size_t sz)
+void AdjustTimeInformationState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x2b && rddata[2] == 0x00)
     {
@@ -2006,8 +2743,17 @@ void AdjustTimeInformationState::Update(std::vector<uint8_t> rddata, size_t sz)
 
         // sucess
 
-        auto ptr = std::make_shared<TransmitGenericModuleFeaturesState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        const MedibusServer::DeviceIdentity& identity = this->context_->GetIdentity();
+        if (this->context_->IsIdentityConfirmed() && identity.featuresKnown)
+        {
+            // module features are part of the cached identity
+            this->context_->ApplyModuleFeatures(identity.features);
+            this->context_->TransitionTo<SwitchBreathDetectionMode_PgmBreathDetection_State>();
+        }
+        else
+        {
+            this->context_->TransitionTo<TransmitGenericModuleFeaturesState>();
+        }
 
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x2b && rddata[2] == 0x01)
@@ -2017,8 +2763,7 @@ void AdjustTimeInformationState::Update(std::vector<uint8_t> rddata, size_t sz)
         std::stringstream msg;
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 }
 
@@ -2030,8 +2775,6 @@ void TransmitGenericModuleFeaturesState::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles TransmitGenericModuleFeaturesState.\n";
         std::stringstream msg;
         msg << "Handles TransmitGenericModuleFeaturesState.\n";
@@ -2057,51 +2800,26 @@ uint32_t TransmitGenericModuleFeaturesState::GetCommandId()
     return 0x2c12;
 }
 
+MedibusServer::CommandClass TransmitGenericModuleFeaturesState::GetPriority()
+{
+    return MedibusServer::CommandClass::Info;
+}
+
 
 void TransmitGenericModuleFeaturesState::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
 // CMD_$2C - Transmit Generic Module Features
-void TransmitGenericModuleFeaturesState::Update(std::vector<uint8_t> rddata, size_t sz)
+void TransmitGenericModuleFeaturesState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x2c && rddata[2] == 0x04)
     {
         // sucess
-        // bit1
-        if ((rddata[6] & 0x02) == 0x02)
-        {
-            // bit2
-            // pneumatic component available
-            if ((rddata[6] & 0x04) == 0x04)
-            {
-                this->context_->SetPneumaticsEnabled(true);
-            }
-            else
-            {
-                // pneumatic component not available
-                this->context_->SetPneumaticsEnabled(false);
-            }
-        }
-        else
-        {
-            // pneumatic component not available
-            this->context_->SetPneumaticsEnabled(false);
-        }
+        this->context_->ApplyModuleFeatures(rddata[6]);
+        this->context_->RecordModuleFeatures(true, rddata[6]);
 
-        // bit0
-        // 	ZERO_CTRL - Zero Control
-        if ((rddata[6] & 0x01) == 0x01)
-        {
-            this->context_->SetAutoZeroCondition(false);
-        }
-        else
-        {
-            this->context_->SetAutoZeroCondition(true);
-        }
-
-        auto ptr = std::make_shared<SwitchBreathDetectionMode_PgmBreathDetection_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<SwitchBreathDetectionMode_PgmBreathDetection_State>();
 
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x2c && rddata[2] == 0x01)
@@ -2116,8 +2834,8 @@ void TransmitGenericModuleFeaturesState::Update(std::vector<uint8_t> rddata, siz
         msg << "Skip to SwitchBreathDetectionMode_PgmBreathDetection_State.\n";
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
-        auto ptr = std::make_shared<SwitchBreathDetectionMode_PgmBreathDetection_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->RecordModuleFeatures(false, 0);
+        this->context_->TransitionTo<SwitchBreathDetectionMode_PgmBreathDetection_State>();
     }
 
     PrintData(rddata);
@@ -2162,7 +2880,7 @@ void TransmitGenericModuleFeaturesState::Update(std::vector<uint8_t> rddata, siz
 //
 //
 //// CMD_$2C - Transmit Generic Module Features
-//void TransmitGenericModuleFeatures_AutoZeroCondition_State::Update(std::vector<uint8_t> rddata, size_t sz)
+//void TransmitGenericModuleFeatures_AutoZeroCondition_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 //{
 //    if (rddata[0] == 0x06 && rddata[1] == 0x2c && rddata[2] == 0x04)
 //    {
@@ -2214,8 +2932,6 @@ void SwitchBreathDetectionMode_PgmBreathDetection_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles SwitchBreathDetectionModeState.\n";
         std::stringstream msg;
         msg << "Handles SwitchBreathDetectionModeState.\n";
@@ -2249,7 +2965,7 @@ void SwitchBreathDetectionMode_PgmBreathDetection_State::Register() {
 }
 
 // CMD_$1E - Switch Breath Detection Mode
-void SwitchBreathDetectionMode_PgmBreathDetection_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SwitchBreathDetectionMode_PgmBreathDetection_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x1e && rddata[2] == 0x00)
     {
@@ -2259,15 +2975,13 @@ void SwitchBreathDetectionMode_PgmBreathDetection_State::Update(std::vector<uint
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
         // sucess
-        auto ptr = std::make_shared<SwitchBreathDetectionMode_PgmBreathDetectionAutoWakeup_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<SwitchBreathDetectionMode_PgmBreathDetectionAutoWakeup_State>();
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -2282,8 +2996,6 @@ void SwitchBreathDetectionMode_PgmBreathDetectionAutoWakeup_State::HandleData()
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles SwitchBreathDetectionModeState.\n";
         std::stringstream msg;
         msg << "Handles SwitchBreathDetectionModeState.\n";
@@ -2315,7 +3027,7 @@ void SwitchBreathDetectionMode_PgmBreathDetectionAutoWakeup_State::Register() {
 }
 
 
-void SwitchBreathDetectionMode_PgmBreathDetectionAutoWakeup_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SwitchBreathDetectionMode_PgmBreathDetectionAutoWakeup_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x1e && rddata[2] == 0x00)
     {
@@ -2325,8 +3037,7 @@ void SwitchBreathDetectionMode_PgmBreathDetectionAutoWakeup_State::Update(std::v
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
         // sucess
-        auto ptr = std::make_shared<SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State>();
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
     {
@@ -2336,8 +3047,7 @@ void SwitchBreathDetectionMode_PgmBreathDetectionAutoWakeup_State::Update(std::v
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -2352,8 +3062,6 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State.\n";
         std::stringstream msg;
         msg << "Handles SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State.\n";
@@ -2385,7 +3093,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x1e && rddata[2] == 0x00)
     {
@@ -2395,8 +3103,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State::Update(std::ve
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
         // sucess
-        auto ptr = std::make_shared<SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr );
+        this->context_->TransitionTo<SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State>();
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
     {
@@ -2406,8 +3113,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase1_State::Update(std::ve
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -2423,8 +3129,6 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State.\n";
         std::stringstream msg;
         msg << "Handles SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State.\n";
@@ -2456,7 +3160,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State::Register() {
 }
 
 
-void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x1e && rddata[2] == 0x00)
     {
@@ -2466,8 +3170,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State::Update(std::ve
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
         // sucess
-        auto ptr = std::make_shared<SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr );
+        this->context_->TransitionTo<SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State>();
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
     {
@@ -2477,8 +3180,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase2_State::Update(std::ve
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -2493,8 +3195,6 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State.\n";
         std::stringstream msg;
         msg << "Handles SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State.\n";
@@ -2526,7 +3226,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State::Register() {
 }
 
 
-void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x1e && rddata[2] == 0x00)
     {
@@ -2536,8 +3236,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State::Update(std::ve
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
         // sucess
-        auto ptr = std::make_shared<SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr );
+        this->context_->TransitionTo<SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State>();
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
     {
@@ -2547,8 +3246,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase3_State::Update(std::ve
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -2564,8 +3262,6 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State.\n";
         std::stringstream msg;
         msg << "Handles SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State.\n";
@@ -2597,7 +3293,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State::Register() {
 }
 
 
-void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x1e && rddata[2] == 0x00)
     {
@@ -2607,8 +3303,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State::Update(std::ve
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
         // sucess
-        auto ptr = std::make_shared<SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr );
+        this->context_->TransitionTo<SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State>();
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
     {
@@ -2618,8 +3313,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase4_State::Update(std::ve
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -2634,8 +3328,6 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State.\n";
         std::stringstream msg;
         msg << "Handles SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State.\n";
@@ -2667,7 +3359,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x1e && rddata[2] == 0x00)
     {
@@ -2677,8 +3369,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State::Update(std::ve
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
         // sucess
-        auto ptr = std::make_shared<TransmitPatientData_120E_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<TransmitPatientData_120E_State>();
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
     {
@@ -2688,8 +3379,7 @@ void SwitchBreathDetectionMode_AutoWakeupAfterBreathphase5_State::Update(std::ve
         msg << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         MedibusServer::LogProvider::Instance().LogFile(msg.str());
 
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -2705,7 +3395,6 @@ void TransmitPatientData_120E_State::HandleData() {
         }
         SetAlreadySent(true);
         std::vector<uint8_t> data;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles TransmitPatientDataState.\n";
         std::stringstream msg;
         msg << "Handles TransmitPatientDataState.\n";
@@ -2751,13 +3440,10 @@ void TransmitPatientData_120E_State::HandleData() {
     }
 }
 
-// Command={10 0d 12 00 00 00 00 00 0f 68 18 40 1f 00 3c a7}
+// Command={10 0d 12 00 00 00 00 00 <selector> 00 3c CS}, all data is 0f 68 18 40 1f
 std::vector<uint8_t> TransmitPatientData_120E_State::GetCommand() {
-
-    //std::vector<uint8_t> data{ 0x10, 0x0d, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x40, 0x05, 0x00, 0x3c, 0x10  };
-    // all data
-    std::vector<uint8_t> data{ 0x10, 0x0d, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x68, 0x18, 0x40, 0x1f, 0x00, 0x3c, 0xa7 };
-    return data;
+    // only the frames subscribed to
+    return this->context_->Subscriptions().IssueCommand();
 }
 
 size_t TransmitPatientData_120E_State::GetRespondBytes() {
@@ -2774,7 +3460,7 @@ void TransmitPatientData_120E_State::Register() {
 }
 
 
-void TransmitPatientData_120E_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void TransmitPatientData_120E_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
@@ -2798,15 +3484,13 @@ void TransmitPatientData_120E_State::Update(std::vector<uint8_t> rddata, size_t
                 // fail
                 std::cout << "Fail with switch to MeasurementModeState: " << '\n';
 
-                auto ptr = std::make_shared<MeasurementModeState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<MeasurementModeState>();
             }
             else
             {
                 // success
                 std::cout << "Change the state of the context to TransmitPatientData_120E_State.\n";
-                auto ptr = std::make_shared<OperatingModeState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<OperatingModeState>();
             }
         }
     }
@@ -2815,8 +3499,7 @@ void TransmitPatientData_120E_State::Update(std::vector<uint8_t> rddata, size_t
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         std::cout << "Skip to OperatingModeState.\n";
-        auto ptr = std::make_shared<OperatingModeState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<OperatingModeState>();
     }
 
     PrintData(rddata);
@@ -2841,8 +3524,6 @@ void MeasurementModeState::HandleData() {
             return;
         }
         SetAlreadySent(true);
-        //std::vector<uint8_t> rddata;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles OperatingModeState.\n";
         std::chrono::milliseconds now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
         
@@ -2899,7 +3580,7 @@ void MeasurementModeState::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void MeasurementModeState::Update(std::vector<uint8_t> rddata, size_t sz)
+void MeasurementModeState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x03 && rddata[2] == 0x01)
     {
@@ -2908,16 +3589,14 @@ void MeasurementModeState::Update(std::vector<uint8_t> rddata, size_t sz)
         if (rddata[3] == 0x00)
         {
             std::cout << "Change the state of the context to OperatingModeState.\n";
-            auto ptr = std::make_shared<OperatingModeState>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            this->context_->TransitionTo<OperatingModeState>();
         }
         else
         {
             // fail
             std::cout << "Still not measurement mode: " << GetErrorMessage(rddata[3]) << '\n';
             std::cout << "Change the state of the context to MeasurementModeState.\n";
-            auto ptr = std::make_shared<MeasurementModeState>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            this->context_->TransitionTo<MeasurementModeState>();
         }
 
     }
@@ -2925,8 +3604,7 @@ void MeasurementModeState::Update(std::vector<uint8_t> rddata, size_t sz)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -2941,7 +3619,6 @@ void OperatingModeState::HandleData() {
         }
         SetAlreadySent(true);
         std::vector<uint8_t> data;
-        uint8_t* rddata = new uint8_t[BUFSZ]();
         std::cout << "Handles OperatingModeState.\n";
 
         size_t bytes_wrote = this->context_->SendCmd(this);
@@ -2987,7 +3664,7 @@ void OperatingModeState::Register() {
     this->context_->AttachNeedResponse(this);
 }
 
-void OperatingModeState::Update(std::vector<uint8_t> rddata, size_t sz)
+void OperatingModeState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x03 && rddata[2] == 0x01)
     {
@@ -2995,8 +3672,7 @@ void OperatingModeState::Update(std::vector<uint8_t> rddata, size_t sz)
         if (rddata[3] == 0x00)
         {
             std::cout << "Change the state of the context SwitchValvesState.\n";
-            auto ptr = std::make_shared<SwitchValvesState>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            this->context_->TransitionTo<SwitchValvesState>();
         }
 
     }
@@ -3004,8 +3680,7 @@ void OperatingModeState::Update(std::vector<uint8_t> rddata, size_t sz)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
 
     PrintData(rddata);
@@ -3022,7 +3697,6 @@ void SwitchValvesState::HandleData()
     }
     SetAlreadySent(true);
     std::vector<uint8_t> data;
-    uint8_t* rddata = new uint8_t[BUFSZ]();
     std::cout << "Handles SwitchValvesState.\n";
 
     size_t bytes_wrote = this->context_->SendCmd(this);
@@ -3051,914 +3725,321 @@ void SwitchValvesState::Register()
     this->context_->AttachNeedResponse(this);
 }
 
-void SwitchValvesState::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x61 && rddata[2] == 0x00)
-    {
-        // success
-        std::cout << "Change the state of the context SwitchPumpState.\n";
-        auto ptr = std::make_shared<SwitchPumpState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x62 && rddata[2] == 0x01)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-    }
-
-    PrintData(rddata);
-}
-
-
-// Switch Valves State
-// CMD_$61 - Switch Valves
-void SwitchPumpState::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::vector<uint8_t> data;
-    uint8_t* rddata = new uint8_t[BUFSZ]();
-    std::cout << "Handles SwitchPumpState.\n";
-
-    size_t bytes_wrote = this->context_->SendCmd(this);
-}
-
-// PF - Pump Flow
-// High Flow
-std::vector<uint8_t> SwitchPumpState::GetCommand()
-{
-    std::vector<uint8_t> data{ 0x10, 0x02, 0x62, 0x02, 0x8a };
-    return data;
-}
-
-size_t SwitchPumpState::GetRespondBytes()
-{
-    return 4;
-}
-
-uint32_t SwitchPumpState::GetCommandId()
-{
-    return 0x6202;
-}
-
-void SwitchPumpState::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void SwitchPumpState::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x62 && rddata[2] == 0x00)
-    {
-        // success
-        std::cout << "Change the state of the context SelectTheAnestheticAgentState.\n";
-        auto ptr = std::make_shared<SelectTheAnestheticAgentState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x62 && rddata[2] == 0x01)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-    }
-
-    PrintData(rddata);
-}
-
-
-// Handle Continuous Command
-// SelectTheAnestheticAgentState
-// FRAME_$12$0E - Parameter Detailed Status
-void SelectTheAnestheticAgentState::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    Register();
-}
-
-std::vector<uint8_t> SelectTheAnestheticAgentState::GetCommand()
-{
-    return std::vector<uint8_t>();
-}
-
-size_t SelectTheAnestheticAgentState::GetRespondBytes()
-{
-    return 0;
-}
-
-// CommandId=0x120e0401
-uint32_t SelectTheAnestheticAgentState::GetCommandId()
-{
-    return 0x120e0401;
-}
-
-void SelectTheAnestheticAgentState::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void SelectTheAnestheticAgentState::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
-    {
-        if (rddata[13] == 0x0e )
-        {
-            // PAI available?
-            if (rddata[4] & 0x0c)
-            {
-                // success
-                std::cout << "PAI is available .\n";
-                this->context_->SetPAIAvailable(true);
-                std::cout << "Change the state of the context Evaluate_1210_State.\n";
-                auto ptr = std::make_shared<Evaluate_1210_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-            // PAI not available
-            else
-            {
-                // success
-                std::cout << "Change the state of the context.\n";
-                auto ptr = std::make_shared<ProvideTheSensorModuleWithRequiredData_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
-       
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-    }
-
-    PrintData(rddata);
-}
-
-
-void Evaluate_1210_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::cout << "Handles Evaluate_1210_State.\n";
-    Register();
-}
-
-std::vector<uint8_t> Evaluate_1210_State::GetCommand()
-{
-    return std::vector<uint8_t>();
-}
-
-size_t Evaluate_1210_State::GetRespondBytes()
-{
-    return 0;
-}
-
-uint32_t Evaluate_1210_State::GetCommandId()
-{
-    return 0x121009;
-}
-
-void Evaluate_1210_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void Evaluate_1210_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
-    {
-        
-        if (rddata[13] == 0x10 && (rddata[9] & 0x03) == 0x0)
-        {
-            // NAIF
-            // success
-            std::cout << "Change the state of the context SelectAnestheticAgentType_Halothane_State.\n";
-            auto ptr = std::make_shared<SelectAnestheticAgentType_Halothane_State>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-        }
-
-        else if (rddata[13] == 0x10 && (rddata[9] & 0x02))
-        {
-            // DAIF
-            // success
-            std::cout << "Change the state of the context ProvideTheSensorModuleWithRequiredData_State.\n";
-            auto ptr = std::make_shared<ProvideTheSensorModuleWithRequiredData_State>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-        }
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-    }
-
-    PrintData(rddata);
-}
-
-void SelectAnestheticAgentType_Halothane_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::vector<uint8_t> data;
-    uint8_t* rddata = new uint8_t[BUFSZ]();
-    std::cout << "Handles SelectAnestheticAgentType_Halothane_State.\n";
-
-    size_t bytes_wrote = this->context_->SendCmd(this);
-}
-
-std::vector<uint8_t> SelectAnestheticAgentType_Halothane_State::GetCommand()
-{
-    std::vector<uint8_t> data{ 0x10, 0x03, 0x1d, 0x01, 0x00, 0xcf };
-    return data;
-}
-
-size_t SelectAnestheticAgentType_Halothane_State::GetRespondBytes()
-{
-    return size_t();
-}
-
-uint32_t SelectAnestheticAgentType_Halothane_State::GetCommandId()
-{
-    return 0x1d01;
-}
-
-void SelectAnestheticAgentType_Halothane_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void SelectAnestheticAgentType_Halothane_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x1d && rddata[2] == 0x00)
-    {
-        // success
-        std::cout << "Change the state of the context ProvideTheSensorModuleWithRequiredData_State.\n";
-        auto ptr = std::make_shared<ProvideTheSensorModuleWithRequiredData_State>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x1d && rddata[2] == 0x01)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-        auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-    }
-
-    PrintData(rddata);
-}
-
-void ProvideTheSensorModuleWithRequiredData_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::cout << "Handles ProvideTheSensorModuleWithRequiredData_State.\n";
-    Register();
-}
-
-
-std::vector<uint8_t> ProvideTheSensorModuleWithRequiredData_State::GetCommand()
-{
-    return std::vector<uint8_t>();
-}
-size_t ProvideTheSensorModuleWithRequiredData_State::GetRespondBytes()
-{
-    return size_t();
-}
-
-// CommandId=0x120e07
-uint32_t ProvideTheSensorModuleWithRequiredData_State::GetCommandId()
-{
-    return 0x120e07;
-}
-void ProvideTheSensorModuleWithRequiredData_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-void ProvideTheSensorModuleWithRequiredData_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
-    {
-        if (rddata[13] == 0x0e)
-        {
-            // check HSP for checking needs the module external data
-            if (rddata[7] & 0xde)
-            {
-                // yes, need
-                 // success
-                std::cout << "Needs External Data .\n";
-
-                std::cout << "Change the state of the context AcceptExternalParameterData_UnknownAccuracy_State.\n";
-                auto ptr = std::make_shared<AcceptExternalParameterData_UnknownAccuracy_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-            else
-            {
-               // no, not need
-                // success
-                std::cout << "Not Needs External Data .\n";
-
-                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit2_State.\n";
-                 auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit2_State>();
-                 this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-    }
-
-    PrintData(rddata);
-}
-
-void AcceptExternalParameterData_UnknownAccuracy_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::vector<uint8_t> data;
-    uint8_t* rddata = new uint8_t[BUFSZ]();
-    std::cout << "Handles AcceptExternalParameterData_UnknownAccuracy_State.\n";
-
-    size_t bytes_wrote = this->context_->SendCmd(this);
-}
-
-// Command={10 06 1c df 0a 02 e3}
-// Command={10 06 1c df 0a 01 e3}
-std::vector<uint8_t> AcceptExternalParameterData_UnknownAccuracy_State::GetCommand()
-{
-    std::vector<uint8_t> data{ 0x10, 0x06, 0x1c, 0xdf, 0x0a, 0x02, 0xe3};
-    return data;
-}
-
-size_t AcceptExternalParameterData_UnknownAccuracy_State::GetRespondBytes()
-{
-    return size_t();
-}
-
-// CommandId=0x06
-uint32_t AcceptExternalParameterData_UnknownAccuracy_State::GetCommandId()
-{
-    return 0x06;
-}
-
-void AcceptExternalParameterData_UnknownAccuracy_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void AcceptExternalParameterData_UnknownAccuracy_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x1c && rddata[2] == 0x00)
-    {
-        // success
-        std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit2_State.\n";
-         auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit2_State>();
-         this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x1c && rddata[2] == 0x01)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-       /* auto ptr = std::make_shared<StopContinuousDataState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);*/
-    }
-
-    PrintData(rddata);
-}
-
-void SuperviseModuleStatus_120E_MSBit2_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::cout << "Handles SuperviseModuleStatus_120E_MSBit2_State.\n";
-    Register();
-}
-std::vector<uint8_t> SuperviseModuleStatus_120E_MSBit2_State::GetCommand()
-{
-    return std::vector<uint8_t>();
-}
-size_t SuperviseModuleStatus_120E_MSBit2_State::GetRespondBytes()
-{
-    return size_t();
-}
-uint32_t SuperviseModuleStatus_120E_MSBit2_State::GetCommandId()
-{
-    return 0x120e02;
-}
-void SuperviseModuleStatus_120E_MSBit2_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-void SuperviseModuleStatus_120E_MSBit2_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
-    {
-        if (rddata[13] == 0x0e)
-        {
-            // check Watertrap? yes
-            if (rddata[14] & 0x04)
-            {
-                // yes
-                std::cout << "Change the state of the context SuperviseModuleStatus_120B_MSWBit5_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120B_MSWBit5_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-            // check Watertrap? no
-            else 
-            {
-                // Is Any Component Fail?
-                 auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit6_State>();
-                 this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
-
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-    }
-
-    PrintData(rddata);
-}
-
-void SuperviseModuleStatus_120B_MSWBit5_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::cout << "Handles SuperviseModuleStatus_120B_MSWBit5_State.\n";
-    Register();
-}
-
-std::vector<uint8_t> SuperviseModuleStatus_120B_MSWBit5_State::GetCommand()
-{
-    return std::vector<uint8_t>();
-}
-
-size_t SuperviseModuleStatus_120B_MSWBit5_State::GetRespondBytes()
-{
-    return size_t();
-}
-
-// CommandId=0x120b05
-uint32_t SuperviseModuleStatus_120B_MSWBit5_State::GetCommandId()
-{
-    return 0x120b05;
-}
-
-void SuperviseModuleStatus_120B_MSWBit5_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void SuperviseModuleStatus_120B_MSWBit5_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    // Is Watertrap disconnected
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
-    {
-        if (rddata[13] == 0x0b)
-        {
-            // MSW, bit5
-            if (rddata[3] & 0x20)
-            {
-                // Watertrap is disconnected.
-                // Do not affect values
-                // Display warning message to check watertrap.
-                std::cout << "Display warning message to check watertrap .\n";
-                std::cout << "Leave gas labels and values unchanged at this point .\n";
-                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit6_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit6_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-
-            }
-            else
-            {
-                std::cout << "Change the state of the context SuperviseModuleStatus_120B_MSWBit6_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120B_MSWBit6_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-    }
-}
-
-
-void SuperviseModuleStatus_120B_MSWBit6_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::cout << "Handles SuperviseModuleStatus_120B_MSWBit6_State.\n";
-    Register();
-}
-
-std::vector<uint8_t> SuperviseModuleStatus_120B_MSWBit6_State::GetCommand()
-{
-    return std::vector<uint8_t>();
-}
-
-size_t SuperviseModuleStatus_120B_MSWBit6_State::GetRespondBytes()
-{
-    return size_t();
-}
-
-uint32_t SuperviseModuleStatus_120B_MSWBit6_State::GetCommandId()
-{
-    return 0x120b06;
-}
-
-void SuperviseModuleStatus_120B_MSWBit6_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void SuperviseModuleStatus_120B_MSWBit6_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    // Watertrap full?
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
-    {
-        if (rddata[13] == 0x0b)
-        {
-            // MSW, bit5
-            if (rddata[3] & 0x40)
-            {
-                // Watertrap is full.
-                // Replace wa
-                // tertrap.
-                // Do not affect values.
-                std::cout << "Display warning message, that watetrap is full. \n";
-                std::cout << "Leave gas labels and values unchanged at this point .\n";
-                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit6_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit6_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-
-            }
-            else
-            {
-                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSWBit7_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSWBit7_State>();
-
+void SwitchValvesState::Update(const std::vector<uint8_t>& rddata, size_t sz)
+{
+    if (rddata[0] == 0x06 && rddata[1] == 0x61 && rddata[2] == 0x00)
+    {
+        // success
+        std::cout << "Change the state of the context SwitchPumpState.\n";
+        this->context_->TransitionTo<SwitchPumpState>();
 
-            	this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
     }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
+    else if (rddata[0] == 0x15 && rddata[1] == 0x62 && rddata[2] == 0x01)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
+
+    PrintData(rddata);
 }
 
-void SuperviseModuleStatus_120E_MSWBit7_State::HandleData()
+
+// Switch Valves State
+// CMD_$61 - Switch Valves
+void SwitchPumpState::HandleData()
 {
     if (IsAlreadySent())
     {
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles SuperviseModuleStatus_120E_MSWBit7_State.\n";
-    Register();
+    std::vector<uint8_t> data;
+    std::cout << "Handles SwitchPumpState.\n";
+
+    size_t bytes_wrote = this->context_->SendCmd(this);
 }
 
-std::vector<uint8_t> SuperviseModuleStatus_120E_MSWBit7_State::GetCommand()
+// PF - Pump Flow
+// High Flow
+std::vector<uint8_t> SwitchPumpState::GetCommand()
 {
-    return std::vector<uint8_t>();
+    std::vector<uint8_t> data{ 0x10, 0x02, 0x62, 0x02, 0x8a };
+    return data;
 }
 
-size_t SuperviseModuleStatus_120E_MSWBit7_State::GetRespondBytes()
+size_t SwitchPumpState::GetRespondBytes()
 {
-    return size_t();
+    return 4;
 }
 
-uint32_t SuperviseModuleStatus_120E_MSWBit7_State::GetCommandId()
+uint32_t SwitchPumpState::GetCommandId()
 {
-    return 0x120b07;
+    return 0x6202;
 }
 
-void SuperviseModuleStatus_120E_MSWBit7_State::Register()
+void SwitchPumpState::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void SuperviseModuleStatus_120E_MSWBit7_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SwitchPumpState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
-    // Watertrap warning?
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
+    if (rddata[0] == 0x06 && rddata[1] == 0x62 && rddata[2] == 0x00)
     {
-        if (rddata[13] == 0x0b)
-        {
-            // MSW, bit5
-            if (rddata[3] & 0x80)
-            {
-                // Watertrap will be full soon.
-                // DO not affect values.
-                std::cout << "Display warning message to check watertrap level. \n";
-                std::cout << "Leave gas labels and values unchanged at this point .\n";
-                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit6_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit6_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        // success
+        std::cout << "Change the state of the context SelectTheAnestheticAgentState.\n";
+        this->context_->TransitionTo<SelectTheAnestheticAgentState>();
 
-            }
-            else
-            {
-                // SW-Bug.
-                // Handle as unspecific pneumatics error.
-                std::cout << "Display warning message to check pneumatics. \n";
-                std::cout << "Leave gas labels and values unchanged at this point .\n";
-                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit6_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit6_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
     }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
+    else if (rddata[0] == 0x15 && rddata[1] == 0x62 && rddata[2] == 0x01)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
+
+    PrintData(rddata);
 }
 
-void SuperviseModuleStatus_120E_MSBit6_State::HandleData()
+
+// Handle Continuous Command
+// SelectTheAnestheticAgentState
+// FRAME_$12$0E - Parameter Detailed Status
+void SelectTheAnestheticAgentState::HandleData()
 {
     if (IsAlreadySent())
     {
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles SuperviseModuleStatus_120E_MSBit6_State.\n";
     Register();
 }
 
-std::vector<uint8_t> SuperviseModuleStatus_120E_MSBit6_State::GetCommand()
+std::vector<uint8_t> SelectTheAnestheticAgentState::GetCommand()
 {
     return std::vector<uint8_t>();
 }
 
-size_t SuperviseModuleStatus_120E_MSBit6_State::GetRespondBytes()
+size_t SelectTheAnestheticAgentState::GetRespondBytes()
 {
-    return size_t();
+    return 0;
 }
 
-// CommandId=0x120e06
-uint32_t SuperviseModuleStatus_120E_MSBit6_State::GetCommandId()
+// CommandId=0x120e0401
+uint32_t SelectTheAnestheticAgentState::GetCommandId()
 {
-    return 0x120e06;
+    return 0x120e0401;
 }
 
-void SuperviseModuleStatus_120E_MSBit6_State::Register()
+void SelectTheAnestheticAgentState::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void SuperviseModuleStatus_120E_MSBit6_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SelectTheAnestheticAgentState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
-    // Any Component Fail
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
-        if (rddata[13] == 0x0e)
+        if (rddata[13] == 0x0e )
         {
-            // check Watertrap? 
-            if (rddata[14] & 0x40)
+            // PAI available?
+            if (rddata[4] & 0x0c)
             {
-                // yes
-                // Display warning message, that a hardware failure is present
-                std::cout << "Display warning message, that a hardware failure is present. \n";
-                std::cout << "Leave gas labels and values unchanged at this point .\n";
-                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit5_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit5_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                // success
+                std::cout << "PAI is available .\n";
+                this->context_->SetPAIAvailable(true);
+                std::cout << "Change the state of the context Evaluate_1210_State.\n";
+                this->context_->TransitionTo<Evaluate_1210_State>();
             }
+            // PAI not available
             else
             {
-                // no
-                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit5_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit5_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                // success
+                std::cout << "Change the state of the context.\n";
+                this->context_->TransitionTo<ProvideTheSensorModuleWithRequiredData_State>();
             }
         }
+       
     }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
+    else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
     }
+
+    PrintData(rddata);
 }
 
-void SuperviseModuleStatus_120E_MSBit5_State::HandleData()
+
+void Evaluate_1210_State::HandleData()
 {
     if (IsAlreadySent())
     {
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles SuperviseModuleStatus_120E_MSBit5_State.\n";
+    std::cout << "Handles Evaluate_1210_State.\n";
     Register();
 }
 
-std::vector<uint8_t> SuperviseModuleStatus_120E_MSBit5_State::GetCommand()
+std::vector<uint8_t> Evaluate_1210_State::GetCommand()
 {
     return std::vector<uint8_t>();
 }
 
-size_t SuperviseModuleStatus_120E_MSBit5_State::GetRespondBytes()
+size_t Evaluate_1210_State::GetRespondBytes()
 {
-    return size_t();
+    return 0;
 }
 
-uint32_t SuperviseModuleStatus_120E_MSBit5_State::GetCommandId()
+uint32_t Evaluate_1210_State::GetCommandId()
 {
-    return 0x120e05;
+    return 0x121009;
 }
 
-void SuperviseModuleStatus_120E_MSBit5_State::Register()
+void Evaluate_1210_State::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void SuperviseModuleStatus_120E_MSBit5_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void Evaluate_1210_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
-        if (rddata[13] == 0x0e)
+        
+        if (rddata[13] == 0x10 && (rddata[9] & 0x03) == 0x0)
         {
-            if (rddata[14] & 0x20)
-            {
-                // yes
-                std::cout << "Frame data contain breath phase related data which can be evaluated for e.g. alarm handling. \n";
-                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit4_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit4_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-            else
-            {
-                // no
-                std::cout << "Frame data contain realtime values(same as corresponding parameter RT_X in RTDATA). \n";
-                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit4_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit4_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
+            // NAIF
+            // success
+            std::cout << "Change the state of the context SelectAnestheticAgentType_Halothane_State.\n";
+            this->context_->TransitionTo<SelectAnestheticAgentType_Halothane_State>();
+        }
+
+        else if (rddata[13] == 0x10 && (rddata[9] & 0x02))
+        {
+            // DAIF
+            // success
+            std::cout << "Change the state of the context ProvideTheSensorModuleWithRequiredData_State.\n";
+            this->context_->TransitionTo<ProvideTheSensorModuleWithRequiredData_State>();
         }
     }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
+    else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
     }
+
+    PrintData(rddata);
 }
 
-void SuperviseModuleStatus_120E_MSBit4_State::HandleData()
+void SelectAnestheticAgentType_Halothane_State::HandleData()
 {
     if (IsAlreadySent())
     {
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles SuperviseModuleStatus_120E_MSBit4_State.\n";
-    Register();
+    std::vector<uint8_t> data;
+    std::cout << "Handles SelectAnestheticAgentType_Halothane_State.\n";
+
+    size_t bytes_wrote = this->context_->SendCmd(this);
 }
 
-std::vector<uint8_t> SuperviseModuleStatus_120E_MSBit4_State::GetCommand()
+std::vector<uint8_t> SelectAnestheticAgentType_Halothane_State::GetCommand()
 {
-    return std::vector<uint8_t>();
+    std::vector<uint8_t> data{ 0x10, 0x03, 0x1d, 0x01, 0x00, 0xcf };
+    return data;
 }
 
-size_t SuperviseModuleStatus_120E_MSBit4_State::GetRespondBytes()
+size_t SelectAnestheticAgentType_Halothane_State::GetRespondBytes()
 {
     return size_t();
 }
 
-uint32_t SuperviseModuleStatus_120E_MSBit4_State::GetCommandId()
+uint32_t SelectAnestheticAgentType_Halothane_State::GetCommandId()
 {
-    return 0x120e0402;
+    return 0x1d01;
 }
 
-void SuperviseModuleStatus_120E_MSBit4_State::Register()
+void SelectAnestheticAgentType_Halothane_State::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void SuperviseModuleStatus_120E_MSBit4_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SelectAnestheticAgentType_Halothane_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
-    // Breath phase data available?
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
+    if (rddata[0] == 0x06 && rddata[1] == 0x1d && rddata[2] == 0x00)
     {
-        if (rddata[13] == 0x0e)
-        {
-            if (rddata[14] & 0x10)
-            {
-                // yes
-                std::cout << "Meaning as \"No respiration\":no breathing cycles detectable. \n";
-                std::cout << "Meaning as \"Apnea\":A previously detected breathing activity has timed out. \n";
-                std::cout << "Change the state of the context SuperviseZeroRequest_120E_OMS_State.\n";
-                auto ptr = std::make_shared<SuperviseZeroRequest_120E_OMS_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-            else
-            {
-                // no
-                std::cout << "Breathing activity on the sample line. \n";
-                std::cout << "Change the state of the context SuperviseZeroRequest_120E_OMS_State.\n";
-                auto ptr = std::make_shared<SuperviseZeroRequest_120E_OMS_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
+        // success
+        std::cout << "Change the state of the context ProvideTheSensorModuleWithRequiredData_State.\n";
+        this->context_->TransitionTo<ProvideTheSensorModuleWithRequiredData_State>();
+
     }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
+    else if (rddata[0] == 0x15 && rddata[1] == 0x1d && rddata[2] == 0x01)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
+        this->context_->TransitionTo<StopContinuousDataState>();
     }
+
+    PrintData(rddata);
 }
 
-void SuperviseZeroRequest_120E_OMS_State::HandleData()
+void ProvideTheSensorModuleWithRequiredData_State::HandleData()
 {
     if (IsAlreadySent())
     {
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles SuperviseZeroRequest_120E_OMS_State.\n";
+    std::cout << "Handles ProvideTheSensorModuleWithRequiredData_State.\n";
     Register();
 }
 
-std::vector<uint8_t> SuperviseZeroRequest_120E_OMS_State::GetCommand()
+
+std::vector<uint8_t> ProvideTheSensorModuleWithRequiredData_State::GetCommand()
 {
     return std::vector<uint8_t>();
 }
-
-size_t SuperviseZeroRequest_120E_OMS_State::GetRespondBytes()
+size_t ProvideTheSensorModuleWithRequiredData_State::GetRespondBytes()
 {
     return size_t();
 }
 
-// CommandId=0x120e1201
-uint32_t SuperviseZeroRequest_120E_OMS_State::GetCommandId()
+// CommandId=0x120e07
+uint32_t ProvideTheSensorModuleWithRequiredData_State::GetCommandId()
 {
-    return 0x120e1201;
+    return 0x120e07;
 }
-
-void SuperviseZeroRequest_120E_OMS_State::Register()
+void ProvideTheSensorModuleWithRequiredData_State::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
-
-void SuperviseZeroRequest_120E_OMS_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void ProvideTheSensorModuleWithRequiredData_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
         if (rddata[13] == 0x0e)
         {
-            if (rddata[12] == 0x00)
+            // check HSP for checking needs the module external data
+            if (rddata[7] & 0xde)
             {
-                // yes
-                std::cout << "Change the state of the context ZeroInProgress_1203_CO2N2OPSBit5_State. \n";
-                 auto ptr = std::make_shared<ZeroInProgress_1203_CO2N2OPSBit5_State>();
-                 this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                // yes, need
+                 // success
+                std::cout << "Needs External Data .\n";
+
+                std::cout << "Change the state of the context AcceptExternalParameterData_UnknownAccuracy_State.\n";
+                this->context_->TransitionTo<AcceptExternalParameterData_UnknownAccuracy_State>();
             }
             else
             {
-                // no
-                std::cout << "Change the state of the context HandleZeroState.\n";
-                auto ptr = std::make_shared<HandleZeroRequestState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+               // no, not need
+                // success
+                std::cout << "Not Needs External Data .\n";
+
+                std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit2_State.\n";
+                 this->context_->TransitionTo<SuperviseModuleStatus_120E_MSBit2_State>();
             }
         }
     }
@@ -3967,120 +4048,108 @@ void SuperviseZeroRequest_120E_OMS_State::Update(std::vector<uint8_t> rddata, si
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
     }
+
+    PrintData(rddata);
 }
 
-void ZeroInProgress_1203_CO2N2OPSBit5_State::HandleData()
+void AcceptExternalParameterData_UnknownAccuracy_State::HandleData()
 {
     if (IsAlreadySent())
     {
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles ZeroInProgress_1203_CO2N2OPSBit5_State.\n";
-    Register();
+    std::vector<uint8_t> data;
+    std::cout << "Handles AcceptExternalParameterData_UnknownAccuracy_State.\n";
+
+    size_t bytes_wrote = this->context_->SendCmd(this);
 }
 
-std::vector<uint8_t> ZeroInProgress_1203_CO2N2OPSBit5_State::GetCommand()
+// Command={10 06 1c df 0a 02 e3}
+// Command={10 06 1c df 0a 01 e3}
+std::vector<uint8_t> AcceptExternalParameterData_UnknownAccuracy_State::GetCommand()
 {
-    return std::vector<uint8_t>();
+    std::vector<uint8_t> data{ 0x10, 0x06, 0x1c, 0xdf, 0x0a, 0x02, 0xe3};
+    return data;
 }
 
-size_t ZeroInProgress_1203_CO2N2OPSBit5_State::GetRespondBytes()
+size_t AcceptExternalParameterData_UnknownAccuracy_State::GetRespondBytes()
 {
     return size_t();
 }
 
-uint32_t ZeroInProgress_1203_CO2N2OPSBit5_State::GetCommandId()
+// CommandId=0x06
+uint32_t AcceptExternalParameterData_UnknownAccuracy_State::GetCommandId()
 {
-    return 0x120305;
+    return 0x06;
 }
 
-void ZeroInProgress_1203_CO2N2OPSBit5_State::Register()
+void AcceptExternalParameterData_UnknownAccuracy_State::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void ZeroInProgress_1203_CO2N2OPSBit5_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void AcceptExternalParameterData_UnknownAccuracy_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
+    if (rddata[0] == 0x06 && rddata[1] == 0x1c && rddata[2] == 0x00)
     {
-        if (rddata[13] == 0x03)
-        {
-            if (rddata[11] & 0x20 || rddata[12] & 0x20)
-            {
-                // yes
-                std::cout << "Change the state of the context HandleZeroRequestState. \n";
-                auto ptr = std::make_shared<HandleZeroRequestState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-            else
-            {
-                // no
-                std::cout << "Change the state of the context ZeroInProgress_1204_O2PSBit5_State.\n";
-                auto ptr = std::make_shared<ZeroInProgress_1204_O2PSBit5_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
+        // success
+        std::cout << "Change the state of the context SuperviseModuleStatus_120E_MSBit2_State.\n";
+         this->context_->TransitionTo<SuperviseModuleStatus_120E_MSBit2_State>();
+
     }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
+    else if (rddata[0] == 0x15 && rddata[1] == 0x1c && rddata[2] == 0x01)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
+       /* auto ptr = std::make_shared<StopContinuousDataState>();
+        this->context_->TransitionTo(ptr->GetCommandId(), ptr);*/
     }
+
+    PrintData(rddata);
 }
 
-void ZeroInProgress_1204_O2PSBit5_State::HandleData()
+void SuperviseModuleStatus_120E_MSBit2_State::HandleData()
 {
     if (IsAlreadySent())
     {
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles ZeroInProgress_1204_O2PSBit5_State.\n";
+    std::cout << "Handles SuperviseModuleStatus_120E_MSBit2_State.\n";
     Register();
 }
-
-std::vector<uint8_t> ZeroInProgress_1204_O2PSBit5_State::GetCommand()
+std::vector<uint8_t> SuperviseModuleStatus_120E_MSBit2_State::GetCommand()
 {
     return std::vector<uint8_t>();
 }
-
-size_t ZeroInProgress_1204_O2PSBit5_State::GetRespondBytes()
+size_t SuperviseModuleStatus_120E_MSBit2_State::GetRespondBytes()
 {
     return size_t();
 }
-
-// CommandId=0x120405
-uint32_t ZeroInProgress_1204_O2PSBit5_State::GetCommandId()
+uint32_t SuperviseModuleStatus_120E_MSBit2_State::GetCommandId()
 {
-    return 0x120405;
+    return 0x120e02;
 }
 
-void ZeroInProgress_1204_O2PSBit5_State::Register()
+MedibusServer::CommandClass SuperviseModuleStatus_120E_MSBit2_State::GetPriority()
+{
+    return MedibusServer::CommandClass::Alarm;
+}
+void SuperviseModuleStatus_120E_MSBit2_State::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
-
-void ZeroInProgress_1204_O2PSBit5_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SuperviseModuleStatus_120E_MSBit2_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
+    // Watertrap, component fail, breath phase and apnea bits of MS and MSW are
+    // evaluated together by Context::Supervise for every frame.
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
-        if (rddata[13] == 0x04)
+        if (rddata[13] == 0x0e)
         {
-            if (rddata[11] & 0x20)
-            {
-                // yes
-                std::cout << "Change the state of the context ZeroRequestState. \n";
-                auto ptr = std::make_shared<HandleZeroRequestState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-            else
-            {
-                // no
-                std::cout << "Change the state of the context ZeroInProgress_1210_A1PSBit5_State.\n";
-                auto ptr = std::make_shared<ZeroInProgress_1210_A1PSBit5_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
+            std::cout << "Change the state of the context SuperviseZeroRequest_120E_OMS_State.\n";
+            this->context_->TransitionTo<SuperviseZeroRequest_120E_OMS_State>();
         }
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
@@ -4088,59 +4157,65 @@ void ZeroInProgress_1204_O2PSBit5_State::Update(std::vector<uint8_t> rddata, siz
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
     }
+
+    PrintData(rddata);
 }
 
-void ZeroInProgress_1210_A1PSBit5_State::HandleData()
+
+void SuperviseZeroRequest_120E_OMS_State::HandleData()
 {
     if (IsAlreadySent())
     {
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles ZeroInProgress_1210_A1PSBit5_State.\n";
+    std::cout << "Handles SuperviseZeroRequest_120E_OMS_State.\n";
     Register();
 }
 
-std::vector<uint8_t> ZeroInProgress_1210_A1PSBit5_State::GetCommand()
+std::vector<uint8_t> SuperviseZeroRequest_120E_OMS_State::GetCommand()
 {
     return std::vector<uint8_t>();
 }
 
-size_t ZeroInProgress_1210_A1PSBit5_State::GetRespondBytes()
+size_t SuperviseZeroRequest_120E_OMS_State::GetRespondBytes()
 {
     return size_t();
 }
 
-// CommandId=0x121005
-uint32_t ZeroInProgress_1210_A1PSBit5_State::GetCommandId()
+// CommandId=0x120e1201
+uint32_t SuperviseZeroRequest_120E_OMS_State::GetCommandId()
+{
+    return 0x120e1201;
+}
+
+MedibusServer::CommandClass SuperviseZeroRequest_120E_OMS_State::GetPriority()
 {
-    return 0x121005;
+    return MedibusServer::CommandClass::Zero;
 }
 
-void ZeroInProgress_1210_A1PSBit5_State::Register()
+void SuperviseZeroRequest_120E_OMS_State::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void ZeroInProgress_1210_A1PSBit5_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void SuperviseZeroRequest_120E_OMS_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
-        if (rddata[13] == 0x10)
+        if (rddata[13] == 0x0e)
         {
-            if (rddata[11] & 0x20)
+            if (rddata[12] == 0x00)
             {
                 // yes
-                std::cout << "Change the state of the context ZeroRequestState. \n";
-                auto ptr = std::make_shared<HandleZeroRequestState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                std::cout << "Change the state of the context ZeroInProgress_1203_CO2N2OPSBit5_State. \n";
+                 this->context_->TransitionTo<ZeroInProgress_1203_CO2N2OPSBit5_State>();
             }
             else
             {
                 // no
-                std::cout << "Change the state of the context ZeroInProgress_1211_A2PSBit5_State.\n";
-                auto ptr = std::make_shared<ZeroInProgress_1211_A2PSBit5_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                std::cout << "Change the state of the context HandleZeroState.\n";
+                this->context_->TransitionTo<HandleZeroRequestState>();
             }
         }
     }
@@ -4151,57 +4226,60 @@ void ZeroInProgress_1210_A1PSBit5_State::Update(std::vector<uint8_t> rddata, siz
     }
 }
 
-void ZeroInProgress_1211_A2PSBit5_State::HandleData()
+void ZeroInProgress_1203_CO2N2OPSBit5_State::HandleData()
 {
     if (IsAlreadySent())
     {
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles ZeroInProgress_1211_A2PSBit5_State.\n";
+    std::cout << "Handles ZeroInProgress_1203_CO2N2OPSBit5_State.\n";
     Register();
 }
 
-std::vector<uint8_t> ZeroInProgress_1211_A2PSBit5_State::GetCommand()
+std::vector<uint8_t> ZeroInProgress_1203_CO2N2OPSBit5_State::GetCommand()
 {
     return std::vector<uint8_t>();
 }
 
-size_t ZeroInProgress_1211_A2PSBit5_State::GetRespondBytes()
+size_t ZeroInProgress_1203_CO2N2OPSBit5_State::GetRespondBytes()
 {
     return size_t();
 }
 
-// CommandId=0x121105
-uint32_t ZeroInProgress_1211_A2PSBit5_State::GetCommandId()
+uint32_t ZeroInProgress_1203_CO2N2OPSBit5_State::GetCommandId()
+{
+    return 0x120305;
+}
+
+MedibusServer::CommandClass ZeroInProgress_1203_CO2N2OPSBit5_State::GetPriority()
 {
-    return 0x121105;
+    return MedibusServer::CommandClass::Zero;
 }
 
-void ZeroInProgress_1211_A2PSBit5_State::Register()
+void ZeroInProgress_1203_CO2N2OPSBit5_State::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void ZeroInProgress_1211_A2PSBit5_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void ZeroInProgress_1203_CO2N2OPSBit5_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
-        if (rddata[13] == 0x11)
+        if (rddata[13] == 0x03)
         {
-            if (rddata[12] & 0x20)
+            // zero in progress bits of CO2, N2O, O2, A1 and A2, latched by Context::Supervise
+            if (this->context_->GetSupervision() & MedibusServer::kZeroInProgressEvents)
             {
                 // yes
-                std::cout << "Change the state of the context ZeroRequestState. \n";
-                auto ptr = std::make_shared<HandleZeroRequestState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                std::cout << "Change the state of the context HandleZeroRequestState. \n";
+                this->context_->TransitionTo<HandleZeroRequestState>();
             }
             else
             {
                 // no
                 std::cout << "Change the state of the context ZeroRequestState.\n";
-                auto ptr = std::make_shared<ZeroRequestState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<ZeroRequestState>();
             }
         }
     }
@@ -4239,12 +4317,17 @@ uint32_t ZeroRequestState::GetCommandId()
     return 0x120e1200;
 }
 
+MedibusServer::CommandClass ZeroRequestState::GetPriority()
+{
+    return MedibusServer::CommandClass::Zero;
+}
+
 void ZeroRequestState::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void ZeroRequestState::Update(std::vector<uint8_t> rddata, size_t sz)
+void ZeroRequestState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
@@ -4254,15 +4337,13 @@ void ZeroRequestState::Update(std::vector<uint8_t> rddata, size_t sz)
             {
                 // yes
                 std::cout << "Change the state of the context HandleZeroRequestState. \n";
-                auto ptr = std::make_shared<HandleZeroRequestState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<HandleZeroRequestState>();
             }
             else
             {
                 // no
                 std::cout << "Change the state of the context HandleZeroRequestState.\n";
-                auto ptr = std::make_shared<HandleZeroRequestState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<HandleZeroRequestState>();
             }
         }
     }
@@ -4281,7 +4362,6 @@ void HandleZeroRequestState::HandleData()
     }
     SetAlreadySent(true);
     std::vector<uint8_t> data;
-    uint8_t* rddata = new uint8_t[BUFSZ]();
     std::cout << "Handles HandleZeroRequestState.\n";
     size_t bytes_wrote = this->context_->SendCmdSync(this);
 
@@ -4304,12 +4384,17 @@ uint32_t HandleZeroRequestState::GetCommandId()
     return 0x2c06;
 }
 
+MedibusServer::CommandClass HandleZeroRequestState::GetPriority()
+{
+    return MedibusServer::CommandClass::Zero;
+}
+
 void HandleZeroRequestState::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void HandleZeroRequestState::Update(std::vector<uint8_t> rddata, size_t sz)
+void HandleZeroRequestState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x2c && rddata[2] == 0x04)
     {
@@ -4329,15 +4414,13 @@ void HandleZeroRequestState::Update(std::vector<uint8_t> rddata, size_t sz)
             }
             // get yes confirmation
             std::cout << "Change the state of the context InitZeroState.\n";
-            auto ptr = std::make_shared<InitZeroState>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            this->context_->TransitionTo<InitZeroState>();
         }
         else
         {
             // yes
             std::cout << "Change the state of the context InitZeroState.\n";
-            auto ptr = std::make_shared<InitZeroState>();
-            this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+            this->context_->TransitionTo<InitZeroState>();
         }
 
     }
@@ -4357,8 +4440,6 @@ void InitZeroState::HandleData()
         return;
     }
     SetAlreadySent(true);
-    //std::vector<uint8_t> rddata;
-    uint8_t* rddata = new uint8_t[BUFSZ]();
     std::cout << "Handles InitZeroState.\n";
 
     size_t bytes_wrote = this->context_->SendCmd(this);
@@ -4382,27 +4463,30 @@ uint32_t InitZeroState::GetCommandId()
     return 0x20010100;
 }
 
+MedibusServer::CommandClass InitZeroState::GetPriority()
+{
+    return MedibusServer::CommandClass::Zero;
+}
+
 void InitZeroState::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void InitZeroState::Update(std::vector<uint8_t> rddata, size_t sz)
+void InitZeroState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x20 && rddata[2] == 0x00)
     {
         std::cout << "Change to GetUnitsState.\n";
         
-        auto ptr = std::make_shared<GetUnitsState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<GetUnitsState>();
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x20 && rddata[2] == 0x01)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
         std::cout << "Skip to GetUnitsState.\n";
-        auto ptr = std::make_shared<GetUnitsState>();
-        this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+        this->context_->TransitionTo<GetUnitsState>();
     }
 
     PrintData(rddata);
@@ -4435,12 +4519,17 @@ uint32_t GetUnitsState::GetCommandId()
     return 0x1212;
 }
 
+MedibusServer::CommandClass GetUnitsState::GetPriority()
+{
+    return MedibusServer::CommandClass::Info;
+}
+
 void GetUnitsState::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void GetUnitsState::Update(std::vector<uint8_t> rddata, size_t sz)
+void GetUnitsState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
@@ -4452,16 +4541,14 @@ void GetUnitsState::Update(std::vector<uint8_t> rddata, size_t sz)
                 // Atps Mmhg
                 std::cout << "CO2_U - Co2 Parameter Unit is Atps Mmhg. \n";
                 std::cout << "Change the state of the context EvaluateConnectionEstablishedState.\n";
-                auto ptr = std::make_shared<EvaluateConnectionEstablishedState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<EvaluateConnectionEstablishedState>();
             }
             else if (rddata[3] == 0x00)
             {
                 // Ats Vol
                 std::cout << "CO2_U - Co2 Parameter Unit is Ats Vol. \n";
                 std::cout << "Change the state of the context EvaluateConnectionEstablishedState.\n";
-                auto ptr = std::make_shared<EvaluateConnectionEstablishedState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<EvaluateConnectionEstablishedState>();
             }
             // N2O_U - N2o Parameter Unit
             if (rddata[4] & 0x05)
@@ -4469,16 +4556,14 @@ void GetUnitsState::Update(std::vector<uint8_t> rddata, size_t sz)
                 // Atps Mmhg
                 std::cout << "N2o Parameter Unit is Atps Mmhg. \n";
                 std::cout << "Change the state of the context EvaluateConnectionEstablishedState.\n";
-                auto ptr = std::make_shared<EvaluateConnectionEstablishedState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<EvaluateConnectionEstablishedState>();
             }
             else if (rddata[4] == 0x00)
             {
                 // Ats Vol
                 std::cout << "N2o Parameter Unit is Ats Vol. \n";
                 std::cout << "Change the state of the context EvaluateConnectionEstablishedState.\n";
-                auto ptr = std::make_shared<EvaluateConnectionEstablishedState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<EvaluateConnectionEstablishedState>();
             }
 
             // A1_U - Agent1 Parameter Unit
@@ -4487,16 +4572,14 @@ void GetUnitsState::Update(std::vector<uint8_t> rddata, size_t sz)
                 // Atps Mmhg
                 std::cout << "A1_U - Agent1 Parameter Unit is Atps Mmhg. \n";
                 std::cout << "Change the state of the context EvaluateConnectionEstablishedState.\n";
-                auto ptr = std::make_shared<EvaluateConnectionEstablishedState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<EvaluateConnectionEstablishedState>();
             }
             else if (rddata[5] == 0x00)
             {
                 // Ats Vol
                 std::cout << "A1_U - Agent1 Parameter Unit is Ats Vol. \n";
                 std::cout << "Change the state of the context EvaluateConnectionEstablishedState.\n";
-                auto ptr = std::make_shared<EvaluateConnectionEstablishedState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<EvaluateConnectionEstablishedState>();
             }
 
             // A2_U - Agent2 Parameter Unit
@@ -4505,16 +4588,14 @@ void GetUnitsState::Update(std::vector<uint8_t> rddata, size_t sz)
                 // Atps Mmhg
                 std::cout << "A2_U - Agent2 Parameter Unit is Atps Mmhg. \n";
                 std::cout << "Change the state of the context EvaluateConnectionEstablishedState.\n";
-                auto ptr = std::make_shared<EvaluateConnectionEstablishedState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<EvaluateConnectionEstablishedState>();
             }
             else if (rddata[6] == 0x00)
             {
                 // Ats Vol
                 std::cout << "A2_U - Agent2 Parameter Unit is Ats Vol. \n";
                 std::cout << "Change the state of the context EvaluateConnectionEstablishedState.\n";
-                auto ptr = std::make_shared<EvaluateConnectionEstablishedState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<EvaluateConnectionEstablishedState>();
             }
 
             // O2_U - O2 Parameter Unit
@@ -4523,16 +4604,14 @@ void GetUnitsState::Update(std::vector<uint8_t> rddata, size_t sz)
                 // Atps Mmhg
                 std::cout << "O2_U - O2 Parameter Unit is Atps Mmhg. \n";
                 std::cout << "Change the state of the context EvaluateConnectionEstablishedState.\n";
-                auto ptr = std::make_shared<EvaluateConnectionEstablishedState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<EvaluateConnectionEstablishedState>();
             }
             else if (rddata[7] == 0x00)
             {
                 // Ats Vol
                 std::cout << "O2_U - O2 Parameter Unit is Ats Vol. \n";
                 std::cout << "Change the state of the context EvaluateConnectionEstablishedState.\n";
-                auto ptr = std::make_shared<EvaluateConnectionEstablishedState>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<EvaluateConnectionEstablishedState>();
             }
         }
     }
@@ -4576,11 +4655,10 @@ void EvaluateConnectionEstablishedState::Register()
     this->context_->AttachNeedResponse(this);
 }
 
-void EvaluateConnectionEstablishedState::Update(std::vector<uint8_t> rddata, size_t sz)
+void EvaluateConnectionEstablishedState::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     std::cout << "Change the state of the context HostSelectableParameters_120E_HSP_State.\n";
-    auto ptr = std::make_shared<HostSelectableParameters_120E_HSP_State>();
-    this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+    this->context_->TransitionTo<HostSelectableParameters_120E_HSP_State>();
 }
 
 void HostSelectableParameters_120E_HSP_State::HandleData()
@@ -4615,7 +4693,7 @@ void HostSelectableParameters_120E_HSP_State::Register()
     this->context_->AttachNeedResponse(this);
 }
 
-void HostSelectableParameters_120E_HSP_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void HostSelectableParameters_120E_HSP_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
@@ -4639,8 +4717,7 @@ void HostSelectableParameters_120E_HSP_State::Update(std::vector<uint8_t> rddata
                 std::cout << "Not Needs External Data .\n";
 
                 std::cout << "Change the state of the context ParameterAvailabilityInformation_120E_PAI_State.\n";
-                auto ptr = std::make_shared<ParameterAvailabilityInformation_120E_PAI_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<ParameterAvailabilityInformation_120E_PAI_State>();
             }
         }
     }
@@ -4660,309 +4737,57 @@ void ParameterAvailabilityInformation_120E_PAI_State::HandleData()
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles HostSelectableParameters_120E_HSP_State.\n";
-    Register();
-}
-
-std::vector<uint8_t> ParameterAvailabilityInformation_120E_PAI_State::GetCommand()
-{
-    return std::vector<uint8_t>();
-}
-
-size_t ParameterAvailabilityInformation_120E_PAI_State::GetRespondBytes()
-{
-    return size_t();
-}
-
-// CommandId=0x120e0403
-uint32_t ParameterAvailabilityInformation_120E_PAI_State::GetCommandId()
-{
-    return 0x120e0403;
-}
-
-void ParameterAvailabilityInformation_120E_PAI_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void ParameterAvailabilityInformation_120E_PAI_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
-    {
-        if (rddata[13] == 0x0e)
-        {
-            // PAI available?
-            if (rddata[4] & 0x0c)
-            {
-                std::cout << "PAI is available .\n";
-                this->context_->SetPAIAvailable(true);
-                std::cout << "Change the state of the context Evaluate_1210_State.\n";
-                auto ptr = std::make_shared<Evaluate_1210_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-            // PAI not available
-            else
-            {
-                std::cout << "PAI is not available .\n";
-                std::cout << "Parameter is not available.\n";
-                std::cout << "That means, it is not installed in the module.\n";
-                std::cout << "Show that the parameter is not installed on the sensor module.\n";
-            }
-        }
-
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-    }
-
-    PrintData(rddata);
-}
-
-
-void ParameterMode_1203_CO2PSBit6Bit7_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::cout << "Handles ParameterMode_1203_CO2PSBit6Bit7_State.\n";
-    Register();
-}
-
-std::vector<uint8_t> ParameterMode_1203_CO2PSBit6Bit7_State::GetCommand()
-{
-    return std::vector<uint8_t>();
-}
-
-size_t ParameterMode_1203_CO2PSBit6Bit7_State::GetRespondBytes()
-{
-    return size_t();
-}
-
-// CommandId=0x12031106
-uint32_t ParameterMode_1203_CO2PSBit6Bit7_State::GetCommandId()
-{
-    return 0x12031106;
-}
-
-void ParameterMode_1203_CO2PSBit6Bit7_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void ParameterMode_1203_CO2PSBit6Bit7_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
-    {
-        if (rddata[13] == 0x03)
-        {
-            if ((rddata[11] & 0x03) == 0x03)
-            {
-                // not available, yes
-                std::cout << "CO2_PS Parameter is not available.\n";
-                std::cout << "Show that the parameter is not installed on the sensor module.\n";
-            }
-            else
-            {
-                // not available, no
-                std::cout << "Change the state of the context ParameterMode_1203_N2OPSBit6Bit7_State.\n";
-                auto ptr = std::make_shared<ParameterMode_1203_N2OPSBit6Bit7_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-    }
-
-    PrintData(rddata);
-}
-
-
-
-void ParameterMode_1203_N2OPSBit6Bit7_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::cout << "Handles ParameterMode_1203_N2OPSBit6Bit7_State.\n";
-    Register();
-}
-
-std::vector<uint8_t> ParameterMode_1203_N2OPSBit6Bit7_State::GetCommand()
-{
-    return std::vector<uint8_t>();
-}
-
-size_t ParameterMode_1203_N2OPSBit6Bit7_State::GetRespondBytes()
-{
-    return size_t();
-}
-
-// CommandId=0x12031206
-uint32_t ParameterMode_1203_N2OPSBit6Bit7_State::GetCommandId()
-{
-    return 0x12031206;
-}
-
-void ParameterMode_1203_N2OPSBit6Bit7_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void ParameterMode_1203_N2OPSBit6Bit7_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
-    {
-        if (rddata[13] == 0x03)
-        {
-            if ((rddata[12] & 0x03) == 0x03)
-            {
-                // not available, yes
-                std::cout << "N2O_PS Parameter is not available.\n";
-                std::cout << "Show that the parameter is not installed on the sensor module.\n";
-            }
-            else
-            {
-                // not available, no
-                std::cout << "Change the state of the context ParameterMode_1204_O2PSBit6Bit7_State.\n";
-                auto ptr = std::make_shared<ParameterMode_1204_O2PSBit6Bit7_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-    }
-
-    PrintData(rddata);
-}
-
-void ParameterMode_1204_O2PSBit6Bit7_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::cout << "Handles ParameterMode_1204_O2PSBit6Bit7_State.\n";
-    Register();
-}
-
-std::vector<uint8_t> ParameterMode_1204_O2PSBit6Bit7_State::GetCommand()
-{
-    return std::vector<uint8_t>();
-}
-
-size_t ParameterMode_1204_O2PSBit6Bit7_State::GetRespondBytes()
-{
-    return size_t();
-}
-
-// CommandId=0x12041106
-uint32_t ParameterMode_1204_O2PSBit6Bit7_State::GetCommandId()
-{
-    return 0x12041106;
-}
-
-void ParameterMode_1204_O2PSBit6Bit7_State::Register()
-{
-    this->context_->AttachNeedResponse(this);
-}
-
-void ParameterMode_1204_O2PSBit6Bit7_State::Update(std::vector<uint8_t> rddata, size_t sz)
-{
-    if (rddata[0] == 0x06 && rddata[1] == 0x12)
-    {
-        if (rddata[13] == 0x04)
-        {
-            if ((rddata[11] & 0x03) == 0x03)
-            {
-                // not available, yes
-                std::cout << "O2_PS Parameter is not available.\n";
-                std::cout << "Show that the parameter is not installed on the sensor module.\n";
-            }
-            else
-            {
-                // not available, no
-                std::cout << "Change the state of the context ParameterMode_1210_A1PSBit6Bit7_State.\n";
-                auto ptr = std::make_shared<ParameterMode_1210_A1PSBit6Bit7_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-        }
-    }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
-    {
-        // fail
-        std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
-    }
-
-    PrintData(rddata);
-}
-
-void ParameterMode_1210_A1PSBit6Bit7_State::HandleData()
-{
-    if (IsAlreadySent())
-    {
-        return;
-    }
-    SetAlreadySent(true);
-    std::cout << "Handles ParameterMode_1210_A1PSBit6Bit7_State.\n";
+    std::cout << "Handles HostSelectableParameters_120E_HSP_State.\n";
     Register();
 }
 
-std::vector<uint8_t> ParameterMode_1210_A1PSBit6Bit7_State::GetCommand()
+std::vector<uint8_t> ParameterAvailabilityInformation_120E_PAI_State::GetCommand()
 {
     return std::vector<uint8_t>();
 }
 
-size_t ParameterMode_1210_A1PSBit6Bit7_State::GetRespondBytes()
+size_t ParameterAvailabilityInformation_120E_PAI_State::GetRespondBytes()
 {
     return size_t();
 }
 
-// CommandId=0x12101206
-uint32_t ParameterMode_1210_A1PSBit6Bit7_State::GetCommandId()
+// CommandId=0x120e0403
+uint32_t ParameterAvailabilityInformation_120E_PAI_State::GetCommandId()
 {
-    return 0x12101206;
+    return 0x120e0403;
 }
 
-void ParameterMode_1210_A1PSBit6Bit7_State::Register()
+void ParameterAvailabilityInformation_120E_PAI_State::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void ParameterMode_1210_A1PSBit6Bit7_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void ParameterAvailabilityInformation_120E_PAI_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
-        if (rddata[13] == 0x10)
+        if (rddata[13] == 0x0e)
         {
-            if ((rddata[12] & 0x03) == 0x03)
+            // PAI available?
+            if (rddata[4] & 0x0c)
             {
-                // not available, yes
-                std::cout << "A1_PS Parameter is not available.\n";
-                std::cout << "Show that the parameter is not installed on the sensor module.\n";
+                std::cout << "PAI is available .\n";
+                this->context_->SetPAIAvailable(true);
+                std::cout << "Change the state of the context Evaluate_1210_State.\n";
+                this->context_->TransitionTo<Evaluate_1210_State>();
             }
+            // PAI not available
             else
             {
-                // not available, no
-                std::cout << "Change the state of the context ParameterMode_1203_CO2PSBit6Bit7_State.\n";
-                auto ptr = std::make_shared<ParameterMode_1203_N2OPSBit6Bit7_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                std::cout << "PAI is not available .\n";
+                std::cout << "Parameter is not available.\n";
+                std::cout << "That means, it is not installed in the module.\n";
+                std::cout << "Show that the parameter is not installed on the sensor module.\n";
             }
         }
+
     }
-    else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
+    else if (rddata[0] == 0x15 && rddata[1] == 0x1e && rddata[2] == 0x01)
     {
         // fail
         std::cout << "Fail with error message: " << GetErrorMessage(rddata[3]) << '\n';
@@ -4971,56 +4796,69 @@ void ParameterMode_1210_A1PSBit6Bit7_State::Update(std::vector<uint8_t> rddata,
     PrintData(rddata);
 }
 
-void ParameterMode_1211_A2PSBit6Bit7_State::HandleData()
+
+void ParameterMode_1203_CO2PSBit6Bit7_State::HandleData()
 {
     if (IsAlreadySent())
     {
         return;
     }
     SetAlreadySent(true);
-    std::cout << "Handles ParameterMode_1211_A2PSBit6Bit7_State.\n";
+    std::cout << "Handles ParameterMode_1203_CO2PSBit6Bit7_State.\n";
     Register();
 }
 
-std::vector<uint8_t> ParameterMode_1211_A2PSBit6Bit7_State::GetCommand()
+std::vector<uint8_t> ParameterMode_1203_CO2PSBit6Bit7_State::GetCommand()
 {
     return std::vector<uint8_t>();
 }
 
-size_t ParameterMode_1211_A2PSBit6Bit7_State::GetRespondBytes()
+size_t ParameterMode_1203_CO2PSBit6Bit7_State::GetRespondBytes()
 {
     return size_t();
 }
 
-// CommandId=0x12111206
-uint32_t ParameterMode_1211_A2PSBit6Bit7_State::GetCommandId()
+// CommandId=0x12031106
+uint32_t ParameterMode_1203_CO2PSBit6Bit7_State::GetCommandId()
 {
-    return 0x12111206;
+    return 0x12031106;
 }
 
-void ParameterMode_1211_A2PSBit6Bit7_State::Register()
+void ParameterMode_1203_CO2PSBit6Bit7_State::Register()
 {
     this->context_->AttachNeedResponse(this);
 }
 
-void ParameterMode_1211_A2PSBit6Bit7_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void ParameterMode_1203_CO2PSBit6Bit7_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
+    static const MedibusServer::SupervisionEvent notAvailable[] = {
+        MedibusServer::SupervisionEvent::CO2NotAvailable,
+        MedibusServer::SupervisionEvent::N2ONotAvailable,
+        MedibusServer::SupervisionEvent::O2NotAvailable,
+        MedibusServer::SupervisionEvent::A1NotAvailable,
+        MedibusServer::SupervisionEvent::A2NotAvailable,
+    };
+
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
-        if (rddata[13] == 0x11)
+        if (rddata[13] == 0x03)
         {
-            if ((rddata[12] & 0x03) == 0x03)
+            // parameter mode of all gases, latched by Context::Supervise
+            bool anyNotAvailable = false;
+            for (auto event : notAvailable)
+            {
+                anyNotAvailable = anyNotAvailable || this->context_->IsSupervisionActive(event);
+            }
+            if (anyNotAvailable)
             {
                 // not available, yes
-                std::cout << "A2_PS Parameter is not available.\n";
                 std::cout << "Show that the parameter is not installed on the sensor module.\n";
             }
             else
             {
                 // not available, no
                 std::cout << "Change the state of the context ParameterInopInformation_120E_PII_State.\n";
-                auto ptr = std::make_shared<ParameterInopInformation_120E_PII_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<ParameterInopInformation_120E_PII_State>();
             }
         }
     }
@@ -5033,6 +4871,8 @@ void ParameterMode_1211_A2PSBit6Bit7_State::Update(std::vector<uint8_t> rddata,
     PrintData(rddata);
 }
 
+
+
 void ParameterInopInformation_120E_PII_State::HandleData()
 {
     if (IsAlreadySent())
@@ -5066,7 +4906,7 @@ void ParameterInopInformation_120E_PII_State::Register()
     this->context_->AttachNeedResponse(this);
 }
 
-void ParameterInopInformation_120E_PII_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void ParameterInopInformation_120E_PII_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
@@ -5083,8 +4923,7 @@ void ParameterInopInformation_120E_PII_State::Update(std::vector<uint8_t> rddata
             {
                 // no
                 std::cout << "Change the state of the context ParameterInopInformation_120E_PII_State.\n";
-                auto ptr = std::make_shared<ParameterInopInformation_120E_PII_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<ParameterInopInformation_120E_PII_State>();
             }
         }
     }
@@ -5129,7 +4968,7 @@ void MeasurementMode_120E_OMS_State::Register()
     this->context_->AttachNeedResponse(this);
 }
 
-void MeasurementMode_120E_OMS_State::Update(std::vector<uint8_t> rddata, size_t sz)
+void MeasurementMode_120E_OMS_State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
@@ -5139,8 +4978,7 @@ void MeasurementMode_120E_OMS_State::Update(std::vector<uint8_t> rddata, size_t
             {
                 // yes
                 std::cout << "Change the state of the context ZeroInProgress_1203_CO2N2OPSBit5_State. \n";
-                auto ptr = std::make_shared<Occlusion_120E_MSBit1__State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
+                this->context_->TransitionTo<Occlusion_120E_MSBit1__State>();
             }
             else
             {
@@ -5182,6 +5020,11 @@ uint32_t Occlusion_120E_MSBit1__State::GetCommandId()
     return 0x120e01;
 }
 
+MedibusServer::CommandClass Occlusion_120E_MSBit1__State::GetPriority()
+{
+    return MedibusServer::CommandClass::Alarm;
+}
+
 
 void Occlusion_120E_MSBit1__State::Register()
 {
@@ -5189,28 +5032,17 @@ void Occlusion_120E_MSBit1__State::Register()
 }
 
 
-void Occlusion_120E_MSBit1__State::Update(std::vector<uint8_t> rddata, size_t sz)
+void Occlusion_120E_MSBit1__State::Update(const std::vector<uint8_t>& rddata, size_t sz)
 {
+    // Watertrap, component fail, breath phase and apnea bits of MS and MSW are
+    // evaluated together by Context::Supervise for every frame.
     if (rddata[0] == 0x06 && rddata[1] == 0x12)
     {
         if (rddata[13] == 0x0e)
         {
-
-            if (rddata[14] & 0x02)
-            {
-                // yes
-                std::cout << "Change the state of the context SuperviseModuleStatus_120B_MSWBit5_State.\n";
-                auto ptr = std::make_shared<SuperviseModuleStatus_120B_MSWBit5_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
-
-            else
-            {
-                auto ptr = std::make_shared<SuperviseModuleStatus_120E_MSBit6_State>();
-                this->context_->TransitionTo(ptr->GetCommandId(), ptr);
-            }
+            std::cout << "Change the state of the context SuperviseZeroRequest_120E_OMS_State.\n";
+            this->context_->TransitionTo<SuperviseZeroRequest_120E_OMS_State>();
         }
-
     }
     else if (rddata[0] == 0x15 && rddata[1] == 0x12 && rddata[2] == 0x09)
     {
@@ -5225,21 +5057,638 @@ void Occlusion_120E_MSBit1__State::Update(std::vector<uint8_t> rddata, size_t sz
 /**
  * The client code.
  */
-void ClientCode() {
-    /*Context* context = new Context(new StopContinuousDataState);*/
-    auto ptr = std::make_shared<StopContinuousDataState>();
-    Context* context = new Context(ptr->GetCommandId(), ptr );
-    context->Init();
-    while(1)
+void ClientCode(const serial::RealtimeProfile& realtime, const std::string& archive, const std::string& port,
+    const MedibusServer::PatientChannelSet& channels) {
+    Context* context = new Context();
+    context->Subscriptions().Subscribe(channels);
+    if (!port.empty())
+    {
+        context->SetPort(port);
+    }
+    context->SetRealtimeProfile(realtime);
+    if (!archive.empty())
     {
-        context->Request1();
+        context->OpenArchive(archive);
     }
+    context->TransitionTo<StopContinuousDataState>();
+    context->Init();
+    context->Run();
 
     delete context;
 }
 
-int main() {
-    ClientCode();
+/**
+ * Probes all ports for MEDIBUS modules and returns the first one found.
+ */
+std::string DiscoverModule()
+{
+    const std::map<std::string, MedibusServer::DiscoveredModule> modules = MedibusServer::ModuleDiscovery().Discover();
+    for (const auto& entry : modules)
+    {
+        const MedibusServer::DiscoveredModule& module = entry.second;
+        std::stringstream msg;
+        msg << "Module on " << module.port << " (" << module.description << "), serial number "
+            << (module.serialNumber.empty() ? "unknown" : module.serialNumber)
+            << ", answered in " << module.responseNs / 1000000 << " ms.\n";
+        std::cout << msg.str();
+        MedibusServer::LogProvider::Instance().LogFile(msg.str());
+    }
+    if (modules.empty())
+    {
+        std::cout << "No module found.\n";
+        return std::string();
+    }
+    return modules.begin()->first;
+}
+
+/**
+ * Talks to every module found, each with its own context and thread, and
+ * writes their continuous data merged by time to a CSV file.
+ */
+int MergeModules(const serial::RealtimeProfile& realtime, const std::string& path,
+    const MedibusServer::PatientChannelSet& channels)
+{
+    using Merger = MedibusServer::SampleMerger<>;
+    std::vector<std::string> ports;
+    for (const auto& entry : MedibusServer::ModuleDiscovery().Discover())
+    {
+        ports.push_back(entry.first);
+    }
+    if (ports.empty())
+    {
+        std::cout << "No module found.\n";
+        return 1;
+    }
+    std::ofstream csv(path);
+    if (!csv)
+    {
+        std::cout << "Cannot create " << path << '\n';
+        return 1;
+    }
+    csv << "time_ms,port,channel,value\n";
+
+    Merger merger(ports.size());
+    ports.resize(merger.Sources());
+    std::vector<std::unique_ptr<Context>> contexts;
+    std::vector<std::thread> actors;
+    for (size_t source = 0; source < ports.size(); ++source)
+    {
+        contexts.push_back(std::make_unique<Context>());
+        Context* context = contexts.back().get();
+        context->Subscriptions().Subscribe(channels);
+        context->SetPort(ports[source]);
+        context->SetRealtimeProfile(realtime);
+        context->SetSampleMerger(&merger, source);
+        context->TransitionTo<StopContinuousDataState>();
+        context->Init();
+        actors.emplace_back(&Context::Run, context);
+    }
+
+    // the single consumer of the merger
+    const int64_t startNs = MedibusServer::PatientDataNow();
+    int64_t reportNs = startNs;
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        const int64_t nowNs = MedibusServer::PatientDataNow();
+        merger.Poll(nowNs, [&](const MedibusServer::MergedSample& sample)
+        {
+            csv << (sample.timestampNs - startNs) / 1000000 << ',' << ports[sample.source] << ','
+                << MedibusServer::PatientChannelName(sample.channel) << ',' << sample.value << '\n';
+        });
+        if (nowNs - reportNs >= 60000000000LL)
+        {
+            reportNs = nowNs;
+            csv.flush();
+            std::stringstream msg;
+            for (size_t source = 0; source < ports.size(); ++source)
+            {
+                const MedibusServer::MergeSourceStats stats = merger.Stats(source);
+                msg << ports[source] << ": " << stats.merged << " samples merged, " << stats.late << " late, "
+                    << stats.dropped << " dropped, lag " << stats.lag.AverageNs() / 1000000 << " ms average, "
+                    << stats.lag.maxNs / 1000000 << " ms max.\n";
+            }
+            std::cout << msg.str();
+            MedibusServer::LogProvider::Instance().LogFile(msg.str());
+        }
+    }
+}
+
+/**
+ * Decodes a recorded capture or log offline and prints its statistics.
+ */
+int DecodeCapture(const std::string& path, const std::string& channels, size_t threads)
+{
+    MedibusServer::detail::FileMapping file;
+    if (!file.Open(path))
+    {
+        std::cout << "Cannot open " << path << '\n';
+        return 1;
+    }
+    MedibusServer::CaptureDecoder::Options options;
+    options.format = MedibusServer::CaptureDecoder::Detect(file.Data(), file.Size());
+    options.threads = threads;
+    options.extractChannels = !channels.empty();
+
+    const int64_t startNs = MedibusServer::PatientDataNow();
+    const MedibusServer::CaptureReport report = MedibusServer::CaptureDecoder::Decode(file.Data(), file.Size(), options);
+    const int64_t elapsedNs = MedibusServer::PatientDataNow() - startNs;
+
+    std::cout << path << ": " << file.Size() << " bytes, "
+        << (options.format == MedibusServer::CaptureFormat::Log ? "log" : "capture") << ", "
+        << elapsedNs / 1000000 << " ms\n";
+    std::cout << report.frames << " frames";
+    if (options.format == MedibusServer::CaptureFormat::Log)
+    {
+        std::cout << " in " << report.lines << " lines, " << report.badDumps << " invalid dumps\n";
+    }
+    else
+    {
+        std::cout << ", " << report.unframedBytes << " bytes outside frames\n";
+    }
+
+    std::cout << "command      ack      nak        bytes\n";
+    for (size_t command = 0; command < report.commands.size(); ++command)
+    {
+        const MedibusServer::CaptureCommandStats& stats = report.commands[command];
+        if (stats.acks + stats.naks != 0)
+        {
+            std::cout << "     " << std::hex << std::setfill('0') << std::setw(2) << command << std::dec << std::setfill(' ')
+                << std::setw(9) << stats.acks << std::setw(9) << stats.naks << std::setw(13) << stats.bytes << '\n';
+        }
+    }
+    for (size_t code = 0; code < report.errors.size(); ++code)
+    {
+        if (report.errors[code] != 0)
+        {
+            std::cout << "error " << std::hex << std::setfill('0') << std::setw(2) << code << std::dec << std::setfill(' ')
+                << std::setw(9) << report.errors[code] << "  " << GetErrorMessage(static_cast<uint8_t>(code)) << '\n';
+        }
+    }
+
+    if (!channels.empty())
+    {
+        std::ofstream csv(channels);
+        csv << (options.format == MedibusServer::CaptureFormat::Log ? "time_ms" : "offset") << ",channel,value\n";
+        for (const MedibusServer::CaptureSample& sample : report.samples)
+        {
+            csv << (options.format == MedibusServer::CaptureFormat::Log ? sample.timeMs : static_cast<int64_t>(sample.offset))
+                << ',' << MedibusServer::PatientChannelName(sample.channel) << ',' << sample.value << '\n';
+        }
+        std::cout << report.samples.size() << " samples written to " << channels << '\n';
+    }
+    return 0;
+}
+
+/**
+ * Follows the shared memory ring of a running server and prints its entries.
+ */
+int FollowSharedRing(const std::string& port)
+{
+    MedibusServer::SharedRingReader reader;
+    if (!reader.Open(MedibusServer::SharedRingName(port)))
+    {
+        std::cout << "No server publishes " << port << '\n';
+        return 1;
+    }
+    MedibusServer::SharedEntry entry;
+    uint64_t lost = 0;
+    while (true)
+    {
+        if (!reader.Read(entry))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        if (reader.Lost() != lost)
+        {
+            std::cout << "lost " << reader.Lost() - lost << " entries\n";
+            lost = reader.Lost();
+        }
+        std::cout << entry.sequence << ' ' << entry.timestampNs / 1000000 << " ms "
+            << (entry.kind == MedibusServer::SharedEntryKind::Frame ? "frame" : "status") << ", " << entry.length << " bytes\n";
+    }
+}
+
+/**
+ * Checks the seqlock protocol of the shared memory ring: a writer thread
+ * overruns a small ring while the reader verifies that every entry it
+ * returns is complete and in order and that it reports every entry it lost.
+ */
+int CheckSharedRing()
+{
+    const std::string name = MedibusServer::SharedRingName("check");
+    MedibusServer::SharedRingWriter writer;
+    if (!writer.Create(name, 8, 64))
+    {
+        std::cout << "Cannot create shared memory " << name << '\n';
+        return 1;
+    }
+    MedibusServer::SharedRingReader reader;
+    if (!reader.Open(name))
+    {
+        std::cout << "Cannot open shared memory " << name << '\n';
+        return 1;
+    }
+
+    const uint64_t count = 2000000;
+    std::thread publisher([&writer, count]() {
+        uint8_t payload[64];
+        for (uint64_t sequence = 0; sequence < count; ++sequence)
+        {
+            const size_t length = 1 + sequence % sizeof(payload);
+            std::memset(payload, static_cast<uint8_t>(sequence), length);
+            writer.Publish(MedibusServer::SharedEntryKind::Frame, payload, length, static_cast<int64_t>(sequence));
+        }
+    });
+
+    uint64_t read = 0;
+    uint64_t torn = 0;
+    uint64_t next = 0;
+    MedibusServer::SharedEntry entry;
+    while (next < count)
+    {
+        if (!reader.Read(entry))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        bool complete = entry.sequence >= next && entry.timestampNs == static_cast<int64_t>(entry.sequence) &&
+            entry.length == 1 + entry.sequence % 64;
+        for (uint32_t i = 0; complete && i < entry.length; ++i)
+        {
+            complete = entry.payload[i] == static_cast<uint8_t>(entry.sequence);
+        }
+        torn += complete ? 0 : 1;
+        next = entry.sequence + 1;
+        ++read;
+    }
+    publisher.join();
+
+    std::cout << read << " entries read, " << reader.Lost() << " lost, " << torn << " torn or out of order\n";
+    return torn == 0 && read + reader.Lost() == count ? 0 : 1;
+}
+
+namespace
+{
+    double SecondsSince(int64_t startNs)
+    {
+        return static_cast<double>(MedibusServer::PatientDataNow() - startNs) / 1e9;
+    }
+
+    double ThreadCpuSeconds()
+    {
+#if defined(_WIN32)
+        FILETIME creation, exited, kernel, user;
+        GetThreadTimes(GetCurrentThread(), &creation, &exited, &kernel, &user);
+        const uint64_t ticks = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime) +
+            (static_cast<uint64_t>(user.dwHighDateTime) << 32 | user.dwLowDateTime);
+        return static_cast<double>(ticks) * 100e-9;
+#else
+        timespec cpu;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        return static_cast<double>(cpu.tv_sec) + static_cast<double>(cpu.tv_nsec) * 1e-9;
+#endif
+    }
+
+    // 24 hours of CO2 and O2 at 20 Hz with up to 0.2 ms jitter and the
+    // module status at 1 Hz, written, read back and compared.
+    bool BenchmarkArchive(const std::string& path)
+    {
+        const size_t count = 24 * 3600 * 20;
+        const int64_t stepNs = 50000000;
+        std::mt19937 random(1);
+        std::vector<int64_t> times(count);
+        std::vector<int32_t> co2(count);
+        MedibusServer::TrendArchiveWriter writer;
+        if (!writer.Open(path))
+        {
+            std::cout << "Cannot create " << path << '\n';
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            times[i] = 1000000000 + static_cast<int64_t>(i) * stepNs + random() % 200000;
+            const double breath = std::max(0.0, std::sin(static_cast<double>(i) * 0.01 * 3.14159));
+            co2[i] = static_cast<int32_t>(200 + 190 * breath) + static_cast<int32_t>(random() % 3);
+            writer.Append(MedibusServer::PatientChannel::CO2, times[i], co2[i]);
+            writer.Append(MedibusServer::PatientChannel::O2, times[i], 210 + static_cast<int32_t>(random() % 2));
+            if (i % 20 == 0)
+            {
+                writer.Append(MedibusServer::PatientChannel::ModuleStatus, times[i], 0x40);
+            }
+        }
+        writer.Close();
+        const size_t samples = 2 * count + count / 20;
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        const double bytes = static_cast<double>(file.tellg());
+
+        MedibusServer::TrendArchiveReader reader;
+        if (!reader.Open(path))
+        {
+            std::cout << "Cannot open " << path << '\n';
+            return false;
+        }
+        int64_t expected = 0;
+        for (int32_t value : co2)
+        {
+            expected += value;
+        }
+        size_t next = 0;
+        size_t wrong = 0;
+        reader.Scan(MedibusServer::PatientChannel::CO2, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(),
+            [&](int64_t timestampNs, int32_t value)
+        {
+            wrong += next >= count || timestampNs != times[next] - times[next] % 1000000 || value != co2[next] ? 1 : 0;
+            ++next;
+        });
+        wrong += next != count ? 1 : 0;
+
+        const int rounds = 10;
+        int64_t sum = 0;
+        int64_t startNs = MedibusServer::PatientDataNow();
+        for (int round = 0; round < rounds; ++round)
+        {
+            reader.Scan(MedibusServer::PatientChannel::CO2, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(),
+                [&sum](int64_t, int32_t value) { sum += value; });
+        }
+        const double scanSeconds = SecondsSince(startNs) / rounds;
+        wrong += sum != expected * rounds ? 1 : 0;
+
+        std::vector<MedibusServer::PatientTrendPoint> trend;
+        startNs = MedibusServer::PatientDataNow();
+        reader.Decimate(MedibusServer::PatientChannel::CO2, times.front(), times.back(), 1000, trend);
+        const double decimateSeconds = SecondsSince(startNs);
+        int32_t min = 0;
+        int32_t max = 0;
+        startNs = MedibusServer::PatientDataNow();
+        reader.MinMax(MedibusServer::PatientChannel::CO2, times[1000], times[count - 1000], min, max);
+        const double minMaxSeconds = SecondsSince(startNs);
+
+        std::cout << std::fixed << std::setprecision(3)
+            << "archive: " << samples << " samples in 24 h, " << bytes / samples << " bytes per sample, "
+            << wrong << " wrong\n"
+            << "archive: full scan " << count / scanSeconds / 1e6 << " samples/us, 24 h to 1000 points "
+            << decimateSeconds * 1e3 << " ms, min/max " << minMaxSeconds * 1e3 << " ms\n";
+        return wrong == 0;
+    }
+
+    // 32 producer threads push into one merger polled by this thread.
+    bool BenchmarkMerger()
+    {
+        const size_t sources = 32;
+        const int perSource = 20000;
+        std::unique_ptr<MedibusServer::SampleMerger<>> merger(new MedibusServer::SampleMerger<>(sources, 50000000));
+        std::atomic<size_t> finished{ 0 };
+        const int64_t startNs = MedibusServer::PatientDataNow();
+        std::vector<std::thread> producers;
+        for (size_t source = 0; source < sources; ++source)
+        {
+            producers.emplace_back([&, source]()
+            {
+                std::mt19937 random(static_cast<uint32_t>(source));
+                int64_t timestampNs = startNs;
+                for (int i = 0; i < perSource; )
+                {
+                    timestampNs += 1000 + random() % 500;
+                    if (merger->Push(source, MedibusServer::PatientChannel::CO2, timestampNs, i))
+                    {
+                        ++i;
+                    }
+                    else
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                ++finished;
+            });
+        }
+
+        const size_t total = sources * perSource;
+        size_t merged = 0;
+        size_t disordered = 0;
+        int64_t lastNs = std::numeric_limits<int64_t>::min();
+        const double cpuStart = ThreadCpuSeconds();
+        while (true)
+        {
+            const bool done = finished == sources;
+            // once all producers finished nothing can overtake the rest
+            const int64_t nowNs = MedibusServer::PatientDataNow() + (done ? 1000000000000LL : 0);
+            const size_t emitted = merger->Poll(nowNs, [&](const MedibusServer::MergedSample& sample)
+            {
+                disordered += sample.timestampNs < lastNs ? 1 : 0;
+                lastNs = sample.timestampNs;
+                ++merged;
+            });
+            size_t late = 0;
+            for (size_t source = 0; done && source < sources; ++source)
+            {
+                late += merger->Stats(source).late;
+            }
+            if (done && emitted == 0 && merged + late >= total)
+            {
+                break;
+            }
+            if (emitted == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        const double cpuSeconds = ThreadCpuSeconds() - cpuStart;
+        for (std::thread& producer : producers)
+        {
+            producer.join();
+        }
+        size_t late = 0;
+        for (size_t source = 0; source < sources; ++source)
+        {
+            late += merger->Stats(source).late;
+        }
+        std::cout << std::fixed << std::setprecision(1)
+            << "merger: " << merged << " samples from " << sources << " threads, " << late << " late, "
+            << disordered << " out of order, " << cpuSeconds * 1e9 / merged << " ns consumer CPU per sample\n";
+        return disordered == 0 && merged + late == total;
+    }
+
+    // 64 MB of random ACK/NAK frames and noise, decoded with growing thread
+    // counts and compared with a single threaded pass.
+    bool BenchmarkCaptureDecoder()
+    {
+        std::mt19937 random(1);
+        std::vector<uint8_t> capture;
+        capture.reserve((64 << 20) + 300);
+        std::vector<uint8_t> frame;
+        while (capture.size() < (64 << 20))
+        {
+            if (random() % 8 == 0)
+            {
+                for (uint32_t noise = random() % 20; noise != 0; --noise)
+                {
+                    capture.push_back(random() % 3 == 0 ? 0x06 : static_cast<uint8_t>(random()));
+                }
+                continue;
+            }
+            const uint8_t command = random() % 4 == 0 ? 0x12 : static_cast<uint8_t>(random());
+            const uint8_t header = random() % 10 == 0 ? 0x15 : 0x06;
+            const size_t length = header == 0x15 ? 1 : command == 0x12 ? 28 : random() % 40;
+            frame.assign({ header, command, static_cast<uint8_t>(length) });
+            for (size_t i = 0; i < length; ++i)
+            {
+                frame.push_back(random() % 5 == 0 ? 0x06 : static_cast<uint8_t>(random()));
+            }
+            if (command == 0x12 && header == 0x06)
+            {
+                frame[13] = 3;
+            }
+            uint8_t checksum = 0;
+            for (uint8_t byte : frame)
+            {
+                checksum += byte;
+            }
+            frame.push_back(static_cast<uint8_t>(0 - checksum));
+            capture.insert(capture.end(), frame.begin(), frame.end());
+        }
+
+        MedibusServer::CaptureDecoder::Options options;
+        options.extractChannels = true;
+        options.threads = 1;
+        options.chunkBytes = capture.size();
+        const MedibusServer::CaptureReport reference = MedibusServer::CaptureDecoder::Decode(capture.data(), capture.size(), options);
+        bool same = true;
+        for (size_t threads : { 1, 2, 4, 8 })
+        {
+            options.threads = threads;
+            options.chunkBytes = 4 << 20;
+            const int64_t startNs = MedibusServer::PatientDataNow();
+            const MedibusServer::CaptureReport report = MedibusServer::CaptureDecoder::Decode(capture.data(), capture.size(), options);
+            const double seconds = SecondsSince(startNs);
+            same = same && report.frames == reference.frames && report.unframedBytes == reference.unframedBytes &&
+                report.errors == reference.errors && report.samples.size() == reference.samples.size();
+            std::cout << std::fixed << std::setprecision(0)
+                << "capture decoder: " << threads << " threads, " << report.frames << " frames, "
+                << capture.size() / seconds / 1e6 << " MB/s\n";
+        }
+        return same;
+    }
+}
+
+/**
+ * Measures the trend archive, the sample merger and the capture decoder on
+ * synthetic data and checks their results.
+ */
+int Benchmark(const std::string& directory)
+{
+    const bool archive = BenchmarkArchive(directory + "/benchmark.mbta");
+    const bool merger = BenchmarkMerger();
+    const bool decoder = BenchmarkCaptureDecoder();
+    std::cout << (archive && merger && decoder ? "all results correct\n" : "wrong results\n");
+    return archive && merger && decoder ? 0 : 1;
+}
+
+// --realtime[=cpu] runs the response thread with a real-time profile,
+// pinned to the given CPU if one is given.
+// --archive=file keeps the continuous data in a trend archive.
+// --subscribe=CO2,O2,... requests only the continuous data of these
+// channels, all by default.
+// --discover probes all ports and talks to the first module found.
+// --merge=file.csv talks to all modules found and writes their continuous
+// data merged by time.
+// --decode=file decodes a capture or log offline instead, with
+// --channels=file.csv for the continuous data and --threads=n.
+// --follow=port prints what the server of a port publishes in shared
+// memory, --check-ring checks the shared memory ring.
+// --benchmark=directory measures archive, merger and capture decoder.
+int main(int argc, char* argv[]) {
+    serial::RealtimeProfile realtime;
+    std::string archive;
+    std::string decode;
+    std::string channels;
+    size_t threads = 0;
+    bool discover = false;
+    std::string merged;
+    MedibusServer::PatientChannelSet subscribed;
+    subscribed.set();
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg.compare(0, 10, "--realtime") == 0)
+        {
+            realtime.priority = 80;
+            realtime.lock_memory = true;
+            realtime.stack_prefault = 256 * 1024;
+            realtime.heap_prefault = 1024 * 1024;
+            if (arg.size() > 11 && arg[10] == '=')
+            {
+                realtime.cpu = std::atoi(arg.c_str() + 11);
+            }
+        }
+        else if (arg.compare(0, 10, "--archive=") == 0)
+        {
+            archive = arg.substr(10);
+        }
+        else if (arg.compare(0, 12, "--subscribe=") == 0)
+        {
+            subscribed.reset();
+            std::stringstream names(arg.substr(12));
+            std::string name;
+            while (std::getline(names, name, ','))
+            {
+                for (size_t channel = 0; channel < MedibusServer::kPatientChannelCount; ++channel)
+                {
+                    if (name == MedibusServer::PatientChannelName(static_cast<MedibusServer::PatientChannel>(channel)))
+                    {
+                        subscribed.set(channel);
+                    }
+                }
+            }
+        }
+        else if (arg == "--discover")
+        {
+            discover = true;
+        }
+        else if (arg.compare(0, 8, "--merge=") == 0)
+        {
+            merged = arg.substr(8);
+        }
+        else if (arg.compare(0, 9, "--decode=") == 0)
+        {
+            decode = arg.substr(9);
+        }
+        else if (arg.compare(0, 11, "--channels=") == 0)
+        {
+            channels = arg.substr(11);
+        }
+        else if (arg.compare(0, 10, "--threads=") == 0)
+        {
+            threads = static_cast<size_t>(std::atoi(arg.c_str() + 10));
+        }
+        else if (arg.compare(0, 9, "--follow=") == 0)
+        {
+            return FollowSharedRing(arg.substr(9));
+        }
+        else if (arg == "--check-ring")
+        {
+            return CheckSharedRing();
+        }
+        else if (arg.compare(0, 12, "--benchmark=") == 0)
+        {
+            return Benchmark(arg.substr(12));
+        }
+    }
+    if (!decode.empty())
+    {
+        return DecodeCapture(decode, channels, threads);
+    }
+    if (!merged.empty())
+    {
+        return MergeModules(realtime, merged, subscribed);
+    }
+    std::string port;
+    if (discover && (port = DiscoverModule()).empty())
+    {
+        return 1;
+    }
+    ClientCode(realtime, archive, port, subscribed);
     return 0;
 }
 